@@ -0,0 +1,16 @@
+#ifndef _PERFECTION_ARRAY_H
+#define _PERFECTION_ARRAY_H
+
+/**
+ * @brief Doubles the capacity of a growable array, starting at 64 items.
+ *
+ * @param items The array to grow, left untouched if the allocation fails.
+ * @param capacity The capacity of the array, in items.
+ * @param item_size The size of an item.
+ *
+ * @return PERF_RES_OK if the array was grown successfully, PERF_RES_MEMORY_ALLOC_FAIL if the allocation failed
+ * or the capacity would no longer fit in 32 bits.
+*/
+perf_result_t perf_array_grow(void **items, uint32_t *capacity, size_t item_size);
+
+#endif // _PERFECTION_ARRAY_H
@@ -1,6 +1,12 @@
 #ifndef _PERF_AST_H_
 #define _PERF_AST_H_
 
+// Index of a missing child or token.
+#define PERF_AST_NONE   UINT32_MAX
+
+// Flags of an AST_CONSTANT folded from an expression.
+#define PERF_AST_FOLDED 1
+
 /**
  * Used to determine which type of node is being used.
 */
@@ -11,45 +17,216 @@ typedef enum _perf_e_parser_node_type_t
 	AST_GROUP_EXPR,
 	AST_UNARY_EXPR,
 	AST_BINARY_EXPR,
+	AST_ASSIGN_EXPR,
+	AST_CALL_EXPR,
+	AST_MEMBER_EXPR,
 	AST_EXPR_FUNCTION_DEF,
-	AST_EXPR_STATEMENT
+	AST_EXPR_STATEMENT,
+	AST_PARAM,
+	AST_VAR_DECL,
+	AST_BLOCK,
+	AST_IF_STMT,
+	AST_WHILE_STMT,
+	AST_DO_WHILE_STMT,
+	AST_FOR_STMT,
+	AST_RETURN_STMT,
+	AST_BREAK_STMT,
+	AST_CONTINUE_STMT,
+	AST_THIS_EXPR,
+	AST_CLASS_DEF
 } perf_e_parser_node_type_t;
 
 /**
- * Represents a node in the abstract syntax tree.
+ * Represents a node in the abstract syntax tree, packed into 16 bytes.
+ *
+ * Children and tokens are referred to by their index in the AST, not by pointer. Children are always
+ * stored before their parent, so a single forward pass over the nodes visits them bottom up. Nodes with
+ * a variable number of children refer to a list in the AST's extra array instead.
+ *
+ * AST_CONSTANT, AST_VARIABLE:  token is the literal / identifier. A constant's flags are PERF_AST_FOLDED if it was
+ *                              folded from an expression, a folded TOKEN_INTEGER holds a signed integer.
+ * AST_GROUP_EXPR:              lhs is the inner expression.
+ * AST_UNARY_EXPR:              token is the operator, lhs the operand.
+ * AST_BINARY_EXPR:             token is the operator, lhs and rhs the operands.
+ * AST_ASSIGN_EXPR:             token is the '=', lhs the variable or member assigned to, rhs the value.
+ * AST_CALL_EXPR:               token is the '(', lhs the callee, rhs the list of arguments.
+ * AST_MEMBER_EXPR:             token is the member name, lhs the object.
+ * AST_EXPR_FUNCTION_DEF:       token is the name, lhs the list of AST_PARAM nodes, rhs the body block.
+ * AST_EXPR_STATEMENT:          lhs is the expression.
+ * AST_PARAM:                   token is the parameter name.
+ * AST_VAR_DECL:                token is the name, flags the let / var / const keyword, lhs the value or PERF_AST_NONE.
+ * AST_BLOCK:                   lhs is the list of statements.
+ * AST_IF_STMT:                 lhs is the condition, rhs the list of the then branch and optional else branch.
+ * AST_WHILE_STMT:              lhs is the condition, rhs the body.
+ * AST_DO_WHILE_STMT:           lhs is the body, rhs the condition.
+ * AST_FOR_STMT:                lhs is the list of init, condition, step and body, any but the body may be PERF_AST_NONE.
+ * AST_RETURN_STMT:             token is the keyword, lhs the value or PERF_AST_NONE.
+ * AST_BREAK_STMT, AST_CONTINUE_STMT: token is the keyword.
+ * AST_THIS_EXPR:               token is the keyword.
+ * AST_CLASS_DEF:               token is the name, lhs the list of AST_EXPR_FUNCTION_DEF methods.
 */
 typedef struct _perf_parser_node_t
 {
-	perf_e_parser_node_type_t node_type;      // The type of node this is.
-
-	union
-	{
-		perf_token_t *constant;
-		perf_token_t *variable;
-
-		struct _perf_parser_node_t *group_expression;
-		struct _unary_expr_t
-		{
-			struct _perf_parser_node_t *operand;
-			perf_token_t *op_token;
-		} unary_expr;
-		struct _binary_expr_t
-		{
-			struct _perf_parser_node_t *left;
-			struct _perf_parser_node_t *right;
-			perf_token_t *op_token;
-		} binary_expr;
-		struct _perf_parser_node_t *expr_statement;
-	} as;
+	uint8_t  node_type;     // The type of node this is, a perf_e_parser_node_type_t.
+	uint8_t  flags;         // Extra detail for some node types, zero otherwise.
+	uint8_t  reserved[2];   // Padding, always zero.
+	uint32_t token;         // Index of the node's token, or PERF_AST_NONE.
+	uint32_t lhs;           // Index of the first child, or PERF_AST_NONE.
+	uint32_t rhs;           // Index of the second child, or PERF_AST_NONE.
 } perf_parser_node_t;
 
 /**
- * @brief Frees a node in the AST.
- * 
- * @param node The node to free.
- * 
- * @return PERF_RES_OK if the node was freed successfully.
+ * Represents a whole abstract syntax tree, stored in flat arrays.
+ *
+ * Nothing in it is a pointer into another part of it, so it can be copied, written out or mapped back
+ * in as is, and freeing it is just freeing the arrays.
+*/
+typedef struct _perf_ast_t
+{
+	perf_parser_node_t* nodes;              // Every node, children before parents
+	uint32_t            node_count;         // Number of nodes
+	uint32_t            node_capacity;      // Number of nodes we can hold
+
+	perf_token_t*       tokens;             // Tokens the nodes refer to
+	uint32_t            token_count;        // Number of tokens
+	uint32_t            token_capacity;     // Number of tokens we can hold
+	bool                owns_tokens;        // False if tokens is the caller's token array
+
+	uint32_t*           extra;              // Child lists, each a count followed by that many node indices
+	uint32_t            extra_count;        // Number of entries in extra
+	uint32_t            extra_capacity;     // Number of entries extra can hold
+
+	uint32_t*           statements;         // Indices of the top level statements, in source order
+	uint32_t            statement_count;    // Number of top level statements
+	uint32_t            statement_capacity; // Number of top level statements we can hold
+
+	uint32_t            allocation_count;   // Times one of the arrays was allocated or grown
+} perf_ast_t;
+
+/**
+ * @brief Initializes an empty AST.
+ *
+ * @param ast The AST to initialize.
+ *
+ * @return PERF_RES_OK if the AST was initialized successfully.
+*/
+perf_result_t perf_ast_init(perf_ast_t *ast);
+
+/**
+ * @brief Appends a node to the AST.
+ *
+ * @param ast The AST to append to.
+ * @param node_type The type of the node.
+ * @param token The index of the node's token, or PERF_AST_NONE.
+ * @param lhs The index of the first child, or PERF_AST_NONE.
+ * @param rhs The index of the second child, or PERF_AST_NONE.
+ * @param index The index of the new node.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the node was appended successfully.
+*/
+perf_result_t perf_ast_add_node(perf_ast_t *ast, perf_e_parser_node_type_t node_type, uint32_t token, uint32_t lhs, uint32_t rhs, uint32_t *index, const char** error);
+
+/**
+ * @brief Appends a copy of a token to the AST's own token array.
+ *
+ * @param ast The AST to append to, must own its tokens.
+ * @param token The token to copy.
+ * @param index The index of the copy.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the token was appended successfully.
+*/
+perf_result_t perf_ast_add_token(perf_ast_t *ast, const perf_token_t *token, uint32_t *index, const char** error);
+
+/**
+ * @brief Appends a list of child nodes to the AST's extra array.
+ *
+ * @param ast The AST to append to.
+ * @param items The indices of the nodes in the list.
+ * @param count The number of nodes in the list.
+ * @param index The index of the list in extra.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the list was appended successfully.
+*/
+perf_result_t perf_ast_add_list(perf_ast_t *ast, const uint32_t *items, uint32_t count, uint32_t *index, const char** error);
+
+/**
+ * @brief Appends a top level statement to the AST.
+ *
+ * @param ast The AST to append to.
+ * @param node The index of the statement node.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the statement was appended successfully.
+*/
+perf_result_t perf_ast_add_statement(perf_ast_t *ast, uint32_t node, const char** error);
+
+/**
+ * @brief Makes sure the AST's node, list and statement arrays can hold the given totals, allocating them exactly.
+ *
+ * @param ast The AST to grow.
+ * @param node_count The number of nodes it must hold.
+ * @param extra_count The number of list entries it must hold.
+ * @param statement_count The number of top level statements it must hold.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the arrays are large enough.
+*/
+perf_result_t perf_ast_reserve(perf_ast_t *ast, uint32_t node_count, uint32_t extra_count, uint32_t statement_count, const char** error);
+
+/**
+ * @brief Copies another AST into this one at the given offsets, moving every child and list index along with it.
+ *
+ * Both ASTs must refer to the same token array. The arrays must already have room, see perf_ast_reserve, and the
+ * counts are left alone, so parts going to different offsets can be placed from several threads at once.
+ *
+ * @param ast The AST to copy into.
+ * @param part The AST to copy.
+ * @param node_base Where the part's first node goes.
+ * @param extra_base Where the part's first list entry goes.
+ * @param statement_base Where the part's first top level statement goes.
+ *
+ * @return PERF_RES_OK if the part was copied successfully.
+*/
+perf_result_t perf_ast_place(perf_ast_t *ast, const perf_ast_t *part, uint32_t node_base, uint32_t extra_base, uint32_t statement_base);
+
+/**
+ * @brief Checks that an AST read from outside the parser, e.g. a cache entry, is one the parser could have built.
+ *
+ * Every token has a known type, and the text of identifiers and strings is a span inside the source. Every node
+ * has a known type and the token its type needs: an operator, a literal or an identifier. Its children come
+ * before it and have no other parent, and its lists lie inside extra. Children that are read as a certain type
+ * have it, e.g. parameters and function bodies. Every top level statement is a node without a parent. Folding,
+ * printing and compiling rely on all of that.
+ *
+ * @param ast The AST to check, its tokens zero copy tokens.
+ * @param source_length The length of the source the tokens' spans refer into.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the AST is well formed, PERF_RES_PARSE_ERROR if it isn't.
+*/
+perf_result_t perf_ast_verify(const perf_ast_t *ast, uint64_t source_length, const char** error);
+
+/**
+ * @brief Prints a node and everything below it, one line per node, without recursing.
+ *
+ * @param ast The AST to use.
+ * @param lexer The lexer the tokens came from, used for identifier and string text.
+ * @param node The index of the node to print.
+ *
+ * @return PERF_RES_OK if the node was printed successfully.
+*/
+perf_result_t perf_ast_print(const perf_ast_t *ast, const perf_lexer_t *lexer, uint32_t node);
+
+/**
+ * @brief Frees the arrays of an AST. A borrowed token array is left alone.
+ *
+ * @param ast The AST to free.
+ *
+ * @return PERF_RES_OK if the AST was freed successfully.
 */
-perf_result_t perf_parser_node_free(perf_parser_node_t *node);
+perf_result_t perf_ast_free(perf_ast_t *ast);
 
-#endif // _PERF_AST_H_
\ No newline at end of file
+#endif // _PERF_AST_H_
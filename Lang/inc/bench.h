@@ -0,0 +1,103 @@
+#ifndef _PERFECTION_BENCH_H
+#define _PERFECTION_BENCH_H
+
+/**
+ * NOTE: The benchmarks generate their own deterministic inputs, so runs are comparable across machines
+ * and commits. Each one runs a few rounds, reports the best, and checks its results against the
+ * reference implementation before reporting anything.
+*/
+
+// Parse throughput the front end should sustain on the generated program, in MB of source per second.
+#define PERF_BENCH_PARSE_TARGET     40.0
+
+/**
+ * @brief Gets a timestamp for measuring elapsed time.
+ *
+ * @return The current time in seconds.
+*/
+double perf_bench_now(void);
+
+/**
+ * @brief Benchmarks numeric literal conversion against the old copy + strtod / strtoull path.
+ *
+ * @param literal_count The number of literals in the generated corpus.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the benchmark ran and both paths agreed.
+*/
+perf_result_t perf_bench_numbers(uint32_t literal_count, const char** error);
+
+/**
+ * @brief Benchmarks the front end, lexing and parsing a generated program of functions, against
+ * PERF_BENCH_PARSE_TARGET.
+ *
+ * @param function_count The number of functions in the generated program.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the benchmark ran and the program parsed.
+*/
+perf_result_t perf_bench_parse(uint32_t function_count, const char** error);
+
+/**
+ * @brief Benchmarks the parallel lexer on 1 to 32 threads against the serial lexer, checking every run
+ * produces exactly the serial lexer's tokens. The program has block comments over several lines and strings
+ * longer than a chunk, so some chunks start inside them and are lexed again.
+ *
+ * @param megabytes The size of the generated program.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the benchmark ran and every run matched.
+*/
+perf_result_t perf_bench_lex(uint32_t megabytes, const char** error);
+
+/**
+ * @brief Benchmarks parsing a generated program of functions on 1 to 32 threads against the serial parser,
+ * checking every run builds exactly the serial parser's AST.
+ *
+ * @param function_count The number of functions in the generated program.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the benchmark ran and every run matched.
+*/
+perf_result_t perf_bench_parse_parallel(uint32_t function_count, const char** error);
+
+/**
+ * @brief Benchmarks the VM on arithmetic, loop and call heavy programs, comparing switch dispatch against
+ * threaded dispatch and the instructions dispatched, for stack code with and without superinstructions and for
+ * register code, and checking every run returns the same value. A few short programs branching on equal, mixed
+ * and signed zero numbers and returning escaped strings are then only checked, with the JIT compiling every
+ * function on its first call, and once more lexed in zero copy mode.
+ *
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the benchmark ran and every run agreed.
+*/
+perf_result_t perf_bench_vm(const char** error);
+
+/**
+ * @brief Benchmarks starting up on the generated program with the token and AST cache: parsing without it, a cold
+ * start that misses and writes the entry, and a warm start that maps and checks it then reads every node and token,
+ * checking the warm AST is the parsed one.
+ *
+ * @param function_count The number of functions in the generated program.
+ * @param directory The directory to write the entry to, it is removed afterwards.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the benchmark ran and the ASTs matched.
+*/
+perf_result_t perf_bench_cache(uint32_t function_count, const char* directory, const char** error);
+
+/**
+ * @brief Benchmarks starting up on a generated program from a module against from its source: parsing, folding
+ * and compiling it, versus mapping, verifying and loading the module compiling it wrote, checking both programs
+ * are the same.
+ *
+ * @param function_count The number of functions in the generated program.
+ * @param directory The directory to write the module to, it is removed afterwards.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the benchmark ran and the programs matched.
+*/
+perf_result_t perf_bench_module(uint32_t function_count, const char* directory, const char** error);
+
+#endif // _PERFECTION_BENCH_H
@@ -0,0 +1,128 @@
+#ifndef _PERFECTION_CACHE_H
+#define _PERFECTION_CACHE_H
+
+/**
+ * NOTE: The cache keeps the tokens and AST parsing a source gave, in a file per source named by the hash of its
+ * contents. The AST is already free of pointers (see ast.h) and zero copy tokens refer to their text by offset
+ * in the source, so an entry is a header followed by the token, node, list and statement arrays exactly as they
+ * are in memory. Loading one maps it and points an AST at the arrays, nothing is fixed up or copied. The mapping
+ * is private and writable, so folding rewrites nodes in place on copies of the pages it touches and the entry
+ * itself never changes.
+ *
+ * An entry is only used if its header matches: the magic, PERF_CACHE_VERSION, the sizes of a token and a node,
+ * and the hash and length of the source, with every array inside the file. The arrays must then hash to the
+ * payload hash in the header, and pass perf_ast_verify, so an entry damaged on disk or written by someone else
+ * never reaches folding or the compiler. Anything else is a miss, the source is parsed and the entry written
+ * again. Entries are written under a temporary name then renamed, so processes
+ * starting at the same time never map half of one. Bump PERF_CACHE_VERSION whenever the lexer or parser change
+ * what they produce for the same source.
+ *
+ * The cache needs mmap, elsewhere every load is a miss.
+*/
+
+// Version of the entries' contents, entries of any other version are misses.
+#define PERF_CACHE_VERSION      2
+
+// File name extension of the entries.
+#define PERF_CACHE_EXTENSION    ".perfast"
+
+/**
+ * Represents the header of an entry, the arrays follow at the offsets it gives, each aligned to 8 bytes.
+*/
+typedef struct _perf_cache_header_t
+{
+    char        magic[8];           // "PERFAST" and a terminator
+    uint32_t    version;            // PERF_CACHE_VERSION
+    uint16_t    token_size;         // sizeof(perf_token_t)
+    uint16_t    node_size;          // sizeof(perf_parser_node_t)
+    uint64_t    source_hash;        // Hash of the source, see perf_cache_hash
+    uint64_t    source_length;      // Length of the source
+    uint64_t    payload_hash;       // Hash of the arrays, see perf_cache_hash
+
+    uint32_t    line_count;         // Lines the lexer counted, as its line_number after the last token
+    uint32_t    token_count;        // Number of tokens
+    uint32_t    node_count;         // Number of nodes
+    uint32_t    extra_count;        // Number of entries in the list array
+    uint32_t    statement_count;    // Number of top level statements
+    uint32_t    reserved;           // Padding, always zero
+
+    uint64_t    token_offset;       // Offset of the tokens from the start of the file
+    uint64_t    node_offset;        // Offset of the nodes
+    uint64_t    extra_offset;       // Offset of the list array
+    uint64_t    statement_offset;   // Offset of the statements
+} perf_cache_header_t;
+
+/**
+ * Represents the entry of one source.
+*/
+typedef struct _perf_cache_t
+{
+    char*       path;               // Path of the entry
+    uint64_t    source_hash;        // Hash of the source
+    uint64_t    source_length;      // Length of the source
+    uint64_t    payload_hash;       // Hash of the arrays, see perf_cache_hash
+
+    void*       mapping;            // The entry, once perf_cache_load found it, otherwise NULL
+    size_t      mapping_size;       // Size of the mapping
+} perf_cache_t;
+
+/**
+ * @brief Hashes the contents of a source, 8 bytes at a time.
+ *
+ * @param data The contents.
+ * @param length The length of the contents.
+ *
+ * @return The hash.
+*/
+uint64_t perf_cache_hash(const char* data, size_t length);
+
+/**
+ * @brief Finds where the entry of a source lives, hashing it.
+ *
+ * @param cache The cache entry to initialize.
+ * @param directory The directory of the entries, which must exist.
+ * @param data The contents of the source.
+ * @param length The length of the contents.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the entry was initialized successfully.
+*/
+perf_result_t perf_cache_init(perf_cache_t *cache, const char* directory, const char* data, size_t length, const char** error);
+
+/**
+ * @brief Maps the entry of the source and points an AST at it.
+ *
+ * The AST refers to the mapping and must not be freed with perf_ast_free, freeing the cache entry frees it.
+ * Its tokens are zero copy tokens, they need a lexer in PERF_LEXER_MODE_ZERO_COPY over the same source.
+ *
+ * @param cache The cache entry to load.
+ * @param ast The AST to point at the entry's arrays.
+ * @param line_count The number of lines the lexer counted.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK on a hit, PERF_RES_UNSUPPORTED if there is no entry or it doesn't match.
+*/
+perf_result_t perf_cache_load(perf_cache_t *cache, perf_ast_t *ast, uint32_t *line_count, const char** error);
+
+/**
+ * @brief Writes the entry of the source.
+ *
+ * @param cache The cache entry to write.
+ * @param ast The AST parsing the source gave, its tokens zero copy tokens.
+ * @param line_count The number of lines the lexer counted.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the entry was written successfully, PERF_RES_IO_ERROR if it couldn't be.
+*/
+perf_result_t perf_cache_store(perf_cache_t *cache, const perf_ast_t *ast, uint32_t line_count, const char** error);
+
+/**
+ * @brief Unmaps the entry, if it was loaded, and frees the path.
+ *
+ * @param cache The cache entry to free.
+ *
+ * @return PERF_RES_OK if the entry was freed successfully.
+*/
+perf_result_t perf_cache_free(perf_cache_t *cache);
+
+#endif // _PERFECTION_CACHE_H
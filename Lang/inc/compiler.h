@@ -0,0 +1,94 @@
+#ifndef _PERFECTION_COMPILER_H
+#define _PERFECTION_COMPILER_H
+
+// Most local slots a function can use, including its parameters. Slots are a u8 operand.
+#define PERF_COMPILER_MAX_SLOTS     256
+
+// Most parameters a function can take, and arguments a call can pass. Argument counts are a u8 operand.
+#define PERF_COMPILER_MAX_ARGUMENTS 255
+
+// Deepest the compiler recurses into expressions and statements. The parser bounds nesting, but not chains of
+// left associative operators like a + a + ..., which are as deep as they are long.
+#define PERF_COMPILER_MAX_DEPTH     4096
+
+/**
+ * Represents a global variable known to the compiler.
+*/
+typedef struct _perf_compiler_global_t
+{
+    const char* name;           // Interned name, NULL if the slot is empty
+    uint32_t    index;          // Index of the global slot in the program
+    bool        is_const;       // True if declared with const
+} perf_compiler_global_t;
+
+/**
+ * Represents our compiler, which lowers an AST to the bytecode of a program.
+ *
+ * Names are resolved while compiling: top level declarations become global slots, everything declared in a
+ * function or a nested block becomes a local slot of its function, and the instructions refer to the slot
+ * by index. Functions may only use their own locals and globals, they can't capture an enclosing function's
+ * locals. Top level functions are defined before the script runs, so they can call each other in any order.
+ * Classes are too, and may only be declared at the top level. Their name is bound to their initializer.
+*/
+typedef struct _perf_compiler_t
+{
+    perf_lexer_t*                       lexer;              // Lexer the tokens came from, its interner owns every name
+    const perf_ast_t*                   ast;                // AST being compiled
+    perf_program_t*                     program;            // Program being built
+    struct _perf_compiler_function_t*   function;           // Function being compiled, the innermost one
+
+    perf_compiler_global_t*             globals;            // Globals by name, open addressing (linear probing)
+    uint32_t                            global_capacity;    // Number of slots, always a power of two
+    uint32_t                            global_count;       // Number of globals
+
+    uint32_t*                           constants;          // Constant pool indices plus one by value, 0 if empty
+    uint32_t                            constant_capacity;  // Number of slots, always a power of two
+
+    uint32_t*                           jumps;              // Pending break and continue jumps of the loops being compiled
+    uint32_t                            jump_count;         // Number of pending jumps
+    uint32_t                            jump_capacity;      // Number of pending jumps we can hold
+
+    bool                                fuse;               // True to fuse common instruction pairs into superinstructions
+    perf_e_program_format_t             format;             // Instruction set to compile to, stack by default
+    uint32_t                            depth;              // Current expression and statement nesting depth
+
+    perf_token_t                        erroring_token;     // Copy of the token the last compile error refers to
+    perf_result_t                       status;             // First error
+    const char*                         status_error;       // The error message for status
+} perf_compiler_t;
+
+/**
+ * @brief Initializes a compiler.
+ *
+ * @param compiler The compiler to initialize.
+ * @param lexer The lexer the tokens of the ASTs to compile came from.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the compiler was initialized successfully.
+*/
+perf_result_t perf_compiler_init(perf_compiler_t *compiler, perf_lexer_t *lexer, const char** error);
+
+/**
+ * @brief Compiles an AST into a program.
+ *
+ * The program refers to the lexer's interned strings, so the lexer must outlive it.
+ *
+ * @param compiler The compiler to use.
+ * @param ast The AST to compile.
+ * @param program The program to populate, it is initialized here and must be freed with perf_program_free even on failure.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the AST was compiled successfully, PERF_RES_COMPILE_ERROR if it isn't a valid program.
+*/
+perf_result_t perf_compiler_compile(perf_compiler_t *compiler, const perf_ast_t *ast, perf_program_t *program, const char** error);
+
+/**
+ * @brief Frees the compiler's tables. Programs it produced are freed separately with perf_program_free.
+ *
+ * @param compiler The compiler to free.
+ *
+ * @return PERF_RES_OK if the compiler was freed successfully.
+*/
+perf_result_t perf_compiler_free(perf_compiler_t *compiler);
+
+#endif // _PERFECTION_COMPILER_H
@@ -0,0 +1,52 @@
+#ifndef _PERFECTION_FOLD_H
+#define _PERFECTION_FOLD_H
+
+/**
+ * NOTE: Folding evaluates at compile time whatever would give the same result every time it runs. Arithmetic,
+ * comparisons, negation and ! on constants become constants, with the same 48-bit integer and number rules as
+ * the VM. Anything that would raise an error, like dividing by zero or adding a number to a boolean, is left
+ * as it is so the error still happens at runtime, on the same line.
+ *
+ * Identities are removed only where they can't change the result: x * 1, x / 1 and x - 0 when x is always
+ * numeric, x + 0 when x is always an integer, since -0 + 0 is 0, and !!x when x is always a boolean or only
+ * decides a branch. A variable could hold anything, so identities on variables stay.
+*/
+
+/**
+ * Represents what a fold pass did.
+*/
+typedef struct _perf_fold_stats_t
+{
+    uint32_t folded;            // Expressions replaced by their constant value
+    uint32_t simplified;        // Identities and double negations replaced by their operand
+    uint32_t groups;            // Groups replaced by the expression inside them
+} perf_fold_stats_t;
+
+/**
+ * @brief Gets the value of a constant node, the way the VM will see it.
+ *
+ * @param ast The AST the node is in.
+ * @param node The index of the node.
+ * @param value The value of the constant.
+ *
+ * @return true if the node is a boolean, integer or number constant, strings are left to the caller.
+*/
+bool perf_fold_constant(const perf_ast_t *ast, uint32_t node, perf_value_t *value);
+
+/**
+ * @brief Folds constant expressions, removes identities and replaces groups with what they contain.
+ *
+ * Nodes are rewritten in place, in a single pass from the first node to the last, which visits every child
+ * before its parent. A folded node becomes an AST_CONSTANT flagged PERF_AST_FOLDED, and its operator token
+ * becomes the literal, so when the AST borrows its tokens the caller's array changes with it. Nodes nothing
+ * refers to anymore stay in the array.
+ *
+ * @param ast The AST to fold.
+ * @param stats What the pass did, may be NULL.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the AST was folded successfully.
+*/
+perf_result_t perf_fold_ast(perf_ast_t *ast, perf_fold_stats_t *stats, const char** error);
+
+#endif // _PERFECTION_FOLD_H
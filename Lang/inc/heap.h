@@ -0,0 +1,245 @@
+#ifndef _PERFECTION_HEAP_H
+#define _PERFECTION_HEAP_H
+
+/**
+ * NOTE: The heap holds everything a program creates while it runs, and frees it once nothing refers to it. It is
+ * generational: objects are bump allocated in the nursery, and a minor collection copies the ones still reachable
+ * out into the old generation before starting the nursery over, so short lived objects cost an allocation and
+ * nothing more. The old generation is collected by mark-sweep when it has grown by PERF_HEAP_GROWTH_FACTOR since
+ * the last major collection. Objects too large for the nursery are allocated in the old generation directly.
+ *
+ * Roots are the values the heap's roots callback hands to perf_heap_trace, plus the temporary roots C code holds
+ * across an allocation. Objects in the old generation that come to refer to the nursery must go through
+ * perf_heap_write_barrier, which remembers them so minor collections find those references without scanning
+ * the whole old generation.
+ *
+ * Strings keep the layout of interned strings: a 32-bit length right before the characters, which are followed
+ * by a terminator, so everything that takes an interned string takes a heap string too. Instances and the field
+ * arrays they outgrow their inline fields into are laid out in object.h.
+*/
+
+// Bytes in the nursery.
+#define PERF_HEAP_NURSERY_SIZE      (1024 * 1024)
+
+// Objects larger than this go straight to the old generation.
+#define PERF_HEAP_LARGE_OBJECT      (PERF_HEAP_NURSERY_SIZE / 8)
+
+// Bytes the old generation may hold before its first major collection.
+#define PERF_HEAP_OLD_MINIMUM       (4 * 1024 * 1024)
+
+// How much the old generation may grow, relative to what survived the last major collection, before the next.
+#define PERF_HEAP_GROWTH_FACTOR     2
+
+// Most temporary roots C code can hold at once.
+#define PERF_HEAP_MAX_TEMPS         8
+
+// Flags of a heap object.
+#define PERF_HEAP_OLD               0x01    // Lives in the old generation
+#define PERF_HEAP_MARKED            0x02    // Reached by the major collection in progress
+#define PERF_HEAP_FORWARDED         0x04    // Copied out of the nursery, next is the copy
+#define PERF_HEAP_REMEMBERED        0x08    // In the remembered set
+
+/**
+ * Used to determine which type of object is being used.
+*/
+typedef enum _perf_e_heap_type_t
+{
+    PERF_HEAP_STRING,           // A string, followed by its length and characters
+    PERF_HEAP_INSTANCE,         // An instance of a class, a perf_instance_t
+    PERF_HEAP_FIELDS            // The fields of an instance that outgrew its inline ones, followed by the values
+} perf_e_heap_type_t;
+
+/**
+ * Represents the header every heap object starts with.
+*/
+typedef struct _perf_heap_object_t
+{
+    struct _perf_heap_object_t* next;       // Next object of the old generation, or the copy once forwarded
+    uint32_t                    size;       // Bytes of the object, header included, a multiple of 8
+    uint8_t                     type;       // The type of object this is, a perf_e_heap_type_t
+    uint8_t                     flags;      // PERF_HEAP_OLD, PERF_HEAP_MARKED, PERF_HEAP_FORWARDED, PERF_HEAP_REMEMBERED
+    uint8_t                     reserved[2];// Padding, always zero
+} perf_heap_object_t;
+
+/**
+ * Represents what the heap has done so far.
+*/
+typedef struct _perf_heap_stats_t
+{
+    uint64_t    allocated_bytes;    // Bytes allocated, in either generation
+    uint64_t    promoted_bytes;     // Bytes copied from the nursery to the old generation
+    uint64_t    freed_bytes;        // Bytes freed by major collections
+    size_t      old_bytes;          // Bytes in the old generation now
+
+    uint32_t    minor_count;        // Number of minor collections
+    double      minor_seconds;      // Time spent in minor collections
+    double      minor_max_pause;    // Longest minor collection, in seconds
+
+    uint32_t    major_count;        // Number of major collections
+    double      major_seconds;      // Time spent in major collections
+    double      major_max_pause;    // Longest major collection, in seconds
+} perf_heap_stats_t;
+
+struct _perf_heap_t;
+
+/**
+ * Represents a function handing the heap its roots, through perf_heap_trace.
+ *
+ * @param heap The heap collecting.
+ * @param context The context given to perf_heap_init.
+*/
+typedef void (*perf_heap_roots_t)(struct _perf_heap_t *heap, void *context);
+
+/**
+ * Represents our heap.
+*/
+typedef struct _perf_heap_t
+{
+    uint8_t*                nursery;            // PERF_HEAP_NURSERY_SIZE bytes
+    uint8_t*                nursery_top;        // First free byte of the nursery
+    uint8_t*                nursery_end;        // End of the nursery
+
+    perf_heap_object_t*     old;                // Every object of the old generation, newest first
+    size_t                  old_limit;          // Bytes the old generation may hold before a major collection
+
+    perf_heap_object_t**    remembered;         // Old objects that may refer to the nursery
+    uint32_t                remembered_count;   // Number of remembered objects
+    uint32_t                remembered_capacity;// Number of remembered objects we can hold
+
+    perf_heap_object_t**    gray;               // Objects reached but not traced yet
+    uint32_t                gray_count;         // Number of objects waiting to be traced
+    uint32_t                gray_capacity;      // Number of objects we can hold
+    bool                    gray_overflow;      // True if an object couldn't be added, the collection must rescan
+
+    perf_value_t*           temps[PERF_HEAP_MAX_TEMPS]; // Values C code holds across an allocation
+    uint32_t                temp_count;         // Number of temporary roots
+
+    perf_heap_roots_t       roots;              // Hands the heap its roots
+    void*                   roots_context;      // Passed to roots
+    bool                    is_major;           // True while a major collection is tracing, false during a minor one
+    bool                    failed;             // True if the last minor collection couldn't copy an object out
+
+    perf_heap_stats_t       stats;              // What the heap has done so far
+} perf_heap_t;
+
+/**
+ * @brief Initializes a heap, allocating its nursery.
+ *
+ * @param heap The heap to initialize.
+ * @param roots Hands the heap its roots when it collects.
+ * @param context Passed to roots.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the heap was initialized successfully.
+*/
+perf_result_t perf_heap_init(perf_heap_t *heap, perf_heap_roots_t roots, void *context, const char** error);
+
+/**
+ * @brief Allocates an object, which may collect first.
+ *
+ * Everything after the header is left for the caller to fill in, and must be before the next allocation. Values
+ * the caller holds outside the roots must be pushed with perf_heap_push_temp first, collecting may move them.
+ *
+ * @param heap The heap to allocate from.
+ * @param type The type of the object.
+ * @param size The bytes of the object, header included, rounded up to a multiple of 8.
+ * @param object The object.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the object was allocated successfully.
+*/
+perf_result_t perf_heap_alloc(perf_heap_t *heap, perf_e_heap_type_t type, size_t size, perf_heap_object_t **object, const char** error);
+
+/**
+ * @brief Allocates a string, which may collect first.
+ *
+ * The characters are left for the caller to fill in, the terminator is already written. Values the caller holds
+ * outside the roots must be pushed with perf_heap_push_temp first, collecting may move them.
+ *
+ * @param heap The heap to allocate from.
+ * @param length The length of the string.
+ * @param str The string.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the string was allocated successfully.
+*/
+perf_result_t perf_heap_string(perf_heap_t *heap, uint32_t length, char **str, const char** error);
+
+/**
+ * @brief Collects the nursery, and the old generation too if it has grown past its limit.
+ *
+ * @param heap The heap to collect.
+ * @param major True to collect the old generation whatever its size.
+ *
+ * @return PERF_RES_OK if the heap was collected successfully.
+*/
+perf_result_t perf_heap_collect(perf_heap_t *heap, bool major);
+
+/**
+ * @brief Hands the heap some of its roots, only called from the roots callback.
+ *
+ * Values referring to the nursery are updated to wherever their object was copied.
+ *
+ * @param heap The heap collecting.
+ * @param values The values.
+ * @param count The number of values.
+*/
+void perf_heap_trace(perf_heap_t *heap, perf_value_t *values, size_t count);
+
+/**
+ * @brief Remembers an old object that was made to refer to the nursery, call it after every store into an object.
+ *
+ * @param heap The heap the object lives in.
+ * @param object The object stored into.
+ * @param value The value stored.
+ *
+ * @return PERF_RES_OK if the object was remembered, or didn't need to be.
+*/
+perf_result_t perf_heap_write_barrier(perf_heap_t *heap, perf_heap_object_t *object, perf_value_t value);
+
+/**
+ * @brief Remembers an old object whatever it was made to refer to, for stores perf_heap_write_barrier can't see.
+ *
+ * @param heap The heap the object lives in.
+ * @param object The object.
+ *
+ * @return PERF_RES_OK if the object was remembered, or didn't need to be.
+*/
+perf_result_t perf_heap_remember(perf_heap_t *heap, perf_heap_object_t *object);
+
+/**
+ * @brief Holds a value as a root until perf_heap_pop_temp, so collecting keeps it and updates it.
+ *
+ * @param heap The heap to use.
+ * @param value The value, which must stay where it is until it is popped.
+*/
+void perf_heap_push_temp(perf_heap_t *heap, perf_value_t *value);
+
+/**
+ * @brief Lets go of the temporary roots pushed last.
+ *
+ * @param heap The heap to use.
+ * @param count The number of temporary roots to let go of.
+*/
+void perf_heap_pop_temp(perf_heap_t *heap, uint32_t count);
+
+/**
+ * @brief Gets what the heap has done so far.
+ *
+ * @param heap The heap to use.
+ * @param stats The statistics to populate.
+ *
+ * @return PERF_RES_OK if the statistics were gathered successfully.
+*/
+perf_result_t perf_heap_get_stats(perf_heap_t *heap, perf_heap_stats_t *stats);
+
+/**
+ * @brief Frees the nursery and every object of the heap.
+ *
+ * @param heap The heap to free.
+ *
+ * @return PERF_RES_OK if the heap was freed successfully.
+*/
+perf_result_t perf_heap_free(perf_heap_t *heap);
+
+#endif // _PERFECTION_HEAP_H
@@ -0,0 +1,133 @@
+#ifndef _PERFECTION_INTERN_H
+#define _PERFECTION_INTERN_H
+
+/**
+ * Represents a slot in the intern table.
+ * The hash is stored with the entry so probing and growing never rehash the string.
+*/
+typedef struct _perf_intern_entry_t
+{
+    uint32_t    hash;       // Hash of the string
+    uint32_t    length;     // Length of the string
+    const char* str;        // Interned string, NULL if the slot is empty
+} perf_intern_entry_t;
+
+/**
+ * Represents a block of memory the interned strings are bump allocated from.
+*/
+typedef struct _perf_intern_chunk_t
+{
+    struct _perf_intern_chunk_t* next;  // Previously filled chunk
+    size_t                       used;      // Bytes used in this chunk
+    size_t                       capacity;  // Bytes available in this chunk
+    char                         data[];    // String storage
+} perf_intern_chunk_t;
+
+/**
+ * Represents a string interner.
+ * Every distinct string is stored exactly once, so interned strings can be compared by pointer.
+*/
+typedef struct _perf_interner_t
+{
+    perf_intern_entry_t* entries;       // Open addressing table (linear probing)
+    uint32_t             capacity;      // Number of slots, always a power of two
+    uint32_t             count;         // Number of unique strings
+
+    perf_intern_chunk_t* chunks;        // String storage
+
+    size_t               string_bytes;  // Bytes of unique string data (excluding headers)
+    size_t               arena_bytes;   // Bytes reserved for string storage
+    uint64_t             lookup_count;  // Number of intern calls
+    uint64_t             probe_count;   // Total slots inspected across all intern calls
+    uint32_t             max_probe;     // Longest probe sequence seen
+} perf_interner_t;
+
+/**
+ * Represents a snapshot of the interner statistics.
+*/
+typedef struct _perf_interner_stats_t
+{
+    uint32_t unique_count;          // Number of unique strings
+    uint32_t capacity;              // Number of slots in the table
+    size_t   string_bytes;          // Bytes of unique string data
+    size_t   arena_bytes;           // Bytes reserved for string storage
+    size_t   table_bytes;           // Bytes used by the table itself
+    uint64_t lookup_count;          // Number of intern calls
+    double   average_probe_length;  // Slots inspected per intern call
+    uint32_t max_probe_length;      // Longest probe sequence seen
+} perf_interner_stats_t;
+
+/**
+ * @brief Initializes an interner. No memory is allocated until the first string is interned.
+ *
+ * @param interner The interner to initialize.
+ *
+ * @return PERF_RES_OK if the interner was initialized successfully.
+*/
+perf_result_t perf_interner_init(perf_interner_t *interner);
+
+/**
+ * @brief Interns a string.
+ *
+ * @param interner The interner to use.
+ * @param str The string to intern (does not need to be null terminated).
+ * @param length The length of the string.
+ * @param out The interned, null terminated string. Stable until the interner is freed.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the string was interned successfully.
+*/
+perf_result_t perf_interner_intern(perf_interner_t *interner, const char* str, size_t length, const char** out, const char** error);
+
+/**
+ * @brief Interns every string of another interner, e.g. one that lexed part of a source on another thread.
+ *
+ * Each of other's strings is overwritten with a forwarding pointer to the equal string in interner, see
+ * perf_interner_forward. From then on other's strings can only be forwarded, and other only freed.
+ *
+ * @param interner The interner to move the strings into.
+ * @param other The interner to move the strings out of.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if every string was interned successfully.
+*/
+perf_result_t perf_interner_absorb(perf_interner_t *interner, perf_interner_t *other, const char** error);
+
+/**
+ * @brief Gets the string an absorbed string was moved to, in O(1).
+ *
+ * @param str A string of an interner passed to perf_interner_absorb as other.
+ *
+ * @return The equal string in the absorbing interner.
+*/
+const char* perf_interner_forward(const char* str);
+
+/**
+ * @brief Gets the length of an interned string in O(1).
+ *
+ * @param str A string returned by perf_interner_intern.
+ *
+ * @return The length of the string.
+*/
+uint32_t perf_interner_length(const char* str);
+
+/**
+ * @brief Gets the statistics of the interner.
+ *
+ * @param interner The interner to use.
+ * @param stats The statistics to populate.
+ *
+ * @return PERF_RES_OK if the statistics were gathered successfully.
+*/
+perf_result_t perf_interner_get_stats(perf_interner_t *interner, perf_interner_stats_t *stats);
+
+/**
+ * @brief Frees the interner and every string it owns.
+ *
+ * @param interner The interner to free.
+ *
+ * @return PERF_RES_OK if the interner was freed successfully.
+*/
+perf_result_t perf_interner_free(perf_interner_t *interner);
+
+#endif // _PERFECTION_INTERN_H
@@ -0,0 +1,125 @@
+#ifndef _PERFECTION_JIT_H
+#define _PERFECTION_JIT_H
+
+/**
+ * NOTE: The JIT is the VM's second tier, for register code. Functions count their calls and back edges, and once
+ * the count reaches the threshold the function is compiled to x86-64 machine code, one template per instruction.
+ * Registers stay in the frame's slots, so the machine code and the interpreter agree on the state of a frame at
+ * every instruction: the interpreter can enter the machine code at any instruction, and the machine code can hand
+ * any instruction back.
+ *
+ * Templates guard the types they were written for: two integers or two numbers for arithmetic and comparisons,
+ * the usual falsy values for branches. Anything else, and every instruction that calls, returns, allocates or
+ * touches an instance, exits to the interpreter, which runs the instruction and carries on until the next call,
+ * back edge or return brings it back to the machine code.
+ *
+ * Leaving and coming back costs more than interpreting a few instructions, so a function that calls but never loops,
+ * like a recursive one, is left in the interpreter: it would exit at every call and has no loop to win it back.
+ *
+ * The machine code is in memory mapped writable to build it, then executable and no longer writable. Build with
+ * PERF_JIT_ENABLED defined to 0 to leave the JIT out, it is only on by default for x86-64 Linux.
+*/
+
+#if !defined(PERF_JIT_ENABLED)
+#if defined(__x86_64__) && defined(__linux__)
+#define PERF_JIT_ENABLED        1
+#else
+#define PERF_JIT_ENABLED        0
+#endif
+#endif
+
+// Calls plus back edges before a function is compiled.
+#define PERF_JIT_THRESHOLD      1000
+
+/**
+ * Represents the machine code of a function, or the count towards compiling it.
+*/
+typedef struct _perf_jit_function_t
+{
+    uint8_t*    code;           // Machine code, NULL until compiled
+    size_t      code_size;      // Bytes mapped for the machine code
+    uint32_t*   entries;        // Offset in code of each instruction, by 4 byte word of the function's bytecode
+    uint32_t    code_offset;    // Offset of the function's bytecode in the program's code
+    uint32_t    counter;        // Calls plus back edges so far
+    bool        failed;         // True if compiling failed, it stays in the interpreter
+} perf_jit_function_t;
+
+/**
+ * Represents what the JIT has done so far.
+*/
+typedef struct _perf_jit_stats_t
+{
+    uint32_t    compiled_count; // Functions compiled
+    size_t      code_bytes;     // Bytes of machine code
+    uint64_t    entry_count;    // Times the interpreter entered machine code, and it exited back
+    uint32_t    declined_count; // Functions left in the interpreter as they call without looping
+} perf_jit_stats_t;
+
+/**
+ * Represents our JIT, for one run of a program.
+*/
+typedef struct _perf_jit_t
+{
+    perf_jit_function_t*    functions;      // One per function of the program
+    uint32_t                function_count; // Number of functions
+    uint32_t                threshold;      // Calls plus back edges before a function is compiled
+    perf_jit_stats_t        stats;          // What the JIT has done so far
+} perf_jit_t;
+
+/**
+ * @brief Sets a JIT up for a run of a program, freeing the machine code of the last one.
+ *
+ * @param jit The JIT, zeroed before its first use.
+ * @param program The program about to run, in register code.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the JIT was set up successfully.
+*/
+perf_result_t perf_jit_reset(perf_jit_t *jit, const perf_program_t *program, const char** error);
+
+/**
+ * @brief Compiles a function to machine code.
+ *
+ * @param jit The JIT to use.
+ * @param program The program running.
+ * @param globals The globals of the run, the machine code refers to them directly.
+ * @param function The index of the function.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the function was compiled, PERF_RES_UNSUPPORTED if the JIT was left out of the build or
+ * the function calls without looping, PERF_RES_COMPILE_ERROR if a template couldn't be built.
+*/
+perf_result_t perf_jit_compile(perf_jit_t *jit, const perf_program_t *program, perf_value_t *globals, uint32_t function, const char** error);
+
+/**
+ * @brief Runs the machine code of a function until it hands an instruction back to the interpreter.
+ *
+ * @param jit The JIT to use.
+ * @param function The index of the function, which must be compiled.
+ * @param slots The frame's slots.
+ * @param offset The offset in the program's code of the instruction to start at.
+ *
+ * @return The offset in the program's code of the instruction for the interpreter to run next.
+*/
+uint32_t perf_jit_enter(perf_jit_t *jit, uint32_t function, perf_value_t *slots, uint32_t offset);
+
+/**
+ * @brief Gets what the JIT has done so far.
+ *
+ * @param jit The JIT to use.
+ * @param stats The statistics to populate.
+ *
+ * @return PERF_RES_OK if the statistics were gathered successfully.
+*/
+perf_result_t perf_jit_get_stats(perf_jit_t *jit, perf_jit_stats_t *stats);
+
+/**
+ * @brief Frees every function's machine code.
+ *
+ * @param jit The JIT to free.
+ *
+ * @return PERF_RES_OK if the JIT was freed successfully.
+*/
+perf_result_t perf_jit_free(perf_jit_t *jit);
+
+#endif // _PERFECTION_JIT_H
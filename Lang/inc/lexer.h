@@ -1,6 +1,24 @@
 #ifndef _PERFECTION_LEXER_H
 #define _PERFECTION_LEXER_H
 
+/**
+ * Determines how the lexer stores the text of identifiers and strings.
+*/
+typedef enum _perf_e_lexer_mode_t
+{
+    PERF_LEXER_MODE_INTERN,     // Text is interned, tokens hold a stable char* (default)
+    PERF_LEXER_MODE_ZERO_COPY   // Tokens hold an (offset, length) span, the caller keeps the source alive
+} perf_e_lexer_mode_t;
+
+// Number of tokens the pull API can look ahead, must be a power of two.
+#define PERF_LEXER_LOOKAHEAD    4
+
+// Smallest chunk perf_lexer_digest_parallel hands to a thread, smaller sources are lexed serially.
+#define PERF_LEXER_PARALLEL_MIN_CHUNK           (1024 * 1024)
+
+// Number of chunks perf_lexer_digest_parallel cuts per thread, so threads that finish early take on more.
+#define PERF_LEXER_PARALLEL_CHUNKS_PER_THREAD   4
+
 // Represents a lexer.
 typedef struct _perf_lexer_t
 {
@@ -10,6 +28,15 @@ typedef struct _perf_lexer_t
 
     uint32_t line_number;       // Current line number
     uint32_t column_number;     // Current column number
+
+    perf_e_lexer_mode_t mode;   // How token text is stored
+    perf_interner_t interner;   // Owns every identifier and string literal in PERF_LEXER_MODE_INTERN
+
+    char error_buffer[64];      // Storage for error messages that include source text
+
+    perf_token_t lookahead[PERF_LEXER_LOOKAHEAD];   // Ring buffer of scanned tokens not yet consumed by perf_lexer_next
+    uint32_t lookahead_head;                        // Slot of the next token
+    uint32_t lookahead_count;                       // Number of buffered tokens
 } perf_lexer_t;
 
 /**
@@ -20,6 +47,14 @@ typedef struct _perf_lexer_t
  */
 perf_result_t perf_lexer_init(perf_lexer_t *lexer);
 
+/**
+ * @brief Frees the memory owned by a lexer, including every interned token string.
+ *
+ * @param lexer The lexer to free.
+ * @return PERF_RES_OK if the lexer was freed successfully.
+ */
+perf_result_t perf_lexer_free(perf_lexer_t *lexer);
+
 /**
  * @brief Parses the given code and converts it into a token stream.
  * 
@@ -30,6 +65,87 @@ perf_result_t perf_lexer_init(perf_lexer_t *lexer);
  */
 perf_result_t perf_lexer_digest(perf_lexer_t *lexer, const char* src, perf_token_t **tokens, int32_t *token_count, const char** error);
 
+/**
+ * @brief Parses the given code into a token stream on several threads, producing exactly the tokens of perf_lexer_digest.
+ *
+ * The source is cut into chunks at line starts and each chunk is lexed on its own, assuming it starts outside any
+ * string or comment. Afterwards a serial pass checks every chunk's first token against where the chunk before it
+ * actually stopped; a chunk that started inside a string or comment doesn't line up, and the chunk before it lexes
+ * it again itself. Line numbers are then offset and the chunks copied into one array in parallel.
+ *
+ * @param lexer The lexer to use. Each chunk gets a lexer of its own, their strings are interned into this one.
+ * @param src The source code to parse.
+ * @param length The length of the source code, src[length] must be its null terminator.
+ * @param thread_count The number of threads to use, 0 for one per processor.
+ * @param tokens The tokens, including the final TOKEN_EOF, to be freed with free. NULL on error.
+ * @param token_count The number of tokens.
+ * @param error The error message if result is not PERF_RES_OK, the first error perf_lexer_digest would report.
+ *
+ * @return PERF_RES_OK if the source code was parsed successfully.
+ */
+perf_result_t perf_lexer_digest_parallel(perf_lexer_t *lexer, const char* src, size_t length, uint32_t thread_count, perf_token_t **tokens, int32_t *token_count, const char** error);
+
+/**
+ * @brief Scans the next token, skipping any whitespace and comments before it.
+ *
+ * @param lexer The lexer to use. src and current_ch must already point into the source.
+ * @param token The token to populate. TOKEN_EOF is produced at the end of the source.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if a token was scanned successfully.
+ */
+perf_result_t perf_lexer_scan_token(perf_lexer_t *lexer, perf_token_t *token, const char** error);
+
+/**
+ * @brief Starts pulling tokens from the given source with perf_lexer_next and perf_lexer_peek.
+ *
+ * Unlike perf_lexer_digest, nothing is materialized up front: memory stays constant however large the
+ * source is, and the consumer can start working on the first token straight away.
+ *
+ * @param lexer The lexer to use.
+ * @param src The source code to lex. Must outlive the lexer in PERF_LEXER_MODE_ZERO_COPY.
+ *
+ * @return PERF_RES_OK if the lexer was reset successfully.
+ */
+perf_result_t perf_lexer_begin(perf_lexer_t *lexer, const char* src);
+
+/**
+ * @brief Consumes the next token. TOKEN_EOF is produced at the end of the source, and every call after it.
+ *
+ * @param lexer The lexer to use, set up by perf_lexer_begin.
+ * @param token The token to populate.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if a token was produced successfully.
+ */
+perf_result_t perf_lexer_next(perf_lexer_t *lexer, perf_token_t *token, const char** error);
+
+/**
+ * @brief Looks at an upcoming token without consuming it.
+ *
+ * @param lexer The lexer to use, set up by perf_lexer_begin.
+ * @param distance How far to look ahead, 0 is the token perf_lexer_next returns next. Must be below PERF_LEXER_LOOKAHEAD.
+ * @param token Set to the buffered token, valid until the next call to perf_lexer_next.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the token was scanned successfully.
+ */
+perf_result_t perf_lexer_peek(perf_lexer_t *lexer, uint32_t distance, const perf_token_t **token, const char** error);
+
+/**
+ * @brief Gets the raw text of an identifier or string token, in either lexer mode.
+ *
+ * In PERF_LEXER_MODE_ZERO_COPY the text points into the source and is not null terminated.
+ * String text excludes the quotes and still contains escape sequences, see perf_token_decode_string.
+ *
+ * @param lexer The lexer that produced the token.
+ * @param token The token to get the text of.
+ * @param length The length of the text.
+ *
+ * @return The text of the token.
+ */
+const char* perf_lexer_token_text(const perf_lexer_t *lexer, const perf_token_t *token, size_t *length);
+
 /**
  * @brief Prints out the error message.
  * 
@@ -0,0 +1,154 @@
+#ifndef _PERFECTION_MODULE_H
+#define _PERFECTION_MODULE_H
+
+/**
+ * NOTE: A module is a compiled program in a file of its own, so it can be shipped and run without its source.
+ * The file is a header followed by sections, each aligned to 8 bytes at the offset the header gives: the
+ * constant pool, the functions, the line table, the globals, the classes, the methods, the member sites, the
+ * string table and last the code. Nothing in the file is a pointer. Names and string constants refer to the
+ * string table by the offset of their first byte, and everything else by index, so the file means the same
+ * wherever it is mapped.
+ *
+ * The string table stores each string once, laid out like the interner does (see intern.h): a 32-bit length,
+ * the bytes and a terminator, padded to 4 bytes. Pointers into it are used as interned strings, which keeps
+ * names comparable by pointer. String constants are stored as NaN-boxed strings with the offset as their
+ * payload.
+ *
+ * Loading a module never copies the code, the line table or the sites: the program points into the file. The
+ * constants and the function, class, method and global tables are small and hold pointers in a program, they
+ * are decoded into arrays of their own. Before anything runs, the verifier checks every section once: offsets,
+ * indices and strings are in range, every instruction's operands name a constant, slot, global or site that
+ * exists, jumps land on instructions of the same function, no function runs off its end, and in stack code the
+ * operand stack never gets deeper than the function's max_stack or shallower than empty. The VM relies on all
+ * of that instead of checking as it runs.
+ *
+ * Modules are written in the byte order and value encoding of the machine that compiled them, the header's
+ * sizes and version tell loaders of another layout to refuse them. Bump PERF_MODULE_VERSION whenever the
+ * instruction sets or any section change.
+*/
+
+// Version of the module format, modules of any other version are refused.
+#define PERF_MODULE_VERSION     1
+
+// File name extension of modules.
+#define PERF_MODULE_EXTENSION   ".perfc"
+
+// String reference of a missing name, the top level script's.
+#define PERF_MODULE_NO_STRING   UINT32_MAX
+
+/**
+ * Represents the header of a module, the sections follow at the offsets it gives.
+*/
+typedef struct _perf_module_header_t
+{
+    char        magic[8];           // "PERFMOD" and a terminator
+    uint32_t    version;            // PERF_MODULE_VERSION
+    uint32_t    format;             // Instruction set of the code, a perf_e_program_format_t
+    uint16_t    value_size;         // sizeof(perf_value_t)
+    uint16_t    function_size;      // sizeof(perf_module_function_t)
+    uint32_t    reserved;           // Padding, always zero
+    uint64_t    size;               // Size of the whole file
+
+    uint32_t    code_count;         // Bytes of code
+    uint32_t    constant_count;     // Number of constants
+    uint32_t    function_count;     // Number of functions
+    uint32_t    line_count;         // Number of entries in the line table
+    uint32_t    global_count;       // Number of globals
+    uint32_t    class_count;        // Number of classes
+    uint32_t    method_count;       // Number of methods
+    uint32_t    site_count;         // Number of member sites
+    uint32_t    string_size;        // Bytes of the string table
+    uint32_t    string_count;       // Number of strings in the string table
+
+    uint64_t    constant_offset;    // Offset of the constant pool from the start of the file
+    uint64_t    function_offset;    // Offset of the functions
+    uint64_t    line_offset;        // Offset of the line table
+    uint64_t    global_offset;      // Offset of the globals' names
+    uint64_t    class_offset;       // Offset of the classes
+    uint64_t    method_offset;      // Offset of the methods
+    uint64_t    site_offset;        // Offset of the member sites
+    uint64_t    string_offset;      // Offset of the string table
+    uint64_t    code_offset;        // Offset of the code
+} perf_module_header_t;
+
+/**
+ * Represents a function in a module, as perf_function_t with its name by string reference.
+*/
+typedef struct _perf_module_function_t
+{
+    uint32_t    name;               // String reference of the name, PERF_MODULE_NO_STRING for the top level script
+    uint32_t    code_offset;        // Offset of the first instruction in the code
+    uint32_t    code_length;        // Number of bytes of code
+    uint32_t    line_offset;        // Index of the first entry in the line table
+    uint32_t    line_count;         // Number of entries in the line table
+    uint8_t     arity;              // Number of parameters
+    uint8_t     kind;               // How calling it starts, a perf_e_function_kind_t
+    uint16_t    slot_count;         // Number of local slots or registers
+    uint32_t    max_stack;          // Deepest the operand stack gets
+    uint32_t    class_index;        // Class of a method or initializer, UINT32_MAX for plain functions
+} perf_module_function_t;
+
+/**
+ * Represents a class in a module, as perf_class_t with its name by string reference.
+*/
+typedef struct _perf_module_class_t
+{
+    uint32_t    name;               // String reference of the name
+    uint32_t    initializer;        // Index of the init function
+    uint32_t    method_offset;      // Index of the first method
+    uint32_t    method_count;       // Number of methods, init included
+} perf_module_class_t;
+
+/**
+ * Represents a method in a module, as perf_method_t with its name by string reference.
+*/
+typedef struct _perf_module_method_t
+{
+    uint32_t    name;               // String reference of the name
+    uint32_t    function;           // Index of the function
+} perf_module_method_t;
+
+/**
+ * Represents a loaded module.
+*/
+typedef struct _perf_module_t
+{
+    perf_program_t          program;    // The program, its code, line table and sites point into the file
+    const uint8_t*          data;       // The file, which must outlive the module
+    size_t                  size;       // Size of the file
+} perf_module_t;
+
+/**
+ * @brief Writes a compiled program as a module.
+ *
+ * @param program The program to write.
+ * @param path The path of the file, replaced if it exists.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the module was written successfully, PERF_RES_IO_ERROR if it couldn't be.
+*/
+perf_result_t perf_module_write(const perf_program_t *program, const char* path, const char** error);
+
+/**
+ * @brief Verifies a module and loads the program in it, in place.
+ *
+ * @param module The module to populate.
+ * @param data The contents of the file, aligned to 8 bytes, e.g. as perf_source_open maps it.
+ * @param size The size of the contents.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the module was loaded, PERF_RES_UNSUPPORTED if it is not a module of this version
+ * and layout, PERF_RES_COMPILE_ERROR if it fails verification.
+*/
+perf_result_t perf_module_load(perf_module_t *module, const void* data, size_t size, const char** error);
+
+/**
+ * @brief Frees the decoded tables of a module, the file is left to its owner.
+ *
+ * @param module The module to free.
+ *
+ * @return PERF_RES_OK if the module was freed successfully.
+*/
+perf_result_t perf_module_free(perf_module_t *module);
+
+#endif // _PERFECTION_MODULE_H
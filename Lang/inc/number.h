@@ -0,0 +1,37 @@
+#ifndef _PERFECTION_NUMBER_H
+#define _PERFECTION_NUMBER_H
+
+/**
+ * NOTE: Numeric literals are converted in the same pass that finds their end, without copying them.
+ *
+ * Integers may use the 0b, 0o and 0x prefixes, and every literal may contain '_' separators.
+ * A '.' only belongs to the literal if a digit or separator follows it, so "1.foo" is an integer followed by a period.
+ * Floats are correctly rounded: exact cases are handled with a single multiply or divide (Clinger),
+ * the rest with a 128-bit power of five (Eisel-Lemire), and the rare ambiguous cases fall back to strtod
+ * on a bounded stack buffer.
+*/
+
+/**
+ * @brief Scans and converts a numeric literal.
+ *
+ * @param ch The first character of the literal, which must be a digit.
+ * @param end Set to the first character after the literal.
+ * @param token The token to populate, the type is set to TOKEN_INTEGER or TOKEN_NUMBER.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the literal was converted successfully.
+*/
+perf_result_t perf_number_scan(const char* ch, const char** end, perf_token_t* token, const char** error);
+
+/**
+ * @brief Converts a decimal significand and exponent to the nearest double.
+ *
+ * @param mantissa The significand.
+ * @param exponent The power of ten to scale the significand by.
+ * @param out The converted value.
+ *
+ * @return true if the value was converted, false if the fast paths can't decide the rounding.
+*/
+bool perf_number_compute_float(uint64_t mantissa, int32_t exponent, double* out);
+
+#endif // _PERFECTION_NUMBER_H
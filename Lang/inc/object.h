@@ -0,0 +1,145 @@
+#ifndef _PERFECTION_OBJECT_H
+#define _PERFECTION_OBJECT_H
+
+/**
+ * NOTE: Instances keep their fields in fixed slots, in the order the fields were first assigned. Which field is in
+ * which slot is described by the instance's shape, its hidden class: a chain of shapes each adding one field to
+ * its parent, starting from a root shape per class with no fields. Instances that get the same fields in the same
+ * order share a shape, so an instance's shape alone says where each of its fields is. That is what the VM's
+ * inline caches remember (see vm.h), turning a member access into a shape compare and a load.
+ *
+ * Shapes form a tree, each one keeping the shapes that add a field to it, so assigning a new field follows the
+ * transition other instances took before. They are not in the heap: they are allocated with malloc, linked into
+ * the list of whoever made them, and freed with it.
+ *
+ * Fields start out inline, right after the instance. An instance that outgrows them moves them to a
+ * PERF_HEAP_FIELDS object, doubling their capacity. The root shape of each class remembers the most fields one
+ * of its instances got, and new instances start out with that many inline.
+*/
+
+// Fewest fields an instance has room for inline.
+#define PERF_OBJECT_MIN_FIELDS  4
+
+/**
+ * Represents a shape, which fields an instance has and in which slots.
+*/
+typedef struct _perf_shape_t
+{
+    struct _perf_shape_t*   parent;         // Shape this one adds a field to, NULL for a root shape
+    struct _perf_shape_t*   root;           // Root shape of the class, itself for a root shape
+    struct _perf_shape_t*   children;       // First shape adding a field to this one
+    struct _perf_shape_t*   sibling;        // Next shape adding a field to the same parent
+    struct _perf_shape_t*   next;           // Next shape of the list that owns it
+    const char*             name;           // Interned name of the field this shape adds, or of the class for a root shape
+    uint32_t                class_index;    // Class of the instances with this shape
+    uint32_t                field_count;    // Number of fields, the one this shape adds is the last
+    uint32_t                field_hint;     // Most fields an instance of the class got, only kept by root shapes
+} perf_shape_t;
+
+/**
+ * Represents an instance of a class, as it lives in the heap.
+*/
+typedef struct _perf_instance_t
+{
+    perf_heap_object_t      header;         // Heap object header, of type PERF_HEAP_INSTANCE
+    perf_shape_t*           shape;          // Which fields the instance has, the first field_count fields are set
+    perf_value_t*           fields;         // The inline fields, or the values of a PERF_HEAP_FIELDS object
+    uint32_t                capacity;       // Number of fields there is room for
+    uint32_t                reserved;       // Padding, always zero
+    perf_value_t            inline_fields[];// Fields the instance was allocated with room for
+} perf_instance_t;
+
+/**
+ * @brief Makes the root shape of a class, with no fields.
+ *
+ * @param list The list of shapes to add it to.
+ * @param class_index The index of the class.
+ * @param name The interned name of the class.
+ * @param shape The root shape.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the shape was made successfully.
+*/
+perf_result_t perf_shape_root(perf_shape_t **list, uint32_t class_index, const char* name, perf_shape_t **shape, const char** error);
+
+/**
+ * @brief Finds the slot of a field.
+ *
+ * @param shape The shape to search.
+ * @param name The interned name of the field.
+ * @param index The slot of the field.
+ *
+ * @return true if the shape has the field.
+*/
+bool perf_shape_find(const perf_shape_t *shape, const char* name, uint32_t *index);
+
+/**
+ * @brief Gets the shape that adds a field to a shape, making it the first time.
+ *
+ * @param list The list of shapes to add a new shape to.
+ * @param shape The shape to add the field to, which must not have it.
+ * @param name The interned name of the field.
+ * @param next The shape with the field.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the shape was found or made successfully.
+*/
+perf_result_t perf_shape_add(perf_shape_t **list, perf_shape_t *shape, const char* name, perf_shape_t **next, const char** error);
+
+/**
+ * @brief Frees every shape of a list.
+ *
+ * @param list The list of shapes, emptied.
+ *
+ * @return PERF_RES_OK if the shapes were freed successfully.
+*/
+perf_result_t perf_shape_free(perf_shape_t **list);
+
+/**
+ * @brief Allocates an instance with no fields, which may collect first.
+ *
+ * @param heap The heap to allocate from.
+ * @param root The root shape of the instance's class.
+ * @param instance The instance.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the instance was allocated successfully.
+*/
+perf_result_t perf_instance_new(perf_heap_t *heap, perf_shape_t *root, perf_value_t *instance, const char** error);
+
+/**
+ * @brief Adds a field to an instance, growing its fields if they are full, which may collect first.
+ *
+ * @param heap The heap the instance lives in.
+ * @param list The list of shapes to add a new shape to.
+ * @param instance The instance, which must not have the field, updated if collecting moves it.
+ * @param name The interned name of the field.
+ * @param value The value of the field, updated if collecting moves it.
+ * @param index The slot of the field.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the field was added successfully.
+*/
+perf_result_t perf_instance_add(perf_heap_t *heap, perf_shape_t **list, perf_value_t *instance, const char* name, perf_value_t *value, uint32_t *index, const char** error);
+
+/**
+ * @brief Stores a value in a field an instance already has.
+ *
+ * @param heap The heap the instance lives in.
+ * @param instance The instance.
+ * @param index The slot of the field.
+ * @param value The value.
+ *
+ * @return PERF_RES_OK if the value was stored successfully.
+*/
+static inline perf_result_t perf_instance_set(perf_heap_t *heap, perf_instance_t *instance, uint32_t index, perf_value_t value)
+{
+    instance->fields[index] = value;
+
+    // Only old instances made to refer to the heap may need remembering.
+    if (!(instance->header.flags & PERF_HEAP_OLD) || !perf_value_is_heap(value)) return PERF_RES_OK;
+
+    return perf_heap_write_barrier(heap, &instance->header, value);
+}
+
+#endif // _PERFECTION_OBJECT_H
@@ -1,14 +1,41 @@
 #ifndef _PERF_PARSER_H_
 #define _PERF_PARSER_H_
 
+// Maximum nesting depth of expressions and statements, deeper input is rejected instead of overflowing the stack.
+#define PERF_PARSER_MAX_DEPTH   1024
+
+// Fewest tokens perf_parser_digest_parallel hands to a thread at once, smaller streams are parsed serially.
+#define PERF_PARSER_PARALLEL_MIN_TOKENS         (16 * 1024)
+
+// Number of ranges perf_parser_digest_parallel aims to cut per thread, so there is something left to steal.
+#define PERF_PARSER_PARALLEL_RANGES_PER_THREAD  8
+
 /**
  * Represents our parser, which is used to parse the token stream into an AST.
+ *
+ * Tokens either come from an array (perf_parser_digest), a structure of arrays token stream
+ * (perf_parser_digest_stream), or are pulled from the lexer one at a time (perf_parser_parse). Outside an
+ * array, only the tokens the AST references are copied into it, everything else is dropped as soon as it
+ * has been looked at. Every rule checks current_type, which on a stream is loaded from its dense type array.
  */
 typedef struct _perf_parser_t
 {
-    perf_lexer_t* lexer;
-    perf_token_t* current_token;
-    perf_token_t* erroring_token;
+    perf_lexer_t* lexer;                    // Lexer to pull tokens from
+    perf_token_t* tokens;                   // Token array being parsed, NULL when pulling from the lexer
+    perf_token_stream_t* stream;            // Token stream being parsed, NULL otherwise
+    uint32_t      position;                 // Index of the token being looked at in the stream
+    perf_token_t* current_token;            // Token being looked at, NULL on a stream
+    uint8_t       current_type;             // Type of the token being looked at
+    perf_token_t  erroring_token;           // Copy of the token the last parse error refers to
+
+    perf_ast_t*   ast;                      // AST being built
+    uint32_t      depth;                    // Current expression nesting depth
+    uint32_t*     scratch;                  // Stack of child nodes collected for lists not yet in the AST
+    uint32_t      scratch_count;            // Number of nodes on the scratch stack
+    uint32_t      scratch_capacity;         // Number of nodes the scratch stack can hold
+    perf_token_t  eof_token;                // Stands in for the current token once pulling has failed
+    perf_result_t status;                   // First lexer or allocation failure
+    const char*   status_error;             // The error message for status
 } perf_parser_t;
 
 /**
@@ -20,19 +47,22 @@ typedef struct _perf_parser_result_t
 
 	union
 	{
-		perf_parser_node_t *node;   // The node that was parsed.
+		uint32_t node;              // Index of the node that was parsed.
 		const char* error;          // The error message
 	};
 } perf_parser_result_t;
 
-perf_parser_result_t perf_parser_parse_primary_expression(perf_parser_t *parser);
-perf_parser_result_t perf_parser_parse_unary_expression(perf_parser_t *parser);
-perf_parser_result_t perf_parser_parse_multiplication_expression(perf_parser_t *parser);
-perf_parser_result_t perf_parser_parse_addition_expression(perf_parser_t *parser);
-perf_parser_result_t perf_parser_parse_comparison_expression(perf_parser_t *parser);
-perf_parser_result_t perf_parser_parse_equality_expression(perf_parser_t *parser);
+perf_parser_result_t perf_parser_parse_precedence(perf_parser_t *parser, uint8_t min_power);
 perf_parser_result_t perf_parser_parse_expression(perf_parser_t *parser);
+perf_parser_result_t perf_parser_parse_declaration(perf_parser_t *parser);
+perf_parser_result_t perf_parser_parse_block(perf_parser_t *parser);
 perf_parser_result_t perf_parser_parse_function_definition(perf_parser_t *parser);
+perf_parser_result_t perf_parser_parse_class_definition(perf_parser_t *parser);
+perf_parser_result_t perf_parser_parse_if_statement(perf_parser_t *parser);
+perf_parser_result_t perf_parser_parse_while_statement(perf_parser_t *parser);
+perf_parser_result_t perf_parser_parse_do_statement(perf_parser_t *parser);
+perf_parser_result_t perf_parser_parse_for_statement(perf_parser_t *parser);
+perf_parser_result_t perf_parser_parse_jump_statement(perf_parser_t *parser);
 perf_parser_result_t perf_parser_parse_generic_statement(perf_parser_t *parser);
 
 
@@ -50,16 +80,93 @@ perf_result_t perf_parser_init(perf_parser_t *parser, perf_lexer_t *lexer, const
 /**
  * @brief Consume the token stream and parse it into an AST.
  * 
+ * The AST refers to the tokens in place, so the token array must outlive it.
+ * 
  * @param parser The parser to use.
  * @param tokens The token stream to parse.
  * @param token_count The number of tokens in the token stream.
- * @param ast The AST to populate.
- * @param ast_count The number of nodes in the AST.
+ * @param ast The AST to populate, it is initialized here and must be freed with perf_ast_free even on failure.
  * @param error The error message to print if result is not RES_OK.
  * 
  * @return PERF_RES_OK if the token stream was parsed successfully.
  */
-perf_result_t perf_parser_digest(perf_parser_t *parser, perf_token_t *tokens, int32_t token_count, perf_parser_node_t **ast, int32_t *ast_count, const char** error);
+perf_result_t perf_parser_digest(perf_parser_t *parser, perf_token_t *tokens, int32_t token_count, perf_ast_t *ast, const char** error);
+
+/**
+ * @brief Parses the top level statements starting in part of a token array, appending them to an AST.
+ *
+ * Parsing starts at tokens[first] and stops before the first statement starting at or past tokens[end], so the
+ * last statement may run past end. Token indices in the AST are indices into the whole array.
+ *
+ * @param parser The parser to use.
+ * @param tokens The whole token stream, ending in TOKEN_EOF.
+ * @param token_count The number of tokens in the token stream.
+ * @param first The index of the token to start at, which must start a top level statement.
+ * @param end The index of the token to stop at.
+ * @param ast The AST to append to, initialized with perf_ast_init. It borrows the token array.
+ * @param stop The index of the token parsing stopped at.
+ * @param error The error message to print if result is not RES_OK.
+ *
+ * @return PERF_RES_OK if the statements were parsed successfully.
+ */
+perf_result_t perf_parser_digest_range(perf_parser_t *parser, perf_token_t *tokens, int32_t token_count, uint32_t first, uint32_t end, perf_ast_t *ast, uint32_t *stop, const char** error);
+
+/**
+ * @brief Parses a token stream on several threads, producing exactly the AST of perf_parser_digest.
+ *
+ * A pre-scan matches braces and parentheses to find top level function definitions, which start independent
+ * statements, and cuts the stream into ranges at them. The ranges are parsed on a work-stealing pool, each
+ * into an AST of its own, and a serial pass then checks each range started where the one before it stopped.
+ * Finally the ASTs are placed one after another in source order, moving their node and list indices along.
+ *
+ * @param parser The parser to use, its lexer is shared with the parsers of the other threads.
+ * @param tokens The token stream to parse.
+ * @param token_count The number of tokens in the token stream.
+ * @param thread_count The number of threads to use, 0 for one per processor.
+ * @param ast The AST to populate, it is initialized here and must be freed with perf_ast_free even on failure.
+ * @param error The error message to print if result is not RES_OK, the first error perf_parser_digest would report.
+ *
+ * @return PERF_RES_OK if the token stream was parsed successfully.
+ */
+perf_result_t perf_parser_digest_parallel(perf_parser_t *parser, perf_token_t *tokens, int32_t token_count, uint32_t thread_count, perf_ast_t *ast, const char** error);
+
+/**
+ * @brief Parses a token stream into an AST.
+ *
+ * Kept tokens are materialized and copied into the AST, with their line and column, so the stream can be
+ * freed once parsing is done. Every other token is only ever looked at through the stream's type array.
+ *
+ * @param parser The parser to use.
+ * @param stream The token stream to parse, ending in TOKEN_EOF.
+ * @param ast The AST to populate, it is initialized here and must be freed with perf_ast_free even on failure.
+ * @param error The error message to print if result is not RES_OK.
+ *
+ * @return PERF_RES_OK if the token stream was parsed successfully.
+ */
+perf_result_t perf_parser_digest_stream(perf_parser_t *parser, perf_token_stream_t *stream, perf_ast_t *ast, const char** error);
+
+/**
+ * @brief Parse source code into an AST, pulling tokens from the parser's lexer as they are needed.
+ * 
+ * Lexing overlaps with parsing and no token array is built, so memory stays proportional to the AST.
+ * 
+ * @param parser The parser to use.
+ * @param src The source code to parse.
+ * @param ast The AST to populate, it is initialized here and must be freed with perf_ast_free even on failure.
+ * @param error The error message to print if result is not RES_OK.
+ * 
+ * @return PERF_RES_OK if the source was parsed successfully, PERF_RES_LEX_ERROR if it couldn't be lexed.
+ */
+perf_result_t perf_parser_parse(perf_parser_t *parser, const char* src, perf_ast_t *ast, const char** error);
+
+/**
+ * @brief Frees the parser's scratch memory. ASTs it produced are freed separately with perf_ast_free.
+ * 
+ * @param parser The parser to free.
+ * 
+ * @return PERF_RES_OK if the parser was freed successfully.
+ */
+perf_result_t perf_parser_free(perf_parser_t *parser);
 
 
 #endif // _PERF_PARSER_H_
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef _PERFECTION_POOL_H
+#define _PERFECTION_POOL_H
+
+// Most threads a pool will start, however many are asked for.
+#define PERF_POOL_MAX_THREADS   64
+
+/**
+ * Represents a task run by the pool.
+ *
+ * @param context The context passed to perf_pool_run.
+ * @param task The index of the task, below the task count.
+ * @param worker The index of the thread running it, below the thread count. 0 is the calling thread.
+*/
+typedef void (*perf_pool_task_t)(void* context, uint32_t task, uint32_t worker);
+
+/**
+ * @brief Gets the number of processors available to the process.
+ *
+ * @return The number of processors, at least 1.
+*/
+uint32_t perf_pool_cpu_count(void);
+
+/**
+ * @brief Runs a batch of independent tasks on a pool of threads and waits for all of them.
+ *
+ * Each thread starts on an even, contiguous share of the tasks and steals from the others once it runs out,
+ * so uneven tasks still balance. The calling thread works as well, so a thread count of 1 runs every task
+ * inline without starting any threads.
+ *
+ * @param thread_count The number of threads to run on, 0 for perf_pool_cpu_count.
+ * @param task_count The number of tasks.
+ * @param task The function run for each task.
+ * @param context Passed to every task.
+ *
+ * @return PERF_RES_OK once every task has run, which it always does: threads that fail to start leave their
+ * share to the calling thread.
+*/
+perf_result_t perf_pool_run(uint32_t thread_count, uint32_t task_count, perf_pool_task_t task, void* context);
+
+#endif // _PERFECTION_POOL_H
@@ -0,0 +1,515 @@
+#ifndef _PERFECTION_PROGRAM_H
+#define _PERFECTION_PROGRAM_H
+
+/**
+ * NOTE: Instructions are a one byte opcode followed by its operands, little endian and unaligned.
+ *
+ * Operands are u8 local slots and argument counts, u16 constant indices and jump distances, and u32 global
+ * slots and member sites. Jumps are measured from the end of the jump instruction, backward for OP_LOOP and forward
+ * for every other jump. Locals live in the frame's slots, separate from the operand
+ * stack, which is empty between statements.
+ *
+ * Every instruction that gets, sets or invokes a member has a site of its own, so the VM can remember what the
+ * objects it saw there looked like (see vm.h). A site names the member through a constant. Methods run with
+ * their receiver in the callee's slot, right below their arguments, where OP_GET_THIS finds it.
+*/
+
+/**
+ * Represents an instruction's opcode.
+*/
+typedef enum _perf_e_opcode_t
+{
+    OP_CONSTANT,            // u16 constant         -> push the constant
+    OP_CONSTANT_WIDE,       // u32 constant         -> push the constant
+    OP_NIL,                 //                      -> push nil
+    OP_TRUE,                //                      -> push true
+    OP_FALSE,               //                      -> push false
+    OP_POP,                 //                      -> pop the top value
+    OP_GET_LOCAL,           // u8 slot              -> push the local
+    OP_SET_LOCAL,           // u8 slot              -> store the top value in the local, leaving it pushed
+    OP_GET_GLOBAL,          // u32 global           -> push the global
+    OP_SET_GLOBAL,          // u32 global           -> store the top value in the global, leaving it pushed
+    OP_GET_MEMBER,          // u32 site             -> replace the object with its member
+    OP_SET_MEMBER,          // u32 site             -> store the top value in the member of the object below it
+    OP_NEGATE,              //                      -> negate the top value
+    OP_NOT,                 //                      -> replace the top value with whether it is falsy
+    OP_ADD,                 //                      -> pop two values, push their sum
+    OP_SUBTRACT,            //                      -> pop two values, push their difference
+    OP_MULTIPLY,            //                      -> pop two values, push their product
+    OP_DIVIDE,              //                      -> pop two values, push their quotient
+    OP_MODULO,              //                      -> pop two values, push their remainder
+    OP_BIT_AND,             //                      -> pop two integers, push their bitwise and
+    OP_EQUAL,               //                      -> pop two values, push a == b
+    OP_NOT_EQUAL,           //                      -> pop two values, push a != b
+    OP_GREATER,             //                      -> pop two values, push a > b
+    OP_GREATER_EQUAL,       //                      -> pop two values, push a >= b
+    OP_LESS,                //                      -> pop two values, push a < b
+    OP_LESS_EQUAL,          //                      -> pop two values, push a <= b
+    OP_JUMP,                // u16 distance         -> jump forward
+    OP_JUMP_IF_FALSE,       // u16 distance         -> pop the condition, jump forward if it is falsy
+    OP_LOOP,                // u16 distance         -> jump backward
+    OP_CALL,                // u8 argument count    -> call the callee below the arguments, leaving its result
+    OP_RETURN,              //                      -> return the top value to the caller
+    OP_INVOKE,              // u32 site, u8 count   -> call the member of the object below the arguments, leaving its result
+    OP_GET_THIS,            //                      -> push the receiver of the running method
+
+    // Superinstructions, fused from common pairs by the compiler.
+    OP_ADD_LOCAL,           // u8 slot              -> GET_LOCAL, ADD
+    OP_ADD_CONSTANT,        // u16 constant         -> CONSTANT, ADD
+    OP_SUBTRACT_CONSTANT,   // u16 constant         -> CONSTANT, SUBTRACT
+    OP_STORE_LOCAL,         // u8 slot              -> SET_LOCAL, POP
+    OP_STORE_GLOBAL,        // u32 global           -> SET_GLOBAL, POP
+    OP_JUMP_IF_NOT_EQUAL,           // u16 distance -> EQUAL, JUMP_IF_FALSE
+    OP_JUMP_IF_EQUAL,               // u16 distance -> NOT_EQUAL, JUMP_IF_FALSE
+    OP_JUMP_IF_NOT_GREATER,         // u16 distance -> GREATER, JUMP_IF_FALSE
+    OP_JUMP_IF_NOT_GREATER_EQUAL,   // u16 distance -> GREATER_EQUAL, JUMP_IF_FALSE
+    OP_JUMP_IF_NOT_LESS,            // u16 distance -> LESS, JUMP_IF_FALSE
+    OP_JUMP_IF_NOT_LESS_EQUAL,      // u16 distance -> LESS_EQUAL, JUMP_IF_FALSE
+
+    OP_COUNT                // Number of opcodes
+} perf_e_opcode_t;
+
+/**
+ * Describes the encoding of an opcode.
+*/
+typedef struct _perf_opcode_info_t
+{
+    const char* name;           // Name of the opcode in dumps
+    uint8_t     operand_size;   // Bytes of operands after the opcode
+    int8_t      stack_effect;   // Change in operand stack depth, OP_CALL and OP_INVOKE also pop their arguments
+} perf_opcode_info_t;
+
+/**
+ * Encoding of each opcode, indexed by perf_e_opcode_t.
+*/
+static const perf_opcode_info_t perf_opcode_info[OP_COUNT] =
+{
+    [OP_CONSTANT]       = { "CONSTANT",         2,  1 },
+    [OP_CONSTANT_WIDE]  = { "CONSTANT_WIDE",    4,  1 },
+    [OP_NIL]            = { "NIL",              0,  1 },
+    [OP_TRUE]           = { "TRUE",             0,  1 },
+    [OP_FALSE]          = { "FALSE",            0,  1 },
+    [OP_POP]            = { "POP",              0, -1 },
+    [OP_GET_LOCAL]      = { "GET_LOCAL",        1,  1 },
+    [OP_SET_LOCAL]      = { "SET_LOCAL",        1,  0 },
+    [OP_GET_GLOBAL]     = { "GET_GLOBAL",       4,  1 },
+    [OP_SET_GLOBAL]     = { "SET_GLOBAL",       4,  0 },
+    [OP_GET_MEMBER]     = { "GET_MEMBER",       4,  0 },
+    [OP_SET_MEMBER]     = { "SET_MEMBER",       4, -1 },
+    [OP_NEGATE]         = { "NEGATE",           0,  0 },
+    [OP_NOT]            = { "NOT",              0,  0 },
+    [OP_ADD]            = { "ADD",              0, -1 },
+    [OP_SUBTRACT]       = { "SUBTRACT",         0, -1 },
+    [OP_MULTIPLY]       = { "MULTIPLY",         0, -1 },
+    [OP_DIVIDE]         = { "DIVIDE",           0, -1 },
+    [OP_MODULO]         = { "MODULO",           0, -1 },
+    [OP_BIT_AND]        = { "BIT_AND",          0, -1 },
+    [OP_EQUAL]          = { "EQUAL",            0, -1 },
+    [OP_NOT_EQUAL]      = { "NOT_EQUAL",        0, -1 },
+    [OP_GREATER]        = { "GREATER",          0, -1 },
+    [OP_GREATER_EQUAL]  = { "GREATER_EQUAL",    0, -1 },
+    [OP_LESS]           = { "LESS",             0, -1 },
+    [OP_LESS_EQUAL]     = { "LESS_EQUAL",       0, -1 },
+    [OP_JUMP]           = { "JUMP",             2,  0 },
+    [OP_JUMP_IF_FALSE]  = { "JUMP_IF_FALSE",    2, -1 },
+    [OP_LOOP]           = { "LOOP",             2,  0 },
+    [OP_CALL]           = { "CALL",             1,  0 },
+    [OP_RETURN]         = { "RETURN",           0, -1 },
+    [OP_INVOKE]         = { "INVOKE",           5,  0 },
+    [OP_GET_THIS]       = { "GET_THIS",         0,  1 },
+
+    [OP_ADD_LOCAL]                  = { "ADD_LOCAL",                    1,  0 },
+    [OP_ADD_CONSTANT]               = { "ADD_CONSTANT",                 2,  0 },
+    [OP_SUBTRACT_CONSTANT]          = { "SUBTRACT_CONSTANT",            2,  0 },
+    [OP_STORE_LOCAL]                = { "STORE_LOCAL",                  1, -1 },
+    [OP_STORE_GLOBAL]               = { "STORE_GLOBAL",                 4, -1 },
+    [OP_JUMP_IF_NOT_EQUAL]          = { "JUMP_IF_NOT_EQUAL",            2, -2 },
+    [OP_JUMP_IF_EQUAL]              = { "JUMP_IF_EQUAL",                2, -2 },
+    [OP_JUMP_IF_NOT_GREATER]        = { "JUMP_IF_NOT_GREATER",          2, -2 },
+    [OP_JUMP_IF_NOT_GREATER_EQUAL]  = { "JUMP_IF_NOT_GREATER_EQUAL",    2, -2 },
+    [OP_JUMP_IF_NOT_LESS]           = { "JUMP_IF_NOT_LESS",             2, -2 },
+    [OP_JUMP_IF_NOT_LESS_EQUAL]     = { "JUMP_IF_NOT_LESS_EQUAL",       2, -2 },
+};
+
+/**
+ * NOTE: Register code is the same program in a different instruction set, picked when compiling. Instructions
+ * are one or two 4 byte words. The first word is the opcode and the register a, then either the registers b and
+ * c or a u16 bx, and the second word is either a u32 x or a u16 bx in its upper half. A function's registers
+ * are its frame's slots, its locals keep the slots they have in stack code and temporaries take the slots above.
+ * Jumps are measured in bytes from the end of the instruction like in stack code.
+*/
+
+/**
+ * Represents a register instruction's opcode.
+*/
+typedef enum _perf_e_reg_opcode_t
+{
+    ROP_MOVE,                       // a b          -> R[a] = R[b]
+    ROP_CONSTANT,                   // a bx         -> R[a] = K[bx]
+    ROP_CONSTANT_WIDE,              // a, x         -> R[a] = K[x]
+    ROP_NIL,                        // a            -> R[a] = nil
+    ROP_TRUE,                       // a            -> R[a] = true
+    ROP_FALSE,                      // a            -> R[a] = false
+    ROP_GET_GLOBAL,                 // a, x         -> R[a] = G[x]
+    ROP_SET_GLOBAL,                 // a, x         -> G[x] = R[a]
+    ROP_GET_MEMBER,                 // a b, x       -> R[a] = R[b].S[x], x is a site
+    ROP_SET_MEMBER,                 // a b, x       -> R[a].S[x] = R[b]
+    ROP_NEGATE,                     // a b          -> R[a] = -R[b]
+    ROP_NOT,                        // a b          -> R[a] = !R[b]
+    ROP_ADD,                        // a b c        -> R[a] = R[b] + R[c]
+    ROP_SUBTRACT,                   // a b c        -> R[a] = R[b] - R[c]
+    ROP_MULTIPLY,                   // a b c        -> R[a] = R[b] * R[c]
+    ROP_DIVIDE,                     // a b c        -> R[a] = R[b] / R[c]
+    ROP_MODULO,                     // a b c        -> R[a] = R[b] % R[c]
+    ROP_BIT_AND,                    // a b c        -> R[a] = R[b] & R[c]
+    ROP_EQUAL,                      // a b c        -> R[a] = R[b] == R[c]
+    ROP_NOT_EQUAL,                  // a b c        -> R[a] = R[b] != R[c]
+    ROP_GREATER,                    // a b c        -> R[a] = R[b] > R[c]
+    ROP_GREATER_EQUAL,              // a b c        -> R[a] = R[b] >= R[c]
+    ROP_LESS,                       // a b c        -> R[a] = R[b] < R[c]
+    ROP_LESS_EQUAL,                 // a b c        -> R[a] = R[b] <= R[c]
+    ROP_ADD_CONSTANT,               // a b c        -> R[a] = R[b] + K[c]
+    ROP_SUBTRACT_CONSTANT,          // a b c        -> R[a] = R[b] - K[c]
+    ROP_JUMP,                       // bx           -> jump forward
+    ROP_JUMP_IF_FALSE,              // a bx         -> jump forward if R[a] is falsy
+    ROP_JUMP_IF_NOT_EQUAL,          // a b, bx      -> jump forward unless R[a] == R[b]
+    ROP_JUMP_IF_EQUAL,              // a b, bx      -> jump forward unless R[a] != R[b]
+    ROP_JUMP_IF_NOT_GREATER,        // a b, bx      -> jump forward unless R[a] > R[b]
+    ROP_JUMP_IF_NOT_GREATER_EQUAL,  // a b, bx      -> jump forward unless R[a] >= R[b]
+    ROP_JUMP_IF_NOT_LESS,           // a b, bx      -> jump forward unless R[a] < R[b]
+    ROP_JUMP_IF_NOT_LESS_EQUAL,     // a b, bx      -> jump forward unless R[a] <= R[b]
+    ROP_LOOP,                       // bx           -> jump backward
+    ROP_CALL,                       // a b          -> R[a] = R[a](R[a + 1] .. R[a + b]), the callee's slots start at R[a + 1]
+    ROP_RETURN,                     // a            -> return R[a] to the caller
+    ROP_INVOKE,                     // a b, x       -> R[a] = R[a].S[x](R[a + 1] .. R[a + b]), the receiver stays in R[a]
+    ROP_GET_THIS,                   // a            -> R[a] = the receiver of the running method
+
+    ROP_COUNT                       // Number of opcodes
+} perf_e_reg_opcode_t;
+
+/**
+ * Used to determine which operands a register instruction has, for tools that decode it.
+*/
+typedef enum _perf_e_reg_layout_t
+{
+    PERF_REG_LAYOUT_A,              // a
+    PERF_REG_LAYOUT_AB,             // a b
+    PERF_REG_LAYOUT_ABC,            // a b c
+    PERF_REG_LAYOUT_ABK,            // a b, c is a constant
+    PERF_REG_LAYOUT_AK,             // a, bx is a constant
+    PERF_REG_LAYOUT_AX_CONSTANT,    // a, x is a constant
+    PERF_REG_LAYOUT_AX_GLOBAL,      // a, x is a global
+    PERF_REG_LAYOUT_ABX_MEMBER,     // a b, x is a site
+    PERF_REG_LAYOUT_JUMP,           // bx is a forward jump
+    PERF_REG_LAYOUT_A_JUMP,         // a, bx is a forward jump
+    PERF_REG_LAYOUT_AB_JUMP,        // a b, the second word's bx is a forward jump
+    PERF_REG_LAYOUT_LOOP,           // bx is a backward jump
+    PERF_REG_LAYOUT_CALL,           // a, b is an argument count
+    PERF_REG_LAYOUT_INVOKE          // a, b is an argument count, x is a site
+} perf_e_reg_layout_t;
+
+/**
+ * Represents the static properties of a register opcode.
+*/
+typedef struct _perf_reg_opcode_info_t
+{
+    const char* name;           // Name for disassembly
+    uint8_t     layout;         // Operands, a perf_e_reg_layout_t
+    uint8_t     size;           // Size of the instruction, 4 or 8 bytes
+} perf_reg_opcode_info_t;
+
+/**
+ * Properties of every register opcode, indexed by opcode.
+*/
+static const perf_reg_opcode_info_t perf_reg_opcode_info[ROP_COUNT] =
+{
+    [ROP_MOVE]                      = { "MOVE",                         PERF_REG_LAYOUT_AB,             4 },
+    [ROP_CONSTANT]                  = { "CONSTANT",                     PERF_REG_LAYOUT_AK,             4 },
+    [ROP_CONSTANT_WIDE]             = { "CONSTANT_WIDE",                PERF_REG_LAYOUT_AX_CONSTANT,    8 },
+    [ROP_NIL]                       = { "NIL",                          PERF_REG_LAYOUT_A,              4 },
+    [ROP_TRUE]                      = { "TRUE",                         PERF_REG_LAYOUT_A,              4 },
+    [ROP_FALSE]                     = { "FALSE",                        PERF_REG_LAYOUT_A,              4 },
+    [ROP_GET_GLOBAL]                = { "GET_GLOBAL",                   PERF_REG_LAYOUT_AX_GLOBAL,      8 },
+    [ROP_SET_GLOBAL]                = { "SET_GLOBAL",                   PERF_REG_LAYOUT_AX_GLOBAL,      8 },
+    [ROP_GET_MEMBER]                = { "GET_MEMBER",                   PERF_REG_LAYOUT_ABX_MEMBER,     8 },
+    [ROP_SET_MEMBER]                = { "SET_MEMBER",                   PERF_REG_LAYOUT_ABX_MEMBER,     8 },
+    [ROP_NEGATE]                    = { "NEGATE",                       PERF_REG_LAYOUT_AB,             4 },
+    [ROP_NOT]                       = { "NOT",                          PERF_REG_LAYOUT_AB,             4 },
+    [ROP_ADD]                       = { "ADD",                          PERF_REG_LAYOUT_ABC,            4 },
+    [ROP_SUBTRACT]                  = { "SUBTRACT",                     PERF_REG_LAYOUT_ABC,            4 },
+    [ROP_MULTIPLY]                  = { "MULTIPLY",                     PERF_REG_LAYOUT_ABC,            4 },
+    [ROP_DIVIDE]                    = { "DIVIDE",                       PERF_REG_LAYOUT_ABC,            4 },
+    [ROP_MODULO]                    = { "MODULO",                       PERF_REG_LAYOUT_ABC,            4 },
+    [ROP_BIT_AND]                   = { "BIT_AND",                      PERF_REG_LAYOUT_ABC,            4 },
+    [ROP_EQUAL]                     = { "EQUAL",                        PERF_REG_LAYOUT_ABC,            4 },
+    [ROP_NOT_EQUAL]                 = { "NOT_EQUAL",                    PERF_REG_LAYOUT_ABC,            4 },
+    [ROP_GREATER]                   = { "GREATER",                      PERF_REG_LAYOUT_ABC,            4 },
+    [ROP_GREATER_EQUAL]             = { "GREATER_EQUAL",                PERF_REG_LAYOUT_ABC,            4 },
+    [ROP_LESS]                      = { "LESS",                         PERF_REG_LAYOUT_ABC,            4 },
+    [ROP_LESS_EQUAL]                = { "LESS_EQUAL",                   PERF_REG_LAYOUT_ABC,            4 },
+    [ROP_ADD_CONSTANT]              = { "ADD_CONSTANT",                 PERF_REG_LAYOUT_ABK,            4 },
+    [ROP_SUBTRACT_CONSTANT]         = { "SUBTRACT_CONSTANT",            PERF_REG_LAYOUT_ABK,            4 },
+    [ROP_JUMP]                      = { "JUMP",                         PERF_REG_LAYOUT_JUMP,           4 },
+    [ROP_JUMP_IF_FALSE]             = { "JUMP_IF_FALSE",                PERF_REG_LAYOUT_A_JUMP,         4 },
+    [ROP_JUMP_IF_NOT_EQUAL]         = { "JUMP_IF_NOT_EQUAL",            PERF_REG_LAYOUT_AB_JUMP,        8 },
+    [ROP_JUMP_IF_EQUAL]             = { "JUMP_IF_EQUAL",                PERF_REG_LAYOUT_AB_JUMP,        8 },
+    [ROP_JUMP_IF_NOT_GREATER]       = { "JUMP_IF_NOT_GREATER",          PERF_REG_LAYOUT_AB_JUMP,        8 },
+    [ROP_JUMP_IF_NOT_GREATER_EQUAL] = { "JUMP_IF_NOT_GREATER_EQUAL",    PERF_REG_LAYOUT_AB_JUMP,        8 },
+    [ROP_JUMP_IF_NOT_LESS]          = { "JUMP_IF_NOT_LESS",             PERF_REG_LAYOUT_AB_JUMP,        8 },
+    [ROP_JUMP_IF_NOT_LESS_EQUAL]    = { "JUMP_IF_NOT_LESS_EQUAL",       PERF_REG_LAYOUT_AB_JUMP,        8 },
+    [ROP_LOOP]                      = { "LOOP",                         PERF_REG_LAYOUT_LOOP,           4 },
+    [ROP_CALL]                      = { "CALL",                         PERF_REG_LAYOUT_CALL,           4 },
+    [ROP_RETURN]                    = { "RETURN",                       PERF_REG_LAYOUT_A,              4 },
+    [ROP_INVOKE]                    = { "INVOKE",                       PERF_REG_LAYOUT_INVOKE,         8 },
+    [ROP_GET_THIS]                  = { "GET_THIS",                     PERF_REG_LAYOUT_A,              4 },
+};
+
+/**
+ * Used to determine which instruction set a program's code is in.
+*/
+typedef enum _perf_e_program_format_t
+{
+    PERF_PROGRAM_FORMAT_STACK,      // Stack code, perf_e_opcode_t
+    PERF_PROGRAM_FORMAT_REGISTER    // Register code, perf_e_reg_opcode_t
+} perf_e_program_format_t;
+
+/**
+ * Used to determine how calling a function starts.
+*/
+typedef enum _perf_e_function_kind_t
+{
+    PERF_FUNCTION_PLAIN,            // Called as it is
+    PERF_FUNCTION_METHOD,           // Invoked on an instance, which sits in the callee's slot
+    PERF_FUNCTION_INITIALIZER       // A class's init, calling it makes the instance it initializes and returns
+} perf_e_function_kind_t;
+
+/**
+ * Represents a compiled function.
+*/
+typedef struct _perf_function_t
+{
+    const char* name;           // Interned name, NULL for the top level script
+    uint32_t    code_offset;    // Offset of the first instruction in the program's code
+    uint32_t    code_length;    // Number of bytes of code
+    uint32_t    line_offset;    // Index of the first entry in the program's line table
+    uint32_t    line_count;     // Number of entries in the line table
+    uint8_t     arity;          // Number of parameters, which take the first slots
+    uint8_t     kind;           // How calling it starts, a perf_e_function_kind_t
+    uint16_t    slot_count;     // Number of local slots, including the parameters, or of registers in register code
+    uint32_t    max_stack;      // Deepest the operand stack gets, so a call checks for room once, 0 in register code
+    uint32_t    class_index;    // Class a method or initializer belongs to, UINT32_MAX for plain functions
+} perf_function_t;
+
+/**
+ * Represents a class: its name, its initializer and a contiguous range of the program's methods.
+ *
+ * The global of the class's name holds its initializer, calling it is how instances are made. Classes without
+ * an init get an empty one.
+*/
+typedef struct _perf_class_t
+{
+    const char* name;           // Interned name
+    uint32_t    initializer;    // Index of the init function
+    uint32_t    method_offset;  // Index of the first method in the program's methods
+    uint32_t    method_count;   // Number of methods, init included
+} perf_class_t;
+
+/**
+ * Represents a method of a class.
+*/
+typedef struct _perf_method_t
+{
+    const char* name;           // Interned name
+    uint32_t    function;       // Index of the function
+} perf_method_t;
+
+/**
+ * Represents an entry of the line table, the source line of the code from an offset up to the next entry.
+*/
+typedef struct _perf_program_line_t
+{
+    uint32_t    offset;         // Offset of the code in the program
+    uint32_t    line;           // Source line number, starting at 1
+} perf_program_line_t;
+
+/**
+ * Represents a compiled program, stored in flat arrays like the AST.
+ *
+ * Function 0 is the top level script. Every function's code is a contiguous range of code, and its lines a
+ * contiguous range of the line table.
+*/
+typedef struct _perf_program_t
+{
+    perf_e_program_format_t format;             // Instruction set of the code
+
+    uint8_t*                code;               // Code of every function
+    uint32_t                code_count;         // Number of bytes of code
+    uint32_t                code_capacity;      // Number of bytes of code we can hold
+
+    perf_value_t*           constants;          // Constant pool, shared by every function
+    uint32_t                constant_count;     // Number of constants
+    uint32_t                constant_capacity;  // Number of constants we can hold
+
+    perf_function_t*        functions;          // Every function
+    uint32_t                function_count;     // Number of functions
+    uint32_t                function_capacity;  // Number of functions we can hold
+
+    perf_program_line_t*    lines;              // Line table of every function
+    uint32_t                line_count;         // Number of entries in the line table
+    uint32_t                line_capacity;      // Number of entries the line table can hold
+
+    const char**            globals;            // Interned name of each global slot
+    uint32_t                global_count;       // Number of global slots
+    uint32_t                global_capacity;    // Number of global slots we can hold
+
+    perf_class_t*           classes;            // Every class
+    uint32_t                class_count;        // Number of classes
+    uint32_t                class_capacity;     // Number of classes we can hold
+
+    perf_method_t*          methods;            // Methods of every class
+    uint32_t                method_count;       // Number of methods
+    uint32_t                method_capacity;    // Number of methods we can hold
+
+    uint32_t*               sites;              // Name constant of each member site
+    uint32_t                site_count;         // Number of member sites
+    uint32_t                site_capacity;      // Number of member sites we can hold
+} perf_program_t;
+
+/**
+ * @brief Initializes an empty program.
+ *
+ * @param program The program to initialize.
+ *
+ * @return PERF_RES_OK if the program was initialized successfully.
+*/
+perf_result_t perf_program_init(perf_program_t *program);
+
+/**
+ * @brief Appends code to the program.
+ *
+ * @param program The program to append to.
+ * @param code The code to append.
+ * @param length The number of bytes of code.
+ * @param offset The offset of the appended code.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the code was appended successfully.
+*/
+perf_result_t perf_program_add_code(perf_program_t *program, const uint8_t *code, uint32_t length, uint32_t *offset, const char** error);
+
+/**
+ * @brief Appends a constant to the constant pool. Constants are not deduplicated here.
+ *
+ * @param program The program to append to.
+ * @param value The constant.
+ * @param index The index of the constant.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the constant was appended successfully.
+*/
+perf_result_t perf_program_add_constant(perf_program_t *program, const perf_value_t *value, uint32_t *index, const char** error);
+
+/**
+ * @brief Appends an empty function to the program, to be filled in once it is compiled.
+ *
+ * @param program The program to append to.
+ * @param name The interned name of the function, NULL for the top level script.
+ * @param index The index of the function.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the function was appended successfully.
+*/
+perf_result_t perf_program_add_function(perf_program_t *program, const char* name, uint32_t *index, const char** error);
+
+/**
+ * @brief Appends entries to the line table.
+ *
+ * @param program The program to append to.
+ * @param lines The entries to append.
+ * @param count The number of entries.
+ * @param offset The index of the first appended entry.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the entries were appended successfully.
+*/
+perf_result_t perf_program_add_lines(perf_program_t *program, const perf_program_line_t *lines, uint32_t count, uint32_t *offset, const char** error);
+
+/**
+ * @brief Appends a global slot to the program.
+ *
+ * @param program The program to append to.
+ * @param name The interned name of the global.
+ * @param index The index of the global.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the global was appended successfully.
+*/
+perf_result_t perf_program_add_global(perf_program_t *program, const char* name, uint32_t *index, const char** error);
+
+/**
+ * @brief Appends an empty class to the program, its methods are the ones appended after it.
+ *
+ * @param program The program to append to.
+ * @param name The interned name of the class.
+ * @param index The index of the class.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the class was appended successfully.
+*/
+perf_result_t perf_program_add_class(perf_program_t *program, const char* name, uint32_t *index, const char** error);
+
+/**
+ * @brief Appends a method to the class appended last.
+ *
+ * @param program The program to append to.
+ * @param name The interned name of the method.
+ * @param function The index of the method's function.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the method was appended successfully.
+*/
+perf_result_t perf_program_add_method(perf_program_t *program, const char* name, uint32_t function, const char** error);
+
+/**
+ * @brief Appends a member site to the program.
+ *
+ * @param program The program to append to.
+ * @param name The index of the constant holding the member's interned name.
+ * @param index The index of the site.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the site was appended successfully.
+*/
+perf_result_t perf_program_add_site(perf_program_t *program, uint32_t name, uint32_t *index, const char** error);
+
+/**
+ * @brief Finds the source line of an instruction.
+ *
+ * @param program The program the instruction is in.
+ * @param function The index of the function the instruction is in.
+ * @param offset The offset of the instruction in the program's code.
+ *
+ * @return The line number, or 0 if the function has no line table.
+*/
+uint32_t perf_program_line(const perf_program_t *program, uint32_t function, uint32_t offset);
+
+/**
+ * @brief Prints the instructions of a function, one per line, with their operands decoded.
+ *
+ * @param program The program the function is in.
+ * @param function The index of the function.
+ *
+ * @return PERF_RES_OK if the function was printed successfully.
+*/
+perf_result_t perf_program_disassemble(const perf_program_t *program, uint32_t function);
+
+/**
+ * @brief Frees the arrays of a program.
+ *
+ * @param program The program to free.
+ *
+ * @return PERF_RES_OK if the program was freed successfully.
+*/
+perf_result_t perf_program_free(perf_program_t *program);
+
+#endif // _PERFECTION_PROGRAM_H
@@ -7,7 +7,11 @@ typedef enum _perf_e_result_t
     PERF_RES_OK,
     PERF_RES_MEMORY_ALLOC_FAIL,
     PERF_RES_LEX_ERROR,
-    PERF_RES_PARSE_ERROR
+    PERF_RES_PARSE_ERROR,
+    PERF_RES_UNSUPPORTED,
+    PERF_RES_IO_ERROR,
+    PERF_RES_COMPILE_ERROR,
+    PERF_RES_RUNTIME_ERROR
 } perf_e_result_t;
 
 typedef int32_t perf_result_t;
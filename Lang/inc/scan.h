@@ -0,0 +1,83 @@
+#ifndef _PERFECTION_SCAN_H
+#define _PERFECTION_SCAN_H
+
+/**
+ * Represents the instruction sets the scanning kernels can use.
+*/
+typedef enum _perf_e_scan_isa_t
+{
+    PERF_SCAN_ISA_SCALAR,       // Byte at a time, works everywhere
+    PERF_SCAN_ISA_SSE2,         // 16 bytes at a time
+    PERF_SCAN_ISA_AVX2          // 32 bytes at a time
+} perf_e_scan_isa_t;
+
+/**
+ * NOTE: The vector kernels read whole aligned blocks, so they may read past the null terminator,
+ * but never past the aligned block that contains it, and therefore never into another page.
+ * Every kernel stops at the null terminator.
+*/
+
+/**
+ * @brief Selects the best kernels the CPU supports. Called by perf_lexer_init, safe to call again.
+ *
+ * @return PERF_RES_OK if the kernels were selected successfully.
+*/
+perf_result_t perf_scan_init(void);
+
+/**
+ * @brief Forces a specific instruction set, e.g. for benchmarking.
+ *
+ * @param isa The instruction set to use.
+ *
+ * @return PERF_RES_OK if the CPU supports the instruction set and it was selected.
+*/
+perf_result_t perf_scan_select(perf_e_scan_isa_t isa);
+
+/**
+ * @brief Gets the instruction set the kernels are currently using.
+ *
+ * @return The selected instruction set.
+*/
+perf_e_scan_isa_t perf_scan_selected(void);
+
+/**
+ * @brief Skips a run of whitespace (space, tab, carriage return, newline).
+ *
+ * @param ch The first character to check.
+ * @param newlines The number of newlines that were skipped.
+ * @param line_start Set to the character after the last skipped newline, untouched if there were none.
+ *
+ * @return The first character that isn't whitespace.
+*/
+const char* perf_scan_whitespace(const char* ch, uint32_t* newlines, const char** line_start);
+
+/**
+ * @brief Skips a run of identifier characters (letters and digits).
+ *
+ * @param ch The first character to check.
+ *
+ * @return The first character that isn't part of an identifier.
+*/
+const char* perf_scan_identifier(const char* ch);
+
+/**
+ * @brief Finds the end of a single line comment.
+ *
+ * @param ch The first character of the comment.
+ *
+ * @return The terminating newline or null terminator.
+*/
+const char* perf_scan_line_comment(const char* ch);
+
+/**
+ * @brief Finds the end of a multi-line comment.
+ *
+ * @param ch The star of the opening slash-star. It may also be the star of the closing star-slash.
+ * @param newlines The number of newlines inside the comment.
+ * @param line_start Set to the character after the last newline, untouched if there were none.
+ *
+ * @return The character after the closing star-slash, or the null terminator if the comment is unterminated.
+*/
+const char* perf_scan_block_comment(const char* ch, uint32_t* newlines, const char** line_start);
+
+#endif // _PERFECTION_SCAN_H
@@ -0,0 +1,69 @@
+#ifndef _PERFECTION_SOURCE_H
+#define _PERFECTION_SOURCE_H
+
+/**
+ * Determines where the contents of a source buffer live.
+*/
+typedef enum _perf_e_source_kind_t
+{
+    PERF_SOURCE_NONE,           // Nothing loaded
+    PERF_SOURCE_MAPPED,         // Read-only file mapping, the file must not be truncated while it is mapped
+    PERF_SOURCE_BUFFERED        // Heap buffer filled by chunked reads (stdin, pipes, platforms without mmap)
+} perf_e_source_kind_t;
+
+/**
+ * Represents the contents of a source file, ready to be handed to the lexer.
+ *
+ * data is always null terminated, so the lexer can run over a mapped file directly without copying it.
+*/
+typedef struct _perf_source_t
+{
+    const char*             data;           // Contents of the source, null terminated
+    size_t                  length;         // Length of the contents, excluding the terminator
+
+    perf_e_source_kind_t    kind;           // Where the contents live
+    void*                   mapping;        // Start of the mapping, or the heap buffer
+    size_t                  mapping_size;   // Size of the mapping, including any sentinel page
+} perf_source_t;
+
+/**
+ * @brief Initializes an empty source buffer.
+ *
+ * @param source The source to initialize.
+ *
+ * @return PERF_RES_OK if the source was initialized successfully.
+*/
+perf_result_t perf_source_init(perf_source_t *source);
+
+/**
+ * @brief Loads a source file, mapping it when possible and reading it in chunks otherwise.
+ *
+ * @param source The source to populate.
+ * @param path The path of the file, "-" reads from stdin.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the file was loaded successfully, PERF_RES_IO_ERROR if it couldn't be opened or read.
+*/
+perf_result_t perf_source_open(perf_source_t *source, const char* path, const char** error);
+
+/**
+ * @brief Reads a stream to its end in chunks, e.g. for pipes.
+ *
+ * @param source The source to populate.
+ * @param stream The stream to read, it is not closed.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the stream was read successfully.
+*/
+perf_result_t perf_source_read(perf_source_t *source, FILE* stream, const char** error);
+
+/**
+ * @brief Unmaps or frees the contents of a source buffer.
+ *
+ * @param source The source to free.
+ *
+ * @return PERF_RES_OK if the source was freed successfully.
+*/
+perf_result_t perf_source_free(perf_source_t *source);
+
+#endif // _PERFECTION_SOURCE_H
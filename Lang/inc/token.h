@@ -2,9 +2,9 @@
 #define _PERFECTION_TOKEN_H
 
 /**
- * NOTE: The token type enum, token map, and token struct are all linked.
- * The structure must be exactly the same across all of them, if you change one, you must change the others.
- * If not, the keyword parsing aspect of the lexer will break entirely.
+ * NOTE: The token type enum is the source of truth for token_map, keyword_map, symbol_map and the
+ * keyword lookup in token_gen.h. If you change the enum, regenerate token_gen.h with Scripts/tokenconv.py.
+ * Keyword tokens must stay contiguous and the symbol tokens must stay first.
 */
 
 /**
@@ -56,109 +56,15 @@ typedef enum _perf_e_token_type_t
     TOKEN_KEYWORD_CLASS,        // class
     TOKEN_KEYWORD_CONTINUE,     // continue
     TOKEN_KEYWORD_BREAK,        // break
+    TOKEN_KEYWORD_THIS,         // this
 
     // Useless tokens / EOF
     TOKEN_SKIP,                 // Skip
     TOKEN_EOF,                  // End of file
 } perf_e_token_type_t;
 
-/**
- * We can use the token type as an index to get the token name as a string.
- **/
-static const char* token_map[] = {
-    "TOKEN_LEFT_PARENTHESES",
-    "TOKEN_RIGHT_PARENTHESES",
-    "TOKEN_LEFT_BRACE",
-    "TOKEN_RIGHT_BRACE",
-    "TOKEN_COMMA",
-    "TOKEN_PERIOD",
-    "TOKEN_SEMICOLON",
-    "TOKEN_COLON",
-    "TOKEN_MINUS",
-    "TOKEN_PLUS",
-    "TOKEN_SLASH",
-    "TOKEN_ASTERISK",
-    "TOKEN_PERCENT",
-    "TOKEN_AMPERSAND",
-    "TOKEN_EXCLAIM",
-    "TOKEN_EXCLAIM_EQUAL",
-    "TOKEN_EQUAL",
-    "TOKEN_EQUAL_EQUAL",
-    "TOKEN_GREATER",
-    "TOKEN_GREATER_EQUAL",
-    "TOKEN_LESS",
-    "TOKEN_LESS_EQUAL",
-    "TOKEN_IDENTIFIER",
-    "TOKEN_STRING",
-    "TOKEN_NUMBER",
-    "TOKEN_INTEGER",
-    "TOKEN_KEYWORD_FUNC",
-    "TOKEN_KEYWORD_VAR",
-    "TOKEN_KEYWORD_LET",
-    "TOKEN_KEYWORD_CONST",
-    "TOKEN_KEYWORD_IF",
-    "TOKEN_KEYWORD_ELSE",
-    "TOKEN_KEYWORD_FOR",
-    "TOKEN_KEYWORD_WHILE",
-    "TOKEN_KEYWORD_TRUE",
-    "TOKEN_KEYWORD_FALSE",
-    "TOKEN_KEYWORD_RETURN",
-    "TOKEN_KEYWORD_DO",
-    "TOKEN_KEYWORD_CLASS",
-    "TOKEN_KEYWORD_CONTINUE",
-    "TOKEN_KEYWORD_BREAK",
-    "TOKEN_SKIP",
-    "TOKEN_EOF"
-};
-
-/**
- * We can use this to map an integer to an actual keyword in the language.
-*/
-static const char* keyword_map[] = {
-    "func",
-    "var",
-    "let",
-    "const",
-    "if",
-    "else",
-    "for",
-    "while",
-    "true",
-    "false",
-    "return",
-    "do",
-    "class",
-    "continue",
-    "break"
-};
-
-/**
- * We can use this to map an integer to a symbol in the language
-*/
-static const char* symbol_map[] = {
-    "(",
-    ")",
-    "{",
-    "}",
-    ",",
-    ".",
-    ";",
-    ":",
-    "-",
-    "+",
-    "/",
-    "*",
-    "%",
-    "&",
-    "!",
-    "!=",
-    "=",
-    "==",
-    ">",
-    ">=",
-    "<",
-    "<="
-};
+// Token name, keyword and symbol tables plus the keyword lookup, generated from the enum above.
+#include "token_gen.h"
 
 /**
  * Represents a token parsed from src code.
@@ -174,12 +80,35 @@ typedef struct _perf_token_t
      **/
     union _perf_token_repr_t
     {
-        char        *str;       // String
+        const char  *str;       // String, interned by the lexer
         uint64_t    integer;    // Integer
         double      number;     // Number
+
+        /**
+         * Text of an identifier or string in PERF_LEXER_MODE_ZERO_COPY, as a span of the source.
+         * String spans exclude the quotes and are not escape decoded.
+         **/
+        struct _perf_token_span_t
+        {
+            uint32_t offset;    // Offset of the text from the start of the source
+            uint32_t length;    // Length of the text
+        } span;
     } as;
 } perf_token_t;
 
+/*
+ * Decodes the escape sequences of a raw string literal.
+ *
+ * @param raw The raw text of the string, without the quotes.
+ * @param length The length of the raw text.
+ * @param out The buffer to decode into. Must hold at least length + 1 bytes.
+ * @param out_length The length of the decoded string.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if successful, otherwise an error code.
+ */
+perf_result_t perf_token_decode_string(const char *raw, size_t length, char *out, size_t *out_length, const char** error);
+
 /*
  * Frees the memory allocated for the token.
  * 
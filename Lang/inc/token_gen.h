@@ -0,0 +1,260 @@
+/**
+ * GENERATED FILE - DO NOT EDIT.
+ * Regenerate with Scripts/tokenconv.py after changing perf_e_token_type_t in token.h.
+*/
+#ifndef _PERFECTION_TOKEN_GEN_H
+#define _PERFECTION_TOKEN_GEN_H
+
+// Number of entries in perf_e_token_type_t.
+#define PERF_TOKEN_COUNT 44
+
+// Number of keywords, and the first keyword token.
+#define PERF_KEYWORD_COUNT 16
+#define PERF_KEYWORD_FIRST TOKEN_KEYWORD_FUNC
+
+// Determines if the given token type is a keyword.
+#define PERF_TOKEN_IS_KEYWORD(type) ((type) >= TOKEN_KEYWORD_FUNC && (type) <= TOKEN_KEYWORD_THIS)
+
+// Number of symbol tokens, which are always the first tokens in the enum.
+#define PERF_SYMBOL_COUNT 22
+
+/**
+ * We can use the token type as an index to get the token name as a string.
+ **/
+static const char* token_map[] = {
+    "TOKEN_LEFT_PARENTHESES",
+    "TOKEN_RIGHT_PARENTHESES",
+    "TOKEN_LEFT_BRACE",
+    "TOKEN_RIGHT_BRACE",
+    "TOKEN_COMMA",
+    "TOKEN_PERIOD",
+    "TOKEN_SEMICOLON",
+    "TOKEN_COLON",
+    "TOKEN_MINUS",
+    "TOKEN_PLUS",
+    "TOKEN_SLASH",
+    "TOKEN_ASTERISK",
+    "TOKEN_PERCENT",
+    "TOKEN_AMPERSAND",
+    "TOKEN_EXCLAIM",
+    "TOKEN_EXCLAIM_EQUAL",
+    "TOKEN_EQUAL",
+    "TOKEN_EQUAL_EQUAL",
+    "TOKEN_GREATER",
+    "TOKEN_GREATER_EQUAL",
+    "TOKEN_LESS",
+    "TOKEN_LESS_EQUAL",
+    "TOKEN_IDENTIFIER",
+    "TOKEN_STRING",
+    "TOKEN_NUMBER",
+    "TOKEN_INTEGER",
+    "TOKEN_KEYWORD_FUNC",
+    "TOKEN_KEYWORD_VAR",
+    "TOKEN_KEYWORD_LET",
+    "TOKEN_KEYWORD_CONST",
+    "TOKEN_KEYWORD_IF",
+    "TOKEN_KEYWORD_ELSE",
+    "TOKEN_KEYWORD_FOR",
+    "TOKEN_KEYWORD_WHILE",
+    "TOKEN_KEYWORD_TRUE",
+    "TOKEN_KEYWORD_FALSE",
+    "TOKEN_KEYWORD_RETURN",
+    "TOKEN_KEYWORD_DO",
+    "TOKEN_KEYWORD_CLASS",
+    "TOKEN_KEYWORD_CONTINUE",
+    "TOKEN_KEYWORD_BREAK",
+    "TOKEN_KEYWORD_THIS",
+    "TOKEN_SKIP",
+    "TOKEN_EOF",
+};
+
+/**
+ * We can use this to map (type - PERF_KEYWORD_FIRST) to an actual keyword in the language.
+*/
+static const char* keyword_map[] = {
+    "func",
+    "var",
+    "let",
+    "const",
+    "if",
+    "else",
+    "for",
+    "while",
+    "true",
+    "false",
+    "return",
+    "do",
+    "class",
+    "continue",
+    "break",
+    "this",
+};
+
+/**
+ * We can use this to map an integer to a symbol in the language
+*/
+static const char* symbol_map[] = {
+    "(",
+    ")",
+    "{",
+    "}",
+    ",",
+    ".",
+    ";",
+    ":",
+    "-",
+    "+",
+    "/",
+    "*",
+    "%",
+    "&",
+    "!",
+    "!=",
+    "=",
+    "==",
+    ">",
+    ">=",
+    "<",
+    "<=",
+};
+
+/**
+ * Maps the first byte of a symbol to its one character token type + 1, or 0 if no symbol starts with it.
+*/
+static const uint8_t symbol_dispatch[256] = {
+    ['!'] = TOKEN_EXCLAIM + 1,
+    ['%'] = TOKEN_PERCENT + 1,
+    ['&'] = TOKEN_AMPERSAND + 1,
+    ['('] = TOKEN_LEFT_PARENTHESES + 1,
+    [')'] = TOKEN_RIGHT_PARENTHESES + 1,
+    ['*'] = TOKEN_ASTERISK + 1,
+    ['+'] = TOKEN_PLUS + 1,
+    [','] = TOKEN_COMMA + 1,
+    ['-'] = TOKEN_MINUS + 1,
+    ['.'] = TOKEN_PERIOD + 1,
+    ['/'] = TOKEN_SLASH + 1,
+    [':'] = TOKEN_COLON + 1,
+    [';'] = TOKEN_SEMICOLON + 1,
+    ['<'] = TOKEN_LESS + 1,
+    ['='] = TOKEN_EQUAL + 1,
+    ['>'] = TOKEN_GREATER + 1,
+    ['{'] = TOKEN_LEFT_BRACE + 1,
+    ['}'] = TOKEN_RIGHT_BRACE + 1,
+};
+
+/**
+ * Maps the first byte of a symbol to the second byte of its two character form, or 0 if it has none.
+*/
+static const char symbol_pair_second[256] = {
+    ['!'] = '=',
+    ['<'] = '=',
+    ['='] = '=',
+    ['>'] = '=',
+};
+
+/**
+ * Maps the first byte of a symbol to the token type of its two character form.
+*/
+static const uint8_t symbol_pair_type[256] = {
+    ['!'] = TOKEN_EXCLAIM_EQUAL,
+    ['<'] = TOKEN_LESS_EQUAL,
+    ['='] = TOKEN_EQUAL_EQUAL,
+    ['>'] = TOKEN_GREATER_EQUAL,
+};
+
+/**
+ * @brief Classifies an identifier span as a keyword without allocating.
+ *
+ * Switches on the length and first character, then compares the remaining bytes
+ * of the (at most two) keywords that share them.
+ *
+ * @param str The start of the identifier (does not need to be null terminated).
+ * @param length The length of the identifier.
+ *
+ * @return The keyword token type, or TOKEN_IDENTIFIER if it is not a keyword.
+*/
+static inline perf_e_token_type_t perf_token_keyword_lookup(const char* str, size_t length)
+{
+    switch (length)
+    {
+    case 2:
+        switch (str[0])
+        {
+        case 'd':
+            if (memcmp(str + 1, "o", 1) == 0) return TOKEN_KEYWORD_DO;
+            break;
+        case 'i':
+            if (memcmp(str + 1, "f", 1) == 0) return TOKEN_KEYWORD_IF;
+            break;
+        }
+        break;
+    case 3:
+        switch (str[0])
+        {
+        case 'f':
+            if (memcmp(str + 1, "or", 2) == 0) return TOKEN_KEYWORD_FOR;
+            break;
+        case 'l':
+            if (memcmp(str + 1, "et", 2) == 0) return TOKEN_KEYWORD_LET;
+            break;
+        case 'v':
+            if (memcmp(str + 1, "ar", 2) == 0) return TOKEN_KEYWORD_VAR;
+            break;
+        }
+        break;
+    case 4:
+        switch (str[0])
+        {
+        case 'e':
+            if (memcmp(str + 1, "lse", 3) == 0) return TOKEN_KEYWORD_ELSE;
+            break;
+        case 'f':
+            if (memcmp(str + 1, "unc", 3) == 0) return TOKEN_KEYWORD_FUNC;
+            break;
+        case 't':
+            if (memcmp(str + 1, "rue", 3) == 0) return TOKEN_KEYWORD_TRUE;
+            if (memcmp(str + 1, "his", 3) == 0) return TOKEN_KEYWORD_THIS;
+            break;
+        }
+        break;
+    case 5:
+        switch (str[0])
+        {
+        case 'b':
+            if (memcmp(str + 1, "reak", 4) == 0) return TOKEN_KEYWORD_BREAK;
+            break;
+        case 'c':
+            if (memcmp(str + 1, "onst", 4) == 0) return TOKEN_KEYWORD_CONST;
+            if (memcmp(str + 1, "lass", 4) == 0) return TOKEN_KEYWORD_CLASS;
+            break;
+        case 'f':
+            if (memcmp(str + 1, "alse", 4) == 0) return TOKEN_KEYWORD_FALSE;
+            break;
+        case 'w':
+            if (memcmp(str + 1, "hile", 4) == 0) return TOKEN_KEYWORD_WHILE;
+            break;
+        }
+        break;
+    case 6:
+        switch (str[0])
+        {
+        case 'r':
+            if (memcmp(str + 1, "eturn", 5) == 0) return TOKEN_KEYWORD_RETURN;
+            break;
+        }
+        break;
+    case 8:
+        switch (str[0])
+        {
+        case 'c':
+            if (memcmp(str + 1, "ontinue", 7) == 0) return TOKEN_KEYWORD_CONTINUE;
+            break;
+        }
+        break;
+    }
+
+    // Not a keyword.
+    return TOKEN_IDENTIFIER;
+}
+
+#endif // _PERFECTION_TOKEN_GEN_H
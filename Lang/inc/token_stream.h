@@ -0,0 +1,101 @@
+#ifndef _PERFECTION_TOKEN_STREAM_H
+#define _PERFECTION_TOKEN_STREAM_H
+
+/**
+ * Represents the payload of a literal token in a token stream.
+ * Identifiers, strings, numbers and integers are the only tokens with payloads.
+*/
+typedef struct _perf_token_literal_t
+{
+    uint32_t                    token_index;    // Index of the token the payload belongs to
+    union _perf_token_repr_t    as;             // The payload
+} perf_token_literal_t;
+
+/**
+ * Represents a token stream stored as a structure of arrays.
+ *
+ * The parser mostly only needs the token type, so the types are kept in their own dense byte array.
+ * Source offsets live in a parallel array, payloads in a side table ordered by token index, and
+ * line / column numbers are only computed when a token is materialized, e.g. for a diagnostic.
+ * Tokens are usually materialized in order, so a cursor counts newlines forward from the last one,
+ * and a line start index is only built for lookups behind it.
+*/
+typedef struct _perf_token_stream_t
+{
+    const char*             src;                // Source the offsets refer to, must outlive the stream
+
+    uint8_t*                types;              // Type of each token
+    uint32_t*               offsets;            // Source offset of the start of each token
+    uint32_t                count;              // Number of tokens
+    uint32_t                capacity;           // Number of tokens we can hold
+
+    perf_token_literal_t*   literals;           // Payloads, ordered by token index
+    uint32_t                literal_count;      // Number of payloads
+    uint32_t                literal_capacity;   // Number of payloads we can hold
+    uint32_t                literal_cursor;     // First payload not behind the last token materialized
+
+    uint32_t                cursor_offset;      // Offset the location cursor has counted newlines up to
+    uint32_t                cursor_line;        // Line the location cursor is on
+    uint32_t                cursor_line_start;  // Offset of the start of that line
+
+    uint32_t*               line_starts;        // Offset of the start of each line, built on demand
+    uint32_t                line_count;         // Number of lines
+    uint32_t                line_capacity;      // Number of lines we can hold
+} perf_token_stream_t;
+
+/**
+ * @brief Initializes a token stream.
+ *
+ * @param stream The stream to initialize.
+ *
+ * @return PERF_RES_OK if the stream was initialized successfully.
+*/
+perf_result_t perf_token_stream_init(perf_token_stream_t *stream);
+
+/**
+ * @brief Lexes the given source into a token stream, ending in TOKEN_EOF.
+ *
+ * @param stream The stream to populate, emptied first.
+ * @param lexer The lexer to use. Its mode decides how identifier and string payloads are stored.
+ * @param src The source code to lex. Must outlive the stream.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the source was lexed successfully.
+*/
+perf_result_t perf_token_stream_digest(perf_token_stream_t *stream, perf_lexer_t *lexer, const char* src, const char** error);
+
+/**
+ * @brief Computes the line and column of a token, counted from 0 like the lexer's.
+ *
+ * @param stream The stream to use.
+ * @param index The index of the token.
+ * @param line_number The line number of the token.
+ * @param column_number The column number of the token.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the location was computed successfully.
+*/
+perf_result_t perf_token_stream_location(perf_token_stream_t *stream, uint32_t index, uint32_t *line_number, uint32_t *column_number, const char** error);
+
+/**
+ * @brief Materializes a single token in the array of structures layout, e.g. for the AST or a diagnostic.
+ *
+ * @param stream The stream to use.
+ * @param index The index of the token.
+ * @param token The token to populate.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the token was materialized successfully.
+*/
+perf_result_t perf_token_stream_get(perf_token_stream_t *stream, uint32_t index, perf_token_t *token, const char** error);
+
+/**
+ * @brief Frees a token stream.
+ *
+ * @param stream The stream to free.
+ *
+ * @return PERF_RES_OK if the stream was freed successfully.
+*/
+perf_result_t perf_token_stream_free(perf_token_stream_t *stream);
+
+#endif // _PERFECTION_TOKEN_STREAM_H
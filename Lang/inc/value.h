@@ -0,0 +1,319 @@
+#ifndef _PERFECTION_VALUE_H
+#define _PERFECTION_VALUE_H
+
+/**
+ * NOTE: Values are NaN-boxed, every value is 64 bits. Doubles are stored as themselves, everything else hides
+ * in the NaN space above the ones hardware produces: the top 16 bits are a tag from 0xFFF9 to 0xFFFF and the low
+ * 48 bits the payload. Any bit pattern below 0xFFF9 << 48 is a double, including the NaNs arithmetic creates.
+ *
+ * Integers are 48-bit signed, anything outside that range becomes a number, whether it is a literal or the
+ * result of arithmetic. Strings are pointers, which fit in 48 bits on the 64-bit platforms we target. Interned
+ * strings are at least 4-byte aligned, so the lowest bit of a string's payload is free to mark the strings that
+ * live in the garbage collected heap (see heap.h). Objects, class instances so far, always live in the heap.
+ *
+ * Globals that haven't been assigned yet hold nil with a payload of 1, which no program can produce.
+*/
+
+// Tag of the first boxed type, bits below PERF_VALUE_BOXED are doubles.
+#define PERF_VALUE_TAG_BASE     0xFFF8
+#define PERF_VALUE_BOXED        ((uint64_t)(PERF_VALUE_TAG_BASE + 1) << 48)
+
+// Bits of the payload of a boxed value.
+#define PERF_VALUE_PAYLOAD      0x0000FFFFFFFFFFFFull
+
+// Bit of a string's payload set when the string lives in the heap.
+#define PERF_VALUE_HEAP         1ull
+
+// Range of integers, anything outside it is a number.
+#define PERF_VALUE_INTEGER_MAX  ((int64_t)0x00007FFFFFFFFFFFll)
+#define PERF_VALUE_INTEGER_MIN  (-PERF_VALUE_INTEGER_MAX - 1)
+
+/**
+ * Used to determine which type of value is being used. Boxed types are tagged PERF_VALUE_TAG_BASE plus their type.
+*/
+typedef enum _perf_e_value_type_t
+{
+    PERF_VALUE_NUMBER,          // Double, stored as itself
+    PERF_VALUE_INTEGER,         // 48-bit signed integer
+    PERF_VALUE_STRING,          // Interned string
+    PERF_VALUE_FUNCTION,        // Function of a program, by index
+    PERF_VALUE_NATIVE,          // Function of the VM, by index
+    PERF_VALUE_NIL,             // nil, the value of anything not set
+    PERF_VALUE_BOOL,            // true or false
+    PERF_VALUE_OBJECT           // Object in the heap, by pointer
+} perf_e_value_type_t;
+
+/**
+ * Represents a value of the language, as held by the constant pool, variables and the operand stack.
+*/
+typedef struct _perf_value_t
+{
+    uint64_t bits;              // A double, or a tag and a payload
+} perf_value_t;
+
+/**
+ * @brief Gets the type of a value.
+ *
+ * @param value The value.
+ *
+ * @return The type.
+*/
+static inline perf_e_value_type_t perf_value_type(perf_value_t value)
+{
+    return value.bits < PERF_VALUE_BOXED ? PERF_VALUE_NUMBER : (perf_e_value_type_t)((value.bits >> 48) - PERF_VALUE_TAG_BASE);
+}
+
+/**
+ * @brief Checks if a value is of a boxed type, anything but PERF_VALUE_NUMBER.
+ *
+ * @param value The value.
+ * @param type The type.
+ *
+ * @return true if the value is of that type.
+*/
+static inline bool perf_value_is(perf_value_t value, perf_e_value_type_t type)
+{
+    return (value.bits >> 48) == PERF_VALUE_TAG_BASE + (uint64_t)type;
+}
+
+/**
+ * @brief Checks if a value is a number.
+ *
+ * @param value The value.
+ *
+ * @return true if the value is a double.
+*/
+static inline bool perf_value_is_number(perf_value_t value)
+{
+    return value.bits < PERF_VALUE_BOXED;
+}
+
+/**
+ * @brief Boxes a payload.
+ *
+ * @param type The type, anything but PERF_VALUE_NUMBER.
+ * @param payload The payload, only its low 48 bits are kept.
+ *
+ * @return The value.
+*/
+static inline perf_value_t perf_value_box(perf_e_value_type_t type, uint64_t payload)
+{
+    perf_value_t value = { (uint64_t)(PERF_VALUE_TAG_BASE + type) << 48 | (payload & PERF_VALUE_PAYLOAD) };
+    return value;
+}
+
+/**
+ * @brief Makes a number.
+ *
+ * @param number The double, NaNs must come from arithmetic or be the default one so they aren't taken for a box.
+ *
+ * @return The value.
+*/
+static inline perf_value_t perf_value_number(double number)
+{
+    perf_value_t value;
+    memcpy(&value.bits, &number, sizeof(double));
+    return value;
+}
+
+/**
+ * @brief Checks if an integer fits in a value.
+ *
+ * @param integer The integer.
+ *
+ * @return true if it is within PERF_VALUE_INTEGER_MIN and PERF_VALUE_INTEGER_MAX.
+*/
+static inline bool perf_value_integer_fits(int64_t integer)
+{
+    // It fits when sign extending its low 48 bits gives it back.
+    return (int64_t)((uint64_t)integer << 16) >> 16 == integer;
+}
+
+/**
+ * @brief Makes an integer, or a number if it doesn't fit.
+ *
+ * @param integer The integer.
+ *
+ * @return The value.
+*/
+static inline perf_value_t perf_value_integer(int64_t integer)
+{
+    return perf_value_integer_fits(integer) ? perf_value_box(PERF_VALUE_INTEGER, (uint64_t)integer) : perf_value_number((double)integer);
+}
+
+/**
+ * @brief Makes nil.
+ *
+ * @return The value.
+*/
+static inline perf_value_t perf_value_nil(void)
+{
+    return perf_value_box(PERF_VALUE_NIL, 0);
+}
+
+/**
+ * @brief Makes the value of a global that hasn't been assigned yet, never seen by programs.
+ *
+ * @return The value.
+*/
+static inline perf_value_t perf_value_undefined(void)
+{
+    return perf_value_box(PERF_VALUE_NIL, 1);
+}
+
+/**
+ * @brief Makes a boolean.
+ *
+ * @param boolean The boolean.
+ *
+ * @return The value.
+*/
+static inline perf_value_t perf_value_bool(bool boolean)
+{
+    return perf_value_box(PERF_VALUE_BOOL, boolean);
+}
+
+/**
+ * @brief Makes a string.
+ *
+ * @param str The interned string.
+ *
+ * @return The value.
+*/
+static inline perf_value_t perf_value_string(const char* str)
+{
+    return perf_value_box(PERF_VALUE_STRING, (uint64_t)(uintptr_t)str);
+}
+
+/**
+ * @brief Makes a string that lives in the heap.
+ *
+ * @param str The string, allocated by perf_heap_string.
+ *
+ * @return The value.
+*/
+static inline perf_value_t perf_value_heap_string(const char* str)
+{
+    return perf_value_box(PERF_VALUE_STRING, (uint64_t)(uintptr_t)str | PERF_VALUE_HEAP);
+}
+
+/**
+ * @brief Makes an object.
+ *
+ * @param object The object, allocated by the heap.
+ *
+ * @return The value.
+*/
+static inline perf_value_t perf_value_object(const void* object)
+{
+    return perf_value_box(PERF_VALUE_OBJECT, (uint64_t)(uintptr_t)object);
+}
+
+/**
+ * @brief Checks if a value refers to something in the heap.
+ *
+ * @param value The value.
+ *
+ * @return true if the value is an object, or a string that lives in the heap.
+*/
+static inline bool perf_value_is_heap(perf_value_t value)
+{
+    return perf_value_is(value, PERF_VALUE_OBJECT) || (perf_value_is(value, PERF_VALUE_STRING) && (value.bits & PERF_VALUE_HEAP) != 0);
+}
+
+/**
+ * @brief Gets the double of a number.
+ *
+ * @param value A number.
+ *
+ * @return The double.
+*/
+static inline double perf_value_as_number(perf_value_t value)
+{
+    double number;
+    memcpy(&number, &value.bits, sizeof(double));
+    return number;
+}
+
+/**
+ * @brief Gets the integer of an integer, sign extending the payload.
+ *
+ * @param value An integer.
+ *
+ * @return The integer.
+*/
+static inline int64_t perf_value_as_integer(perf_value_t value)
+{
+    return (int64_t)(value.bits << 16) >> 16;
+}
+
+/**
+ * @brief Gets the payload of a boolean, function or native, their index or 0 or 1.
+ *
+ * @param value A boolean, function or native.
+ *
+ * @return The payload.
+*/
+static inline uint32_t perf_value_as_index(perf_value_t value)
+{
+    return (uint32_t)value.bits;
+}
+
+/**
+ * @brief Gets the string of a string.
+ *
+ * @param value A string.
+ *
+ * @return The string, interned or in the heap.
+*/
+static inline const char* perf_value_as_string(perf_value_t value)
+{
+    return (const char*)(uintptr_t)(value.bits & (PERF_VALUE_PAYLOAD & ~PERF_VALUE_HEAP));
+}
+
+/**
+ * @brief Gets the object of an object.
+ *
+ * @param value An object.
+ *
+ * @return The object.
+*/
+static inline void* perf_value_as_object(perf_value_t value)
+{
+    return (void*)(uintptr_t)(value.bits & PERF_VALUE_PAYLOAD);
+}
+
+/**
+ * @brief Checks if two values are the same constant, comparing the payload bit for bit.
+ *
+ * Unlike the language's ==, 1 and 1.0 differ, and so do 0.0 and -0.0.
+ *
+ * @param a The first value.
+ * @param b The second value.
+ *
+ * @return true if the values are identical.
+*/
+bool perf_value_identical(perf_value_t a, perf_value_t b);
+
+/**
+ * @brief Checks if two values are equal, the way the language's == does.
+ *
+ * Integers and numbers compare by value, strings by content, everything else by identity.
+ *
+ * @param a The first value.
+ * @param b The second value.
+ *
+ * @return true if the values are equal.
+*/
+bool perf_value_equal(perf_value_t a, perf_value_t b);
+
+/**
+ * @brief Prints a value the way it appears in bytecode dumps.
+ *
+ * @param value The value to print.
+ *
+ * @return PERF_RES_OK if the value was printed successfully.
+*/
+perf_result_t perf_value_print(perf_value_t value);
+
+#endif // _PERFECTION_VALUE_H
@@ -0,0 +1,203 @@
+#ifndef _PERFECTION_VM_H
+#define _PERFECTION_VM_H
+
+/**
+ * NOTE: The interpreter loop lives in vm_loop.h, and the one for register code in vm_register_loop.h. vm.c
+ * compiles each of them three times: dispatching through a switch, through a switch counting every instruction,
+ * and threaded, jumping straight from one handler to the next through a table of label addresses (computed
+ * goto). Threaded dispatch gives every handler its own indirect branch, which the branch predictor learns per
+ * opcode, instead of one shared branch at the top of the switch. Computed goto is a GCC and Clang extension,
+ * other compilers only get the switches.
+ *
+ * Semantics: integers are 48-bit (see value.h) and any result outside that range is a number, / and % on two
+ * integers truncate and fail on a zero divisor, anything mixing an integer and a number is done on numbers.
+ * + also joins two strings. nil, false, 0 and 0.0 are falsy, everything else is truthy.
+ *
+ * Strings built while running live in the VM's heap (see heap.h). Its roots are the globals and the live part
+ * of the stack: up to stack_top for stack code, which keeps its stack pointer in a local and so stores it before
+ * anything that may allocate, and up to the end of the highest frame's registers for register code, whose
+ * registers are all set when a call starts.
+ *
+ * Every member site of the program (see program.h) has an inline cache, remembering the shapes of the instances
+ * it saw and where the member was for each (see object.h). The loops check the first way themselves, a shape
+ * compare and a load; anything else goes to vm.c, which checks the other ways and otherwise looks the member up
+ * and caches it. A site that misses with all PERF_VM_CACHE_WAYS ways in use is megamorphic, it keeps its ways
+ * but stops adding to them. Shapes outlive runs, so instances a run leaves behind stay valid.
+ *
+ * PERF_VM_DISPATCH_JIT runs register code in a fourth, threaded, copy of its loop that counts calls and back
+ * edges and hands hot functions to the JIT (see jit.h). Stack code with it runs threaded. The other copies
+ * don't have the counters at all.
+*/
+
+// Values on the stack, shared by every frame. Each frame holds its callee, its slots and its operand stack.
+#define PERF_VM_STACK_SIZE      (256 * 1024)
+
+// Deepest calls can nest.
+#define PERF_VM_MAX_FRAMES      4096
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PERF_VM_THREADED        1
+#else
+#define PERF_VM_THREADED        0
+#endif
+
+// Shapes an inline cache remembers before its site is megamorphic.
+#define PERF_VM_CACHE_WAYS      4
+
+/**
+ * Used to determine how the VM dispatches instructions.
+*/
+typedef enum _perf_e_vm_dispatch_t
+{
+    PERF_VM_DISPATCH_THREADED,  // Every handler jumps to the next one through a table of labels, the default
+    PERF_VM_DISPATCH_SWITCH,    // Every handler goes back to one switch
+    PERF_VM_DISPATCH_COUNTED,   // Like PERF_VM_DISPATCH_SWITCH, counting every instruction in instruction_count
+    PERF_VM_DISPATCH_JIT        // Like PERF_VM_DISPATCH_THREADED, compiling hot functions of register code to machine code
+} perf_e_vm_dispatch_t;
+
+/**
+ * Used to determine what a way of an inline cache found.
+*/
+typedef enum _perf_e_vm_cache_kind_t
+{
+    PERF_VM_CACHE_FIELD,        // The instance has the field, index is its slot
+    PERF_VM_CACHE_ADD,          // Setting adds the field in slot index, the instance then has shape target
+    PERF_VM_CACHE_METHOD        // The instance has no such field but its class has the method, index is its function
+} perf_e_vm_cache_kind_t;
+
+/**
+ * Represents a shape an inline cache saw, and where the member is for it.
+*/
+typedef struct _perf_vm_cache_way_t
+{
+    const struct _perf_shape_t* shape;      // Shape of the instances, NULL if the way is not in use
+    struct _perf_shape_t*       target;     // Shape once the field is added, only for PERF_VM_CACHE_ADD
+    uint32_t                    index;      // Slot of the field, or index of the method's function
+    uint32_t                    kind;       // What was found, a perf_e_vm_cache_kind_t
+} perf_vm_cache_way_t;
+
+/**
+ * Represents the inline cache of a member site.
+*/
+typedef struct _perf_vm_cache_t
+{
+    perf_vm_cache_way_t ways[PERF_VM_CACHE_WAYS];   // The shapes seen, the loops check the first one themselves
+    uint32_t            count;                      // Number of ways in use
+    bool                megamorphic;                // True once the site missed with every way in use
+} perf_vm_cache_t;
+
+/**
+ * Represents how the inline caches of the last run did.
+*/
+typedef struct _perf_vm_cache_stats_t
+{
+    uint32_t    site_count;         // Number of member sites
+    uint32_t    monomorphic_count;  // Sites that saw one shape
+    uint32_t    polymorphic_count;  // Sites that saw a few shapes, all of them cached
+    uint32_t    megamorphic_count;  // Sites that saw more shapes than they could cache
+} perf_vm_cache_stats_t;
+
+/**
+ * Represents a function call in progress.
+*/
+typedef struct _perf_vm_frame_t
+{
+    uint32_t            function;   // Index of the function running
+    const uint8_t*      ip;         // Next instruction, only up to date while a callee runs
+    perf_value_t*       slots;      // First local slot, the arguments come first and the callee sits right below
+} perf_vm_frame_t;
+
+/**
+ * Represents our virtual machine, which runs the bytecode of a program.
+*/
+typedef struct _perf_vm_t
+{
+    const perf_program_t*   program;            // Program running
+    perf_e_vm_dispatch_t    dispatch;           // How instructions are dispatched
+
+    perf_value_t*           stack;              // PERF_VM_STACK_SIZE values
+    perf_value_t*           globals;            // One value per global of the program
+    perf_vm_frame_t*        frames;             // PERF_VM_MAX_FRAMES frames
+    uint32_t                frame_count;        // Number of calls in progress
+    uint64_t                instruction_count;  // Instructions dispatched by the last run, only counted by PERF_VM_DISPATCH_COUNTED
+
+    perf_heap_t             heap;               // Strings built while running, collected once nothing refers to them
+    perf_value_t*           stack_top;          // Top of the operand stack, only up to date while stack code allocates
+
+    struct _perf_shape_t*   shapes;             // Every shape made so far, freed with the VM
+    struct _perf_shape_t**  class_shapes;       // Root shape of each class of the program running
+    perf_vm_cache_t*        caches;             // Inline cache of each member site of the program running
+
+    perf_jit_t              jit;                // Machine code of the hot functions, only used by PERF_VM_DISPATCH_JIT
+
+    uint32_t                error_line;         // Line the last runtime error happened on, 1-based
+    char                    error_buffer[128];  // Storage for error messages that include names
+} perf_vm_t;
+
+/**
+ * Represents a function of the VM that programs can call, e.g. print.
+ *
+ * @param vm The VM calling it.
+ * @param args The arguments.
+ * @param count The number of arguments.
+ * @param result The value to return.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the call succeeded, PERF_RES_RUNTIME_ERROR to stop the program.
+*/
+typedef perf_result_t (*perf_vm_native_t)(perf_vm_t *vm, const perf_value_t *args, uint32_t count, perf_value_t *result, const char** error);
+
+/**
+ * @brief Initializes a VM, allocating its stack.
+ *
+ * @param vm The VM to initialize.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the VM was initialized successfully.
+*/
+perf_result_t perf_vm_init(perf_vm_t *vm, const char** error);
+
+/**
+ * @brief Runs a program's script from the start, with fresh globals, in the loop for the program's format.
+ *
+ * Globals named after a native (print, clock) start out as that native, the rest start out undefined and
+ * reading one before it is assigned is an error.
+ *
+ * @param vm The VM to use.
+ * @param program The program to run, it must outlive the VM's use of its results.
+ * @param result The value the script returned, may be NULL.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the script ran to the end, PERF_RES_RUNTIME_ERROR if it failed, see error_line.
+*/
+perf_result_t perf_vm_run(perf_vm_t *vm, const perf_program_t *program, perf_value_t *result, const char** error);
+
+/**
+ * @brief Prints a value the way print does, strings without quotes.
+ *
+ * @param value The value to print.
+ *
+ * @return PERF_RES_OK if the value was printed successfully.
+*/
+perf_result_t perf_vm_print_value(perf_value_t value);
+
+/**
+ * @brief Gets how the inline caches of the last run did.
+ *
+ * @param vm The VM to use.
+ * @param stats The statistics to populate.
+ *
+ * @return PERF_RES_OK if the statistics were gathered successfully.
+*/
+perf_result_t perf_vm_get_cache_stats(perf_vm_t *vm, perf_vm_cache_stats_t *stats);
+
+/**
+ * @brief Frees the VM, every string and instance it built, and every shape it made.
+ *
+ * @param vm The VM to free.
+ *
+ * @return PERF_RES_OK if the VM was freed successfully.
+*/
+perf_result_t perf_vm_free(perf_vm_t *vm);
+
+#endif // _PERFECTION_VM_H
@@ -0,0 +1,614 @@
+/**
+ * NOTE: This is the body of the interpreter loop, it has no include guard on purpose. vm.c includes it once per
+ * way of dispatching, defining PERF_VM_EXECUTE as the name of the function to generate, PERF_VM_LOOP_THREADED
+ * as 1 for computed goto or 0 for a switch, and PERF_VM_LOOP_COUNTED as 1 to count every instruction dispatched.
+ *
+ * The hot state (ip, sp, the frame's slots, the constants) lives in locals so it stays in registers, and is
+ * only written back to the frame around calls and errors. Operands are decoded in place from ip.
+*/
+
+/**
+ * @brief Runs the VM's frames until the script returns.
+ *
+ * @param vm The VM to use, with the script's frame set up.
+ * @param result The value the script returned.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the script returned, PERF_RES_RUNTIME_ERROR if it failed.
+*/
+static perf_result_t PERF_VM_EXECUTE(perf_vm_t *vm, perf_value_t *result, const char** error)
+{
+    // The program, which doesn't change while running.
+    const perf_program_t*   program     = vm->program;
+    const uint8_t*          code        = program->code;
+    const perf_value_t*     constants   = program->constants;
+    perf_value_t*           globals     = vm->globals;
+    perf_vm_cache_t*        caches      = vm->caches;
+    const perf_value_t*     stack_end   = vm->stack + PERF_VM_STACK_SIZE;
+
+    // The frame running.
+    perf_vm_frame_t*        frame       = &vm->frames[vm->frame_count - 1];
+    const uint8_t*          ip          = frame->ip;
+    perf_value_t*           slots       = frame->slots;
+    perf_value_t*           sp          = slots + program->functions[frame->function].slot_count;
+
+    // The message of a runtime error, set before jumping to perf_vm_error.
+    const char*             message     = NULL;
+
+    // The call being made, shared by OP_CALL and OP_INVOKE, which jumps into it.
+    uint32_t                call_count  = 0;
+    perf_value_t*           callee      = NULL;
+    uint32_t                callee_index= 0;
+
+#if PERF_VM_LOOP_THREADED
+    // Handlers by opcode.
+    static const void* const perf_vm_labels[OP_COUNT] =
+    {
+        [OP_CONSTANT]                   = &&PERF_VM_OP_CONSTANT,
+        [OP_CONSTANT_WIDE]              = &&PERF_VM_OP_CONSTANT_WIDE,
+        [OP_NIL]                        = &&PERF_VM_OP_NIL,
+        [OP_TRUE]                       = &&PERF_VM_OP_TRUE,
+        [OP_FALSE]                      = &&PERF_VM_OP_FALSE,
+        [OP_POP]                        = &&PERF_VM_OP_POP,
+        [OP_GET_LOCAL]                  = &&PERF_VM_OP_GET_LOCAL,
+        [OP_SET_LOCAL]                  = &&PERF_VM_OP_SET_LOCAL,
+        [OP_GET_GLOBAL]                 = &&PERF_VM_OP_GET_GLOBAL,
+        [OP_SET_GLOBAL]                 = &&PERF_VM_OP_SET_GLOBAL,
+        [OP_GET_MEMBER]                 = &&PERF_VM_OP_GET_MEMBER,
+        [OP_SET_MEMBER]                 = &&PERF_VM_OP_SET_MEMBER,
+        [OP_NEGATE]                     = &&PERF_VM_OP_NEGATE,
+        [OP_NOT]                        = &&PERF_VM_OP_NOT,
+        [OP_ADD]                        = &&PERF_VM_OP_ADD,
+        [OP_SUBTRACT]                   = &&PERF_VM_OP_SUBTRACT,
+        [OP_MULTIPLY]                   = &&PERF_VM_OP_MULTIPLY,
+        [OP_DIVIDE]                     = &&PERF_VM_OP_DIVIDE,
+        [OP_MODULO]                     = &&PERF_VM_OP_MODULO,
+        [OP_BIT_AND]                    = &&PERF_VM_OP_BIT_AND,
+        [OP_EQUAL]                      = &&PERF_VM_OP_EQUAL,
+        [OP_NOT_EQUAL]                  = &&PERF_VM_OP_NOT_EQUAL,
+        [OP_GREATER]                    = &&PERF_VM_OP_GREATER,
+        [OP_GREATER_EQUAL]              = &&PERF_VM_OP_GREATER_EQUAL,
+        [OP_LESS]                       = &&PERF_VM_OP_LESS,
+        [OP_LESS_EQUAL]                 = &&PERF_VM_OP_LESS_EQUAL,
+        [OP_JUMP]                       = &&PERF_VM_OP_JUMP,
+        [OP_JUMP_IF_FALSE]              = &&PERF_VM_OP_JUMP_IF_FALSE,
+        [OP_LOOP]                       = &&PERF_VM_OP_LOOP,
+        [OP_CALL]                       = &&PERF_VM_OP_CALL,
+        [OP_RETURN]                     = &&PERF_VM_OP_RETURN,
+        [OP_INVOKE]                     = &&PERF_VM_OP_INVOKE,
+        [OP_GET_THIS]                   = &&PERF_VM_OP_GET_THIS,
+        [OP_ADD_LOCAL]                  = &&PERF_VM_OP_ADD_LOCAL,
+        [OP_ADD_CONSTANT]               = &&PERF_VM_OP_ADD_CONSTANT,
+        [OP_SUBTRACT_CONSTANT]          = &&PERF_VM_OP_SUBTRACT_CONSTANT,
+        [OP_STORE_LOCAL]                = &&PERF_VM_OP_STORE_LOCAL,
+        [OP_STORE_GLOBAL]               = &&PERF_VM_OP_STORE_GLOBAL,
+        [OP_JUMP_IF_NOT_EQUAL]          = &&PERF_VM_OP_JUMP_IF_NOT_EQUAL,
+        [OP_JUMP_IF_EQUAL]              = &&PERF_VM_OP_JUMP_IF_EQUAL,
+        [OP_JUMP_IF_NOT_GREATER]        = &&PERF_VM_OP_JUMP_IF_NOT_GREATER,
+        [OP_JUMP_IF_NOT_GREATER_EQUAL]  = &&PERF_VM_OP_JUMP_IF_NOT_GREATER_EQUAL,
+        [OP_JUMP_IF_NOT_LESS]           = &&PERF_VM_OP_JUMP_IF_NOT_LESS,
+        [OP_JUMP_IF_NOT_LESS_EQUAL]     = &&PERF_VM_OP_JUMP_IF_NOT_LESS_EQUAL,
+    };
+
+    // Each handler ends by jumping straight to the next one.
+    #define PERF_VM_CASE(name)  PERF_VM_OP_##name:
+    #define PERF_VM_NEXT()      goto *perf_vm_labels[*ip++]
+#else
+    // Each handler ends by going back to the switch.
+    #define PERF_VM_CASE(name)  case OP_##name:
+    #define PERF_VM_NEXT()      continue
+#endif
+
+    // Stops with a runtime error.
+    #define PERF_VM_FAIL(text)  do { message = (text); goto perf_vm_error; } while (0)
+
+    // Applies + or - to a and b, leaving the result in a. Two integers or two numbers take the fast path, which
+    // works on the unboxed payloads, everything else goes through perf_vm_arithmetic, which may allocate a string
+    // so it gets the stack pointer first. Integer results that don't fit in 48 bits become numbers.
+    #define PERF_VM_ARITHMETIC(opcode, a, b, operator)                                                      \
+        if (perf_value_is(*(a), PERF_VALUE_INTEGER) && perf_value_is(*(b), PERF_VALUE_INTEGER))             \
+            *(a) = perf_vm_integer_arithmetic(opcode, *(a), *(b));                                          \
+        else if (perf_value_is_number(*(a)) && perf_value_is_number(*(b)))                                  \
+            *(a) = perf_value_number(perf_value_as_number(*(a)) operator perf_value_as_number(*(b)));       \
+        else if ((vm->stack_top = sp, message = perf_vm_arithmetic(vm, opcode, a, *(b))) != NULL) goto perf_vm_error
+
+    // Compares a and b into out. Two integers or two numbers take the fast path, everything else goes through
+    // perf_vm_compare.
+    #define PERF_VM_COMPARE(opcode, a, b, operator, out)                                                    \
+        if (perf_value_is(*(a), PERF_VALUE_INTEGER) && perf_value_is(*(b), PERF_VALUE_INTEGER))             \
+            out = perf_value_as_integer(*(a)) operator perf_value_as_integer(*(b));                         \
+        else if (perf_value_is_number(*(a)) && perf_value_is_number(*(b)))                                  \
+            out = perf_value_as_number(*(a)) operator perf_value_as_number(*(b));                           \
+        else if ((message = perf_vm_compare(opcode, *(a), *(b), &out)) != NULL) goto perf_vm_error
+
+    // Checks if a and b are equal, two integers are equal when their bits are.
+    #define PERF_VM_EQUAL(a, b)                                                                             \
+        (perf_value_is(a, PERF_VALUE_INTEGER) && perf_value_is(b, PERF_VALUE_INTEGER) ? (a).bits == (b).bits : perf_value_equal(a, b))
+
+#if PERF_VM_LOOP_THREADED
+    PERF_VM_NEXT();
+#elif PERF_VM_LOOP_COUNTED
+    for (;;) switch (vm->instruction_count++, *ip++)
+    {
+#else
+    for (;;) switch (*ip++)
+    {
+#endif
+
+    PERF_VM_CASE(CONSTANT)
+    {
+        *sp++ = constants[PERF_VM_U16(ip)];
+        ip += 2;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(CONSTANT_WIDE)
+    {
+        *sp++ = constants[PERF_VM_U32(ip)];
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(NIL)
+    {
+        *sp++ = perf_value_nil();
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(TRUE)
+    {
+        *sp++ = perf_value_bool(true);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(FALSE)
+    {
+        *sp++ = perf_value_bool(false);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(POP)
+    {
+        sp--;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(GET_LOCAL)
+    {
+        *sp++ = slots[*ip++];
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(SET_LOCAL)
+    {
+        slots[*ip++] = sp[-1];
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(STORE_LOCAL)
+    {
+        slots[*ip++] = *--sp;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(GET_GLOBAL)
+    {
+        uint32_t index = PERF_VM_U32(ip);
+        ip += 4;
+
+        if (globals[index].bits == perf_value_undefined().bits)
+        {
+            snprintf(vm->error_buffer, sizeof(vm->error_buffer), "undefined variable '%s'", program->globals[index]);
+            PERF_VM_FAIL(vm->error_buffer);
+        }
+
+        *sp++ = globals[index];
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(SET_GLOBAL)
+    {
+        globals[PERF_VM_U32(ip)] = sp[-1];
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(STORE_GLOBAL)
+    {
+        globals[PERF_VM_U32(ip)] = *--sp;
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(GET_MEMBER)
+    {
+        uint32_t                    site    = PERF_VM_U32(ip);
+        const perf_vm_cache_way_t*  way     = &caches[site].ways[0];
+        ip += 4;
+
+        // Instances of the shape the site saw first are a compare and a load, the rest go through perf_vm_get_member.
+        if (perf_value_is(sp[-1], PERF_VALUE_OBJECT) && ((perf_instance_t*)perf_value_as_object(sp[-1]))->shape == way->shape)
+            sp[-1] = ((perf_instance_t*)perf_value_as_object(sp[-1]))->fields[way->index];
+        else if ((message = perf_vm_get_member(vm, site, sp - 1)) != NULL) goto perf_vm_error;
+
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(SET_MEMBER)
+    {
+        uint32_t                    site    = PERF_VM_U32(ip);
+        const perf_vm_cache_way_t*  way     = &caches[site].ways[0];
+        ip += 4;
+
+        // Fields of the shape the site saw first are stored directly, the rest go through perf_vm_set_member,
+        // which may allocate so it gets the stack pointer first.
+        if (perf_value_is(sp[-2], PERF_VALUE_OBJECT) && ((perf_instance_t*)perf_value_as_object(sp[-2]))->shape == way->shape && way->kind == PERF_VM_CACHE_FIELD)
+        {
+            if (perf_instance_set(&vm->heap, (perf_instance_t*)perf_value_as_object(sp[-2]), way->index, sp[-1]) != PERF_RES_OK)
+                PERF_VM_FAIL("Failed to allocate memory for remembered set");
+        }
+        else if ((vm->stack_top = sp, message = perf_vm_set_member(vm, site, sp - 2, sp - 1)) != NULL) goto perf_vm_error;
+
+        // The assignment's value replaces the object.
+        sp[-2] = sp[-1];
+        sp--;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(NEGATE)
+    {
+        perf_value_t* a = sp - 1;
+
+        if (perf_value_is_number(*a)) *a = perf_value_number(-perf_value_as_number(*a));
+        else if (perf_value_is(*a, PERF_VALUE_INTEGER)) *a = perf_value_integer(-perf_value_as_integer(*a));
+        else PERF_VM_FAIL("operand must be a number");
+
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(NOT)
+    {
+        sp[-1] = perf_value_bool(perf_vm_falsy(sp[-1]));
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(ADD)
+    {
+        PERF_VM_ARITHMETIC(OP_ADD, sp - 2, sp - 1, +);
+        sp--;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(SUBTRACT)
+    {
+        PERF_VM_ARITHMETIC(OP_SUBTRACT, sp - 2, sp - 1, -);
+        sp--;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(MULTIPLY)
+    {
+        perf_value_t* a = sp - 2;
+        perf_value_t* b = sp - 1;
+
+        if (perf_value_is(*a, PERF_VALUE_INTEGER) && perf_value_is(*b, PERF_VALUE_INTEGER)) *a = perf_vm_integer_arithmetic(OP_MULTIPLY, *a, *b);
+        else if (perf_value_is_number(*a) && perf_value_is_number(*b)) *a = perf_value_number(perf_value_as_number(*a) * perf_value_as_number(*b));
+        else if ((message = perf_vm_arithmetic(vm, OP_MULTIPLY, a, *b)) != NULL) goto perf_vm_error;
+
+        sp--;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(DIVIDE)
+    {
+        // Positive divisors can't fail or leave the range, the rest are checked by perf_vm_arithmetic.
+        perf_value_t* a = sp - 2;
+        perf_value_t* b = sp - 1;
+
+        if (perf_value_is(*a, PERF_VALUE_INTEGER) && perf_value_is(*b, PERF_VALUE_INTEGER) && perf_value_as_integer(*b) > 0)
+            *a = perf_value_box(PERF_VALUE_INTEGER, (uint64_t)(perf_value_as_integer(*a) / perf_value_as_integer(*b)));
+        else if ((message = perf_vm_arithmetic(vm, OP_DIVIDE, a, *b)) != NULL) goto perf_vm_error;
+
+        sp--;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(MODULO)
+    {
+        // Positive divisors can't fail or leave the range, the rest are checked by perf_vm_arithmetic.
+        perf_value_t* a = sp - 2;
+        perf_value_t* b = sp - 1;
+
+        if (perf_value_is(*a, PERF_VALUE_INTEGER) && perf_value_is(*b, PERF_VALUE_INTEGER) && perf_value_as_integer(*b) > 0)
+            *a = perf_value_box(PERF_VALUE_INTEGER, (uint64_t)(perf_value_as_integer(*a) % perf_value_as_integer(*b)));
+        else if ((message = perf_vm_arithmetic(vm, OP_MODULO, a, *b)) != NULL) goto perf_vm_error;
+
+        sp--;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(BIT_AND)
+    {
+        // The bits of two integers that fit always fit.
+        perf_value_t* a = sp - 2;
+        perf_value_t* b = sp - 1;
+
+        if (perf_value_is(*a, PERF_VALUE_INTEGER) && perf_value_is(*b, PERF_VALUE_INTEGER)) a->bits &= b->bits;
+        else if ((message = perf_vm_arithmetic(vm, OP_BIT_AND, a, *b)) != NULL) goto perf_vm_error;
+
+        sp--;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(ADD_LOCAL)
+    {
+        PERF_VM_ARITHMETIC(OP_ADD, sp - 1, &slots[*ip], +);
+        ip++;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(ADD_CONSTANT)
+    {
+        PERF_VM_ARITHMETIC(OP_ADD, sp - 1, &constants[PERF_VM_U16(ip)], +);
+        ip += 2;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(SUBTRACT_CONSTANT)
+    {
+        PERF_VM_ARITHMETIC(OP_SUBTRACT, sp - 1, &constants[PERF_VM_U16(ip)], -);
+        ip += 2;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(EQUAL)
+    {
+        sp[-2] = perf_value_bool(PERF_VM_EQUAL(sp[-2], sp[-1]));
+        sp--;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(NOT_EQUAL)
+    {
+        sp[-2] = perf_value_bool(!PERF_VM_EQUAL(sp[-2], sp[-1]));
+        sp--;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(GREATER)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_GREATER, sp - 2, sp - 1, >, out);
+        sp--;
+        sp[-1] = perf_value_bool(out);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(GREATER_EQUAL)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_GREATER_EQUAL, sp - 2, sp - 1, >=, out);
+        sp--;
+        sp[-1] = perf_value_bool(out);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(LESS)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_LESS, sp - 2, sp - 1, <, out);
+        sp--;
+        sp[-1] = perf_value_bool(out);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(LESS_EQUAL)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_LESS_EQUAL, sp - 2, sp - 1, <=, out);
+        sp--;
+        sp[-1] = perf_value_bool(out);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP)
+    {
+        ip += 2 + PERF_VM_U16(ip);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_FALSE)
+    {
+        sp--;
+
+        bool falsy = perf_vm_falsy(*sp);
+
+        ip += falsy ? 2 + PERF_VM_U16(ip) : 2;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_NOT_EQUAL)
+    {
+        sp -= 2;
+        bool equal = PERF_VM_EQUAL(sp[0], sp[1]);
+        ip += equal ? 2 : 2 + PERF_VM_U16(ip);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_EQUAL)
+    {
+        sp -= 2;
+        bool equal = PERF_VM_EQUAL(sp[0], sp[1]);
+        ip += equal ? 2 + PERF_VM_U16(ip) : 2;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_NOT_GREATER)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_GREATER, sp - 2, sp - 1, >, out);
+        sp -= 2;
+        ip += out ? 2 : 2 + PERF_VM_U16(ip);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_NOT_GREATER_EQUAL)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_GREATER_EQUAL, sp - 2, sp - 1, >=, out);
+        sp -= 2;
+        ip += out ? 2 : 2 + PERF_VM_U16(ip);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_NOT_LESS)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_LESS, sp - 2, sp - 1, <, out);
+        sp -= 2;
+        ip += out ? 2 : 2 + PERF_VM_U16(ip);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_NOT_LESS_EQUAL)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_LESS_EQUAL, sp - 2, sp - 1, <=, out);
+        sp -= 2;
+        ip += out ? 2 : 2 + PERF_VM_U16(ip);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(LOOP)
+    {
+        ip = ip + 2 - PERF_VM_U16(ip);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(CALL)
+    {
+        call_count  = *ip++;
+        callee      = sp - call_count - 1;
+
+    perf_vm_call:
+        // Functions of the program get a frame of their own.
+        if (perf_value_is(*callee, PERF_VALUE_FUNCTION))
+        {
+            callee_index = perf_value_as_index(*callee);
+
+            // Calling a class makes the instance its initializer runs on, in place of the callee.
+            if (program->functions[callee_index].kind == PERF_FUNCTION_INITIALIZER && (vm->stack_top = sp, message = perf_vm_construct(vm, callee_index, callee)) != NULL)
+                goto perf_vm_error;
+
+        perf_vm_enter:;
+            const perf_function_t* function = &program->functions[callee_index];
+
+            if (call_count != function->arity)
+            {
+                snprintf(vm->error_buffer, sizeof(vm->error_buffer), "expected %u arguments but got %u", function->arity, call_count);
+                PERF_VM_FAIL(vm->error_buffer);
+            }
+
+            // The callee's slots and operand stack must fit, checked once here instead of on every push.
+            if (vm->frame_count == PERF_VM_MAX_FRAMES || callee + 1 + function->slot_count + function->max_stack > stack_end)
+                PERF_VM_FAIL("stack overflow");
+
+            // Save where the caller resumes, and switch to the new frame.
+            frame->ip = ip;
+
+            frame           = &vm->frames[vm->frame_count++];
+            frame->function = callee_index;
+            frame->slots    = slots = callee + 1;
+
+            // The arguments are the first slots, the rest start out nil.
+            for (perf_value_t* slot = slots + call_count; slot < slots + function->slot_count; slot++) *slot = perf_value_nil();
+
+            sp = slots + function->slot_count;
+            ip = code + function->code_offset;
+            PERF_VM_NEXT();
+        }
+
+        // Natives run right away, their result replaces the callee.
+        if (perf_value_is(*callee, PERF_VALUE_NATIVE))
+        {
+            perf_value_t value;
+
+            frame->ip = ip;
+            if (perf_vm_natives[perf_value_as_index(*callee)].function(vm, callee + 1, call_count, &value, &message) != PERF_RES_OK) goto perf_vm_error;
+
+            *callee = value;
+            sp      = callee + 1;
+            PERF_VM_NEXT();
+        }
+
+        PERF_VM_FAIL("can only call functions");
+    }
+
+    PERF_VM_CASE(INVOKE)
+    {
+        uint32_t                    site    = PERF_VM_U32(ip);
+        const perf_vm_cache_way_t*  way     = &caches[site].ways[0];
+
+        call_count  = ip[4];
+        callee      = sp - call_count - 1;
+        ip += 5;
+
+        // The receiver is in the callee's slot, where methods find this. Methods of the shape the site saw first
+        // are entered directly, the rest go through perf_vm_invoke_member.
+        if (perf_value_is(*callee, PERF_VALUE_OBJECT) && ((perf_instance_t*)perf_value_as_object(*callee))->shape == way->shape && way->kind == PERF_VM_CACHE_METHOD)
+        {
+            callee_index = way->index;
+            goto perf_vm_enter;
+        }
+
+        if ((message = perf_vm_invoke_member(vm, site, callee, &callee_index)) != NULL) goto perf_vm_error;
+
+        // A field replaced the receiver, it is called like any value.
+        if (callee_index == UINT32_MAX) goto perf_vm_call;
+        goto perf_vm_enter;
+    }
+
+    PERF_VM_CASE(GET_THIS)
+    {
+        *sp++ = slots[-1];
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(RETURN)
+    {
+        perf_value_t value = sp[-1];
+
+        // Returning from the script stops the VM.
+        if (--vm->frame_count == 0)
+        {
+            *result = value;
+            return PERF_RES_OK;
+        }
+
+        // Replace the callee with the value, and resume the caller.
+        sp      = slots - 1;
+        *sp++   = value;
+
+        frame   = &vm->frames[vm->frame_count - 1];
+        ip      = frame->ip;
+        slots   = frame->slots;
+        PERF_VM_NEXT();
+    }
+
+#if !PERF_VM_LOOP_THREADED
+    default: PERF_VM_FAIL("invalid opcode");
+    }
+#endif
+
+perf_vm_error:
+    // ip is past the opcode and maybe some operands, but still inside the failing instruction.
+    frame->ip = ip;
+    return perf_vm_error(vm, frame->function, (uint32_t)(ip - 1 - code), message, error);
+
+    #undef PERF_VM_CASE
+    #undef PERF_VM_NEXT
+    #undef PERF_VM_FAIL
+    #undef PERF_VM_ARITHMETIC
+    #undef PERF_VM_COMPARE
+    #undef PERF_VM_EQUAL
+}
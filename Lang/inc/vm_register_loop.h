@@ -0,0 +1,626 @@
+/**
+ * NOTE: This is the body of the interpreter loop for register code, it has no include guard on purpose. vm.c
+ * includes it once per way of dispatching, like vm_loop.h, defining PERF_VM_EXECUTE as the name of the function
+ * to generate, PERF_VM_LOOP_THREADED as 1 for computed goto or 0 for a switch, PERF_VM_LOOP_COUNTED as 1 to
+ * count every instruction dispatched, and PERF_VM_LOOP_JIT as 1 to count calls and back edges and enter the
+ * JIT's machine code (see jit.h).
+ *
+ * Registers are the frame's slots, so there is no operand stack: ip points at the start of the instruction
+ * running, each handler reads its operands from the instruction's words and moves ip past them when done.
+*/
+
+/**
+ * @brief Runs the VM's frames until the script returns.
+ *
+ * @param vm The VM to use, with the script's frame set up.
+ * @param result The value the script returned.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the script returned, PERF_RES_RUNTIME_ERROR if it failed.
+*/
+static perf_result_t PERF_VM_EXECUTE(perf_vm_t *vm, perf_value_t *result, const char** error)
+{
+    // The program, which doesn't change while running.
+    const perf_program_t*   program     = vm->program;
+    const uint8_t*          code        = program->code;
+    const perf_value_t*     constants   = program->constants;
+    perf_value_t*           globals     = vm->globals;
+    perf_vm_cache_t*        caches      = vm->caches;
+    const perf_value_t*     stack_end   = vm->stack + PERF_VM_STACK_SIZE;
+
+    // The frame running.
+    perf_vm_frame_t*        frame       = &vm->frames[vm->frame_count - 1];
+    const uint8_t*          ip          = frame->ip;
+    perf_value_t*           slots       = frame->slots;
+
+    // The message of a runtime error, set before jumping to perf_vm_error.
+    const char*             message     = NULL;
+
+    // The call being made, shared by ROP_CALL and ROP_INVOKE, which jumps into it.
+    uint32_t                call_count  = 0;
+    perf_value_t*           callee      = NULL;
+    uint32_t                callee_index= 0;
+
+#if PERF_VM_LOOP_THREADED
+    // Handlers by opcode.
+    static const void* const perf_vm_labels[ROP_COUNT] =
+    {
+        [ROP_MOVE]                      = &&PERF_VM_ROP_MOVE,
+        [ROP_CONSTANT]                  = &&PERF_VM_ROP_CONSTANT,
+        [ROP_CONSTANT_WIDE]             = &&PERF_VM_ROP_CONSTANT_WIDE,
+        [ROP_NIL]                       = &&PERF_VM_ROP_NIL,
+        [ROP_TRUE]                      = &&PERF_VM_ROP_TRUE,
+        [ROP_FALSE]                     = &&PERF_VM_ROP_FALSE,
+        [ROP_GET_GLOBAL]                = &&PERF_VM_ROP_GET_GLOBAL,
+        [ROP_SET_GLOBAL]                = &&PERF_VM_ROP_SET_GLOBAL,
+        [ROP_GET_MEMBER]                = &&PERF_VM_ROP_GET_MEMBER,
+        [ROP_SET_MEMBER]                = &&PERF_VM_ROP_SET_MEMBER,
+        [ROP_NEGATE]                    = &&PERF_VM_ROP_NEGATE,
+        [ROP_NOT]                       = &&PERF_VM_ROP_NOT,
+        [ROP_ADD]                       = &&PERF_VM_ROP_ADD,
+        [ROP_SUBTRACT]                  = &&PERF_VM_ROP_SUBTRACT,
+        [ROP_MULTIPLY]                  = &&PERF_VM_ROP_MULTIPLY,
+        [ROP_DIVIDE]                    = &&PERF_VM_ROP_DIVIDE,
+        [ROP_MODULO]                    = &&PERF_VM_ROP_MODULO,
+        [ROP_BIT_AND]                   = &&PERF_VM_ROP_BIT_AND,
+        [ROP_EQUAL]                     = &&PERF_VM_ROP_EQUAL,
+        [ROP_NOT_EQUAL]                 = &&PERF_VM_ROP_NOT_EQUAL,
+        [ROP_GREATER]                   = &&PERF_VM_ROP_GREATER,
+        [ROP_GREATER_EQUAL]             = &&PERF_VM_ROP_GREATER_EQUAL,
+        [ROP_LESS]                      = &&PERF_VM_ROP_LESS,
+        [ROP_LESS_EQUAL]                = &&PERF_VM_ROP_LESS_EQUAL,
+        [ROP_ADD_CONSTANT]              = &&PERF_VM_ROP_ADD_CONSTANT,
+        [ROP_SUBTRACT_CONSTANT]         = &&PERF_VM_ROP_SUBTRACT_CONSTANT,
+        [ROP_JUMP]                      = &&PERF_VM_ROP_JUMP,
+        [ROP_JUMP_IF_FALSE]             = &&PERF_VM_ROP_JUMP_IF_FALSE,
+        [ROP_JUMP_IF_NOT_EQUAL]         = &&PERF_VM_ROP_JUMP_IF_NOT_EQUAL,
+        [ROP_JUMP_IF_EQUAL]             = &&PERF_VM_ROP_JUMP_IF_EQUAL,
+        [ROP_JUMP_IF_NOT_GREATER]       = &&PERF_VM_ROP_JUMP_IF_NOT_GREATER,
+        [ROP_JUMP_IF_NOT_GREATER_EQUAL] = &&PERF_VM_ROP_JUMP_IF_NOT_GREATER_EQUAL,
+        [ROP_JUMP_IF_NOT_LESS]          = &&PERF_VM_ROP_JUMP_IF_NOT_LESS,
+        [ROP_JUMP_IF_NOT_LESS_EQUAL]    = &&PERF_VM_ROP_JUMP_IF_NOT_LESS_EQUAL,
+        [ROP_LOOP]                      = &&PERF_VM_ROP_LOOP,
+        [ROP_CALL]                      = &&PERF_VM_ROP_CALL,
+        [ROP_RETURN]                    = &&PERF_VM_ROP_RETURN,
+        [ROP_INVOKE]                    = &&PERF_VM_ROP_INVOKE,
+        [ROP_GET_THIS]                  = &&PERF_VM_ROP_GET_THIS,
+    };
+
+    // Each handler ends by jumping straight to the next one.
+    #define PERF_VM_CASE(name)  PERF_VM_ROP_##name:
+    #define PERF_VM_NEXT()      goto *perf_vm_labels[*ip]
+#else
+    // Each handler ends by going back to the switch.
+    #define PERF_VM_CASE(name)  case ROP_##name:
+    #define PERF_VM_NEXT()      continue
+#endif
+
+    // The operands of the instruction at ip.
+    #define PERF_VM_A           (&slots[ip[1]])
+    #define PERF_VM_B           (&slots[ip[2]])
+    #define PERF_VM_C           (&slots[ip[3]])
+    #define PERF_VM_BX          ((uint32_t)ip[2] | (uint32_t)ip[3] << 8)
+
+    // Stops with a runtime error.
+    #define PERF_VM_FAIL(text)  do { message = (text); goto perf_vm_error; } while (0)
+
+    // Runs x op y through perf_vm_arithmetic. The copy keeps x itself from having its address taken, which would
+    // pin it to the stack on the fast paths too.
+    #define PERF_VM_ARITHMETIC_SLOW(opcode, x, y)                                                           \
+        do                                                                                                  \
+        {                                                                                                   \
+            perf_value_t z = (x);                                                                           \
+            if ((message = perf_vm_arithmetic(vm, opcode, &z, y)) != NULL) goto perf_vm_error;              \
+            (x) = z;                                                                                        \
+        } while (0)
+
+    // Applies + or - to R[b] and R[c] into R[a], any of which may be the same register. Two integers or two
+    // numbers take the fast path, which works on the unboxed payloads, everything else goes through
+    // perf_vm_arithmetic on a copy of R[b]. Integer results that don't fit in 48 bits become numbers.
+    #define PERF_VM_ARITHMETIC(opcode, b, c, operator)                                                      \
+        do                                                                                                  \
+        {                                                                                                   \
+            perf_value_t x = *(b);                                                                          \
+            perf_value_t y = *(c);                                                                          \
+                                                                                                            \
+            if (perf_value_is(x, PERF_VALUE_INTEGER) && perf_value_is(y, PERF_VALUE_INTEGER))               \
+                x = perf_vm_integer_arithmetic(opcode, x, y);                                               \
+            else if (perf_value_is_number(x) && perf_value_is_number(y))                                    \
+                x = perf_value_number(perf_value_as_number(x) operator perf_value_as_number(y));            \
+            else PERF_VM_ARITHMETIC_SLOW(opcode, x, y);                                                     \
+                                                                                                            \
+            *PERF_VM_A = x;                                                                                 \
+            ip += 4;                                                                                        \
+        } while (0)
+
+    // Compares a and b into out. Two integers or two numbers take the fast path, everything else goes through
+    // perf_vm_compare.
+    #define PERF_VM_COMPARE(opcode, a, b, operator, out)                                                    \
+        if (perf_value_is(*(a), PERF_VALUE_INTEGER) && perf_value_is(*(b), PERF_VALUE_INTEGER))             \
+            out = perf_value_as_integer(*(a)) operator perf_value_as_integer(*(b));                         \
+        else if (perf_value_is_number(*(a)) && perf_value_is_number(*(b)))                                  \
+            out = perf_value_as_number(*(a)) operator perf_value_as_number(*(b));                           \
+        else if ((message = perf_vm_compare(opcode, *(a), *(b), &out)) != NULL) goto perf_vm_error
+
+    // Checks if a and b are equal, two integers are equal when their bits are.
+    #define PERF_VM_EQUAL(a, b)                                                                             \
+        (perf_value_is(a, PERF_VALUE_INTEGER) && perf_value_is(b, PERF_VALUE_INTEGER) ? (a).bits == (b).bits : perf_value_equal(a, b))
+
+    // Moves past a compare-and-jump, jumping by its second word's bx unless the comparison held.
+    #define PERF_VM_JUMP_UNLESS(held)       ip += (held) ? 8 : 8 + ((uint32_t)ip[6] | (uint32_t)ip[7] << 8)
+
+#if PERF_VM_LOOP_JIT
+    // Counts a call or back edge towards compiling the running function, running its machine code once it has some.
+    // Functions that stay in the interpreter skip the call.
+    #define PERF_VM_JIT_TIER()      if (!vm->jit.functions[frame->function].failed) ip = perf_vm_jit_tier(vm, frame->function, slots, ip)
+
+    // Runs the machine code of the running function from ip, if it has some.
+    #define PERF_VM_JIT_RESUME()    if (vm->jit.functions[frame->function].code != NULL) ip = code + perf_jit_enter(&vm->jit, frame->function, slots, (uint32_t)(ip - code))
+#else
+    #define PERF_VM_JIT_TIER()
+    #define PERF_VM_JIT_RESUME()
+#endif
+
+#if PERF_VM_LOOP_THREADED
+    PERF_VM_NEXT();
+#elif PERF_VM_LOOP_COUNTED
+    for (;;) switch (vm->instruction_count++, *ip)
+    {
+#else
+    for (;;) switch (*ip)
+    {
+#endif
+
+    PERF_VM_CASE(MOVE)
+    {
+        *PERF_VM_A = *PERF_VM_B;
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(CONSTANT)
+    {
+        *PERF_VM_A = constants[PERF_VM_BX];
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(CONSTANT_WIDE)
+    {
+        *PERF_VM_A = constants[PERF_VM_U32(ip + 4)];
+        ip += 8;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(NIL)
+    {
+        *PERF_VM_A = perf_value_nil();
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(TRUE)
+    {
+        *PERF_VM_A = perf_value_bool(true);
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(FALSE)
+    {
+        *PERF_VM_A = perf_value_bool(false);
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(GET_GLOBAL)
+    {
+        uint32_t index = PERF_VM_U32(ip + 4);
+
+        if (globals[index].bits == perf_value_undefined().bits)
+        {
+            snprintf(vm->error_buffer, sizeof(vm->error_buffer), "undefined variable '%s'", program->globals[index]);
+            PERF_VM_FAIL(vm->error_buffer);
+        }
+
+        *PERF_VM_A = globals[index];
+        ip += 8;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(SET_GLOBAL)
+    {
+        globals[PERF_VM_U32(ip + 4)] = *PERF_VM_A;
+        ip += 8;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(GET_MEMBER)
+    {
+        uint32_t                    site    = PERF_VM_U32(ip + 4);
+        const perf_vm_cache_way_t*  way     = &caches[site].ways[0];
+        perf_value_t                object  = *PERF_VM_B;
+
+        // Instances of the shape the site saw first are a compare and a load, the rest go through perf_vm_get_member.
+        if (perf_value_is(object, PERF_VALUE_OBJECT) && ((perf_instance_t*)perf_value_as_object(object))->shape == way->shape)
+            object = ((perf_instance_t*)perf_value_as_object(object))->fields[way->index];
+        else if ((message = perf_vm_get_member(vm, site, &object)) != NULL) goto perf_vm_error;
+
+        *PERF_VM_A = object;
+        ip += 8;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(SET_MEMBER)
+    {
+        uint32_t                    site    = PERF_VM_U32(ip + 4);
+        const perf_vm_cache_way_t*  way     = &caches[site].ways[0];
+        perf_value_t*               object  = PERF_VM_A;
+
+        // Fields of the shape the site saw first are stored directly, the rest go through perf_vm_set_member.
+        if (perf_value_is(*object, PERF_VALUE_OBJECT) && ((perf_instance_t*)perf_value_as_object(*object))->shape == way->shape && way->kind == PERF_VM_CACHE_FIELD)
+        {
+            if (perf_instance_set(&vm->heap, (perf_instance_t*)perf_value_as_object(*object), way->index, *PERF_VM_B) != PERF_RES_OK)
+                PERF_VM_FAIL("Failed to allocate memory for remembered set");
+        }
+        else if ((message = perf_vm_set_member(vm, site, object, PERF_VM_B)) != NULL) goto perf_vm_error;
+
+        ip += 8;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(NEGATE)
+    {
+        perf_value_t value = *PERF_VM_B;
+
+        if (perf_value_is_number(value)) *PERF_VM_A = perf_value_number(-perf_value_as_number(value));
+        else if (perf_value_is(value, PERF_VALUE_INTEGER)) *PERF_VM_A = perf_value_integer(-perf_value_as_integer(value));
+        else PERF_VM_FAIL("operand must be a number");
+
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(NOT)
+    {
+        *PERF_VM_A = perf_value_bool(perf_vm_falsy(*PERF_VM_B));
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(ADD)
+    {
+        PERF_VM_ARITHMETIC(OP_ADD, PERF_VM_B, PERF_VM_C, +);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(SUBTRACT)
+    {
+        PERF_VM_ARITHMETIC(OP_SUBTRACT, PERF_VM_B, PERF_VM_C, -);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(MULTIPLY)
+    {
+        perf_value_t x = *PERF_VM_B;
+        perf_value_t y = *PERF_VM_C;
+
+        if (perf_value_is(x, PERF_VALUE_INTEGER) && perf_value_is(y, PERF_VALUE_INTEGER)) x = perf_vm_integer_arithmetic(OP_MULTIPLY, x, y);
+        else if (perf_value_is_number(x) && perf_value_is_number(y)) x = perf_value_number(perf_value_as_number(x) * perf_value_as_number(y));
+        else PERF_VM_ARITHMETIC_SLOW(OP_MULTIPLY, x, y);
+
+        *PERF_VM_A = x;
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(DIVIDE)
+    {
+        // Positive divisors can't fail or leave the range, the rest are checked by perf_vm_arithmetic.
+        perf_value_t x = *PERF_VM_B;
+        perf_value_t y = *PERF_VM_C;
+
+        if (perf_value_is(x, PERF_VALUE_INTEGER) && perf_value_is(y, PERF_VALUE_INTEGER) && perf_value_as_integer(y) > 0)
+            x = perf_value_box(PERF_VALUE_INTEGER, (uint64_t)(perf_value_as_integer(x) / perf_value_as_integer(y)));
+        else PERF_VM_ARITHMETIC_SLOW(OP_DIVIDE, x, y);
+
+        *PERF_VM_A = x;
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(MODULO)
+    {
+        // Positive divisors can't fail or leave the range, the rest are checked by perf_vm_arithmetic.
+        perf_value_t x = *PERF_VM_B;
+        perf_value_t y = *PERF_VM_C;
+
+        if (perf_value_is(x, PERF_VALUE_INTEGER) && perf_value_is(y, PERF_VALUE_INTEGER) && perf_value_as_integer(y) > 0)
+            x = perf_value_box(PERF_VALUE_INTEGER, (uint64_t)(perf_value_as_integer(x) % perf_value_as_integer(y)));
+        else PERF_VM_ARITHMETIC_SLOW(OP_MODULO, x, y);
+
+        *PERF_VM_A = x;
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(BIT_AND)
+    {
+        // The bits of two integers that fit always fit.
+        perf_value_t x = *PERF_VM_B;
+        perf_value_t y = *PERF_VM_C;
+
+        if (perf_value_is(x, PERF_VALUE_INTEGER) && perf_value_is(y, PERF_VALUE_INTEGER)) x.bits &= y.bits;
+        else PERF_VM_ARITHMETIC_SLOW(OP_BIT_AND, x, y);
+
+        *PERF_VM_A = x;
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(ADD_CONSTANT)
+    {
+        PERF_VM_ARITHMETIC(OP_ADD, PERF_VM_B, &constants[ip[3]], +);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(SUBTRACT_CONSTANT)
+    {
+        PERF_VM_ARITHMETIC(OP_SUBTRACT, PERF_VM_B, &constants[ip[3]], -);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(EQUAL)
+    {
+        *PERF_VM_A = perf_value_bool(PERF_VM_EQUAL(*PERF_VM_B, *PERF_VM_C));
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(NOT_EQUAL)
+    {
+        *PERF_VM_A = perf_value_bool(!PERF_VM_EQUAL(*PERF_VM_B, *PERF_VM_C));
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(GREATER)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_GREATER, PERF_VM_B, PERF_VM_C, >, out);
+        *PERF_VM_A = perf_value_bool(out);
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(GREATER_EQUAL)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_GREATER_EQUAL, PERF_VM_B, PERF_VM_C, >=, out);
+        *PERF_VM_A = perf_value_bool(out);
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(LESS)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_LESS, PERF_VM_B, PERF_VM_C, <, out);
+        *PERF_VM_A = perf_value_bool(out);
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(LESS_EQUAL)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_LESS_EQUAL, PERF_VM_B, PERF_VM_C, <=, out);
+        *PERF_VM_A = perf_value_bool(out);
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP)
+    {
+        ip += 4 + PERF_VM_BX;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_FALSE)
+    {
+        bool falsy = perf_vm_falsy(*PERF_VM_A);
+
+        ip += falsy ? 4 + PERF_VM_BX : 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_NOT_EQUAL)
+    {
+        bool equal = PERF_VM_EQUAL(*PERF_VM_A, *PERF_VM_B);
+        PERF_VM_JUMP_UNLESS(equal);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_EQUAL)
+    {
+        bool equal = PERF_VM_EQUAL(*PERF_VM_A, *PERF_VM_B);
+        PERF_VM_JUMP_UNLESS(!equal);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_NOT_GREATER)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_GREATER, PERF_VM_A, PERF_VM_B, >, out);
+        PERF_VM_JUMP_UNLESS(out);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_NOT_GREATER_EQUAL)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_GREATER_EQUAL, PERF_VM_A, PERF_VM_B, >=, out);
+        PERF_VM_JUMP_UNLESS(out);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_NOT_LESS)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_LESS, PERF_VM_A, PERF_VM_B, <, out);
+        PERF_VM_JUMP_UNLESS(out);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(JUMP_IF_NOT_LESS_EQUAL)
+    {
+        bool out;
+        PERF_VM_COMPARE(OP_LESS_EQUAL, PERF_VM_A, PERF_VM_B, <=, out);
+        PERF_VM_JUMP_UNLESS(out);
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(LOOP)
+    {
+        ip = ip + 4 - PERF_VM_BX;
+        PERF_VM_JIT_TIER();
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(CALL)
+    {
+        call_count  = ip[2];
+        callee      = PERF_VM_A;
+
+    perf_vm_call:
+        // Functions of the program get a frame of their own.
+        if (perf_value_is(*callee, PERF_VALUE_FUNCTION))
+        {
+            callee_index = perf_value_as_index(*callee);
+
+            // Calling a class makes the instance its initializer runs on, in place of the callee.
+            if (program->functions[callee_index].kind == PERF_FUNCTION_INITIALIZER && (message = perf_vm_construct(vm, callee_index, callee)) != NULL)
+                goto perf_vm_error;
+
+        perf_vm_enter:;
+            const perf_function_t* function = &program->functions[callee_index];
+
+            if (call_count != function->arity)
+            {
+                snprintf(vm->error_buffer, sizeof(vm->error_buffer), "expected %u arguments but got %u", function->arity, call_count);
+                PERF_VM_FAIL(vm->error_buffer);
+            }
+
+            // The callee's registers must fit, checked once here instead of on every access.
+            if (vm->frame_count == PERF_VM_MAX_FRAMES || callee + 1 + function->slot_count > stack_end) PERF_VM_FAIL("stack overflow");
+
+            // Save where the caller resumes, and switch to the new frame.
+            frame->ip = ip + 4;
+
+            frame           = &vm->frames[vm->frame_count++];
+            frame->function = callee_index;
+            frame->slots    = slots = callee + 1;
+
+            // The arguments are the first registers, the rest start out nil.
+            for (perf_value_t* slot = slots + call_count; slot < slots + function->slot_count; slot++) *slot = perf_value_nil();
+
+            ip = code + function->code_offset;
+            PERF_VM_JIT_TIER();
+            PERF_VM_NEXT();
+        }
+
+        // Natives run right away, their result replaces the callee.
+        if (perf_value_is(*callee, PERF_VALUE_NATIVE))
+        {
+            perf_value_t value;
+
+            frame->ip = ip;
+            if (perf_vm_natives[perf_value_as_index(*callee)].function(vm, callee + 1, call_count, &value, &message) != PERF_RES_OK) goto perf_vm_error;
+
+            *callee = value;
+            ip += 4;
+            PERF_VM_NEXT();
+        }
+
+        PERF_VM_FAIL("can only call functions");
+    }
+
+    PERF_VM_CASE(INVOKE)
+    {
+        uint32_t                    site    = PERF_VM_U32(ip + 4);
+        const perf_vm_cache_way_t*  way     = &caches[site].ways[0];
+
+        call_count  = ip[2];
+        callee      = PERF_VM_A;
+
+        // The rest is ROP_CALL's, which expects the 4 bytes of a call left.
+        ip += 4;
+
+        // The receiver is in the callee's register, where methods find this. Methods of the shape the site saw
+        // first are entered directly, the rest go through perf_vm_invoke_member.
+        if (perf_value_is(*callee, PERF_VALUE_OBJECT) && ((perf_instance_t*)perf_value_as_object(*callee))->shape == way->shape && way->kind == PERF_VM_CACHE_METHOD)
+        {
+            callee_index = way->index;
+            goto perf_vm_enter;
+        }
+
+        if ((message = perf_vm_invoke_member(vm, site, callee, &callee_index)) != NULL) goto perf_vm_error;
+
+        // A field replaced the receiver, it is called like any value.
+        if (callee_index == UINT32_MAX) goto perf_vm_call;
+        goto perf_vm_enter;
+    }
+
+    PERF_VM_CASE(GET_THIS)
+    {
+        *PERF_VM_A = slots[-1];
+        ip += 4;
+        PERF_VM_NEXT();
+    }
+
+    PERF_VM_CASE(RETURN)
+    {
+        perf_value_t value = *PERF_VM_A;
+
+        // Returning from the script stops the VM.
+        if (--vm->frame_count == 0)
+        {
+            *result = value;
+            return PERF_RES_OK;
+        }
+
+        // Replace the callee with the value, and resume the caller.
+        slots[-1] = value;
+
+        frame   = &vm->frames[vm->frame_count - 1];
+        ip      = frame->ip;
+        slots   = frame->slots;
+        PERF_VM_JIT_RESUME();
+        PERF_VM_NEXT();
+    }
+
+#if !PERF_VM_LOOP_THREADED
+    default: PERF_VM_FAIL("invalid opcode");
+    }
+#endif
+
+perf_vm_error:
+    // ip is still at the start of the failing instruction.
+    frame->ip = ip;
+    return perf_vm_error(vm, frame->function, (uint32_t)(ip - code), message, error);
+
+    #undef PERF_VM_CASE
+    #undef PERF_VM_NEXT
+    #undef PERF_VM_A
+    #undef PERF_VM_B
+    #undef PERF_VM_C
+    #undef PERF_VM_BX
+    #undef PERF_VM_FAIL
+    #undef PERF_VM_ARITHMETIC_SLOW
+    #undef PERF_VM_ARITHMETIC
+    #undef PERF_VM_COMPARE
+    #undef PERF_VM_EQUAL
+    #undef PERF_VM_JUMP_UNLESS
+    #undef PERF_VM_JIT_TIER
+    #undef PERF_VM_JIT_RESUME
+}
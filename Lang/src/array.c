@@ -0,0 +1,24 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/array.h"
+
+// Implementation for array.h perf_array_grow
+perf_result_t perf_array_grow(void **items, uint32_t *capacity, size_t item_size)
+{
+    // Adjust the capacity of the array, refusing to wrap around.
+    uint32_t grown_capacity = *capacity < 64 ? 64 : *capacity * 2;
+    if (grown_capacity <= *capacity) return PERF_RES_MEMORY_ALLOC_FAIL;
+
+    // Resize the array
+    void* grown = realloc(*items, (size_t)grown_capacity * item_size);
+
+    // Check if the array was resized successfully, the old array is still valid if not.
+    if (grown == NULL) return PERF_RES_MEMORY_ALLOC_FAIL;
+
+    // Use the resized array
+    *items      = grown;
+    *capacity   = grown_capacity;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
@@ -1,70 +1,670 @@
 #include "../inc/shared.h"
 #include "../inc/result.h"
+#include "../inc/array.h"
 #include "../inc/token.h"
+#include "../inc/intern.h"
+#include "../inc/lexer.h"
 #include "../inc/ast.h"
 
 /**
- * @brief Frees a node and all of its children.
- * 
- * @param node The node to free.
- * 
- * @return PERF_RES_OK if the node was freed successfully.
+ * Names of the node types, indexed by perf_e_parser_node_type_t.
 */
-void perf_parse_node_free_internal( perf_parser_node_t *node, perf_parser_node_t *parent_node )
-{
-    // Check for expression nodes
-	if ( node->node_type == AST_GROUP_EXPR )
-	{
-        // Free the group expression
-		perf_parse_node_free_internal( node->as.group_expression, node );
-
-        // Set the group expression to NULL
-		node->as.group_expression = NULL;
-	}
-
-    // Check for unary expression nodes
-	else if ( node->node_type == AST_UNARY_EXPR )
-	{
-        // Free the operand
-		perf_parse_node_free_internal( node->as.unary_expr.operand, node );
-
-        // Set the operand to NULL
-		node->as.unary_expr.operand = NULL;
-	}
-
-    // Check for binary expression nodes
-	else if ( node->node_type == AST_BINARY_EXPR )
-	{
-        // Free the left and right nodes
-		perf_parse_node_free_internal( node->as.binary_expr.left, node );
-		perf_parse_node_free_internal( node->as.binary_expr.right, node );
-
-        // Set the left and right nodes to NULL
-		node->as.binary_expr.left = NULL;
-		node->as.binary_expr.right = NULL;
-	}
-
-    // Check for expression statement nodes
-	else if ( node->node_type == AST_EXPR_STATEMENT )
-	{
-        // Free the expression statement
-		perf_parse_node_free_internal( node->as.expr_statement, node );
-
-        // Set the expression statement to NULL
-		node->as.expr_statement = NULL;
-	}
-
-    // Check for constant nodes
-	if ( parent_node != NULL )
-		free( node );   // Free the node
-}
-
-// Implementation of ast.h perf_parser_node_free
-perf_result_t perf_parser_node_free( perf_parser_node_t *node )
-{
-    // Free the node and all of its children
-	perf_parse_node_free_internal( node, NULL );
-
-    // Return PERF_RES_OK
-	return PERF_RES_OK;
-}
\ No newline at end of file
+static const char* perf_ast_node_names[] =
+{
+    "Constant",
+    "Variable",
+    "Group",
+    "Unary",
+    "Binary",
+    "Assign",
+    "Call",
+    "Member",
+    "FunctionDef",
+    "ExpressionStatement",
+    "Param",
+    "VarDecl",
+    "Block",
+    "If",
+    "While",
+    "DoWhile",
+    "For",
+    "Return",
+    "Break",
+    "Continue",
+    "This",
+    "ClassDef"
+};
+
+/**
+ * Determines what the lhs or rhs of a node refers to.
+*/
+typedef enum _perf_e_ast_slot_t
+{
+    PERF_AST_SLOT_NONE,         // Nothing, or a token
+    PERF_AST_SLOT_NODE,         // A child node
+    PERF_AST_SLOT_LIST          // A list of child nodes in extra
+} perf_e_ast_slot_t;
+
+/**
+ * What the lhs and rhs of each node type refer to, indexed by perf_e_parser_node_type_t.
+*/
+static const uint8_t perf_ast_node_slots[][2] =
+{
+    { PERF_AST_SLOT_NONE, PERF_AST_SLOT_NONE },     // Constant
+    { PERF_AST_SLOT_NONE, PERF_AST_SLOT_NONE },     // Variable
+    { PERF_AST_SLOT_NODE, PERF_AST_SLOT_NONE },     // Group
+    { PERF_AST_SLOT_NODE, PERF_AST_SLOT_NONE },     // Unary
+    { PERF_AST_SLOT_NODE, PERF_AST_SLOT_NODE },     // Binary
+    { PERF_AST_SLOT_NODE, PERF_AST_SLOT_NODE },     // Assign
+    { PERF_AST_SLOT_NODE, PERF_AST_SLOT_LIST },     // Call
+    { PERF_AST_SLOT_NODE, PERF_AST_SLOT_NONE },     // Member
+    { PERF_AST_SLOT_LIST, PERF_AST_SLOT_NODE },     // FunctionDef
+    { PERF_AST_SLOT_NODE, PERF_AST_SLOT_NONE },     // ExpressionStatement
+    { PERF_AST_SLOT_NONE, PERF_AST_SLOT_NONE },     // Param
+    { PERF_AST_SLOT_NODE, PERF_AST_SLOT_NONE },     // VarDecl
+    { PERF_AST_SLOT_LIST, PERF_AST_SLOT_NONE },     // Block
+    { PERF_AST_SLOT_NODE, PERF_AST_SLOT_LIST },     // If
+    { PERF_AST_SLOT_NODE, PERF_AST_SLOT_NODE },     // While
+    { PERF_AST_SLOT_NODE, PERF_AST_SLOT_NODE },     // DoWhile
+    { PERF_AST_SLOT_LIST, PERF_AST_SLOT_NONE },     // For
+    { PERF_AST_SLOT_NODE, PERF_AST_SLOT_NONE },     // Return
+    { PERF_AST_SLOT_NONE, PERF_AST_SLOT_NONE },     // Break
+    { PERF_AST_SLOT_NONE, PERF_AST_SLOT_NONE },     // Continue
+    { PERF_AST_SLOT_NONE, PERF_AST_SLOT_NONE },     // This
+    { PERF_AST_SLOT_LIST, PERF_AST_SLOT_NONE }      // ClassDef
+};
+
+// Implementation for ast.h perf_ast_init
+perf_result_t perf_ast_init(perf_ast_t *ast)
+{
+    // Zero everything, the arrays are allocated on first use.
+    memset(ast, 0, sizeof(perf_ast_t));
+
+    // Tokens are copied in unless the parser borrows an array.
+    ast->owns_tokens = true;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for ast.h perf_ast_add_node
+perf_result_t perf_ast_add_node(perf_ast_t *ast, perf_e_parser_node_type_t node_type, uint32_t token, uint32_t lhs, uint32_t rhs, uint32_t *index, const char** error)
+{
+    // Make room for the node
+    if (ast->node_count == ast->node_capacity)
+    {
+        if (perf_array_grow((void**)&ast->nodes, &ast->node_capacity, sizeof(perf_parser_node_t)) != PERF_RES_OK)
+        {
+            // Set the error
+            *error = "Failed to allocate memory for AST node";
+
+            // Return memory allocation failure result.
+            return PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+
+        ast->allocation_count++;
+    }
+
+    // Fill in the node
+    perf_parser_node_t* node = &ast->nodes[ast->node_count];
+    node->node_type     = (uint8_t)node_type;
+    node->flags         = 0;
+    node->reserved[0]   = 0;
+    node->reserved[1]   = 0;
+    node->token         = token;
+    node->lhs           = lhs;
+    node->rhs           = rhs;
+
+    // Output the index
+    *index = ast->node_count++;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for ast.h perf_ast_add_token
+perf_result_t perf_ast_add_token(perf_ast_t *ast, const perf_token_t *token, uint32_t *index, const char** error)
+{
+    // Make room for the token
+    if (ast->token_count == ast->token_capacity)
+    {
+        if (perf_array_grow((void**)&ast->tokens, &ast->token_capacity, sizeof(perf_token_t)) != PERF_RES_OK)
+        {
+            // Set the error
+            *error = "Failed to allocate memory for parser tokens";
+
+            // Return memory allocation failure result.
+            return PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+
+        ast->allocation_count++;
+    }
+
+    // Copy the token
+    ast->tokens[ast->token_count] = *token;
+
+    // Output the index
+    *index = ast->token_count++;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for ast.h perf_ast_add_list
+perf_result_t perf_ast_add_list(perf_ast_t *ast, const uint32_t *items, uint32_t count, uint32_t *index, const char** error)
+{
+    // Make room for the count and the items
+    while (ast->extra_capacity - ast->extra_count < count + 1)
+    {
+        if (perf_array_grow((void**)&ast->extra, &ast->extra_capacity, sizeof(uint32_t)) != PERF_RES_OK)
+        {
+            // Set the error
+            *error = "Failed to allocate memory for AST node";
+
+            // Return memory allocation failure result.
+            return PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+
+        ast->allocation_count++;
+    }
+
+    // Store the count, then the items.
+    ast->extra[ast->extra_count] = count;
+    if (count > 0) memcpy(&ast->extra[ast->extra_count + 1], items, (size_t)count * sizeof(uint32_t));
+
+    // Output the index
+    *index = ast->extra_count;
+    ast->extra_count += count + 1;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for ast.h perf_ast_add_statement
+perf_result_t perf_ast_add_statement(perf_ast_t *ast, uint32_t node, const char** error)
+{
+    // Make room for the statement
+    if (ast->statement_count == ast->statement_capacity)
+    {
+        if (perf_array_grow((void**)&ast->statements, &ast->statement_capacity, sizeof(uint32_t)) != PERF_RES_OK)
+        {
+            // Set the error
+            *error = "Failed to allocate AST nodes buffer";
+
+            // Return memory allocation failure result.
+            return PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+
+        ast->allocation_count++;
+    }
+
+    // Append the statement
+    ast->statements[ast->statement_count++] = node;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+/**
+ * @brief Makes sure one of the AST's arrays can hold the given number of items.
+ *
+ * @param items The array to grow, left untouched if the allocation fails.
+ * @param capacity The capacity of the array, in items.
+ * @param count The number of items it must hold.
+ * @param item_size The size of an item.
+ * @param allocation_count Incremented if the array had to be allocated.
+ *
+ * @return PERF_RES_OK if the array is large enough.
+*/
+static perf_result_t perf_ast_reserve_array(void **items, uint32_t *capacity, uint32_t count, size_t item_size, uint32_t *allocation_count)
+{
+    // Nothing to do if it is already large enough.
+    if (count <= *capacity) return PERF_RES_OK;
+
+    // Resize the array to exactly the count.
+    void* grown = realloc(*items, (size_t)count * item_size);
+
+    // Check if the array was resized successfully, the old array is still valid if not.
+    if (grown == NULL) return PERF_RES_MEMORY_ALLOC_FAIL;
+
+    // Use the resized array
+    *items      = grown;
+    *capacity   = count;
+    (*allocation_count)++;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for ast.h perf_ast_reserve
+perf_result_t perf_ast_reserve(perf_ast_t *ast, uint32_t node_count, uint32_t extra_count, uint32_t statement_count, const char** error)
+{
+    // Grow each array
+    if (perf_ast_reserve_array((void**)&ast->nodes, &ast->node_capacity, node_count, sizeof(perf_parser_node_t), &ast->allocation_count) != PERF_RES_OK
+        || perf_ast_reserve_array((void**)&ast->extra, &ast->extra_capacity, extra_count, sizeof(uint32_t), &ast->allocation_count) != PERF_RES_OK
+        || perf_ast_reserve_array((void**)&ast->statements, &ast->statement_capacity, statement_count, sizeof(uint32_t), &ast->allocation_count) != PERF_RES_OK)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for AST node";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+/**
+ * @brief Moves a child or list index of a placed node along with the nodes or lists.
+ *
+ * @param slot What the index refers to, a perf_e_ast_slot_t.
+ * @param value The index.
+ * @param node_base Added to node indices.
+ * @param extra_base Added to list indices.
+ *
+ * @return The moved index.
+*/
+static inline uint32_t perf_ast_relocate(uint8_t slot, uint32_t value, uint32_t node_base, uint32_t extra_base)
+{
+    // Missing children and tokens stay where they are.
+    if (value == PERF_AST_NONE || slot == PERF_AST_SLOT_NONE) return value;
+
+    // Move the index
+    return value + (slot == PERF_AST_SLOT_NODE ? node_base : extra_base);
+}
+
+// Implementation for ast.h perf_ast_place
+perf_result_t perf_ast_place(perf_ast_t *ast, const perf_ast_t *part, uint32_t node_base, uint32_t extra_base, uint32_t statement_base)
+{
+    // Copy the nodes, moving their children and lists along.
+    perf_parser_node_t* nodes = ast->nodes + node_base;
+    for (uint32_t idx = 0; idx < part->node_count; idx++)
+    {
+        // Copy the node
+        perf_parser_node_t node = part->nodes[idx];
+
+        // Move the children
+        const uint8_t* slots = perf_ast_node_slots[node.node_type];
+        node.lhs = perf_ast_relocate(slots[0], node.lhs, node_base, extra_base);
+        node.rhs = perf_ast_relocate(slots[1], node.rhs, node_base, extra_base);
+
+        // Output the node
+        nodes[idx] = node;
+    }
+
+    // Copy the lists, each a count followed by that many node indices.
+    uint32_t* extra = ast->extra + extra_base;
+    for (uint32_t idx = 0; idx < part->extra_count; )
+    {
+        // Copy the count
+        uint32_t count = part->extra[idx];
+        extra[idx++] = count;
+
+        // Move the items
+        for (uint32_t item = 0; item < count; item++, idx++)
+            extra[idx] = perf_ast_relocate(PERF_AST_SLOT_NODE, part->extra[idx], node_base, extra_base);
+    }
+
+    // Copy the statements
+    for (uint32_t idx = 0; idx < part->statement_count; idx++) ast->statements[statement_base + idx] = part->statements[idx] + node_base;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+/**
+ * @brief Prints a token the way it appears in the AST dump.
+ *
+ * @param lexer The lexer the token came from.
+ * @param token The token to print.
+ * @param is_signed True if an integer holds a signed value, as folded ones do.
+*/
+static void perf_ast_print_token(const perf_lexer_t *lexer, const perf_token_t *token, bool is_signed)
+{
+    // Print the type and location
+    printf(" %s %u:%u", token_map[token->type], token->line_number, token->column_number);
+
+    // Print the payload, if any.
+    switch (token->type)
+    {
+    case TOKEN_IDENTIFIER:
+    case TOKEN_STRING:
+    {
+        size_t length = 0;
+        const char* text = perf_lexer_token_text(lexer, token, &length);
+        printf(" '%.*s'", (int)length, text);
+        break;
+    }
+    case TOKEN_INTEGER:
+    {
+        if (is_signed) printf(" %lld", (long long)token->as.integer);
+        else printf(" %llu", (unsigned long long)token->as.integer);
+        break;
+    }
+    case TOKEN_NUMBER:  printf(" %.17g", token->as.number);                         break;
+    default:                                                                        break;
+    }
+}
+
+// Implementation for ast.h perf_ast_print
+perf_result_t perf_ast_print(const perf_ast_t *ast, const perf_lexer_t *lexer, uint32_t node)
+{
+    // Will store the nodes still to print, and how deep they are.
+    uint32_t  stack_count    = 0;
+    uint32_t  stack_capacity = 0;
+    uint32_t* stack          = NULL;
+
+    // Start with the given node, at depth 0.
+    if (perf_array_grow((void**)&stack, &stack_capacity, sizeof(uint32_t) * 2) != PERF_RES_OK) return PERF_RES_MEMORY_ALLOC_FAIL;
+    stack[stack_count * 2]     = node;
+    stack[stack_count * 2 + 1] = 0;
+    stack_count++;
+
+    while (stack_count > 0)
+    {
+        // Pop the next node
+        stack_count--;
+        const perf_parser_node_t* current = &ast->nodes[stack[stack_count * 2]];
+        uint32_t depth = stack[stack_count * 2 + 1];
+
+        // Print the node, indented by its depth.
+        printf("%*s%s", (int)(depth * 2), "", perf_ast_node_names[current->node_type]);
+        if (current->node_type == AST_VAR_DECL) printf(" %s", token_map[current->flags]);
+        bool folded = current->node_type == AST_CONSTANT && current->flags == PERF_AST_FOLDED;
+        if (folded) printf(" folded");
+        if (current->token != PERF_AST_NONE) perf_ast_print_token(lexer, &ast->tokens[current->token], folded);
+        printf("\n");
+
+        // Lists take as many stack entries as they have items, nodes one.
+        const uint8_t* slots = perf_ast_node_slots[current->node_type];
+        uint32_t lhs_count = slots[0] == PERF_AST_SLOT_LIST ? ast->extra[current->lhs] : 1;
+        uint32_t rhs_count = slots[1] == PERF_AST_SLOT_LIST ? ast->extra[current->rhs] : 1;
+
+        // Make room for the children
+        while (stack_count + lhs_count + rhs_count > stack_capacity)
+        {
+            if (perf_array_grow((void**)&stack, &stack_capacity, sizeof(uint32_t) * 2) != PERF_RES_OK)
+            {
+                free(stack);
+                return PERF_RES_MEMORY_ALLOC_FAIL;
+            }
+        }
+
+        // Push the children last to first, so they are printed first to last. Missing ones are skipped.
+        for (uint32_t slot = 2; slot > 0; slot--)
+        {
+            uint32_t value = slot == 2 ? current->rhs : current->lhs;
+            if (slots[slot - 1] == PERF_AST_SLOT_NONE || value == PERF_AST_NONE) continue;
+
+            // Single child nodes look like a list of one.
+            uint32_t        count = slots[slot - 1] == PERF_AST_SLOT_LIST ? ast->extra[value] : 1;
+            const uint32_t* items = slots[slot - 1] == PERF_AST_SLOT_LIST ? &ast->extra[value + 1] : &value;
+
+            for (uint32_t idx = count; idx > 0; idx--)
+            {
+                if (items[idx - 1] == PERF_AST_NONE) continue;
+
+                stack[stack_count * 2]     = items[idx - 1];
+                stack[stack_count * 2 + 1] = depth + 1;
+                stack_count++;
+            }
+        }
+    }
+
+    // Free the stack
+    free(stack);
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+/**
+ * @brief Claims a node as the child of another, checking it comes first and has no other parent.
+ *
+ * @param child The index of the child.
+ * @param parent The index of the parent.
+ * @param claimed One bit per node, set once the node has a parent.
+ *
+ * @return true if the node could be claimed.
+*/
+static bool perf_ast_claim(uint32_t child, uint32_t parent, uint8_t *claimed)
+{
+    // Children come before their parent, and belong to only one.
+    if (child >= parent || (claimed[child / 8] & (1u << (child % 8))) != 0) return false;
+
+    claimed[child / 8] |= (uint8_t)(1u << (child % 8));
+    return true;
+}
+
+/**
+ * @brief Checks that a list lies inside extra, and claims its items.
+ *
+ * @param ast The AST.
+ * @param list The index of the list.
+ * @param parent The index of the node the list belongs to.
+ * @param optional True if items may be PERF_AST_NONE.
+ * @param claimed One bit per node, set once the node has a parent.
+ *
+ * @return true if the list is inside extra and every item could be claimed.
+*/
+static bool perf_ast_claim_list(const perf_ast_t *ast, uint32_t list, uint32_t parent, bool optional, uint8_t *claimed)
+{
+    // The count and then that many items, all inside extra.
+    if (list >= ast->extra_count || ast->extra[list] > ast->extra_count - list - 1) return false;
+
+    for (uint32_t idx = 0; idx < ast->extra[list]; idx++)
+    {
+        uint32_t item = ast->extra[list + 1 + idx];
+        if (!(optional && item == PERF_AST_NONE) && !perf_ast_claim(item, parent, claimed)) return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Checks a child's type is one of two, for children the passes read as a certain type.
+ *
+ * @param ast The AST.
+ * @param child The index of the child, already claimed.
+ * @param type The expected type.
+ * @param other The other type allowed, the same as type if there isn't one.
+ *
+ * @return true if the child has one of the types.
+*/
+static inline bool perf_ast_is(const perf_ast_t *ast, uint32_t child, perf_e_parser_node_type_t type, perf_e_parser_node_type_t other)
+{
+    return ast->nodes[child].node_type == type || ast->nodes[child].node_type == other;
+}
+
+/**
+ * @brief Checks every token, node and statement of an AST, see perf_ast_verify.
+ *
+ * @param ast The AST to check.
+ * @param source_length The length of the source.
+ * @param claimed One bit per node, all clear.
+ *
+ * @return NULL if the AST is well formed, otherwise what is wrong with it.
+*/
+static const char* perf_ast_verify_nodes(const perf_ast_t *ast, uint64_t source_length, uint8_t *claimed)
+{
+    // Tokens have a known type, and identifiers and strings a span of the source.
+    for (uint32_t idx = 0; idx < ast->token_count; idx++)
+    {
+        const perf_token_t* token = &ast->tokens[idx];
+
+        if ((uint32_t)token->type > TOKEN_EOF) return "AST has a token of an unknown type";
+
+        if ((token->type == TOKEN_IDENTIFIER || token->type == TOKEN_STRING)
+            && ((uint64_t)token->as.span.offset > source_length || token->as.span.length > source_length - token->as.span.offset))
+            return "AST has a token whose text is outside the source";
+    }
+
+    for (uint32_t idx = 0; idx < ast->node_count; idx++)
+    {
+        const perf_parser_node_t* node = &ast->nodes[idx];
+
+        if (node->node_type > AST_CLASS_DEF) return "AST has a node of an unknown type";
+        if (node->token != PERF_AST_NONE && node->token >= ast->token_count) return "AST has a node whose token doesn't exist";
+
+        // The type of the node's token, TOKEN_SKIP if it has none as the parser never keeps one.
+        perf_e_token_type_t token = node->token == PERF_AST_NONE ? TOKEN_SKIP : ast->tokens[node->token].type;
+
+        // Each type has the token and children the parser gives it.
+        bool ok;
+
+        switch (node->node_type)
+        {
+        case AST_CONSTANT:
+            ok = (token == TOKEN_STRING || token == TOKEN_NUMBER || token == TOKEN_INTEGER || token == TOKEN_KEYWORD_TRUE || token == TOKEN_KEYWORD_FALSE)
+                && (node->flags == 0 || node->flags == PERF_AST_FOLDED);
+            break;
+
+        case AST_VARIABLE:
+        case AST_PARAM:
+            ok = token == TOKEN_IDENTIFIER;
+            break;
+
+        case AST_GROUP_EXPR:
+        case AST_EXPR_STATEMENT:
+            ok = perf_ast_claim(node->lhs, idx, claimed);
+            break;
+
+        case AST_UNARY_EXPR:
+            ok = (token == TOKEN_MINUS || token == TOKEN_EXCLAIM) && perf_ast_claim(node->lhs, idx, claimed);
+            break;
+
+        case AST_BINARY_EXPR:
+            ok = (token == TOKEN_PLUS || token == TOKEN_MINUS || token == TOKEN_ASTERISK || token == TOKEN_SLASH || token == TOKEN_PERCENT
+                || token == TOKEN_AMPERSAND || token == TOKEN_EQUAL_EQUAL || token == TOKEN_EXCLAIM_EQUAL || token == TOKEN_GREATER
+                || token == TOKEN_GREATER_EQUAL || token == TOKEN_LESS || token == TOKEN_LESS_EQUAL)
+                && perf_ast_claim(node->lhs, idx, claimed) && perf_ast_claim(node->rhs, idx, claimed);
+            break;
+
+        // Anything but a member is assigned to as a variable.
+        case AST_ASSIGN_EXPR:
+            ok = token != TOKEN_SKIP && perf_ast_claim(node->lhs, idx, claimed) && perf_ast_claim(node->rhs, idx, claimed)
+                && perf_ast_is(ast, node->lhs, AST_VARIABLE, AST_MEMBER_EXPR);
+            break;
+
+        case AST_CALL_EXPR:
+            ok = token != TOKEN_SKIP && perf_ast_claim(node->lhs, idx, claimed) && perf_ast_claim_list(ast, node->rhs, idx, false, claimed);
+            break;
+
+        case AST_MEMBER_EXPR:
+            ok = token == TOKEN_IDENTIFIER && perf_ast_claim(node->lhs, idx, claimed);
+            break;
+
+        // Parameters and the body block are read as such.
+        case AST_EXPR_FUNCTION_DEF:
+        {
+            ok = token == TOKEN_IDENTIFIER && perf_ast_claim_list(ast, node->lhs, idx, false, claimed)
+                && perf_ast_claim(node->rhs, idx, claimed) && perf_ast_is(ast, node->rhs, AST_BLOCK, AST_BLOCK);
+
+            for (uint32_t item = 0; ok && item < ast->extra[node->lhs]; item++)
+                ok = perf_ast_is(ast, ast->extra[node->lhs + 1 + item], AST_PARAM, AST_PARAM);
+            break;
+        }
+
+        case AST_VAR_DECL:
+            ok = token == TOKEN_IDENTIFIER && (node->flags == TOKEN_KEYWORD_VAR || node->flags == TOKEN_KEYWORD_LET || node->flags == TOKEN_KEYWORD_CONST)
+                && (node->lhs == PERF_AST_NONE || perf_ast_claim(node->lhs, idx, claimed));
+            break;
+
+        case AST_BLOCK:
+            ok = perf_ast_claim_list(ast, node->lhs, idx, false, claimed);
+            break;
+
+        // The then branch and an optional else branch.
+        case AST_IF_STMT:
+            ok = perf_ast_claim(node->lhs, idx, claimed) && perf_ast_claim_list(ast, node->rhs, idx, false, claimed)
+                && (ast->extra[node->rhs] == 1 || ast->extra[node->rhs] == 2);
+            break;
+
+        case AST_WHILE_STMT:
+        case AST_DO_WHILE_STMT:
+            ok = perf_ast_claim(node->lhs, idx, claimed) && perf_ast_claim(node->rhs, idx, claimed);
+            break;
+
+        // The init, condition, step and body, only the body is always there.
+        case AST_FOR_STMT:
+            ok = perf_ast_claim_list(ast, node->lhs, idx, true, claimed) && ast->extra[node->lhs] == 4 && ast->extra[node->lhs + 4] != PERF_AST_NONE;
+            break;
+
+        case AST_RETURN_STMT:
+            ok = token != TOKEN_SKIP && (node->lhs == PERF_AST_NONE || perf_ast_claim(node->lhs, idx, claimed));
+            break;
+
+        case AST_BREAK_STMT:
+        case AST_CONTINUE_STMT:
+        case AST_THIS_EXPR:
+            ok = token != TOKEN_SKIP;
+            break;
+
+        // Methods are read as functions.
+        default:
+        {
+            ok = token == TOKEN_IDENTIFIER && perf_ast_claim_list(ast, node->lhs, idx, false, claimed);
+
+            for (uint32_t item = 0; ok && item < ast->extra[node->lhs]; item++)
+                ok = perf_ast_is(ast, ast->extra[node->lhs + 1 + item], AST_EXPR_FUNCTION_DEF, AST_EXPR_FUNCTION_DEF);
+            break;
+        }
+        }
+
+        if (!ok) return "AST has a node the parser couldn't have built";
+    }
+
+    // Top level statements are nodes no other node contains.
+    for (uint32_t idx = 0; idx < ast->statement_count; idx++)
+        if (!perf_ast_claim(ast->statements[idx], ast->node_count, claimed)) return "AST has a statement that isn't a top level node";
+
+    return NULL;
+}
+
+// Implementation for ast.h perf_ast_verify
+perf_result_t perf_ast_verify(const perf_ast_t *ast, uint64_t source_length, const char** error)
+{
+    // Will store which nodes have a parent.
+    uint8_t* claimed = (uint8_t*)calloc((size_t)ast->node_count / 8 + 1, 1);
+
+    if (claimed == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for AST verifier";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Check everything
+    const char* message = perf_ast_verify_nodes(ast, source_length, claimed);
+    free(claimed);
+
+    if (message != NULL)
+    {
+        // Set the error
+        *error = message;
+
+        // Return parse error result.
+        return PERF_RES_PARSE_ERROR;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for ast.h perf_ast_free
+perf_result_t perf_ast_free(perf_ast_t *ast)
+{
+    // Free the arrays, every node goes at once.
+    free(ast->nodes);
+    free(ast->extra);
+    free(ast->statements);
+
+    // Only free tokens we copied in.
+    if (ast->owns_tokens) free(ast->tokens);
+
+    // Reset back to the initial state.
+    return perf_ast_init(ast);
+}
@@ -0,0 +1,1622 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/token.h"
+#include "../inc/intern.h"
+#include "../inc/lexer.h"
+#include "../inc/token_stream.h"
+#include "../inc/ast.h"
+#include "../inc/parser.h"
+#include "../inc/cache.h"
+#include "../inc/value.h"
+#include "../inc/heap.h"
+#include "../inc/fold.h"
+#include "../inc/program.h"
+#include "../inc/compiler.h"
+#include "../inc/module.h"
+#include "../inc/jit.h"
+#include "../inc/vm.h"
+#include "../inc/number.h"
+#include "../inc/pool.h"
+#include "../inc/source.h"
+#include "../inc/bench.h"
+
+#include <time.h>
+
+// Number of times each benchmark is repeated, the best round is reported.
+#define PERF_BENCH_ROUNDS           5
+
+// Most characters perf_bench_function writes: 12 statements of ~130 characters, plus the header and return.
+#define PERF_BENCH_FUNCTION_SIZE    2048
+
+// Most threads the lex benchmark runs the parallel lexer on.
+#define PERF_BENCH_LEX_MAX_THREADS  32
+
+// Number of strings longer than a chunk the lex benchmark's program has.
+#define PERF_BENCH_LONG_STRINGS     4
+
+/**
+ * @brief Generates the next pseudo random number (xorshift64).
+ *
+ * @param state The generator state, must not be zero.
+ *
+ * @return The next number.
+*/
+static uint64_t perf_bench_random(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * @brief Appends random digits to a buffer.
+ *
+ * @param out Where to write the digits.
+ * @param state The generator state.
+ * @param count The number of digits.
+ * @param digits The allowed digits.
+ * @param base The number of allowed digits.
+ *
+ * @return The number of characters written, including separators.
+*/
+static size_t perf_bench_digits(char* out, uint64_t* state, uint32_t count, const char* digits, uint32_t base)
+{
+    size_t length = 0;
+
+    for (uint32_t idx = 0; idx < count; idx++)
+    {
+        // Never start with a zero, it would look like a notation prefix.
+        uint32_t digit = (uint32_t)(perf_bench_random(state) % base);
+        if (idx == 0 && digit == 0) digit = 1;
+        out[length++] = digits[digit];
+
+        // Sprinkle in some separators, like real data files do.
+        if (idx + 1 < count && perf_bench_random(state) % 8 == 0) out[length++] = '_';
+    }
+
+    return length;
+}
+
+/**
+ * @brief Converts a literal the way the lexer used to, by copying it without separators to the heap.
+ *
+ * @param literal The literal to convert.
+ * @param length The length of the literal.
+ * @param bits The bits of the converted value.
+ *
+ * @return PERF_RES_OK if the literal was converted successfully.
+*/
+static perf_result_t perf_bench_number_reference(const char* literal, size_t length, uint64_t* bits)
+{
+    // Check for integer notation
+    int base = 10;
+    if (length > 2 && literal[0] == '0' && literal[1] == 'x') base = 16;
+    size_t offset = base == 10 ? 0 : 2;
+
+    // Copy the digits without separators
+    char* copy = (char*)malloc(length + 1);
+    if (copy == NULL) return PERF_RES_MEMORY_ALLOC_FAIL;
+
+    size_t copy_length = 0;
+    bool is_float = false;
+    for (size_t idx = offset; idx < length; idx++)
+    {
+        if (literal[idx] == '_') continue;
+        if (literal[idx] == '.') is_float = true;
+        copy[copy_length++] = literal[idx];
+    }
+    copy[copy_length] = '\x00';
+
+    // Convert it
+    if (is_float)
+    {
+        double value = strtod(copy, NULL);
+        memcpy(bits, &value, sizeof(double));
+    }
+    else *bits = strtoull(copy, NULL, base);
+
+    // Free the copy, the old lexer didn't.
+    free(copy);
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for bench.h perf_bench_now
+double perf_bench_now(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+// Implementation for bench.h perf_bench_numbers
+perf_result_t perf_bench_numbers(uint32_t literal_count, const char** error)
+{
+    // A literal is at most ~80 characters including separators, plus a separating space.
+    size_t capacity = (size_t)literal_count * 96 + 1;
+
+    // Allocate the corpus and the literal boundaries.
+    char*     corpus  = (char*)malloc(capacity);
+    uint32_t* starts  = (uint32_t*)malloc((size_t)literal_count * sizeof(uint32_t));
+    uint32_t* lengths = (uint32_t*)malloc((size_t)literal_count * sizeof(uint32_t));
+
+    // Check if the allocations failed.
+    if (corpus == NULL || starts == NULL || lengths == NULL)
+    {
+        free(corpus);
+        free(starts);
+        free(lengths);
+
+        // Set the error
+        *error = "Failed to allocate memory for benchmark corpus.";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Generate the corpus: short and long decimals, hex integers and floats of every length.
+    uint64_t state  = 0x9E3779B97F4A7C15ull;
+    size_t   length = 0;
+    uint32_t float_count = 0;
+
+    for (uint32_t idx = 0; idx < literal_count; idx++)
+    {
+        // Save where the literal starts
+        starts[idx] = (uint32_t)length;
+
+        // Pick a shape
+        switch (perf_bench_random(&state) % 8)
+        {
+        case 0:                                 // Small integer, e.g. a count or an index
+            length += perf_bench_digits(corpus + length, &state, 1 + (uint32_t)(perf_bench_random(&state) % 4), "0123456789", 10);
+            break;
+        case 1:                                 // Large integer, e.g. an id or a timestamp
+            length += perf_bench_digits(corpus + length, &state, 10 + (uint32_t)(perf_bench_random(&state) % 9), "0123456789", 10);
+            break;
+        case 2:                                 // Hex integer
+            corpus[length++] = '0';
+            corpus[length++] = 'x';
+            length += perf_bench_digits(corpus + length, &state, 1 + (uint32_t)(perf_bench_random(&state) % 16), "0123456789abcdef", 16);
+            break;
+        default:                                // Float with up to 40 significant digits
+            length += perf_bench_digits(corpus + length, &state, 1 + (uint32_t)(perf_bench_random(&state) % 8), "0123456789", 10);
+            corpus[length++] = '.';
+            length += perf_bench_digits(corpus + length, &state, 1 + (uint32_t)(perf_bench_random(&state) % 32), "0123456789", 10);
+            float_count++;
+            break;
+        }
+
+        // Save the length and separate the literals.
+        lengths[idx] = (uint32_t)(length - starts[idx]);
+        corpus[length++] = ' ';
+    }
+    corpus[length] = '\x00';
+
+    // Best time of each path.
+    double best_scan        = 1e30;
+    double best_reference   = 1e30;
+
+    // Checksums, so neither loop can be optimized away and the results can be compared.
+    uint64_t scan_sum       = 0;
+    uint64_t reference_sum  = 0;
+    uint32_t mismatches     = 0;
+
+    // Used to store the result of each path.
+    perf_result_t result = PERF_RES_OK;
+
+    for (uint32_t round = 0; round < PERF_BENCH_ROUNDS && result == PERF_RES_OK; round++)
+    {
+        // Time the single pass converter over the whole corpus.
+        double start = perf_bench_now();
+        scan_sum = 0;
+        const char* ch = corpus;
+        for (uint32_t idx = 0; idx < literal_count && result == PERF_RES_OK; idx++)
+        {
+            perf_token_t token;
+            result = perf_number_scan(ch, &ch, &token, error);
+            scan_sum += token.as.integer;
+            ch++;
+        }
+        double elapsed = perf_bench_now() - start;
+        if (elapsed < best_scan) best_scan = elapsed;
+
+        // Time the reference path.
+        start = perf_bench_now();
+        reference_sum = 0;
+        for (uint32_t idx = 0; idx < literal_count && result == PERF_RES_OK; idx++)
+        {
+            uint64_t bits;
+            result = perf_bench_number_reference(corpus + starts[idx], lengths[idx], &bits);
+            reference_sum += bits;
+        }
+        elapsed = perf_bench_now() - start;
+        if (elapsed < best_reference) best_reference = elapsed;
+    }
+
+    // Compare every literal once, outside the timed loops.
+    for (uint32_t idx = 0; idx < literal_count && result == PERF_RES_OK; idx++)
+    {
+        perf_token_t token;
+        const char*  end;
+        uint64_t     bits;
+        result = perf_number_scan(corpus + starts[idx], &end, &token, error);
+        if (result == PERF_RES_OK) result = perf_bench_number_reference(corpus + starts[idx], lengths[idx], &bits);
+        if (result == PERF_RES_OK && bits != token.as.integer) mismatches++;
+    }
+
+    // Report the results.
+    if (result == PERF_RES_OK)
+    {
+        double megabytes = (double)length / (1024.0 * 1024.0);
+        printf("Numbers: %u literals (%u floats), %.2f MB\n", literal_count, float_count, megabytes);
+        printf("  single pass:     %8.2f ms  %7.2f ns/literal  %8.2f MB/s\n",
+            best_scan * 1e3, best_scan * 1e9 / literal_count, megabytes / best_scan);
+        printf("  copy + strtod:   %8.2f ms  %7.2f ns/literal  %8.2f MB/s\n",
+            best_reference * 1e3, best_reference * 1e9 / literal_count, megabytes / best_reference);
+        printf("  speedup:         %8.2fx\n", best_reference / best_scan);
+        printf("  mismatches:      %u (checksums %s)\n", mismatches, scan_sum == reference_sum ? "match" : "differ");
+    }
+
+    // Free the corpus.
+    free(corpus);
+    free(starts);
+    free(lengths);
+
+    // Check for allocation failures in the reference path.
+    if (result == PERF_RES_MEMORY_ALLOC_FAIL) *error = "Failed to allocate memory for reference conversion.";
+
+    // Check that both paths agreed.
+    if (result == PERF_RES_OK && mismatches != 0)
+    {
+        // Set the error
+        *error = "Single pass conversion disagrees with strtod.";
+
+        // Return the error result.
+        return PERF_RES_LEX_ERROR;
+    }
+
+    // Return the result.
+    return result;
+}
+
+/**
+ * Names the generated program picks its variables and members from.
+*/
+static const char* perf_bench_names[] =
+{
+    "alpha", "beta", "count", "total", "index", "value", "result", "offset", "node", "item", "x", "y"
+};
+
+/**
+ * @brief Picks a random name for the generated program.
+ *
+ * @param state The generator state.
+ *
+ * @return The name.
+*/
+static const char* perf_bench_name(uint64_t* state)
+{
+    return perf_bench_names[perf_bench_random(state) % (sizeof(perf_bench_names) / sizeof(perf_bench_names[0]))];
+}
+
+/**
+ * @brief Appends a random statement to the generated program.
+ *
+ * @param out Where to write the statement.
+ * @param state The generator state.
+ *
+ * @return The number of characters written.
+*/
+static size_t perf_bench_statement(char* out, uint64_t* state)
+{
+    // Pick the names and constants up front, so every shape can use them.
+    const char* a = perf_bench_name(state);
+    const char* b = perf_bench_name(state);
+    const char* c = perf_bench_name(state);
+    uint32_t    k = (uint32_t)(perf_bench_random(state) % 1000);
+
+    switch (perf_bench_random(state) % 8)
+    {
+    case 0:  return (size_t)sprintf(out, "    let %s = %s * %u + %s %% 7;\n", a, b, k, c);
+    case 1:  return (size_t)sprintf(out, "    var %s = \"%s_%u\";\n", a, b, k);
+    case 2:  return (size_t)sprintf(out, "    if (%s > %s) { %s = %s - %u; } else { %s = %s.update(%s, %u.5); }\n", a, b, a, a, k, a, c, b, k);
+    case 3:  return (size_t)sprintf(out, "    while (%s < %u) { %s = %s + 1; if (%s == %s) break; }\n", a, k, a, a, a, b);
+    case 4:  return (size_t)sprintf(out, "    for (let i = 0; i < %u; i = i + 1) { %s = %s + i * 2.5; }\n", k, a, a);
+    case 5:  return (size_t)sprintf(out, "    %s.%s = -(%s + %u) / (%s - 1);\n", a, b, c, k, a);
+    case 6:  return (size_t)sprintf(out, "    const %s = helper(%s, !%s, %s.%s);\n", a, b, c, a, b);
+    default: return (size_t)sprintf(out, "    // Adjust %s by %u\n    %s = %s & 0x%x;\n", a, k, a, b, k);
+    }
+}
+
+/**
+ * @brief Appends a random function to the generated program.
+ *
+ * @param out Where to write the function, at most PERF_BENCH_FUNCTION_SIZE characters.
+ * @param index The index of the function, used for its name.
+ * @param state The generator state.
+ *
+ * @return The number of characters written.
+*/
+static size_t perf_bench_function(char* out, uint32_t index, uint64_t* state)
+{
+    // Write the header
+    size_t length = (size_t)sprintf(out, "func f%u(%s, %s, %s) {\n", index,
+        perf_bench_name(state), perf_bench_name(state), perf_bench_name(state));
+
+    // Write 4 to 12 random statements.
+    uint32_t statement_count = 4 + (uint32_t)(perf_bench_random(state) % 9);
+    for (uint32_t statement = 0; statement < statement_count; statement++)
+        length += perf_bench_statement(out + length, state);
+
+    // Write the return and close the function.
+    length += (size_t)sprintf(out + length, "    return f%u(%s, 1) + %s;\n}\n\n", index / 2,
+        perf_bench_name(state), perf_bench_name(state));
+
+    // Return the length
+    return length;
+}
+
+/**
+ * @brief Checks two ASTs have exactly the same nodes, lists and statements.
+ *
+ * @param a The first AST.
+ * @param b The second AST.
+ *
+ * @return true if they are the same.
+*/
+static bool perf_bench_same_ast(const perf_ast_t* a, const perf_ast_t* b)
+{
+    // Compare the counts first, then every array.
+    return a->node_count == b->node_count && a->extra_count == b->extra_count && a->statement_count == b->statement_count
+        && (a->node_count == 0 || memcmp(a->nodes, b->nodes, (size_t)a->node_count * sizeof(perf_parser_node_t)) == 0)
+        && (a->extra_count == 0 || memcmp(a->extra, b->extra, (size_t)a->extra_count * sizeof(uint32_t)) == 0)
+        && (a->statement_count == 0 || memcmp(a->statements, b->statements, (size_t)a->statement_count * sizeof(uint32_t)) == 0);
+}
+
+// Implementation for bench.h perf_bench_parse
+perf_result_t perf_bench_parse(uint32_t function_count, const char** error)
+{
+    // Allocate room for every function.
+    size_t capacity = (size_t)function_count * PERF_BENCH_FUNCTION_SIZE + 1;
+
+    // Allocate the program
+    char* program = (char*)malloc(capacity);
+
+    // Check if the allocation failed.
+    if (program == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for benchmark corpus.";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Generate the program: functions of 4 to 12 random statements.
+    uint64_t state  = 0x9E3779B97F4A7C15ull;
+    size_t   length = 0;
+
+    for (uint32_t idx = 0; idx < function_count; idx++) length += perf_bench_function(program + length, idx, &state);
+    program[length] = '\x00';
+
+    // Best time of each phase.
+    double best_lex     = 1e30;
+    double best_parse   = 1e30;
+    double best_stream  = 1e30;
+
+    // Counts, so neither loop can be optimized away.
+    uint64_t token_count = 0;
+    uint32_t node_count  = 0;
+
+    // What the AST allocated, and the bytes it reserved per source line.
+    uint32_t allocation_count   = 0;
+    double   line_bytes         = 0.0;
+
+    // Bytes the token stream holds per token.
+    double   stream_bytes       = 0.0;
+
+    // Used to store the result of each round.
+    perf_result_t result = PERF_RES_OK;
+
+    for (uint32_t round = 0; round < PERF_BENCH_ROUNDS && result == PERF_RES_OK; round++)
+    {
+        // Time the lexer on its own.
+        perf_lexer_t lexer;
+        perf_lexer_init(&lexer);
+        perf_lexer_begin(&lexer, program);
+
+        double start = perf_bench_now();
+        perf_token_t token;
+        token_count = 0;
+        do
+        {
+            result = perf_lexer_next(&lexer, &token, error);
+            token_count++;
+        } while (result == PERF_RES_OK && token.type != TOKEN_EOF);
+        double elapsed = perf_bench_now() - start;
+        if (elapsed < best_lex) best_lex = elapsed;
+
+        perf_lexer_free(&lexer);
+
+        // Time the parser pulling tokens from a fresh lexer.
+        perf_parser_t parser;
+        perf_ast_t    ast;
+        perf_lexer_init(&lexer);
+        if (result == PERF_RES_OK) result = perf_parser_init(&parser, &lexer, error);
+
+        if (result == PERF_RES_OK)
+        {
+            start = perf_bench_now();
+            result = perf_parser_parse(&parser, program, &ast, error);
+            elapsed = perf_bench_now() - start;
+            if (elapsed < best_parse) best_parse = elapsed;
+
+            // A failed parse leaves nothing to compare the stream against.
+            if (result != PERF_RES_OK) perf_ast_free(&ast);
+
+            node_count          = ast.node_count;
+            allocation_count    = ast.allocation_count;
+            line_bytes          = ((double)ast.node_capacity * sizeof(perf_parser_node_t) + (double)ast.token_capacity * sizeof(perf_token_t)
+                + (double)ast.extra_capacity * sizeof(uint32_t) + (double)ast.statement_capacity * sizeof(uint32_t)) / (double)(lexer.line_number + 1);
+            perf_parser_free(&parser);
+        }
+
+        perf_lexer_free(&lexer);
+
+        // Time lexing into a token stream and parsing that, on a fresh lexer.
+        perf_token_stream_t stream;
+        perf_ast_t          stream_ast;
+        perf_token_stream_init(&stream);
+        perf_ast_init(&stream_ast);
+        perf_lexer_init(&lexer);
+
+        if (result == PERF_RES_OK)
+        {
+            result = perf_parser_init(&parser, &lexer, error);
+
+            start = perf_bench_now();
+            if (result == PERF_RES_OK) result = perf_token_stream_digest(&stream, &lexer, program, error);
+            if (result == PERF_RES_OK) result = perf_parser_digest_stream(&parser, &stream, &stream_ast, error);
+            elapsed = perf_bench_now() - start;
+            if (elapsed < best_stream) best_stream = elapsed;
+
+            // Check the AST is exactly the pulled one.
+            if (result == PERF_RES_OK && (!perf_bench_same_ast(&stream_ast, &ast) || stream_ast.token_count != ast.token_count))
+            {
+                *error = "Parsing the token stream built a different AST than pulling tokens.";
+                result = PERF_RES_PARSE_ERROR;
+            }
+
+            stream_bytes = ((double)stream.count * (sizeof(uint8_t) + sizeof(uint32_t)) + (double)stream.literal_count * sizeof(perf_token_literal_t)) / (double)stream.count;
+            perf_ast_free(&stream_ast);
+            perf_ast_free(&ast);
+            perf_parser_free(&parser);
+        }
+
+        perf_token_stream_free(&stream);
+        perf_lexer_free(&lexer);
+    }
+
+    // Report the results.
+    if (result == PERF_RES_OK)
+    {
+        double megabytes  = (double)length / (1024.0 * 1024.0);
+        double throughput = megabytes / best_parse;
+        printf("Parse: %u functions, %.2f MB, %llu tokens, %u nodes\n", function_count, megabytes, (unsigned long long)token_count, node_count);
+        printf("  lex only:        %8.2f ms  %7.2f ns/token  %8.2f MB/s\n",
+            best_lex * 1e3, best_lex * 1e9 / (double)token_count, megabytes / best_lex);
+        printf("  lex + parse:     %8.2f ms  %7.2f ns/token  %8.2f MB/s\n",
+            best_parse * 1e3, best_parse * 1e9 / (double)token_count, throughput);
+        printf("  token stream:    %8.2f ms  %7.2f ns/token  %8.2f MB/s  %5.1f bytes/token (%zu as structs)\n",
+            best_stream * 1e3, best_stream * 1e9 / (double)token_count, megabytes / best_stream, stream_bytes, sizeof(perf_token_t));
+        printf("  target:          %8.2f MB/s (%s)\n", PERF_BENCH_PARSE_TARGET, throughput >= PERF_BENCH_PARSE_TARGET ? "met" : "missed");
+        printf("  ast memory:      %8u allocations  %7.1f bytes/line reserved\n", allocation_count, line_bytes);
+    }
+
+    // Free the program.
+    free(program);
+
+    // Return the result.
+    return result;
+}
+
+/**
+ * @brief Hashes a token stream, text by value, so streams from different lexers can be compared.
+ *
+ * @param lexer The lexer that produced the tokens.
+ * @param tokens The tokens.
+ * @param token_count The number of tokens.
+ *
+ * @return The hash of the stream.
+*/
+static uint64_t perf_bench_hash_tokens(const perf_lexer_t* lexer, const perf_token_t* tokens, int32_t token_count)
+{
+    // FNV offset basis
+    uint64_t hash = 14695981039346656037ull;
+
+    for (int32_t idx = 0; idx < token_count; idx++)
+    {
+        // Get the token
+        const perf_token_t* token = &tokens[idx];
+
+        // Mix in the type and location.
+        uint64_t fields[3] = { (uint64_t)token->type, token->line_number, token->column_number };
+
+        // Mix in the payload, text by value.
+        size_t      length  = 0;
+        const char* text    = NULL;
+        if (token->type == TOKEN_IDENTIFIER || token->type == TOKEN_STRING) text = perf_lexer_token_text(lexer, token, &length);
+        else if (token->type == TOKEN_INTEGER || token->type == TOKEN_NUMBER)
+        {
+            text    = (const char*)&token->as.integer;
+            length  = sizeof(token->as.integer);
+        }
+
+        for (size_t field = 0; field < 3; field++) hash = (hash ^ fields[field]) * 1099511628211ull;
+        for (size_t byte = 0; byte < length; byte++) hash = (hash ^ (uint8_t)text[byte]) * 1099511628211ull;
+    }
+
+    // Return the hash
+    return hash;
+}
+
+/**
+ * @brief Appends a block comment over several lines to the generated program, with quotes and a line comment
+ * inside it, so chunks of the parallel lexer can start inside it.
+ *
+ * @param out Where to write the comment, at most PERF_BENCH_FUNCTION_SIZE characters.
+ * @param state The generator state.
+ *
+ * @return The number of characters written.
+*/
+static size_t perf_bench_block_comment(char* out, uint64_t* state)
+{
+    // Write the opening line
+    size_t length = (size_t)sprintf(out, "/*\n * Notes on %s\n", perf_bench_name(state));
+
+    // Write 2 to 9 lines, some of which look like code.
+    uint32_t line_count = 2 + (uint32_t)(perf_bench_random(state) % 8);
+
+    for (uint32_t line = 0; line < line_count; line++)
+    {
+        switch (perf_bench_random(state) % 3)
+        {
+        case 0:  length += (size_t)sprintf(out + length, " * %s = \"%s\"; // not a string\n", perf_bench_name(state), perf_bench_name(state)); break;
+        case 1:  length += (size_t)sprintf(out + length, " * let %s = 0x%x;\n", perf_bench_name(state), (uint32_t)(perf_bench_random(state) % 4096)); break;
+        default: length += (size_t)sprintf(out + length, " *\n");                                                                                 break;
+        }
+    }
+
+    // Close the comment
+    length += (size_t)sprintf(out + length, " */\n\n");
+
+    // Return the length
+    return length;
+}
+
+/**
+ * @brief Appends a declaration of a string longer than a chunk to the generated program, over many lines that
+ * look like code and comments, so chunks of the parallel lexer can start and end inside it.
+ *
+ * @param out Where to write the declaration, at most size plus 64 characters.
+ * @param index Used for the variable's name.
+ * @param size The length of the string.
+ *
+ * @return The number of characters written.
+*/
+static size_t perf_bench_long_string(char* out, uint32_t index, size_t size)
+{
+    // Write the start of the declaration
+    size_t length = (size_t)sprintf(out, "let text%u = \"", index);
+    size_t end    = length + size;
+
+    // Fill it with lines, none of them ending it.
+    for (uint32_t line = 0; length < end; line++)
+    {
+        switch (line % 3)
+        {
+        case 0:  length += (size_t)sprintf(out + length, "/* line %u of the text\n", line);     break;
+        case 1:  length += (size_t)sprintf(out + length, "let x = %u; // still text\n", line);  break;
+        default: length += (size_t)sprintf(out + length, " */ func f%u() {}\n", line);         break;
+        }
+    }
+
+    // End the string and the declaration
+    length += (size_t)sprintf(out + length, "\";\n\n");
+
+    // Return the length
+    return length;
+}
+
+// Implementation for bench.h perf_bench_lex
+perf_result_t perf_bench_lex(uint32_t megabytes, const char** error)
+{
+    // Strings half as long again as the chunks cut for the most threads, or the smallest chunks if those are larger.
+    size_t size         = (size_t)megabytes * 1024 * 1024;
+    size_t chunk_size   = size / (PERF_BENCH_LEX_MAX_THREADS * PERF_LEXER_PARALLEL_CHUNKS_PER_THREAD);
+    size_t string_size  = (chunk_size > PERF_LEXER_PARALLEL_MIN_CHUNK ? chunk_size : PERF_LEXER_PARALLEL_MIN_CHUNK) * 3 / 2;
+
+    // Allocate the program, with room for the function, comment and string that cross the size.
+    char*  program  = (char*)malloc(size + 2 * PERF_BENCH_FUNCTION_SIZE + string_size + 128);
+
+    // Check if the allocation failed.
+    if (program == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for benchmark corpus.";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Generate functions until the program is large enough, with block comments between some of them and a
+    // string longer than a chunk every so often, so the parallel lexer has chunks starting inside both to redo.
+    uint64_t state          = 0x9E3779B97F4A7C15ull;
+    size_t   length         = 0;
+    size_t   next_string    = size / (2 * PERF_BENCH_LONG_STRINGS);
+    uint32_t function_count = 0;
+    uint32_t string_count   = 0;
+
+    while (length < size)
+    {
+        length += perf_bench_function(program + length, function_count++, &state);
+
+        if (function_count % 8 == 0) length += perf_bench_block_comment(program + length, &state);
+
+        if (length >= next_string && length < size)
+        {
+            length      += perf_bench_long_string(program + length, string_count++, string_size);
+            next_string += size / PERF_BENCH_LONG_STRINGS;
+        }
+    }
+
+    program[length] = '\x00';
+
+    // Used to store the result of each round.
+    perf_result_t result = PERF_RES_OK;
+
+    // Time the serial lexer, and keep a hash of its output to check every parallel run against.
+    double   best_serial    = 1e30;
+    uint64_t serial_hash    = 0;
+    int32_t  serial_count   = 0;
+
+    for (uint32_t round = 0; round < PERF_BENCH_ROUNDS && result == PERF_RES_OK; round++)
+    {
+        perf_lexer_t  lexer;
+        perf_token_t* tokens = NULL;
+        perf_lexer_init(&lexer);
+
+        double start = perf_bench_now();
+        result = perf_lexer_digest(&lexer, program, &tokens, &serial_count, error);
+        double elapsed = perf_bench_now() - start;
+        if (elapsed < best_serial) best_serial = elapsed;
+
+        if (result == PERF_RES_OK && round == 0) serial_hash = perf_bench_hash_tokens(&lexer, tokens, serial_count);
+
+        free(tokens);
+        perf_lexer_free(&lexer);
+    }
+
+    // Report the serial lexer.
+    double megabytes_lexed = (double)length / (1024.0 * 1024.0);
+    if (result == PERF_RES_OK)
+    {
+        printf("Lex: %u functions, %u long strings, %.2f MB, %d tokens, %u processors\n", function_count, string_count, megabytes_lexed, serial_count, perf_pool_cpu_count());
+        printf("  serial:          %8.2f ms  %8.2f MB/s\n", best_serial * 1e3, megabytes_lexed / best_serial);
+    }
+
+    // Time the parallel lexer on 1 to 32 threads.
+    for (uint32_t threads = 1; threads <= PERF_BENCH_LEX_MAX_THREADS && result == PERF_RES_OK; threads *= 2)
+    {
+        double best = 1e30;
+
+        for (uint32_t round = 0; round < PERF_BENCH_ROUNDS && result == PERF_RES_OK; round++)
+        {
+            perf_lexer_t  lexer;
+            perf_token_t* tokens        = NULL;
+            int32_t       token_count   = 0;
+            perf_lexer_init(&lexer);
+
+            double start = perf_bench_now();
+            result = perf_lexer_digest_parallel(&lexer, program, length, threads, &tokens, &token_count, error);
+            double elapsed = perf_bench_now() - start;
+            if (elapsed < best) best = elapsed;
+
+            // Check the output is exactly the serial lexer's.
+            if (result == PERF_RES_OK && round == 0 && (token_count != serial_count || perf_bench_hash_tokens(&lexer, tokens, token_count) != serial_hash))
+            {
+                // Set the error
+                *error = "Parallel lexer output differs from the serial lexer.";
+
+                // Set the error result.
+                result = PERF_RES_LEX_ERROR;
+            }
+
+            free(tokens);
+            perf_lexer_free(&lexer);
+        }
+
+        if (result == PERF_RES_OK)
+            printf("  %2u threads:      %8.2f ms  %8.2f MB/s  %5.2fx\n", threads, best * 1e3, megabytes_lexed / best, best_serial / best);
+    }
+
+    // Free the program.
+    free(program);
+
+    // Return the result.
+    return result;
+}
+
+// Implementation for bench.h perf_bench_parse_parallel
+perf_result_t perf_bench_parse_parallel(uint32_t function_count, const char** error)
+{
+    // Allocate room for every function.
+    char* program = (char*)malloc((size_t)function_count * PERF_BENCH_FUNCTION_SIZE + 1);
+
+    // Check if the allocation failed.
+    if (program == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for benchmark corpus.";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Generate the program, the same one perf_bench_parse uses.
+    uint64_t state  = 0x9E3779B97F4A7C15ull;
+    size_t   length = 0;
+
+    for (uint32_t idx = 0; idx < function_count; idx++) length += perf_bench_function(program + length, idx, &state);
+    program[length] = '\x00';
+
+    // Lex it once, every run parses the same tokens.
+    perf_lexer_t  lexer;
+    perf_parser_t parser;
+    perf_token_t* tokens        = NULL;
+    int32_t       token_count   = 0;
+    perf_lexer_init(&lexer);
+
+    perf_result_t result = perf_lexer_digest(&lexer, program, &tokens, &token_count, error);
+    if (result == PERF_RES_OK) result = perf_parser_init(&parser, &lexer, error);
+
+    // Time the serial parser, and keep its AST to check every parallel run against.
+    perf_ast_t serial_ast;
+    double     best_serial = 1e30;
+    perf_ast_init(&serial_ast);
+
+    for (uint32_t round = 0; round < PERF_BENCH_ROUNDS && result == PERF_RES_OK; round++)
+    {
+        perf_ast_free(&serial_ast);
+
+        double start = perf_bench_now();
+        result = perf_parser_digest(&parser, tokens, token_count, &serial_ast, error);
+        double elapsed = perf_bench_now() - start;
+        if (elapsed < best_serial) best_serial = elapsed;
+    }
+
+    // Report the serial parser.
+    if (result == PERF_RES_OK)
+    {
+        printf("Parse: %u functions, %d tokens, %u nodes, %u processors\n", function_count, token_count, serial_ast.node_count, perf_pool_cpu_count());
+        printf("  serial:          %8.2f ms  %7.2f ns/token\n", best_serial * 1e3, best_serial * 1e9 / (double)token_count);
+    }
+
+    // Time the parallel parser on 1 to 32 threads.
+    for (uint32_t threads = 1; threads <= 32 && result == PERF_RES_OK; threads *= 2)
+    {
+        double best = 1e30;
+
+        for (uint32_t round = 0; round < PERF_BENCH_ROUNDS && result == PERF_RES_OK; round++)
+        {
+            perf_ast_t ast;
+
+            double start = perf_bench_now();
+            result = perf_parser_digest_parallel(&parser, tokens, token_count, threads, &ast, error);
+            double elapsed = perf_bench_now() - start;
+            if (elapsed < best) best = elapsed;
+
+            // Check the AST is exactly the serial parser's.
+            if (result == PERF_RES_OK && !perf_bench_same_ast(&ast, &serial_ast))
+            {
+                // Set the error
+                *error = "Parallel parser AST differs from the serial parser.";
+
+                // Set the error result.
+                result = PERF_RES_PARSE_ERROR;
+            }
+
+            perf_ast_free(&ast);
+        }
+
+        if (result == PERF_RES_OK)
+            printf("  %2u threads:      %8.2f ms  %7.2f ns/token  %5.2fx\n", threads, best * 1e3, best * 1e9 / (double)token_count, best_serial / best);
+    }
+
+    // Free everything
+    perf_ast_free(&serial_ast);
+    perf_parser_free(&parser);
+    perf_lexer_free(&lexer);
+    free(tokens);
+    free(program);
+
+    // Return the result.
+    return result;
+}
+
+/**
+ * Represents a program the VM benchmark runs.
+*/
+typedef struct _perf_bench_vm_program_t
+{
+    const char* name;       // Name to report
+    const char* source;     // Source, the script returns a value every run must agree on
+} perf_bench_vm_program_t;
+
+/**
+ * Programs the VM benchmark runs.
+*/
+static const perf_bench_vm_program_t perf_bench_vm_programs[] =
+{
+    { "loop",       "func run(n) { let sum = 0; for (let i = 0; i < n; i = i + 1) { sum = sum + i; } return sum; }\n"
+                    "return run(10000000);" },
+    { "arithmetic", "func run(n) { let x = 1; let i = 0; while (i < n) { x = (x * 31 + i) % 1000003 - (x & 255) + i / 7; i = i + 1; } return x; }\n"
+                    "return run(3000000);" },
+    { "nested",     "func run(n) { let count = 0; for (let i = 0; i < n; i = i + 1) { for (let j = 0; j < n; j = j + 1) { if ((i + j) % 3 == 0) count = count + 1; } } return count; }\n"
+                    "return run(2000);" },
+    { "numeric",    "func run(n) { let x = 0.5; let k = 1.0; let sum = 0.0; for (let i = 0; i < n; i = i + 1) { x = x * 0.999 + 0.25; sum = sum + x / k; k = k + 1.0; } return sum; }\n"
+                    "return run(5000000);" },
+    { "calls",      "func fib(n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }\n"
+                    "return fib(30);" },
+};
+
+/**
+ * Programs the VM benchmark checks but doesn't time, their branches on equal, mixed and signed zero numbers are
+ * where the JIT's templates and the interpreter are easiest to get out of step. Each returns its outcomes folded
+ * into one value, and the functions under test don't call so the JIT compiles them.
+*/
+static const perf_bench_vm_program_t perf_bench_vm_checks[] =
+{
+    { "equality",   "func both(a, b) { let e = a == b; let n = a != b; let r = 0; if (e) r = r + 1; if (n) r = r + 2; if (a == b) r = r + 4; if (a != b) r = r + 8; return r; }\n"
+                    "func mix(r, x) { return (r * 16 + x) % 1000000007; }\n"
+                    "func run() { let r = 0;\n"
+                    "r = mix(r, both(1.5, 1.5)); r = mix(r, both(1.5, 2.5)); r = mix(r, both(0.0, -0.0)); r = mix(r, both(-0.0, 0.0));\n"
+                    "r = mix(r, both(0.1 + 0.2, 0.3)); r = mix(r, both(1, 1)); r = mix(r, both(1, 2)); r = mix(r, both(1, 1.0));\n"
+                    "r = mix(r, both(2.0, 2)); r = mix(r, both(\"ab\", \"ab\")); r = mix(r, both(\"ab\", \"ba\"));\n"
+                    "r = mix(r, both(true, true)); r = mix(r, both(true, false)); r = mix(r, both(true, 1)); return r; }\n"
+                    "return run();" },
+    { "ordering",   "func lt(a, b) { if (a < b) return 1; return 0; }\n"
+                    "func le(a, b) { if (a <= b) return 1; return 0; }\n"
+                    "func gt(a, b) { if (a > b) return 1; return 0; }\n"
+                    "func ge(a, b) { if (a >= b) return 1; return 0; }\n"
+                    "func all(a, b) { return lt(a, b) * 8 + le(a, b) * 4 + gt(a, b) * 2 + ge(a, b); }\n"
+                    "func run() { let r = 0;\n"
+                    "r = r * 16 + all(1.5, 1.5); r = r * 16 + all(1.5, 2.5); r = r * 16 + all(2.5, 1.5); r = r * 16 + all(0.0, -0.0);\n"
+                    "r = r * 16 + all(-1.5, 1); r = r * 16 + all(1, 1.0); r = r * 16 + all(3, 2); r = r * 16 + all(2, 3);\n"
+                    "r = r * 16 + all(-2, -2); return r; }\n"
+                    "return run();" },
+    { "loops",      "func run() { let n = 0; let x = 0.0; while (x != 5.0) { x = x + 0.5; n = n + 1; }\n"
+                    "for (let i = 0.0; i < 3.0; i = i + 0.25) { if (i == 1.5) n = n + 100; if (i != 2.0) n = n + 1000; }\n"
+                    "let y = 10.0; while (y >= 0.0) { if (y == 0.0) n = n + 10000; y = y - 2.5; } return n; }\n"
+                    "return run();" },
+    { "strings",    "func pick(n) { if (n == 0) return \"tab\\tquote\\\"back\\\\slash\\nnul\\0end\"; return \"\\r\\'\"; }\n"
+                    "return pick(0);" },
+};
+
+/**
+ * @brief Runs a check program as stack code and as register code on every dispatch, the JIT compiling every
+ * function on its first call, and checks every run returns the same value.
+ *
+ * @param vm The VM to use.
+ * @param source The source of the program.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if every run agreed, PERF_RES_RUNTIME_ERROR if one didn't.
+*/
+static perf_result_t perf_bench_vm_check(perf_vm_t* vm, const char* source, const char** error)
+{
+    // Parse the program
+    perf_lexer_t    lexer;
+    perf_parser_t   parser;
+    perf_ast_t      ast;
+    perf_lexer_init(&lexer);
+    perf_ast_init(&ast);
+
+    perf_result_t result = perf_parser_init(&parser, &lexer, error);
+    if (result == PERF_RES_OK) result = perf_parser_parse(&parser, source, &ast, error);
+
+    // Compile it to stack code and to register code.
+    perf_compiler_t compiler;
+    perf_program_t  stack;
+    perf_program_t  registers;
+    perf_program_init(&stack);
+    perf_program_init(&registers);
+
+    if (result == PERF_RES_OK) result = perf_compiler_init(&compiler, &lexer, error);
+
+    if (result == PERF_RES_OK)
+    {
+        result = perf_compiler_compile(&compiler, &ast, &stack, error);
+
+        compiler.format = PERF_PROGRAM_FORMAT_REGISTER;
+        if (result == PERF_RES_OK) result = perf_compiler_compile(&compiler, &ast, &registers, error);
+
+        perf_compiler_free(&compiler);
+    }
+
+    // The stack code on the switch is what every other run must return.
+    perf_value_t expected;
+    perf_value_t value;
+
+    vm->dispatch = PERF_VM_DISPATCH_SWITCH;
+    if (result == PERF_RES_OK) result = perf_vm_run(vm, &stack, &expected, error);
+
+    // Run the rest
+    static const perf_e_vm_dispatch_t dispatches[] =
+    {
+        PERF_VM_DISPATCH_THREADED,
+        PERF_VM_DISPATCH_SWITCH,
+        PERF_VM_DISPATCH_THREADED,
+#if PERF_JIT_ENABLED
+        PERF_VM_DISPATCH_JIT,
+#endif
+    };
+
+#if PERF_JIT_ENABLED
+    // Compile every function the first time it's called, so the JIT runs all of the program.
+    uint32_t threshold  = vm->jit.threshold;
+    vm->jit.threshold   = 1;
+#endif
+
+    for (uint32_t idx = 0; idx < sizeof(dispatches) / sizeof(dispatches[0]) && result == PERF_RES_OK; idx++)
+    {
+        vm->dispatch = dispatches[idx];
+        result = perf_vm_run(vm, idx == 0 ? &stack : &registers, &value, error);
+
+        // Check the value is the stack code's.
+        if (result == PERF_RES_OK && !perf_value_identical(value, expected))
+        {
+            // Set the error
+            *error = vm->dispatch == PERF_VM_DISPATCH_JIT ? "JIT run returned a different value than the interpreter." : "VM runs returned different values.";
+
+            // Set the error result.
+            result = PERF_RES_RUNTIME_ERROR;
+        }
+    }
+
+#if PERF_JIT_ENABLED
+    vm->jit.threshold = threshold;
+#endif
+
+    // Free everything, the lexer last as the programs refer to its strings.
+    perf_program_free(&stack);
+    perf_program_free(&registers);
+    perf_ast_free(&ast);
+    perf_parser_free(&parser);
+    perf_lexer_free(&lexer);
+
+    // Return the result.
+    return result;
+}
+
+/**
+ * @brief Runs a check program lexed in each lexer mode, and checks both runs return the same value, so escape
+ * sequences and names mean the same whether tokens are interned or refer to the source.
+ *
+ * @param vm The VM to use.
+ * @param source The source of the program.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if both runs agreed, PERF_RES_RUNTIME_ERROR if they didn't.
+*/
+static perf_result_t perf_bench_vm_check_modes(perf_vm_t* vm, const char* source, const char** error)
+{
+    static const perf_e_lexer_mode_t modes[2] = { PERF_LEXER_MODE_INTERN, PERF_LEXER_MODE_ZERO_COPY };
+
+    perf_lexer_t    lexers[2];
+    perf_program_t  programs[2];
+    perf_value_t    values[2];
+    perf_result_t   result = PERF_RES_OK;
+
+    vm->dispatch = PERF_VM_DISPATCH_SWITCH;
+
+    for (uint32_t idx = 0; idx < 2; idx++)
+    {
+        perf_lexer_init(&lexers[idx]);
+        perf_program_init(&programs[idx]);
+        lexers[idx].mode = modes[idx];
+
+        if (result != PERF_RES_OK) continue;
+
+        // Parse, compile and run it
+        perf_parser_t   parser;
+        perf_ast_t      ast;
+        perf_compiler_t compiler;
+        perf_ast_init(&ast);
+
+        result = perf_parser_init(&parser, &lexers[idx], error);
+        if (result == PERF_RES_OK) result = perf_parser_parse(&parser, source, &ast, error);
+        if (result == PERF_RES_OK) result = perf_compiler_init(&compiler, &lexers[idx], error);
+
+        if (result == PERF_RES_OK)
+        {
+            result = perf_compiler_compile(&compiler, &ast, &programs[idx], error);
+            perf_compiler_free(&compiler);
+        }
+
+        if (result == PERF_RES_OK) result = perf_vm_run(vm, &programs[idx], &values[idx], error);
+
+        perf_ast_free(&ast);
+        perf_parser_free(&parser);
+    }
+
+    // Check the values are the same, strings by their contents as they come from different interners.
+    if (result == PERF_RES_OK && !perf_value_equal(values[0], values[1]))
+    {
+        // Set the error
+        *error = "Runs lexed with and without zero copy returned different values.";
+
+        // Set the error result.
+        result = PERF_RES_RUNTIME_ERROR;
+    }
+
+    // Free everything, the lexers last as the programs refer to their strings.
+    for (uint32_t idx = 0; idx < 2; idx++)
+    {
+        perf_program_free(&programs[idx]);
+        perf_lexer_free(&lexers[idx]);
+    }
+
+    // Return the result.
+    return result;
+}
+
+/**
+ * @brief Times a program on the VM, keeping the best of PERF_BENCH_ROUNDS runs.
+ *
+ * @param vm The VM to use.
+ * @param program The program to run.
+ * @param dispatch How the VM dispatches instructions.
+ * @param best The best time, in seconds.
+ * @param value The value the script returned.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if every run succeeded.
+*/
+static perf_result_t perf_bench_vm_time(perf_vm_t* vm, const perf_program_t* program, perf_e_vm_dispatch_t dispatch, double* best, perf_value_t* value, const char** error)
+{
+    perf_result_t result = PERF_RES_OK;
+
+    vm->dispatch = dispatch;
+    *best        = 1e30;
+
+    for (uint32_t round = 0; round < PERF_BENCH_ROUNDS && result == PERF_RES_OK; round++)
+    {
+        double start = perf_bench_now();
+        result = perf_vm_run(vm, program, value, error);
+        double elapsed = perf_bench_now() - start;
+        if (elapsed < *best) *best = elapsed;
+    }
+
+    // Return the result.
+    return result;
+}
+
+// Implementation for bench.h perf_bench_vm
+perf_result_t perf_bench_vm(const char** error)
+{
+    perf_vm_t vm;
+    perf_result_t result = perf_vm_init(&vm, error);
+
+    if (result == PERF_RES_OK)
+        printf("VM: best of %u rounds, %u-byte values, threaded dispatch %s\n", PERF_BENCH_ROUNDS, (uint32_t)sizeof(perf_value_t),
+            PERF_VM_THREADED ? "available" : "unavailable, both rows use the switch");
+
+    for (uint32_t idx = 0; idx < sizeof(perf_bench_vm_programs) / sizeof(perf_bench_vm_programs[0]) && result == PERF_RES_OK; idx++)
+    {
+        // Parse the program
+        perf_lexer_t    lexer;
+        perf_parser_t   parser;
+        perf_ast_t      ast;
+        perf_lexer_init(&lexer);
+        perf_ast_init(&ast);
+
+        result = perf_parser_init(&parser, &lexer, error);
+        if (result == PERF_RES_OK) result = perf_parser_parse(&parser, perf_bench_vm_programs[idx].source, &ast, error);
+
+        // Compile it three times: stack code without and with superinstructions, and register code.
+        perf_compiler_t compiler;
+        perf_program_t  programs[3];
+        perf_program_init(&programs[0]);
+        perf_program_init(&programs[1]);
+        perf_program_init(&programs[2]);
+
+        if (result == PERF_RES_OK) result = perf_compiler_init(&compiler, &lexer, error);
+
+        if (result == PERF_RES_OK)
+        {
+            compiler.fuse = false;
+            result = perf_compiler_compile(&compiler, &ast, &programs[0], error);
+
+            compiler.fuse = true;
+            if (result == PERF_RES_OK) result = perf_compiler_compile(&compiler, &ast, &programs[1], error);
+
+            compiler.format = PERF_PROGRAM_FORMAT_REGISTER;
+            if (result == PERF_RES_OK) result = perf_compiler_compile(&compiler, &ast, &programs[2], error);
+
+            perf_compiler_free(&compiler);
+        }
+
+        // Time every combination on both dispatches and count its instructions, keeping the first value to check the rest against.
+        double          best[3][2];
+        uint64_t        instructions[3];
+        perf_value_t    expected;
+        perf_value_t    value;
+
+        for (uint32_t variant = 0; variant < 3 && result == PERF_RES_OK; variant++)
+        {
+            for (uint32_t mode = 0; mode < 3 && result == PERF_RES_OK; mode++)
+            {
+                // The last run counts the instructions dispatched, it is slower and not timed.
+                if (mode == 2)
+                {
+                    vm.dispatch = PERF_VM_DISPATCH_COUNTED;
+                    result = perf_vm_run(&vm, &programs[variant], &value, error);
+                    instructions[variant] = vm.instruction_count;
+                }
+                else result = perf_bench_vm_time(&vm, &programs[variant], mode ? PERF_VM_DISPATCH_THREADED : PERF_VM_DISPATCH_SWITCH, &best[variant][mode], &value, error);
+
+                if (result == PERF_RES_OK && variant == 0 && mode == 0) expected = value;
+
+                // Check the value is the first run's.
+                if (result == PERF_RES_OK && !perf_value_identical(value, expected))
+                {
+                    // Set the error
+                    *error = "VM runs returned different values.";
+
+                    // Set the error result.
+                    result = PERF_RES_RUNTIME_ERROR;
+                }
+            }
+        }
+
+#if PERF_JIT_ENABLED
+        // Time the register code once more with its hot functions compiled, it must return the same value.
+        double best_jit = 0.0;
+
+        if (result == PERF_RES_OK) result = perf_bench_vm_time(&vm, &programs[2], PERF_VM_DISPATCH_JIT, &best_jit, &value, error);
+
+        if (result == PERF_RES_OK && !perf_value_identical(value, expected))
+        {
+            // Set the error
+            *error = "VM runs returned different values.";
+
+            // Set the error result.
+            result = PERF_RES_RUNTIME_ERROR;
+        }
+#endif
+
+        // Report the program.
+        if (result == PERF_RES_OK)
+        {
+            printf("  %-11s plain:     %6u bytes  %10llu instructions  switch %8.2f ms  threaded %8.2f ms  %5.2fx\n", perf_bench_vm_programs[idx].name,
+                programs[0].code_count, (unsigned long long)instructions[0], best[0][0] * 1e3, best[0][1] * 1e3, best[0][0] / best[0][1]);
+            printf("  %-11s fused:     %6u bytes  %10llu instructions  switch %8.2f ms  threaded %8.2f ms  %5.2fx  (%.2fx over plain switch)\n", "",
+                programs[1].code_count, (unsigned long long)instructions[1], best[1][0] * 1e3, best[1][1] * 1e3, best[1][0] / best[1][1], best[0][0] / best[1][1]);
+            printf("  %-11s registers: %6u bytes  %10llu instructions  switch %8.2f ms  threaded %8.2f ms  %5.2fx  (%.2fx fewer instructions, %.2fx over fused threaded)\n", "",
+                programs[2].code_count, (unsigned long long)instructions[2], best[2][0] * 1e3, best[2][1] * 1e3, best[2][0] / best[2][1],
+                (double)instructions[1] / (double)instructions[2], best[1][1] / best[2][1]);
+#if PERF_JIT_ENABLED
+            printf("  %-11s jit:       %6u bytes  %10s                                 jit %8.2f ms  %5.2fx over registers threaded%s\n", "",
+                (uint32_t)vm.jit.stats.code_bytes, "", best_jit * 1e3, best[2][1] / best_jit,
+                vm.jit.stats.declined_count > 0 ? "  (functions calling without looping stay in the interpreter)" : "");
+#endif
+        }
+
+        // Free everything, the lexer last as the programs refer to its strings.
+        perf_program_free(&programs[0]);
+        perf_program_free(&programs[1]);
+        perf_program_free(&programs[2]);
+        perf_ast_free(&ast);
+        perf_parser_free(&parser);
+        perf_lexer_free(&lexer);
+    }
+
+    // Check the programs that aren't timed.
+    for (uint32_t idx = 0; idx < sizeof(perf_bench_vm_checks) / sizeof(perf_bench_vm_checks[0]) && result == PERF_RES_OK; idx++)
+    {
+        result = perf_bench_vm_check(&vm, perf_bench_vm_checks[idx].source, error);
+        if (result == PERF_RES_OK) result = perf_bench_vm_check_modes(&vm, perf_bench_vm_checks[idx].source, error);
+
+        if (result == PERF_RES_OK) printf("  %-11s check:     stack and register code agree on every dispatch, in both lexer modes\n", perf_bench_vm_checks[idx].name);
+    }
+
+    perf_vm_free(&vm);
+
+    // Return the result.
+    return result;
+}
+
+/**
+ * @brief Reads every node and token of an AST, so a mapped one is faulted in like using it would.
+ *
+ * @param ast The AST to read.
+ *
+ * @return A sum of what was read.
+*/
+static uint64_t perf_bench_touch_ast(const perf_ast_t* ast)
+{
+    uint64_t sum = 0;
+
+    for (uint32_t idx = 0; idx < ast->node_count; idx++) sum += ast->nodes[idx].node_type + ast->nodes[idx].lhs;
+    for (uint32_t idx = 0; idx < ast->token_count; idx++) sum += ast->tokens[idx].type + ast->tokens[idx].line_number;
+    for (uint32_t idx = 0; idx < ast->extra_count; idx++) sum += ast->extra[idx];
+
+    return sum;
+}
+
+// Implementation for bench.h perf_bench_cache
+perf_result_t perf_bench_cache(uint32_t function_count, const char* directory, const char** error)
+{
+    // Allocate room for every function.
+    size_t capacity = (size_t)function_count * PERF_BENCH_FUNCTION_SIZE + 1;
+
+    // Allocate the program
+    char* program = (char*)malloc(capacity);
+
+    // Check if the allocation failed.
+    if (program == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for benchmark corpus.";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Generate the program, the same one the parse benchmark uses.
+    uint64_t state  = 0x9E3779B97F4A7C15ull;
+    size_t   length = 0;
+
+    for (uint32_t idx = 0; idx < function_count; idx++) length += perf_bench_function(program + length, idx, &state);
+    program[length] = '\x00';
+
+    // Best time of each way to start.
+    double best_parse   = 1e30;
+    double best_cold    = 1e30;
+    double best_warm    = 1e30;
+
+    // What the runs saw, so neither can be optimized away and the warm AST can be checked.
+    uint64_t parsed_sum     = 0;
+    uint64_t warm_sum       = 0;
+    uint64_t parsed_hash    = 0;
+    uint64_t warm_hash      = 0;
+    uint32_t parsed_nodes   = 0;
+    uint32_t warm_nodes     = 0;
+    size_t   entry_size     = 0;
+
+    // Used to store the result of each round.
+    perf_result_t result = PERF_RES_OK;
+
+    for (uint32_t round = 0; round < PERF_BENCH_ROUNDS && result == PERF_RES_OK; round++)
+    {
+        perf_lexer_t    lexer;
+        perf_parser_t   parser;
+        perf_ast_t      ast;
+        perf_cache_t    cache;
+        uint32_t        line_count  = 0;
+        const char*     miss        = NULL;
+
+        // Parse without the cache, zero copy like the cache does.
+        perf_lexer_init(&lexer);
+        lexer.mode = PERF_LEXER_MODE_ZERO_COPY;
+        result = perf_parser_init(&parser, &lexer, error);
+
+        if (result == PERF_RES_OK)
+        {
+            double start = perf_bench_now();
+            result = perf_parser_parse(&parser, program, &ast, error);
+            if (result == PERF_RES_OK) parsed_sum = perf_bench_touch_ast(&ast);
+            double elapsed = perf_bench_now() - start;
+            if (elapsed < best_parse) best_parse = elapsed;
+
+            if (result == PERF_RES_OK)
+            {
+                parsed_nodes    = ast.node_count;
+                parsed_hash     = perf_bench_hash_tokens(&lexer, ast.tokens, (int32_t)ast.token_count);
+                perf_ast_free(&ast);
+            }
+
+            perf_parser_free(&parser);
+        }
+
+        perf_lexer_free(&lexer);
+
+        // Start cold: hash, miss, parse and write the entry.
+        perf_lexer_init(&lexer);
+        lexer.mode = PERF_LEXER_MODE_ZERO_COPY;
+        if (result == PERF_RES_OK) result = perf_parser_init(&parser, &lexer, error);
+
+        if (result == PERF_RES_OK)
+        {
+            double start = perf_bench_now();
+            result = perf_cache_init(&cache, directory, program, length, error);
+            if (result == PERF_RES_OK)
+            {
+                remove(cache.path);
+                perf_cache_load(&cache, &ast, &line_count, &miss);
+                result = perf_parser_parse(&parser, program, &ast, error);
+            }
+            if (result == PERF_RES_OK) result = perf_cache_store(&cache, &ast, lexer.line_number, error);
+            double elapsed = perf_bench_now() - start;
+            if (elapsed < best_cold) best_cold = elapsed;
+
+            if (cache.path != NULL) perf_ast_free(&ast);
+            perf_cache_free(&cache);
+            perf_parser_free(&parser);
+        }
+
+        perf_lexer_free(&lexer);
+
+        // Start warm: hash, map and check the entry, then read all of it.
+        perf_lexer_init(&lexer);
+        lexer.mode = PERF_LEXER_MODE_ZERO_COPY;
+
+        if (result == PERF_RES_OK)
+        {
+            double start = perf_bench_now();
+            result = perf_cache_init(&cache, directory, program, length, error);
+            if (result == PERF_RES_OK) result = perf_cache_load(&cache, &ast, &line_count, error);
+            if (result == PERF_RES_OK) warm_sum = perf_bench_touch_ast(&ast);
+            double elapsed = perf_bench_now() - start;
+            if (elapsed < best_warm) best_warm = elapsed;
+
+            // The tokens' text comes from the source, as it would after a hit.
+            if (result == PERF_RES_OK)
+            {
+                perf_lexer_begin(&lexer, program);
+                warm_nodes  = ast.node_count;
+                warm_hash   = perf_bench_hash_tokens(&lexer, ast.tokens, (int32_t)ast.token_count);
+                entry_size  = cache.mapping_size;
+            }
+
+            // Leave nothing behind.
+            if (cache.path != NULL && round + 1 == PERF_BENCH_ROUNDS) remove(cache.path);
+            perf_cache_free(&cache);
+        }
+
+        perf_lexer_free(&lexer);
+
+        // Check the warm AST is the parsed one.
+        if (result == PERF_RES_OK && (warm_nodes != parsed_nodes || warm_sum != parsed_sum || warm_hash != parsed_hash))
+        {
+            // Set the error
+            *error = "Cached AST differs from the parsed one.";
+
+            // Set the error result.
+            result = PERF_RES_RUNTIME_ERROR;
+        }
+    }
+
+    // Report the results.
+    if (result == PERF_RES_OK)
+    {
+        printf("Cache: %u functions, %.2f MB of source, %u nodes, %zu byte entry in %s\n", function_count,
+            (double)length / (1024.0 * 1024.0), parsed_nodes, entry_size, directory);
+        printf("  parse:           %8.2f ms\n", best_parse * 1e3);
+        printf("  cold:            %8.2f ms  (hash, miss, parse, write)\n", best_cold * 1e3);
+        printf("  warm:            %8.2f ms  (hash, map, check, read)  %.2fx over cold, %.2fx over parse\n", best_warm * 1e3,
+            best_cold / best_warm, best_parse / best_warm);
+    }
+
+    // Free the program.
+    free(program);
+
+    // Return the result.
+    return result;
+}
+
+/**
+ * @brief Appends a random function that compiles to the generated program, every variable declared once.
+ *
+ * @param out Where to write the function, at most PERF_BENCH_FUNCTION_SIZE characters.
+ * @param index The index of the function, used for its name.
+ * @param state The generator state.
+ *
+ * @return The number of characters written.
+*/
+static size_t perf_bench_compiled_function(char* out, uint32_t index, uint64_t* state)
+{
+    // Write the header, the parameters and the one local every statement shares.
+    size_t length = (size_t)sprintf(out, "func f%u(a, b, c) {\n    var total = 0;\n", index);
+
+    // Write 4 to 12 random statements.
+    uint32_t statement_count = 4 + (uint32_t)(perf_bench_random(state) % 9);
+
+    for (uint32_t statement = 0; statement < statement_count; statement++)
+    {
+        uint32_t k = (uint32_t)(perf_bench_random(state) % 1000);
+
+        switch (perf_bench_random(state) % 8)
+        {
+        case 0:  length += (size_t)sprintf(out + length, "    total = total + a * %u - b %% 7;\n", k);                                      break;
+        case 1:  length += (size_t)sprintf(out + length, "    var s%u = \"%s_%u\";\n", statement, perf_bench_name(state), k);             break;
+        case 2:  length += (size_t)sprintf(out + length, "    if (a > b) { total = total - %u; } else { total = total + c * %u.5; }\n", k, k); break;
+        case 3:  length += (size_t)sprintf(out + length, "    while (total < %u) { total = total + a + 1; }\n", k);                         break;
+        case 4:  length += (size_t)sprintf(out + length, "    for (let i = 0; i < %u; i = i + 1) { total = total + i * 2.5; }\n", k);        break;
+        case 5:  length += (size_t)sprintf(out + length, "    total = f%u(total, b, %u) + total;\n", index / 2, k);                         break;
+        case 6:  length += (size_t)sprintf(out + length, "    c = -(a + %u) / (b - 1);\n", k);                                               break;
+        default: length += (size_t)sprintf(out + length, "    total = total & 0x%x;\n", k);                                                  break;
+        }
+    }
+
+    // Write the return and close the function.
+    length += (size_t)sprintf(out + length, "    return total;\n}\n\n");
+
+    // Return the length
+    return length;
+}
+
+/**
+ * @brief Checks a program loaded from a module is the one that was written.
+ *
+ * @param a The program compiled from source.
+ * @param b The program loaded from the module.
+ *
+ * @return true if their code, constants and tables match.
+*/
+static bool perf_bench_same_program(const perf_program_t* a, const perf_program_t* b)
+{
+    if (a->format != b->format || a->code_count != b->code_count || a->constant_count != b->constant_count
+        || a->function_count != b->function_count || a->global_count != b->global_count || a->line_count != b->line_count
+        || a->site_count != b->site_count) return false;
+
+    if (memcmp(a->code, b->code, a->code_count) != 0 || memcmp(a->sites, b->sites, (size_t)a->site_count * sizeof(uint32_t)) != 0
+        || memcmp(a->lines, b->lines, (size_t)a->line_count * sizeof(perf_program_line_t)) != 0) return false;
+
+    // Strings moved to the module's string table, compare them by contents.
+    for (uint32_t idx = 0; idx < a->constant_count; idx++)
+        if (!perf_value_equal(a->constants[idx], b->constants[idx]) || perf_value_type(a->constants[idx]) != perf_value_type(b->constants[idx])) return false;
+
+    for (uint32_t idx = 0; idx < a->function_count; idx++)
+        if (a->functions[idx].code_offset != b->functions[idx].code_offset || a->functions[idx].max_stack != b->functions[idx].max_stack) return false;
+
+    return true;
+}
+
+// Implementation for bench.h perf_bench_module
+perf_result_t perf_bench_module(uint32_t function_count, const char* directory, const char** error)
+{
+    // Allocate room for every function, and the module's path.
+    size_t  capacity    = (size_t)function_count * PERF_BENCH_FUNCTION_SIZE + 1;
+    size_t  path_size   = strlen(directory) + 32;
+    char*   program     = (char*)malloc(capacity);
+    char*   path        = (char*)malloc(path_size);
+
+    // Check if the allocation failed.
+    if (program == NULL || path == NULL)
+    {
+        free(program);
+        free(path);
+
+        // Set the error
+        *error = "Failed to allocate memory for benchmark corpus.";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    snprintf(path, path_size, "%s/perf_bench%s", directory, PERF_MODULE_EXTENSION);
+
+    // Generate the program, one that compiles.
+    uint64_t state  = 0x9E3779B97F4A7C15ull;
+    size_t   length = 0;
+
+    for (uint32_t idx = 0; idx < function_count; idx++) length += perf_bench_compiled_function(program + length, idx, &state);
+    program[length] = '\x00';
+
+    // Best time of each way to start, and of writing the module.
+    double best_source  = 1e30;
+    double best_write   = 1e30;
+    double best_load    = 1e30;
+
+    // What the runs made, for the report.
+    uint32_t code_count     = 0;
+    uint32_t function_total = 0;
+    size_t   module_size    = 0;
+
+    // Used to store the result of each round.
+    perf_result_t result = PERF_RES_OK;
+
+    for (uint32_t round = 0; round < PERF_BENCH_ROUNDS && result == PERF_RES_OK; round++)
+    {
+        perf_lexer_t        lexer;
+        perf_parser_t       parser;
+        perf_ast_t          ast;
+        perf_compiler_t     compiler;
+        perf_program_t      compiled;
+        perf_fold_stats_t   fold_stats = { 0 };
+
+        perf_lexer_init(&lexer);
+        perf_ast_init(&ast);
+        perf_program_init(&compiled);
+
+        // Start from source: parse, fold and compile.
+        double start = perf_bench_now();
+        result = perf_parser_init(&parser, &lexer, error);
+        if (result == PERF_RES_OK) result = perf_parser_parse(&parser, program, &ast, error);
+        if (result == PERF_RES_OK) result = perf_fold_ast(&ast, &fold_stats, error);
+        if (result == PERF_RES_OK) result = perf_compiler_init(&compiler, &lexer, error);
+
+        if (result == PERF_RES_OK)
+        {
+            result = perf_compiler_compile(&compiler, &ast, &compiled, error);
+            perf_compiler_free(&compiler);
+        }
+
+        double elapsed = perf_bench_now() - start;
+        if (elapsed < best_source) best_source = elapsed;
+
+        // Write the module.
+        start = perf_bench_now();
+        if (result == PERF_RES_OK) result = perf_module_write(&compiled, path, error);
+        elapsed = perf_bench_now() - start;
+        if (elapsed < best_write) best_write = elapsed;
+
+        // Start from the module: map, verify and load it.
+        perf_source_t   source;
+        perf_module_t   module;
+
+        perf_source_init(&source);
+        memset(&module, 0, sizeof(module));
+
+        start = perf_bench_now();
+        if (result == PERF_RES_OK) result = perf_source_open(&source, path, error);
+        if (result == PERF_RES_OK) result = perf_module_load(&module, source.data, source.length, error);
+        elapsed = perf_bench_now() - start;
+        if (elapsed < best_load) best_load = elapsed;
+
+        // Check the module's program is the compiled one.
+        if (result == PERF_RES_OK && !perf_bench_same_program(&compiled, &module.program))
+        {
+            // Set the error
+            *error = "Program loaded from the module differs from the compiled one.";
+
+            // Set the error result.
+            result = PERF_RES_RUNTIME_ERROR;
+        }
+
+        code_count      = compiled.code_count;
+        function_total  = compiled.function_count;
+        module_size     = module.size;
+
+        perf_module_free(&module);
+        perf_source_free(&source);
+        perf_program_free(&compiled);
+        perf_ast_free(&ast);
+        perf_parser_free(&parser);
+        perf_lexer_free(&lexer);
+    }
+
+    // Leave nothing behind.
+    remove(path);
+
+    // Report the results.
+    if (result == PERF_RES_OK)
+    {
+        printf("Module: %u functions, %.2f MB of source, %u functions and %u code bytes compiled, %zu byte module in %s\n",
+            function_count, (double)length / (1024.0 * 1024.0), function_total, code_count, module_size, directory);
+        printf("  source:          %8.2f ms  (parse, fold, compile)\n", best_source * 1e3);
+        printf("  write:           %8.2f ms\n", best_write * 1e3);
+        printf("  module:          %8.2f ms  (map, verify, load)  %.2fx over source\n", best_load * 1e3, best_source / best_load);
+    }
+
+    // Free the program and the path.
+    free(program);
+    free(path);
+
+    // Return the result.
+    return result;
+}
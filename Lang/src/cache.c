@@ -0,0 +1,363 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#endif
+
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/token.h"
+#include "../inc/intern.h"
+#include "../inc/lexer.h"
+#include "../inc/ast.h"
+#include "../inc/cache.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Magic at the start of every entry.
+static const char perf_cache_magic[8] = "PERFAST";
+
+/**
+ * @brief Rounds an offset up to the next multiple of 8, where every array of an entry starts.
+*/
+static inline uint64_t perf_cache_align(uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+// Implementation for cache.h perf_cache_hash
+uint64_t perf_cache_hash(const char* data, size_t length)
+{
+    // Start from the length, so sources that differ only in trailing zeros don't collide.
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ (uint64_t)length;
+    size_t   idx  = 0;
+
+    // Mix in 8 bytes at a time: multiply to spread the bits up, shift to bring them back down.
+    for (; idx + 8 <= length; idx += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + idx, sizeof(word));
+
+        hash  = (hash ^ word) * 0xBF58476D1CE4E5B9ull;
+        hash ^= hash >> 31;
+    }
+
+    // Then whatever is left, zero padded.
+    if (idx < length)
+    {
+        uint64_t word = 0;
+        memcpy(&word, data + idx, length - idx);
+
+        hash  = (hash ^ word) * 0xBF58476D1CE4E5B9ull;
+        hash ^= hash >> 31;
+    }
+
+    // Finalize so every bit depends on every byte.
+    hash ^= hash >> 30;
+    hash *= 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+
+    // Return the hash
+    return hash;
+}
+
+/**
+ * @brief Hashes the arrays of an AST, as they are written to an entry.
+ *
+ * @param ast The AST.
+ *
+ * @return The hash of its tokens, nodes, lists and statements.
+*/
+static uint64_t perf_cache_payload_hash(const perf_ast_t *ast)
+{
+    // Chain the hash of each array into the next, so moving items between arrays changes it too.
+    uint64_t hash = perf_cache_hash((const char*)ast->tokens, (size_t)ast->token_count * sizeof(perf_token_t));
+
+    hash = hash * 0xBF58476D1CE4E5B9ull ^ perf_cache_hash((const char*)ast->nodes, (size_t)ast->node_count * sizeof(perf_parser_node_t));
+    hash = hash * 0xBF58476D1CE4E5B9ull ^ perf_cache_hash((const char*)ast->extra, (size_t)ast->extra_count * sizeof(uint32_t));
+    hash = hash * 0xBF58476D1CE4E5B9ull ^ perf_cache_hash((const char*)ast->statements, (size_t)ast->statement_count * sizeof(uint32_t));
+
+    // Return the hash
+    return hash;
+}
+
+// Implementation for cache.h perf_cache_init
+perf_result_t perf_cache_init(perf_cache_t *cache, const char* directory, const char* data, size_t length, const char** error)
+{
+    // Nothing is mapped yet.
+    memset(cache, 0, sizeof(perf_cache_t));
+
+    cache->source_hash      = perf_cache_hash(data, length);
+    cache->source_length    = length;
+
+    // The entry is the hash in hex, in the directory.
+    size_t size = strlen(directory) + 1 + 16 + sizeof(PERF_CACHE_EXTENSION);
+
+    cache->path = (char*)malloc(size);
+
+    if (cache->path == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for cache path";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    snprintf(cache->path, size, "%s/%016llx%s", directory, (unsigned long long)cache->source_hash, PERF_CACHE_EXTENSION);
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+/**
+ * @brief Checks that an array of an entry is aligned and inside the file.
+ *
+ * @param offset The offset of the array.
+ * @param count The number of items.
+ * @param item_size The size of an item.
+ * @param size The size of the file.
+ *
+ * @return true if the array can be used in place.
+*/
+static bool perf_cache_check_array(uint64_t offset, uint32_t count, size_t item_size, size_t size)
+{
+    return offset % 8 == 0 && offset <= size && (uint64_t)count * item_size <= size - offset;
+}
+
+/**
+ * @brief Checks that an entry belongs to a source and that its arrays can be used in place.
+ *
+ * @param cache The cache entry of the source.
+ * @param header The header of the entry.
+ * @param size The size of the file.
+ *
+ * @return true if the entry can be used.
+*/
+static bool perf_cache_check(const perf_cache_t *cache, const perf_cache_header_t *header, size_t size)
+{
+    // Written by this version, for this source.
+    if (memcmp(header->magic, perf_cache_magic, sizeof(perf_cache_magic)) != 0 || header->version != PERF_CACHE_VERSION) return false;
+    if (header->token_size != sizeof(perf_token_t) || header->node_size != sizeof(perf_parser_node_t)) return false;
+    if (header->source_hash != cache->source_hash || header->source_length != cache->source_length) return false;
+
+    // Every array is where it can be used in place.
+    return perf_cache_check_array(header->token_offset, header->token_count, sizeof(perf_token_t), size)
+        && perf_cache_check_array(header->node_offset, header->node_count, sizeof(perf_parser_node_t), size)
+        && perf_cache_check_array(header->extra_offset, header->extra_count, sizeof(uint32_t), size)
+        && perf_cache_check_array(header->statement_offset, header->statement_count, sizeof(uint32_t), size);
+}
+
+// Implementation for cache.h perf_cache_load
+perf_result_t perf_cache_load(perf_cache_t *cache, perf_ast_t *ast, uint32_t *line_count, const char** error)
+{
+#if !defined(_WIN32)
+    // Open the entry, a missing one is the usual miss.
+    int fd = open(cache->path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        // Set the error
+        *error = "No cache entry for the source";
+
+        // Return unsupported result.
+        return PERF_RES_UNSUPPORTED;
+    }
+
+    // Map all of it, privately so folding can write to the nodes without the file seeing it.
+    struct stat info;
+    void*       mapping = MAP_FAILED;
+
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(perf_cache_header_t))
+        mapping = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        // Set the error
+        *error = "Failed to map cache entry";
+
+        // Return unsupported result.
+        return PERF_RES_UNSUPPORTED;
+    }
+
+    // Check it is this source's, from this version.
+    const perf_cache_header_t*  header  = (const perf_cache_header_t*)mapping;
+    uint8_t*                    base    = (uint8_t*)mapping;
+
+    if (!perf_cache_check(cache, header, (size_t)info.st_size))
+    {
+        munmap(mapping, (size_t)info.st_size);
+
+        // Set the error
+        *error = "Cache entry is stale";
+
+        // Return unsupported result.
+        return PERF_RES_UNSUPPORTED;
+    }
+
+    // Point the AST at the arrays, it owns none of them.
+    perf_ast_init(ast);
+
+    ast->tokens             = (perf_token_t*)(base + header->token_offset);
+    ast->token_count        = ast->token_capacity       = header->token_count;
+    ast->owns_tokens        = false;
+    ast->nodes              = (perf_parser_node_t*)(base + header->node_offset);
+    ast->node_count         = ast->node_capacity        = header->node_count;
+    ast->extra              = (uint32_t*)(base + header->extra_offset);
+    ast->extra_count        = ast->extra_capacity       = header->extra_count;
+    ast->statements         = (uint32_t*)(base + header->statement_offset);
+    ast->statement_count    = ast->statement_capacity   = header->statement_count;
+
+    // Check nothing in the arrays changed since they were written, and that they are an AST the parser could have
+    // built, so a damaged or crafted entry can't send folding or the compiler outside the arrays.
+    const char*     message = "Cache entry is damaged";
+    perf_result_t   result  = PERF_RES_UNSUPPORTED;
+
+    if (perf_cache_payload_hash(ast) == header->payload_hash) result = perf_ast_verify(ast, header->source_length, &message);
+
+    if (result != PERF_RES_OK)
+    {
+        // Leave the AST empty, not pointing at the unmapped entry.
+        munmap(mapping, (size_t)info.st_size);
+        perf_ast_init(ast);
+
+        // Set the error
+        *error = message;
+
+        // Return unsupported result.
+        return PERF_RES_UNSUPPORTED;
+    }
+
+    *line_count = header->line_count;
+
+    cache->mapping      = mapping;
+    cache->mapping_size = (size_t)info.st_size;
+
+    // Return OK result.
+    return PERF_RES_OK;
+#else
+    // Set the error
+    *error = "The cache needs mmap";
+
+    // Return unsupported result.
+    return PERF_RES_UNSUPPORTED;
+#endif
+}
+
+/**
+ * @brief Writes an array of an entry at its offset, padding up to it with zeros.
+ *
+ * @param file The entry being written.
+ * @param written The bytes written so far, updated.
+ * @param offset The offset of the array.
+ * @param items The array.
+ * @param size The size of the array in bytes.
+ *
+ * @return true if everything was written.
+*/
+static bool perf_cache_write_array(FILE* file, uint64_t* written, uint64_t offset, const void* items, size_t size)
+{
+    static const uint8_t zeros[8] = { 0 };
+
+    if (offset > *written && fwrite(zeros, 1, (size_t)(offset - *written), file) != offset - *written) return false;
+    if (size > 0 && fwrite(items, 1, size, file) != size) return false;
+
+    *written = offset + size;
+    return true;
+}
+
+// Implementation for cache.h perf_cache_store
+perf_result_t perf_cache_store(perf_cache_t *cache, const perf_ast_t *ast, uint32_t line_count, const char** error)
+{
+    // Lay the arrays out after the header, each aligned.
+    perf_cache_header_t header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, perf_cache_magic, sizeof(perf_cache_magic));
+    header.version          = PERF_CACHE_VERSION;
+    header.token_size       = (uint16_t)sizeof(perf_token_t);
+    header.node_size        = (uint16_t)sizeof(perf_parser_node_t);
+    header.source_hash      = cache->source_hash;
+    header.source_length    = cache->source_length;
+
+    header.line_count       = line_count;
+    header.token_count      = ast->token_count;
+    header.node_count       = ast->node_count;
+    header.extra_count      = ast->extra_count;
+    header.statement_count  = ast->statement_count;
+    header.payload_hash     = perf_cache_payload_hash(ast);
+
+    header.token_offset     = perf_cache_align(sizeof(header));
+    header.node_offset      = perf_cache_align(header.token_offset + (uint64_t)ast->token_count * sizeof(perf_token_t));
+    header.extra_offset     = perf_cache_align(header.node_offset + (uint64_t)ast->node_count * sizeof(perf_parser_node_t));
+    header.statement_offset = perf_cache_align(header.extra_offset + (uint64_t)ast->extra_count * sizeof(uint32_t));
+
+    // Write it under a name of its own, then rename it over the entry so nobody maps half of it.
+    size_t  size        = strlen(cache->path) + 32;
+    char*   temporary   = (char*)malloc(size);
+
+    if (temporary == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for cache path";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+#if !defined(_WIN32)
+    snprintf(temporary, size, "%s.%ld.tmp", cache->path, (long)getpid());
+#else
+    snprintf(temporary, size, "%s.tmp", cache->path);
+#endif
+
+    FILE*       file    = fopen(temporary, "wb");
+    uint64_t    written = 0;
+    bool        ok      = file != NULL
+        && perf_cache_write_array(file, &written, 0, &header, sizeof(header))
+        && perf_cache_write_array(file, &written, header.token_offset, ast->tokens, (size_t)ast->token_count * sizeof(perf_token_t))
+        && perf_cache_write_array(file, &written, header.node_offset, ast->nodes, (size_t)ast->node_count * sizeof(perf_parser_node_t))
+        && perf_cache_write_array(file, &written, header.extra_offset, ast->extra, (size_t)ast->extra_count * sizeof(uint32_t))
+        && perf_cache_write_array(file, &written, header.statement_offset, ast->statements, (size_t)ast->statement_count * sizeof(uint32_t));
+
+    // Closing flushes, it can fail too.
+    if (file != NULL && fclose(file) != 0) ok = false;
+    if (ok && rename(temporary, cache->path) != 0) ok = false;
+
+    // Leave nothing behind if it failed.
+    if (!ok && file != NULL) remove(temporary);
+    free(temporary);
+
+    if (!ok)
+    {
+        // Set the error
+        *error = "Failed to write cache entry";
+
+        // Return IO error result.
+        return PERF_RES_IO_ERROR;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for cache.h perf_cache_free
+perf_result_t perf_cache_free(perf_cache_t *cache)
+{
+#if !defined(_WIN32)
+    // Unmap the entry, and with it the AST pointing at it.
+    if (cache->mapping != NULL) munmap(cache->mapping, cache->mapping_size);
+#endif
+
+    free(cache->path);
+    memset(cache, 0, sizeof(perf_cache_t));
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
@@ -0,0 +1,2366 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/array.h"
+#include "../inc/token.h"
+#include "../inc/intern.h"
+#include "../inc/lexer.h"
+#include "../inc/ast.h"
+#include "../inc/value.h"
+#include "../inc/fold.h"
+#include "../inc/program.h"
+#include "../inc/compiler.h"
+
+// Marks a pending jump as a continue, the rest are breaks.
+#define PERF_COMPILER_CONTINUE  0x80000000u
+
+/**
+ * Represents a local variable in scope.
+*/
+typedef struct _perf_compiler_local_t
+{
+    const char* name;           // Interned name
+    uint32_t    depth;          // Scope depth it was declared at
+    bool        is_const;       // True if declared with const
+} perf_compiler_local_t;
+
+/**
+ * Represents a loop being compiled, so break and continue know where to go.
+*/
+typedef struct _perf_compiler_loop_t
+{
+    struct _perf_compiler_loop_t*   enclosing;          // Loop this one is nested in
+    uint32_t                        jump_base;          // Number of pending jumps when the loop started
+    uint32_t                        continue_target;    // Where continue jumps back to, UINT32_MAX if it comes after the body
+} perf_compiler_loop_t;
+
+/**
+ * Represents a function being compiled. Its code and lines are moved into the program once it is done.
+*/
+typedef struct _perf_compiler_function_t
+{
+    struct _perf_compiler_function_t*   enclosing;      // Function this one is nested in, NULL for the script
+    uint32_t                            index;          // Index of the function in the program
+    const char*                         name;           // Interned name, NULL for the script
+    bool                                is_local;       // True if the function is a local of the enclosing one
+    perf_e_function_kind_t              kind;           // Plain function, method or initializer
+
+    uint8_t*                            code;           // Code emitted so far
+    uint32_t                            code_count;     // Number of bytes of code
+    uint32_t                            code_capacity;  // Number of bytes of code we can hold
+    uint32_t                            last_op;        // Offset of the last instruction emitted
+    uint32_t                            label;          // Offset of the last jump target, nothing is fused across it
+
+    perf_program_line_t*                lines;          // Line table, offsets relative to the function
+    uint32_t                            line_count;     // Number of entries in the line table
+    uint32_t                            line_capacity;  // Number of entries the line table can hold
+    uint32_t                            line;           // Line of the code being emitted
+
+    perf_compiler_local_t               locals[PERF_COMPILER_MAX_SLOTS];    // Locals in scope, each in the slot of its index
+    uint32_t                            local_count;    // Number of locals in scope
+    uint32_t                            slot_count;     // Most locals in scope at once
+    uint32_t                            scope_depth;    // Number of scopes we are in, 0 is the script's top level
+
+    int32_t                             stack_depth;    // Depth of the operand stack after the code emitted so far
+    uint32_t                            max_stack;      // Deepest the operand stack gets
+
+    uint32_t                            next_register;  // First free register in register code, temporaries go above the locals
+    bool                                alias_locals;   // True if the expression being compiled can read locals in their own registers
+
+    perf_compiler_loop_t*               loop;           // Innermost loop being compiled, NULL outside loops
+} perf_compiler_function_t;
+
+/**
+ * Determines where a variable lives.
+*/
+typedef enum _perf_e_compiler_variable_t
+{
+    PERF_COMPILER_VARIABLE_LOCAL,       // A slot of the current function
+    PERF_COMPILER_VARIABLE_GLOBAL,      // A global slot
+    PERF_COMPILER_VARIABLE_FUNCTION     // A local function referring to itself, or to a function it is nested in
+} perf_e_compiler_variable_t;
+
+/**
+ * Represents a resolved variable.
+*/
+typedef struct _perf_compiler_variable_t
+{
+    perf_e_compiler_variable_t  kind;       // Where the variable lives
+    uint32_t                    index;      // The local slot, global slot, or function index
+    bool                        is_const;   // True if it can't be assigned to
+} perf_compiler_variable_t;
+
+/**
+ * Opcodes of the binary operators, indexed by token type.
+*/
+static const uint8_t perf_compiler_binary_ops[TOKEN_EOF + 1] =
+{
+    [TOKEN_PLUS]            = OP_ADD,
+    [TOKEN_MINUS]           = OP_SUBTRACT,
+    [TOKEN_ASTERISK]        = OP_MULTIPLY,
+    [TOKEN_SLASH]           = OP_DIVIDE,
+    [TOKEN_PERCENT]         = OP_MODULO,
+    [TOKEN_AMPERSAND]       = OP_BIT_AND,
+    [TOKEN_EQUAL_EQUAL]     = OP_EQUAL,
+    [TOKEN_EXCLAIM_EQUAL]   = OP_NOT_EQUAL,
+    [TOKEN_GREATER]         = OP_GREATER,
+    [TOKEN_GREATER_EQUAL]   = OP_GREATER_EQUAL,
+    [TOKEN_LESS]            = OP_LESS,
+    [TOKEN_LESS_EQUAL]      = OP_LESS_EQUAL,
+};
+
+/**
+ * Register opcodes of the binary operators, indexed by token type.
+*/
+static const uint8_t perf_compiler_register_ops[TOKEN_EOF + 1] =
+{
+    [TOKEN_PLUS]            = ROP_ADD,
+    [TOKEN_MINUS]           = ROP_SUBTRACT,
+    [TOKEN_ASTERISK]        = ROP_MULTIPLY,
+    [TOKEN_SLASH]           = ROP_DIVIDE,
+    [TOKEN_PERCENT]         = ROP_MODULO,
+    [TOKEN_AMPERSAND]       = ROP_BIT_AND,
+    [TOKEN_EQUAL_EQUAL]     = ROP_EQUAL,
+    [TOKEN_EXCLAIM_EQUAL]   = ROP_NOT_EQUAL,
+    [TOKEN_GREATER]         = ROP_GREATER,
+    [TOKEN_GREATER_EQUAL]   = ROP_GREATER_EQUAL,
+    [TOKEN_LESS]            = ROP_LESS,
+    [TOKEN_LESS_EQUAL]      = ROP_LESS_EQUAL,
+};
+
+/**
+ * @brief Records the first compile error. Compiling carries on until the callers notice, emitting nothing useful.
+ *
+ * @param compiler The compiler to use.
+ * @param status The result of the failed operation.
+ * @param error The error message.
+ * @param token The index of the token the error refers to, or PERF_AST_NONE.
+*/
+static void perf_compiler_fail(perf_compiler_t *compiler, perf_result_t status, const char* error, uint32_t token)
+{
+    // Keep the first failure, later ones are usually caused by it.
+    if (compiler->status != PERF_RES_OK) return;
+
+    compiler->status        = status;
+    compiler->status_error  = error;
+
+    // Point at the token, if any.
+    if (token != PERF_AST_NONE) compiler->erroring_token = compiler->ast->tokens[token];
+}
+
+/**
+ * @brief Enters a level of expression or statement nesting, failing once it gets too deep.
+ *
+ * @param compiler The compiler to use.
+ * @param token The index of the token to point the error at.
+ * @param error The error message if the nesting is too deep.
+ *
+ * @return true if the level was entered, to be left by decrementing depth, false if compiling failed.
+*/
+static bool perf_compiler_enter(perf_compiler_t *compiler, uint32_t token, const char* error)
+{
+    // Check if we went too deep.
+    if (compiler->depth >= PERF_COMPILER_MAX_DEPTH)
+    {
+        perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, error, token);
+        return false;
+    }
+
+    compiler->depth++;
+    return true;
+}
+
+/**
+ * @brief Sets the line of the code emitted next to the line of a token.
+ *
+ * @param compiler The compiler to use.
+ * @param token The index of the token, or PERF_AST_NONE to keep the current line.
+*/
+static inline void perf_compiler_at(perf_compiler_t *compiler, uint32_t token)
+{
+    if (token != PERF_AST_NONE) compiler->function->line = compiler->ast->tokens[token].line_number + 1;
+}
+
+/**
+ * @brief Appends a byte to the current function's code.
+ *
+ * @param compiler The compiler to use.
+ * @param byte The byte to append.
+*/
+static void perf_compiler_emit_byte(perf_compiler_t *compiler, uint8_t byte)
+{
+    perf_compiler_function_t* function = compiler->function;
+
+    // Make room for the byte
+    if (function->code_count == function->code_capacity
+        && perf_array_grow((void**)&function->code, &function->code_capacity, sizeof(uint8_t)) != PERF_RES_OK)
+    {
+        perf_compiler_fail(compiler, PERF_RES_MEMORY_ALLOC_FAIL, "Failed to allocate memory for bytecode", PERF_AST_NONE);
+        return;
+    }
+
+    // Append the byte
+    function->code[function->code_count++] = byte;
+}
+
+/**
+ * @brief Appends an operand to the current function's code, little endian.
+ *
+ * @param compiler The compiler to use.
+ * @param operand The operand.
+ * @param size The size of the operand, in bytes.
+*/
+static void perf_compiler_emit_operand(perf_compiler_t *compiler, uint32_t operand, uint8_t size)
+{
+    for (uint8_t idx = 0; idx < size; idx++) perf_compiler_emit_byte(compiler, (uint8_t)(operand >> (idx * 8)));
+}
+
+/**
+ * @brief Starts a new line table entry for the next instruction if the line changed.
+ *
+ * @param compiler The compiler to use.
+ *
+ * @return false if the entry couldn't be added.
+*/
+static bool perf_compiler_mark_line(perf_compiler_t *compiler)
+{
+    perf_compiler_function_t* function = compiler->function;
+
+    // Nothing to do while the line stays the same.
+    if (function->line_count > 0 && function->lines[function->line_count - 1].line == function->line) return true;
+
+    // Make room for the entry
+    if (function->line_count == function->line_capacity
+        && perf_array_grow((void**)&function->lines, &function->line_capacity, sizeof(perf_program_line_t)) != PERF_RES_OK)
+    {
+        perf_compiler_fail(compiler, PERF_RES_MEMORY_ALLOC_FAIL, "Failed to allocate memory for line table", PERF_AST_NONE);
+        return false;
+    }
+
+    // Add the entry
+    function->lines[function->line_count].offset    = function->code_count;
+    function->lines[function->line_count].line      = function->line;
+    function->line_count++;
+
+    return true;
+}
+
+/**
+ * @brief Finds the superinstruction a pair of instructions fuses into.
+ *
+ * @param previous The opcode of the previous instruction.
+ * @param opcode The opcode following it.
+ *
+ * @return The fused opcode, or OP_COUNT if the pair doesn't fuse.
+*/
+static perf_e_opcode_t perf_compiler_fused(uint8_t previous, perf_e_opcode_t opcode)
+{
+    switch (opcode)
+    {
+    case OP_ADD:
+        if (previous == OP_GET_LOCAL) return OP_ADD_LOCAL;
+        if (previous == OP_CONSTANT) return OP_ADD_CONSTANT;
+        break;
+
+    case OP_SUBTRACT:
+        if (previous == OP_CONSTANT) return OP_SUBTRACT_CONSTANT;
+        break;
+
+    case OP_POP:
+        if (previous == OP_SET_LOCAL) return OP_STORE_LOCAL;
+        if (previous == OP_SET_GLOBAL) return OP_STORE_GLOBAL;
+        break;
+
+    case OP_JUMP_IF_FALSE:
+        // The jump is taken when the comparison is false, which isn't the opposite comparison once NaN is involved.
+        switch (previous)
+        {
+        case OP_EQUAL:          return OP_JUMP_IF_NOT_EQUAL;
+        case OP_NOT_EQUAL:      return OP_JUMP_IF_EQUAL;
+        case OP_GREATER:        return OP_JUMP_IF_NOT_GREATER;
+        case OP_GREATER_EQUAL:  return OP_JUMP_IF_NOT_GREATER_EQUAL;
+        case OP_LESS:           return OP_JUMP_IF_NOT_LESS;
+        case OP_LESS_EQUAL:     return OP_JUMP_IF_NOT_LESS_EQUAL;
+        default:                break;
+        }
+        break;
+
+    default: break;
+    }
+
+    // Return nothing to fuse.
+    return OP_COUNT;
+}
+
+/**
+ * @brief Appends an opcode to the current function's code, tracking its line and its effect on the stack.
+ *
+ * When the opcode and the previous instruction make a superinstruction, the previous instruction is rewritten
+ * instead. Its operand stays where it is, and the operand of the opcode, if any, is appended after it.
+ *
+ * @param compiler The compiler to use.
+ * @param opcode The opcode.
+*/
+static void perf_compiler_emit_op(perf_compiler_t *compiler, perf_e_opcode_t opcode)
+{
+    perf_compiler_function_t* function = compiler->function;
+
+    // Fuse the opcode into the previous instruction, unless something jumps in between them.
+    if (compiler->fuse && function->label != function->code_count)
+    {
+        perf_e_opcode_t fused = perf_compiler_fused(function->code[function->last_op], opcode);
+
+        if (fused != OP_COUNT)
+        {
+            function->code[function->last_op] = (uint8_t)fused;
+            function->stack_depth += perf_opcode_info[opcode].stack_effect;
+            return;
+        }
+    }
+
+    // Track the line of the instruction
+    if (!perf_compiler_mark_line(compiler)) return;
+
+    // Append the opcode
+    function->last_op = function->code_count;
+    perf_compiler_emit_byte(compiler, (uint8_t)opcode);
+
+    // Track the depth of the stack
+    function->stack_depth += perf_opcode_info[opcode].stack_effect;
+    if (function->stack_depth > (int32_t)function->max_stack) function->max_stack = (uint32_t)function->stack_depth;
+}
+
+/**
+ * @brief Appends an opcode and its operand to the current function's code.
+ *
+ * @param compiler The compiler to use.
+ * @param opcode The opcode.
+ * @param operand The operand, sized by the opcode.
+*/
+static void perf_compiler_emit(perf_compiler_t *compiler, perf_e_opcode_t opcode, uint32_t operand)
+{
+    perf_compiler_emit_op(compiler, opcode);
+    perf_compiler_emit_operand(compiler, operand, perf_opcode_info[opcode].operand_size);
+}
+
+/**
+ * @brief Appends a register instruction to the current function's code, tracking its line.
+ *
+ * @param compiler The compiler to use.
+ * @param opcode The opcode.
+ * @param a The a operand.
+ * @param b The b operand, or the low byte of bx.
+ * @param c The c operand, or the high byte of bx.
+*/
+static void perf_compiler_emit_register(perf_compiler_t *compiler, perf_e_reg_opcode_t opcode, uint32_t a, uint32_t b, uint32_t c)
+{
+    if (!perf_compiler_mark_line(compiler)) return;
+
+    perf_compiler_emit_byte(compiler, (uint8_t)opcode);
+    perf_compiler_emit_byte(compiler, (uint8_t)a);
+    perf_compiler_emit_byte(compiler, (uint8_t)b);
+    perf_compiler_emit_byte(compiler, (uint8_t)c);
+}
+
+/**
+ * @brief Takes a free register of the current function for a temporary.
+ *
+ * @param compiler The compiler to use.
+ *
+ * @return The register.
+*/
+static uint32_t perf_compiler_register(perf_compiler_t *compiler)
+{
+    perf_compiler_function_t* function = compiler->function;
+
+    // Registers are a u8 operand.
+    if (function->next_register == PERF_COMPILER_MAX_SLOTS)
+    {
+        perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "expression needs too many registers, split it up", PERF_AST_NONE);
+        return 0;
+    }
+
+    // Track the most registers in use at once
+    if (++function->next_register > function->slot_count) function->slot_count = function->next_register;
+
+    // Return the register
+    return function->next_register - 1;
+}
+
+/**
+ * @brief Hashes a constant for the constant table.
+ *
+ * @param value The constant.
+ *
+ * @return The hash.
+*/
+static inline uint32_t perf_compiler_hash_constant(const perf_value_t *value)
+{
+    return (uint32_t)((value->bits * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+/**
+ * @brief Hashes an interned name for the global table.
+ *
+ * @param name The interned name.
+ *
+ * @return The hash.
+*/
+static inline uint32_t perf_compiler_hash_name(const char* name)
+{
+    return (uint32_t)(((uint64_t)(uintptr_t)name * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+/**
+ * @brief Finds a constant in the constant pool, adding it if it isn't there yet.
+ *
+ * @param compiler The compiler to use.
+ * @param value The constant.
+ * @param index The index of the constant.
+ *
+ * @return true if the constant was found or added.
+*/
+static bool perf_compiler_constant(perf_compiler_t *compiler, const perf_value_t *value, uint32_t *index)
+{
+    perf_program_t* program = compiler->program;
+
+    // Keep the table at most half full, rehashing every constant when it grows.
+    if ((program->constant_count + 1) * 2 > compiler->constant_capacity)
+    {
+        uint32_t  capacity = compiler->constant_capacity < 64 ? 64 : compiler->constant_capacity * 2;
+        uint32_t* table    = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+
+        // Check if the allocation failed.
+        if (table == NULL)
+        {
+            perf_compiler_fail(compiler, PERF_RES_MEMORY_ALLOC_FAIL, "Failed to allocate memory for constant table", PERF_AST_NONE);
+            return false;
+        }
+
+        // Reinsert every constant
+        for (uint32_t idx = 0; idx < program->constant_count; idx++)
+        {
+            uint32_t slot = perf_compiler_hash_constant(&program->constants[idx]) & (capacity - 1);
+            while (table[slot] != 0) slot = (slot + 1) & (capacity - 1);
+            table[slot] = idx + 1;
+        }
+
+        // Use the new table
+        free(compiler->constants);
+        compiler->constants         = table;
+        compiler->constant_capacity = capacity;
+    }
+
+    // Probe for the constant
+    uint32_t mask = compiler->constant_capacity - 1;
+    uint32_t slot = perf_compiler_hash_constant(value) & mask;
+
+    for (; compiler->constants[slot] != 0; slot = (slot + 1) & mask)
+    {
+        if (perf_value_identical(program->constants[compiler->constants[slot] - 1], *value))
+        {
+            *index = compiler->constants[slot] - 1;
+            return true;
+        }
+    }
+
+    // Add it to the pool
+    const char*   error  = NULL;
+    perf_result_t result = perf_program_add_constant(program, value, index, &error);
+
+    // Check if the constant was added.
+    if (result != PERF_RES_OK)
+    {
+        perf_compiler_fail(compiler, result, error, PERF_AST_NONE);
+        return false;
+    }
+
+    // Remember where it is
+    compiler->constants[slot] = *index + 1;
+    return true;
+}
+
+/**
+ * @brief Appends an instruction pushing a constant, using the short form when the index allows it.
+ *
+ * @param compiler The compiler to use.
+ * @param value The constant.
+*/
+static void perf_compiler_emit_constant(perf_compiler_t *compiler, const perf_value_t *value)
+{
+    uint32_t index = 0;
+    if (!perf_compiler_constant(compiler, value, &index)) return;
+
+    perf_compiler_emit(compiler, index <= UINT16_MAX ? OP_CONSTANT : OP_CONSTANT_WIDE, index);
+}
+
+/**
+ * @brief Appends an instruction pushing a function.
+ *
+ * @param compiler The compiler to use.
+ * @param function The index of the function.
+*/
+static void perf_compiler_emit_function(perf_compiler_t *compiler, uint32_t function)
+{
+    perf_value_t value = perf_value_box(PERF_VALUE_FUNCTION, function);
+
+    perf_compiler_emit_constant(compiler, &value);
+}
+
+/**
+ * @brief Appends a register instruction loading a constant, using the short form when the index allows it.
+ *
+ * @param compiler The compiler to use.
+ * @param value The constant.
+ * @param target The register to load it into.
+*/
+static void perf_compiler_emit_load(perf_compiler_t *compiler, const perf_value_t *value, uint32_t target)
+{
+    uint32_t index = 0;
+    if (!perf_compiler_constant(compiler, value, &index)) return;
+
+    if (index <= UINT16_MAX) perf_compiler_emit_register(compiler, ROP_CONSTANT, target, index & 0xFF, index >> 8);
+    else
+    {
+        perf_compiler_emit_register(compiler, ROP_CONSTANT_WIDE, target, 0, 0);
+        perf_compiler_emit_operand(compiler, index, 4);
+    }
+}
+
+/**
+ * @brief Appends a register instruction loading a function.
+ *
+ * @param compiler The compiler to use.
+ * @param function The index of the function.
+ * @param target The register to load it into.
+*/
+static void perf_compiler_emit_load_function(perf_compiler_t *compiler, uint32_t function, uint32_t target)
+{
+    perf_value_t value = perf_value_box(PERF_VALUE_FUNCTION, function);
+
+    perf_compiler_emit_load(compiler, &value, target);
+}
+
+/**
+ * @brief Finds a global by name, adding a slot for it if asked to.
+ *
+ * @param compiler The compiler to use.
+ * @param name The interned name.
+ * @param create True to add the global if it isn't there yet.
+ *
+ * @return The global, or NULL if it isn't there and wasn't added.
+*/
+static perf_compiler_global_t* perf_compiler_global(perf_compiler_t *compiler, const char* name, bool create)
+{
+    // Keep the table at most half full.
+    if ((compiler->global_count + 1) * 2 > compiler->global_capacity)
+    {
+        uint32_t                capacity = compiler->global_capacity < 64 ? 64 : compiler->global_capacity * 2;
+        perf_compiler_global_t* table    = (perf_compiler_global_t*)calloc(capacity, sizeof(perf_compiler_global_t));
+
+        // Check if the allocation failed.
+        if (table == NULL)
+        {
+            perf_compiler_fail(compiler, PERF_RES_MEMORY_ALLOC_FAIL, "Failed to allocate memory for global table", PERF_AST_NONE);
+            return NULL;
+        }
+
+        // Reinsert every global
+        for (uint32_t idx = 0; idx < compiler->global_capacity; idx++)
+        {
+            if (compiler->globals[idx].name == NULL) continue;
+
+            uint32_t slot = perf_compiler_hash_name(compiler->globals[idx].name) & (capacity - 1);
+            while (table[slot].name != NULL) slot = (slot + 1) & (capacity - 1);
+            table[slot] = compiler->globals[idx];
+        }
+
+        // Use the new table
+        free(compiler->globals);
+        compiler->globals           = table;
+        compiler->global_capacity   = capacity;
+    }
+
+    // Probe for the global
+    uint32_t mask = compiler->global_capacity - 1;
+    uint32_t slot = perf_compiler_hash_name(name) & mask;
+
+    for (; compiler->globals[slot].name != NULL; slot = (slot + 1) & mask)
+        if (compiler->globals[slot].name == name) return &compiler->globals[slot];
+
+    // Check if we should add it.
+    if (!create) return NULL;
+
+    // Add a slot to the program
+    perf_compiler_global_t* global = &compiler->globals[slot];
+    const char*             error  = NULL;
+    perf_result_t           result = perf_program_add_global(compiler->program, name, &global->index, &error);
+
+    // Check if the slot was added.
+    if (result != PERF_RES_OK)
+    {
+        perf_compiler_fail(compiler, result, error, PERF_AST_NONE);
+        return NULL;
+    }
+
+    // Fill in the entry
+    global->name        = name;
+    global->is_const    = false;
+    compiler->global_count++;
+
+    // Return the global
+    return global;
+}
+
+/**
+ * @brief Gets the interned text of an identifier or string token, in either lexer mode, strings escape decoded.
+ *
+ * @param compiler The compiler to use.
+ * @param token The index of the token.
+ *
+ * @return The interned text, or NULL if it couldn't be interned.
+*/
+static const char* perf_compiler_string(perf_compiler_t *compiler, uint32_t token)
+{
+    const perf_token_t* tok = &compiler->ast->tokens[token];
+
+    // Interned identifiers already hold the name.
+    if (compiler->lexer->mode != PERF_LEXER_MODE_ZERO_COPY && tok->type != TOKEN_STRING) return tok->as.str;
+
+    // Get the text, from the source or the interner
+    size_t      length  = 0;
+    const char* text    = perf_lexer_token_text(compiler->lexer, tok, &length);
+    const char* str     = NULL;
+    const char* error   = NULL;
+
+    // Will store the result of interning the text.
+    perf_result_t result;
+
+    // String literals still have their escape sequences in either mode, decode them first.
+    if (tok->type == TOKEN_STRING)
+    {
+        char*  decoded        = (char*)malloc(length + 1);
+        size_t decoded_length = 0;
+
+        if (decoded == NULL)
+        {
+            perf_compiler_fail(compiler, PERF_RES_MEMORY_ALLOC_FAIL, "Failed to allocate memory for string constant", token);
+            return NULL;
+        }
+
+        result = perf_token_decode_string(text, length, decoded, &decoded_length, &error);
+        if (result == PERF_RES_OK) result = perf_interner_intern(&compiler->lexer->interner, decoded, decoded_length, &str, &error);
+
+        free(decoded);
+    }
+
+    // Identifiers are interned as they are.
+    else result = perf_interner_intern(&compiler->lexer->interner, text, length, &str, &error);
+
+    // Check if the text was interned.
+    if (result != PERF_RES_OK)
+    {
+        perf_compiler_fail(compiler, result, error, token);
+        return NULL;
+    }
+
+    // Return the interned text
+    return str;
+}
+
+/**
+ * @brief Appends a member site to the program, its name going to the constant pool.
+ *
+ * @param compiler The compiler to use.
+ * @param token The index of the member name's token.
+ * @param index The index of the site.
+ *
+ * @return true if the site was added.
+*/
+static bool perf_compiler_site(perf_compiler_t *compiler, uint32_t token, uint32_t *index)
+{
+    const char* name = perf_compiler_string(compiler, token);
+    if (name == NULL) return false;
+
+    // Sites of the same name share the constant, but each has a cache of its own.
+    perf_value_t    value       = perf_value_string(name);
+    uint32_t        constant    = 0;
+
+    if (!perf_compiler_constant(compiler, &value, &constant)) return false;
+
+    const char*   error  = NULL;
+    perf_result_t result = perf_program_add_site(compiler->program, constant, index, &error);
+
+    if (result != PERF_RES_OK)
+    {
+        perf_compiler_fail(compiler, result, error, token);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Checks that this is used inside a method.
+ *
+ * @param compiler The compiler to use.
+ * @param token The index of the keyword's token.
+ *
+ * @return true if the running function has a receiver.
+*/
+static bool perf_compiler_this(perf_compiler_t *compiler, uint32_t token)
+{
+    if (compiler->function->kind != PERF_FUNCTION_PLAIN) return true;
+
+    perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "cannot use this outside of a method", token);
+    return false;
+}
+
+/**
+ * @brief Appends a forward jump, to be patched once its target is known.
+ *
+ * @param compiler The compiler to use.
+ * @param opcode OP_JUMP or OP_JUMP_IF_FALSE.
+ *
+ * @return The offset of the jump's operand.
+*/
+static uint32_t perf_compiler_emit_jump(perf_compiler_t *compiler, perf_e_opcode_t opcode)
+{
+    // Register code only jumps unconditionally through here, its bx is the last two bytes too.
+    if (compiler->format == PERF_PROGRAM_FORMAT_REGISTER) perf_compiler_emit_register(compiler, ROP_JUMP, 0, 0, 0);
+    else perf_compiler_emit(compiler, opcode, 0);
+
+    return compiler->function->code_count - 2;
+}
+
+/**
+ * @brief Marks the current offset as a jump target, so the next instruction isn't fused into the previous one.
+ *
+ * @param compiler The compiler to use.
+ *
+ * @return The current offset.
+*/
+static uint32_t perf_compiler_label(perf_compiler_t *compiler)
+{
+    return compiler->function->label = compiler->function->code_count;
+}
+
+/**
+ * @brief Points a forward jump at a target.
+ *
+ * @param compiler The compiler to use.
+ * @param at The offset of the jump's operand.
+ * @param target The offset to jump to.
+*/
+static void perf_compiler_patch_jump(perf_compiler_t *compiler, uint32_t at, uint32_t target)
+{
+    // The jump may not have been emitted if we ran out of memory.
+    if (compiler->status != PERF_RES_OK) return;
+
+    // Jumps are measured from the end of the instruction.
+    uint32_t distance = target - (at + 2);
+
+    if (distance > UINT16_MAX)
+    {
+        perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "jump too far, split up the function", PERF_AST_NONE);
+        return;
+    }
+
+    compiler->function->code[at]        = (uint8_t)distance;
+    compiler->function->code[at + 1]    = (uint8_t)(distance >> 8);
+
+    // Jumps to the current offset make it a target.
+    if (target == compiler->function->code_count) perf_compiler_label(compiler);
+}
+
+/**
+ * @brief Appends a backward jump.
+ *
+ * @param compiler The compiler to use.
+ * @param target The offset to jump to.
+*/
+static void perf_compiler_emit_loop(perf_compiler_t *compiler, uint32_t target)
+{
+    bool is_register = compiler->format == PERF_PROGRAM_FORMAT_REGISTER;
+
+    // Jumps are measured from the end of the instruction.
+    uint32_t distance = compiler->function->code_count + (is_register ? 4 : 3) - target;
+
+    if (distance > UINT16_MAX)
+    {
+        perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "loop body too large, split up the function", PERF_AST_NONE);
+        return;
+    }
+
+    if (is_register) perf_compiler_emit_register(compiler, ROP_LOOP, 0, distance & 0xFF, distance >> 8);
+    else perf_compiler_emit(compiler, OP_LOOP, distance);
+}
+
+/**
+ * @brief Adds a break or continue jump to the innermost loop.
+ *
+ * @param compiler The compiler to use.
+ * @param at The offset of the jump's operand, or'd with PERF_COMPILER_CONTINUE for a continue.
+*/
+static void perf_compiler_push_jump(perf_compiler_t *compiler, uint32_t at)
+{
+    // Make room for the jump
+    if (compiler->jump_count == compiler->jump_capacity
+        && perf_array_grow((void**)&compiler->jumps, &compiler->jump_capacity, sizeof(uint32_t)) != PERF_RES_OK)
+    {
+        perf_compiler_fail(compiler, PERF_RES_MEMORY_ALLOC_FAIL, "Failed to allocate memory for loop jumps", PERF_AST_NONE);
+        return;
+    }
+
+    // Add the jump
+    compiler->jumps[compiler->jump_count++] = at;
+}
+
+/**
+ * @brief Starts compiling a loop.
+ *
+ * @param compiler The compiler to use.
+ * @param loop The loop to start.
+ * @param continue_target Where continue jumps back to, UINT32_MAX if it comes after the body.
+*/
+static void perf_compiler_begin_loop(perf_compiler_t *compiler, perf_compiler_loop_t *loop, uint32_t continue_target)
+{
+    loop->enclosing         = compiler->function->loop;
+    loop->jump_base         = compiler->jump_count;
+    loop->continue_target   = continue_target;
+
+    compiler->function->loop = loop;
+}
+
+/**
+ * @brief Finishes compiling a loop, pointing its breaks at the current offset.
+ *
+ * @param compiler The compiler to use.
+ * @param loop The loop to finish.
+ * @param continue_target Where the forward continue jumps go.
+*/
+static void perf_compiler_end_loop(perf_compiler_t *compiler, perf_compiler_loop_t *loop, uint32_t continue_target)
+{
+    // Patch the loop's jumps
+    for (uint32_t idx = loop->jump_base; idx < compiler->jump_count; idx++)
+    {
+        uint32_t at = compiler->jumps[idx];
+
+        if (at & PERF_COMPILER_CONTINUE) perf_compiler_patch_jump(compiler, at & ~PERF_COMPILER_CONTINUE, continue_target);
+        else perf_compiler_patch_jump(compiler, at, compiler->function->code_count);
+    }
+
+    // Drop them, and leave the loop.
+    compiler->jump_count        = loop->jump_base;
+    compiler->function->loop    = loop->enclosing;
+}
+
+/**
+ * @brief Leaves a scope, releasing the slots of the locals declared in it.
+ *
+ * @param compiler The compiler to use.
+*/
+static void perf_compiler_end_scope(perf_compiler_t *compiler)
+{
+    perf_compiler_function_t* function = compiler->function;
+
+    function->scope_depth--;
+
+    while (function->local_count > 0 && function->locals[function->local_count - 1].depth > function->scope_depth)
+        function->local_count--;
+}
+
+/**
+ * @brief Declares a local in the current scope.
+ *
+ * @param compiler The compiler to use.
+ * @param token The index of the name's token.
+ * @param is_const True if the local can't be assigned to.
+ *
+ * @return The slot of the local, or UINT32_MAX if it couldn't be declared.
+*/
+static uint32_t perf_compiler_declare_local(perf_compiler_t *compiler, uint32_t token, bool is_const)
+{
+    perf_compiler_function_t* function = compiler->function;
+
+    // Get the name
+    const char* name = perf_compiler_string(compiler, token);
+    if (name == NULL) return UINT32_MAX;
+
+    // Names are unique within a scope.
+    for (uint32_t idx = function->local_count; idx > 0 && function->locals[idx - 1].depth == function->scope_depth; idx--)
+    {
+        if (function->locals[idx - 1].name == name)
+        {
+            perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "variable already declared in this scope", token);
+            return UINT32_MAX;
+        }
+    }
+
+    // Slots are a u8 operand.
+    if (function->local_count == PERF_COMPILER_MAX_SLOTS)
+    {
+        perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "too many local variables in function", token);
+        return UINT32_MAX;
+    }
+
+    // Take the next slot
+    perf_compiler_local_t* local = &function->locals[function->local_count];
+    local->name     = name;
+    local->depth    = function->scope_depth;
+    local->is_const = is_const;
+
+    // Track the most slots in use at once
+    if (++function->local_count > function->slot_count) function->slot_count = function->local_count;
+
+    // Return the slot
+    return function->local_count - 1;
+}
+
+/**
+ * @brief Resolves a variable name to a local slot, a global slot or a function.
+ *
+ * @param compiler The compiler to use.
+ * @param token The index of the name's token.
+ * @param variable The resolved variable.
+ *
+ * @return true if the name was resolved.
+*/
+static bool perf_compiler_resolve(perf_compiler_t *compiler, uint32_t token, perf_compiler_variable_t *variable)
+{
+    // Get the name
+    const char* name = perf_compiler_string(compiler, token);
+    if (name == NULL) return false;
+
+    // Look through the function and the ones it is nested in, innermost first.
+    for (perf_compiler_function_t* function = compiler->function; function != NULL; function = function->enclosing)
+    {
+        // Look for a local, the innermost scope first.
+        for (uint32_t idx = function->local_count; idx > 0; idx--)
+        {
+            if (function->locals[idx - 1].name != name) continue;
+
+            // Locals of enclosing functions aren't reachable from here.
+            if (function != compiler->function)
+            {
+                perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "cannot use a local variable of an enclosing function", token);
+                return false;
+            }
+
+            variable->kind      = PERF_COMPILER_VARIABLE_LOCAL;
+            variable->index     = idx - 1;
+            variable->is_const  = function->locals[idx - 1].is_const;
+            return true;
+        }
+
+        // A local function's name refers to the function itself inside it, there is nothing to capture.
+        if (function->is_local && function->name == name)
+        {
+            variable->kind      = PERF_COMPILER_VARIABLE_FUNCTION;
+            variable->index     = function->index;
+            variable->is_const  = true;
+            return true;
+        }
+    }
+
+    // Otherwise it is a global, which may be defined by code that hasn't run yet.
+    perf_compiler_global_t* global = perf_compiler_global(compiler, name, true);
+    if (global == NULL) return false;
+
+    variable->kind      = PERF_COMPILER_VARIABLE_GLOBAL;
+    variable->index     = global->index;
+    variable->is_const  = global->is_const;
+    return true;
+}
+
+static void perf_compiler_expression(perf_compiler_t *compiler, uint32_t node);
+static void perf_compiler_statement(perf_compiler_t *compiler, uint32_t node);
+static uint32_t perf_compiler_function(perf_compiler_t *compiler, uint32_t node, bool is_local, perf_e_function_kind_t kind);
+
+/**
+ * @brief Builds the value of a constant.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the constant's node.
+ * @param value The value.
+ *
+ * @return true if the value was built.
+*/
+static bool perf_compiler_literal_value(perf_compiler_t *compiler, uint32_t node, perf_value_t *value)
+{
+    // Everything but strings reads the same as it folds.
+    if (perf_fold_constant(compiler->ast, node, value)) return true;
+
+    const char* str = perf_compiler_string(compiler, compiler->ast->nodes[node].token);
+    if (str == NULL) return false;
+
+    *value = perf_value_string(str);
+    return true;
+}
+
+/**
+ * @brief Compiles a constant.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the constant's node.
+*/
+static void perf_compiler_literal(perf_compiler_t *compiler, uint32_t node)
+{
+    perf_value_t value;
+    if (!perf_compiler_literal_value(compiler, node, &value)) return;
+
+    // Booleans have instructions of their own.
+    if (perf_value_is(value, PERF_VALUE_BOOL)) perf_compiler_emit_op(compiler, perf_value_as_index(value) ? OP_TRUE : OP_FALSE);
+    else perf_compiler_emit_constant(compiler, &value);
+}
+
+/**
+ * @brief Compiles an expression, leaving its value on the stack.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the expression node.
+*/
+static void perf_compiler_expression(perf_compiler_t *compiler, uint32_t node)
+{
+    // Stop once something failed.
+    if (compiler->status != PERF_RES_OK) return;
+
+    const perf_parser_node_t* current = &compiler->ast->nodes[node];
+
+    // Refuse input nested deep enough to overflow the stack.
+    if (!perf_compiler_enter(compiler, current->token, "expression nested too deeply")) return;
+
+    // Point the code at the node's token
+    perf_compiler_at(compiler, current->token);
+
+    switch (current->node_type)
+    {
+    case AST_CONSTANT: perf_compiler_literal(compiler, node); break;
+
+    case AST_VARIABLE:
+    {
+        perf_compiler_variable_t variable;
+        if (!perf_compiler_resolve(compiler, current->token, &variable)) break;
+
+        if (variable.kind == PERF_COMPILER_VARIABLE_LOCAL) perf_compiler_emit(compiler, OP_GET_LOCAL, variable.index);
+        else if (variable.kind == PERF_COMPILER_VARIABLE_GLOBAL) perf_compiler_emit(compiler, OP_GET_GLOBAL, variable.index);
+        else perf_compiler_emit_function(compiler, variable.index);
+        break;
+    }
+
+    case AST_GROUP_EXPR: perf_compiler_expression(compiler, current->lhs); break;
+
+    case AST_UNARY_EXPR:
+    {
+        perf_compiler_expression(compiler, current->lhs);
+
+        perf_compiler_at(compiler, current->token);
+        perf_compiler_emit_op(compiler, compiler->ast->tokens[current->token].type == TOKEN_MINUS ? OP_NEGATE : OP_NOT);
+        break;
+    }
+
+    case AST_BINARY_EXPR:
+    {
+        perf_compiler_expression(compiler, current->lhs);
+        perf_compiler_expression(compiler, current->rhs);
+
+        perf_compiler_at(compiler, current->token);
+        perf_compiler_emit_op(compiler, (perf_e_opcode_t)perf_compiler_binary_ops[compiler->ast->tokens[current->token].type]);
+        break;
+    }
+
+    case AST_ASSIGN_EXPR:
+    {
+        const perf_parser_node_t* target = &compiler->ast->nodes[current->lhs];
+
+        // Members are set on the object.
+        if (target->node_type == AST_MEMBER_EXPR)
+        {
+            uint32_t site = 0;
+            if (!perf_compiler_site(compiler, target->token, &site)) break;
+
+            perf_compiler_expression(compiler, target->lhs);
+            perf_compiler_expression(compiler, current->rhs);
+
+            perf_compiler_at(compiler, current->token);
+            perf_compiler_emit(compiler, OP_SET_MEMBER, site);
+            break;
+        }
+
+        // Otherwise it is a variable.
+        perf_compiler_expression(compiler, current->rhs);
+
+        perf_compiler_variable_t variable;
+        if (!perf_compiler_resolve(compiler, target->token, &variable)) break;
+
+        if (variable.is_const)
+        {
+            perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "cannot assign to a constant", target->token);
+            break;
+        }
+
+        perf_compiler_at(compiler, current->token);
+        perf_compiler_emit(compiler, variable.kind == PERF_COMPILER_VARIABLE_LOCAL ? OP_SET_LOCAL : OP_SET_GLOBAL, variable.index);
+        break;
+    }
+
+    case AST_CALL_EXPR:
+    {
+        const perf_parser_node_t*   callee  = &compiler->ast->nodes[current->lhs];
+        uint32_t                    site    = UINT32_MAX;
+
+        // Calling a member invokes it on the object, which goes where the callee would.
+        if (callee->node_type == AST_MEMBER_EXPR)
+        {
+            if (!perf_compiler_site(compiler, callee->token, &site)) break;
+
+            perf_compiler_expression(compiler, callee->lhs);
+        }
+
+        // Otherwise push the callee, then the arguments.
+        else perf_compiler_expression(compiler, current->lhs);
+
+        uint32_t        count = compiler->ast->extra[current->rhs];
+        const uint32_t* items = &compiler->ast->extra[current->rhs + 1];
+
+        if (count > PERF_COMPILER_MAX_ARGUMENTS)
+        {
+            perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "too many arguments", current->token);
+            break;
+        }
+
+        for (uint32_t idx = 0; idx < count; idx++) perf_compiler_expression(compiler, items[idx]);
+
+        // The call pops the arguments and leaves the result in the callee's place.
+        perf_compiler_at(compiler, current->token);
+
+        if (site != UINT32_MAX)
+        {
+            perf_compiler_emit_op(compiler, OP_INVOKE);
+            perf_compiler_emit_operand(compiler, site, 4);
+            perf_compiler_emit_byte(compiler, (uint8_t)count);
+        }
+        else perf_compiler_emit(compiler, OP_CALL, count);
+
+        compiler->function->stack_depth -= (int32_t)count;
+        break;
+    }
+
+    case AST_MEMBER_EXPR:
+    {
+        uint32_t site = 0;
+        if (!perf_compiler_site(compiler, current->token, &site)) break;
+
+        perf_compiler_expression(compiler, current->lhs);
+
+        perf_compiler_at(compiler, current->token);
+        perf_compiler_emit(compiler, OP_GET_MEMBER, site);
+        break;
+    }
+
+    case AST_THIS_EXPR:
+    {
+        if (perf_compiler_this(compiler, current->token)) perf_compiler_emit_op(compiler, OP_GET_THIS);
+        break;
+    }
+
+    default: perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "expected an expression", current->token); break;
+    }
+
+    // Leave the level
+    compiler->depth--;
+}
+
+// Marks a register operand that isn't there, e.g. the value of an assignment nothing reads.
+#define PERF_COMPILER_NO_REGISTER   UINT32_MAX
+
+/**
+ * @brief Checks if an expression assigns to anything, the only way a local can change while an expression is
+ * evaluated, as functions can't reach their caller's locals.
+ *
+ * @param ast The AST the expression is in.
+ * @param node The index of the expression node.
+ * @param depth The nesting depth of the node, expressions too deep to compile are assumed to assign.
+ *
+ * @return true if there is an assignment anywhere in the expression.
+*/
+static bool perf_compiler_assigns(const perf_ast_t *ast, uint32_t node, uint32_t depth)
+{
+    const perf_parser_node_t* current = &ast->nodes[node];
+
+    // Don't recurse past what the compiler will, it fails there anyway.
+    if (depth >= PERF_COMPILER_MAX_DEPTH) return true;
+
+    switch (current->node_type)
+    {
+    case AST_ASSIGN_EXPR:   return true;
+    case AST_GROUP_EXPR:
+    case AST_UNARY_EXPR:
+    case AST_MEMBER_EXPR:   return perf_compiler_assigns(ast, current->lhs, depth + 1);
+    case AST_BINARY_EXPR:   return perf_compiler_assigns(ast, current->lhs, depth + 1) || perf_compiler_assigns(ast, current->rhs, depth + 1);
+
+    case AST_CALL_EXPR:
+    {
+        if (perf_compiler_assigns(ast, current->lhs, depth + 1)) return true;
+
+        uint32_t        count = ast->extra[current->rhs];
+        const uint32_t* items = &ast->extra[current->rhs + 1];
+
+        for (uint32_t idx = 0; idx < count; idx++) if (perf_compiler_assigns(ast, items[idx], depth + 1)) return true;
+        return false;
+    }
+
+    default: return false;
+    }
+}
+
+/**
+ * @brief Starts compiling an expression of a statement to register code.
+ *
+ * Reading a local in its own register saves a move, but the register must not change before the read is
+ * done with, so that is only allowed when nothing in the expression below its root assigns.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the expression node.
+*/
+static void perf_compiler_register_begin(perf_compiler_t *compiler, uint32_t node)
+{
+    const perf_ast_t*         ast     = compiler->ast;
+    const perf_parser_node_t* current = &ast->nodes[node];
+    bool                      assigns;
+
+    // An assignment at the root stores its value last, after every read.
+    if (current->node_type == AST_ASSIGN_EXPR)
+    {
+        const perf_parser_node_t* target = &ast->nodes[current->lhs];
+        assigns = perf_compiler_assigns(ast, current->rhs, compiler->depth) || (target->node_type == AST_MEMBER_EXPR && perf_compiler_assigns(ast, target->lhs, compiler->depth));
+    }
+    else assigns = perf_compiler_assigns(ast, node, compiler->depth);
+
+    compiler->function->alias_locals = !assigns;
+}
+
+static void perf_compiler_register_expression(perf_compiler_t *compiler, uint32_t node, uint32_t target);
+
+/**
+ * @brief Compiles an expression to register code, into whichever register is cheapest.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the expression node.
+ *
+ * @return The register holding the value, a local's own register when it can be read in place.
+*/
+static uint32_t perf_compiler_register_operand(perf_compiler_t *compiler, uint32_t node)
+{
+    const perf_parser_node_t* current = &compiler->ast->nodes[node];
+
+    // Skip the parentheses
+    while (current->node_type == AST_GROUP_EXPR)
+    {
+        node    = current->lhs;
+        current = &compiler->ast->nodes[node];
+    }
+
+    // Read locals in place when allowed.
+    if (current->node_type == AST_VARIABLE && compiler->function->alias_locals)
+    {
+        perf_compiler_variable_t variable;
+        if (!perf_compiler_resolve(compiler, current->token, &variable)) return 0;
+
+        if (variable.kind == PERF_COMPILER_VARIABLE_LOCAL) return variable.index;
+    }
+
+    // Everything else goes to a temporary.
+    uint32_t target = perf_compiler_register(compiler);
+    perf_compiler_register_expression(compiler, node, target);
+
+    return target;
+}
+
+/**
+ * @brief Compiles an assignment to a variable to register code.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the AST_ASSIGN_EXPR node.
+ * @param target The register to also leave the value in, or PERF_COMPILER_NO_REGISTER.
+*/
+static void perf_compiler_register_assign(perf_compiler_t *compiler, uint32_t node, uint32_t target)
+{
+    const perf_parser_node_t* current   = &compiler->ast->nodes[node];
+    uint32_t                  name      = compiler->ast->nodes[current->lhs].token;
+
+    perf_compiler_variable_t variable;
+    if (!perf_compiler_resolve(compiler, name, &variable)) return;
+
+    if (variable.is_const)
+    {
+        perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "cannot assign to a constant", name);
+        return;
+    }
+
+    // Locals get the value straight into their register, it is written last so the value can still read it.
+    if (variable.kind == PERF_COMPILER_VARIABLE_LOCAL)
+    {
+        perf_compiler_register_expression(compiler, current->rhs, variable.index);
+
+        perf_compiler_at(compiler, current->token);
+        if (target != PERF_COMPILER_NO_REGISTER && target != variable.index) perf_compiler_emit_register(compiler, ROP_MOVE, target, variable.index, 0);
+        return;
+    }
+
+    // Globals are stored from wherever the value is.
+    uint32_t value = target;
+
+    if (value == PERF_COMPILER_NO_REGISTER) value = perf_compiler_register_operand(compiler, current->rhs);
+    else perf_compiler_register_expression(compiler, current->rhs, value);
+
+    perf_compiler_at(compiler, current->token);
+    perf_compiler_emit_register(compiler, ROP_SET_GLOBAL, value, 0, 0);
+    perf_compiler_emit_operand(compiler, variable.index, 4);
+}
+
+/**
+ * @brief Compiles an expression to register code.
+ *
+ * Operands go to temporaries above the ones in use, which are free again once the value is in the target.
+ * Only the last instruction writes the target, so the target may be a local the expression reads.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the expression node.
+ * @param target The register to leave the value in.
+*/
+static void perf_compiler_register_expression(perf_compiler_t *compiler, uint32_t node, uint32_t target)
+{
+    // Stop once something failed.
+    if (compiler->status != PERF_RES_OK) return;
+
+    const perf_parser_node_t*   current     = &compiler->ast->nodes[node];
+    perf_compiler_function_t*   function    = compiler->function;
+    uint32_t                    mark        = function->next_register;
+
+    // Refuse input nested deep enough to overflow the stack.
+    if (!perf_compiler_enter(compiler, current->token, "expression nested too deeply")) return;
+
+    // Point the code at the node's token
+    perf_compiler_at(compiler, current->token);
+
+    switch (current->node_type)
+    {
+    case AST_CONSTANT:
+    {
+        perf_value_t value;
+        if (!perf_compiler_literal_value(compiler, node, &value)) break;
+
+        // Booleans have instructions of their own.
+        if (perf_value_is(value, PERF_VALUE_BOOL)) perf_compiler_emit_register(compiler, perf_value_as_index(value) ? ROP_TRUE : ROP_FALSE, target, 0, 0);
+        else perf_compiler_emit_load(compiler, &value, target);
+        break;
+    }
+
+    case AST_VARIABLE:
+    {
+        perf_compiler_variable_t variable;
+        if (!perf_compiler_resolve(compiler, current->token, &variable)) break;
+
+        if (variable.kind == PERF_COMPILER_VARIABLE_LOCAL)
+        {
+            if (variable.index != target) perf_compiler_emit_register(compiler, ROP_MOVE, target, variable.index, 0);
+        }
+        else if (variable.kind == PERF_COMPILER_VARIABLE_GLOBAL)
+        {
+            perf_compiler_emit_register(compiler, ROP_GET_GLOBAL, target, 0, 0);
+            perf_compiler_emit_operand(compiler, variable.index, 4);
+        }
+        else perf_compiler_emit_load_function(compiler, variable.index, target);
+        break;
+    }
+
+    case AST_GROUP_EXPR: perf_compiler_register_expression(compiler, current->lhs, target); break;
+
+    case AST_UNARY_EXPR:
+    {
+        uint32_t operand = perf_compiler_register_operand(compiler, current->lhs);
+
+        perf_compiler_at(compiler, current->token);
+        perf_compiler_emit_register(compiler, compiler->ast->tokens[current->token].type == TOKEN_MINUS ? ROP_NEGATE : ROP_NOT, target, operand, 0);
+        break;
+    }
+
+    case AST_BINARY_EXPR:
+    {
+        perf_e_reg_opcode_t         opcode  = (perf_e_reg_opcode_t)perf_compiler_register_ops[compiler->ast->tokens[current->token].type];
+        const perf_parser_node_t*   rhs     = &compiler->ast->nodes[current->rhs];
+
+        // Adding or subtracting a constant reads it from the pool, if its index fits in c.
+        if ((opcode == ROP_ADD || opcode == ROP_SUBTRACT) && rhs->node_type == AST_CONSTANT)
+        {
+            perf_value_t value;
+            uint32_t     index = 0;
+
+            if (!perf_compiler_literal_value(compiler, current->rhs, &value)) break;
+
+            if (!perf_value_is(value, PERF_VALUE_BOOL) && perf_compiler_constant(compiler, &value, &index) && index <= UINT8_MAX)
+            {
+                uint32_t lhs = perf_compiler_register_operand(compiler, current->lhs);
+
+                perf_compiler_at(compiler, current->token);
+                perf_compiler_emit_register(compiler, opcode == ROP_ADD ? ROP_ADD_CONSTANT : ROP_SUBTRACT_CONSTANT, target, lhs, index);
+                break;
+            }
+        }
+
+        uint32_t lhs = perf_compiler_register_operand(compiler, current->lhs);
+        uint32_t rhs_register = perf_compiler_register_operand(compiler, current->rhs);
+
+        perf_compiler_at(compiler, current->token);
+        perf_compiler_emit_register(compiler, opcode, target, lhs, rhs_register);
+        break;
+    }
+
+    case AST_ASSIGN_EXPR:
+    {
+        const perf_parser_node_t* assigned = &compiler->ast->nodes[current->lhs];
+
+        // Variables are stored to directly.
+        if (assigned->node_type != AST_MEMBER_EXPR)
+        {
+            perf_compiler_register_assign(compiler, node, target);
+            break;
+        }
+
+        // Members are set on the object, which comes first.
+        uint32_t site = 0;
+        if (!perf_compiler_site(compiler, assigned->token, &site)) break;
+
+        uint32_t object = perf_compiler_register_operand(compiler, assigned->lhs);
+        perf_compiler_register_expression(compiler, current->rhs, target);
+
+        perf_compiler_at(compiler, current->token);
+        perf_compiler_emit_register(compiler, ROP_SET_MEMBER, object, target, 0);
+        perf_compiler_emit_operand(compiler, site, 4);
+        break;
+    }
+
+    case AST_CALL_EXPR:
+    {
+        uint32_t        count = compiler->ast->extra[current->rhs];
+        const uint32_t* items = &compiler->ast->extra[current->rhs + 1];
+
+        if (count > PERF_COMPILER_MAX_ARGUMENTS)
+        {
+            perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "too many arguments", current->token);
+            break;
+        }
+
+        // The callee and the arguments take consecutive registers above everything in use, starting at the
+        // target when it is the newest temporary, so the result lands where it is wanted.
+        uint32_t base = target + 1 == function->next_register && target >= function->local_count ? target : perf_compiler_register(compiler);
+
+        // Calling a member invokes it on the object, which goes where the callee would.
+        const perf_parser_node_t*   callee  = &compiler->ast->nodes[current->lhs];
+        uint32_t                    site    = UINT32_MAX;
+
+        if (callee->node_type == AST_MEMBER_EXPR)
+        {
+            if (!perf_compiler_site(compiler, callee->token, &site)) break;
+
+            perf_compiler_register_expression(compiler, callee->lhs, base);
+        }
+        else perf_compiler_register_expression(compiler, current->lhs, base);
+
+        for (uint32_t idx = 0; idx < count; idx++) perf_compiler_register_expression(compiler, items[idx], perf_compiler_register(compiler));
+
+        perf_compiler_at(compiler, current->token);
+
+        if (site != UINT32_MAX)
+        {
+            perf_compiler_emit_register(compiler, ROP_INVOKE, base, count, 0);
+            perf_compiler_emit_operand(compiler, site, 4);
+        }
+        else perf_compiler_emit_register(compiler, ROP_CALL, base, count, 0);
+
+        if (base != target) perf_compiler_emit_register(compiler, ROP_MOVE, target, base, 0);
+        break;
+    }
+
+    case AST_MEMBER_EXPR:
+    {
+        uint32_t site = 0;
+        if (!perf_compiler_site(compiler, current->token, &site)) break;
+
+        uint32_t object = perf_compiler_register_operand(compiler, current->lhs);
+
+        perf_compiler_at(compiler, current->token);
+        perf_compiler_emit_register(compiler, ROP_GET_MEMBER, target, object, 0);
+        perf_compiler_emit_operand(compiler, site, 4);
+        break;
+    }
+
+    case AST_THIS_EXPR:
+    {
+        if (perf_compiler_this(compiler, current->token)) perf_compiler_emit_register(compiler, ROP_GET_THIS, target, 0, 0);
+        break;
+    }
+
+    default: perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "expected an expression", current->token); break;
+    }
+
+    // Free the temporaries
+    function->next_register = mark;
+
+    // Leave the level
+    compiler->depth--;
+}
+
+/**
+ * @brief Compiles an expression for its effect, dropping its value.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the expression node.
+*/
+static void perf_compiler_effect(perf_compiler_t *compiler, uint32_t node)
+{
+    // Stack code pops the value the expression leaves.
+    if (compiler->format != PERF_PROGRAM_FORMAT_REGISTER)
+    {
+        perf_compiler_expression(compiler, node);
+        perf_compiler_emit_op(compiler, OP_POP);
+        return;
+    }
+
+    const perf_parser_node_t* current = &compiler->ast->nodes[node];
+
+    compiler->function->next_register = compiler->function->local_count;
+    perf_compiler_register_begin(compiler, node);
+
+    // Assignments to variables need no register for the value of the assignment.
+    if (current->node_type == AST_ASSIGN_EXPR && compiler->ast->nodes[current->lhs].node_type != AST_MEMBER_EXPR)
+    {
+        perf_compiler_at(compiler, current->token);
+        perf_compiler_register_assign(compiler, node, PERF_COMPILER_NO_REGISTER);
+        return;
+    }
+
+    perf_compiler_register_expression(compiler, node, perf_compiler_register(compiler));
+}
+
+/**
+ * @brief Compiles a condition, and a forward jump taken when it is falsy.
+ *
+ * In register code a comparison and its jump are one instruction, reading the operands where they are.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the condition's expression node.
+ *
+ * @return The offset of the jump's operand.
+*/
+static uint32_t perf_compiler_condition(perf_compiler_t *compiler, uint32_t node)
+{
+    // Stack code tests the value the expression leaves.
+    if (compiler->format != PERF_PROGRAM_FORMAT_REGISTER)
+    {
+        perf_compiler_expression(compiler, node);
+        return perf_compiler_emit_jump(compiler, OP_JUMP_IF_FALSE);
+    }
+
+    perf_compiler_function_t*   function    = compiler->function;
+    const perf_parser_node_t*   current     = &compiler->ast->nodes[node];
+
+    function->next_register = function->local_count;
+    perf_compiler_register_begin(compiler, node);
+
+    // Skip the parentheses
+    while (current->node_type == AST_GROUP_EXPR) current = &compiler->ast->nodes[current->lhs];
+
+    // Comparisons jump on their own.
+    perf_e_reg_opcode_t jump = ROP_COUNT;
+
+    if (current->node_type == AST_BINARY_EXPR)
+    {
+        switch (perf_compiler_register_ops[compiler->ast->tokens[current->token].type])
+        {
+        case ROP_EQUAL:         jump = ROP_JUMP_IF_NOT_EQUAL;           break;
+        case ROP_NOT_EQUAL:     jump = ROP_JUMP_IF_EQUAL;               break;
+        case ROP_GREATER:       jump = ROP_JUMP_IF_NOT_GREATER;         break;
+        case ROP_GREATER_EQUAL: jump = ROP_JUMP_IF_NOT_GREATER_EQUAL;   break;
+        case ROP_LESS:          jump = ROP_JUMP_IF_NOT_LESS;            break;
+        case ROP_LESS_EQUAL:    jump = ROP_JUMP_IF_NOT_LESS_EQUAL;      break;
+        default:                                                        break;
+        }
+    }
+
+    if (jump != ROP_COUNT)
+    {
+        uint32_t lhs = perf_compiler_register_operand(compiler, current->lhs);
+        uint32_t rhs = perf_compiler_register_operand(compiler, current->rhs);
+
+        // The distance is the second word's bx.
+        perf_compiler_at(compiler, current->token);
+        perf_compiler_emit_register(compiler, jump, lhs, rhs, 0);
+        perf_compiler_emit_operand(compiler, 0, 4);
+    }
+
+    // Everything else is tested for falsiness.
+    else perf_compiler_emit_register(compiler, ROP_JUMP_IF_FALSE, perf_compiler_register_operand(compiler, node), 0, 0);
+
+    return function->code_count - 2;
+}
+
+/**
+ * @brief Compiles a variable declaration to register code.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the AST_VAR_DECL node.
+ * @param is_const True if the variable can't be assigned to.
+*/
+static void perf_compiler_register_declaration(perf_compiler_t *compiler, uint32_t node, bool is_const)
+{
+    const perf_parser_node_t*   current     = &compiler->ast->nodes[node];
+    perf_compiler_function_t*   function    = compiler->function;
+    uint32_t                    value;
+
+    if (current->lhs != PERF_AST_NONE) perf_compiler_register_begin(compiler, current->lhs);
+
+    // Top level declarations are globals, stored from wherever the value is.
+    if (function->enclosing == NULL && function->scope_depth == 0)
+    {
+        const char* name = perf_compiler_string(compiler, current->token);
+        if (name == NULL) return;
+
+        if (current->lhs != PERF_AST_NONE) value = perf_compiler_register_operand(compiler, current->lhs);
+        else perf_compiler_emit_register(compiler, ROP_NIL, value = perf_compiler_register(compiler), 0, 0);
+
+        perf_compiler_at(compiler, current->token);
+        perf_compiler_emit_register(compiler, ROP_SET_GLOBAL, value, 0, 0);
+        perf_compiler_emit_operand(compiler, perf_compiler_global(compiler, name, false)->index, 4);
+        return;
+    }
+
+    // Locals are computed into the first free register, which becomes their slot once declared, so the value
+    // can't see the variable being declared.
+    value = perf_compiler_register(compiler);
+
+    if (current->lhs != PERF_AST_NONE) perf_compiler_register_expression(compiler, current->lhs, value);
+    else perf_compiler_emit_register(compiler, ROP_NIL, value, 0, 0);
+
+    perf_compiler_at(compiler, current->token);
+    perf_compiler_declare_local(compiler, current->token, is_const);
+}
+
+/**
+ * @brief Compiles a list of statements in a new scope.
+ *
+ * @param compiler The compiler to use.
+ * @param list The index of the list in the AST's extra array.
+*/
+static void perf_compiler_block(perf_compiler_t *compiler, uint32_t list)
+{
+    compiler->function->scope_depth++;
+
+    uint32_t        count = compiler->ast->extra[list];
+    const uint32_t* items = &compiler->ast->extra[list + 1];
+
+    for (uint32_t idx = 0; idx < count && compiler->status == PERF_RES_OK; idx++) perf_compiler_statement(compiler, items[idx]);
+
+    perf_compiler_end_scope(compiler);
+}
+
+/**
+ * @brief Compiles the branch of an if or the body of a loop in a scope of its own, so a lone declaration stays local to it.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the statement node.
+*/
+static void perf_compiler_body(perf_compiler_t *compiler, uint32_t node)
+{
+    compiler->function->scope_depth++;
+
+    perf_compiler_statement(compiler, node);
+
+    perf_compiler_end_scope(compiler);
+}
+
+/**
+ * @brief Compiles a statement. The operand stack is empty before and after it.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the statement node.
+*/
+static void perf_compiler_statement(perf_compiler_t *compiler, uint32_t node)
+{
+    // Stop once something failed.
+    if (compiler->status != PERF_RES_OK) return;
+
+    const perf_parser_node_t*   current     = &compiler->ast->nodes[node];
+    perf_compiler_function_t*   function    = compiler->function;
+
+    // Statements nest too (blocks, branches, loop bodies), so they count towards the depth limit.
+    if (!perf_compiler_enter(compiler, current->token, "statement nested too deeply")) return;
+
+    // Point the code at the node's token
+    perf_compiler_at(compiler, current->token);
+
+    // No temporaries are live between statements.
+    function->next_register = function->local_count;
+
+    switch (current->node_type)
+    {
+    case AST_EXPR_STATEMENT: perf_compiler_effect(compiler, current->lhs); break;
+
+    case AST_VAR_DECL:
+    {
+        bool is_const = current->flags == TOKEN_KEYWORD_CONST;
+
+        if (compiler->format == PERF_PROGRAM_FORMAT_REGISTER)
+        {
+            perf_compiler_register_declaration(compiler, node, is_const);
+            break;
+        }
+
+        // The value comes first, so it can't see the variable being declared.
+        if (current->lhs != PERF_AST_NONE) perf_compiler_expression(compiler, current->lhs);
+        else perf_compiler_emit_op(compiler, OP_NIL);
+
+        perf_compiler_at(compiler, current->token);
+
+        // Top level declarations are globals, declared before anything is compiled.
+        if (function->enclosing == NULL && function->scope_depth == 0)
+        {
+            const char* name = perf_compiler_string(compiler, current->token);
+            if (name == NULL) break;
+
+            perf_compiler_emit(compiler, OP_SET_GLOBAL, perf_compiler_global(compiler, name, false)->index);
+        }
+
+        // Everything else is a local of the function.
+        else
+        {
+            uint32_t slot = perf_compiler_declare_local(compiler, current->token, is_const);
+            if (slot == UINT32_MAX) break;
+
+            perf_compiler_emit(compiler, OP_SET_LOCAL, slot);
+        }
+
+        perf_compiler_emit_op(compiler, OP_POP);
+        break;
+    }
+
+    case AST_EXPR_FUNCTION_DEF:
+    {
+        // Top level functions were defined before the script's first statement.
+        if (function->enclosing == NULL && function->scope_depth == 0) break;
+
+        // Declare the local first, so later statements can call it.
+        uint32_t slot = perf_compiler_declare_local(compiler, current->token, false);
+        if (slot == UINT32_MAX) break;
+
+        uint32_t index = perf_compiler_function(compiler, node, true, PERF_FUNCTION_PLAIN);
+
+        perf_compiler_at(compiler, current->token);
+
+        // Register code loads it straight into its slot.
+        if (compiler->format == PERF_PROGRAM_FORMAT_REGISTER)
+        {
+            perf_compiler_emit_load_function(compiler, index, slot);
+            break;
+        }
+
+        perf_compiler_emit_function(compiler, index);
+        perf_compiler_emit(compiler, OP_SET_LOCAL, slot);
+        perf_compiler_emit_op(compiler, OP_POP);
+        break;
+    }
+
+    case AST_CLASS_DEF:
+    {
+        // Classes were defined before the script's first statement, they can't be declared anywhere else.
+        if (function->enclosing == NULL && function->scope_depth == 0) break;
+
+        perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "classes can only be declared at the top level", current->token);
+        break;
+    }
+
+    case AST_BLOCK: perf_compiler_block(compiler, current->lhs); break;
+
+    case AST_IF_STMT:
+    {
+        uint32_t        count = compiler->ast->extra[current->rhs];
+        const uint32_t* items = &compiler->ast->extra[current->rhs + 1];
+
+        // Skip the then branch if the condition is falsy.
+        uint32_t skip_then = perf_compiler_condition(compiler, current->lhs);
+
+        perf_compiler_body(compiler, items[0]);
+
+        // Without an else branch the condition jumps straight past the then branch.
+        if (count == 1)
+        {
+            perf_compiler_patch_jump(compiler, skip_then, function->code_count);
+            break;
+        }
+
+        // Otherwise the then branch jumps past the else branch.
+        uint32_t skip_else = perf_compiler_emit_jump(compiler, OP_JUMP);
+        perf_compiler_patch_jump(compiler, skip_then, function->code_count);
+
+        perf_compiler_body(compiler, items[1]);
+        perf_compiler_patch_jump(compiler, skip_else, function->code_count);
+        break;
+    }
+
+    case AST_WHILE_STMT:
+    {
+        perf_compiler_loop_t loop;
+        uint32_t start = perf_compiler_label(compiler);
+
+        // Check the condition, then run the body and go back to the condition.
+        uint32_t exit = perf_compiler_condition(compiler, current->lhs);
+
+        perf_compiler_begin_loop(compiler, &loop, start);
+        perf_compiler_body(compiler, current->rhs);
+        perf_compiler_emit_loop(compiler, start);
+
+        perf_compiler_patch_jump(compiler, exit, function->code_count);
+        perf_compiler_end_loop(compiler, &loop, start);
+        break;
+    }
+
+    case AST_DO_WHILE_STMT:
+    {
+        perf_compiler_loop_t loop;
+        uint32_t start = perf_compiler_label(compiler);
+
+        // Run the body, continue goes to the condition after it.
+        perf_compiler_begin_loop(compiler, &loop, UINT32_MAX);
+        perf_compiler_body(compiler, current->lhs);
+
+        uint32_t condition = perf_compiler_label(compiler);
+        uint32_t exit = perf_compiler_condition(compiler, current->rhs);
+        perf_compiler_emit_loop(compiler, start);
+
+        perf_compiler_patch_jump(compiler, exit, function->code_count);
+        perf_compiler_end_loop(compiler, &loop, condition);
+        break;
+    }
+
+    case AST_FOR_STMT:
+    {
+        const uint32_t* parts = &compiler->ast->extra[current->lhs + 1];
+        perf_compiler_loop_t loop;
+
+        // The init's declarations are scoped to the loop.
+        function->scope_depth++;
+
+        if (parts[0] != PERF_AST_NONE)
+        {
+            // A declaration is a statement of its own, an expression leaves a value to drop.
+            if (compiler->ast->nodes[parts[0]].node_type == AST_VAR_DECL) perf_compiler_statement(compiler, parts[0]);
+            else perf_compiler_effect(compiler, parts[0]);
+        }
+
+        // Check the condition, if any.
+        uint32_t start  = perf_compiler_label(compiler);
+        uint32_t exit   = UINT32_MAX;
+
+        if (parts[1] != PERF_AST_NONE) exit = perf_compiler_condition(compiler, parts[1]);
+
+        // Run the body, continue goes to the step after it.
+        perf_compiler_begin_loop(compiler, &loop, UINT32_MAX);
+        perf_compiler_body(compiler, parts[3]);
+
+        uint32_t step = perf_compiler_label(compiler);
+
+        if (parts[2] != PERF_AST_NONE) perf_compiler_effect(compiler, parts[2]);
+
+        perf_compiler_emit_loop(compiler, start);
+
+        if (exit != UINT32_MAX) perf_compiler_patch_jump(compiler, exit, function->code_count);
+        perf_compiler_end_loop(compiler, &loop, step);
+
+        perf_compiler_end_scope(compiler);
+        break;
+    }
+
+    case AST_RETURN_STMT:
+    {
+        // Initializers always return their instance.
+        bool is_initializer = function->kind == PERF_FUNCTION_INITIALIZER;
+
+        if (is_initializer && current->lhs != PERF_AST_NONE)
+        {
+            perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "cannot return a value from an initializer", current->token);
+            break;
+        }
+
+        // Register code returns the value from wherever it is.
+        if (compiler->format == PERF_PROGRAM_FORMAT_REGISTER)
+        {
+            uint32_t value;
+
+            if (current->lhs != PERF_AST_NONE)
+            {
+                perf_compiler_register_begin(compiler, current->lhs);
+                value = perf_compiler_register_operand(compiler, current->lhs);
+            }
+            else perf_compiler_emit_register(compiler, is_initializer ? ROP_GET_THIS : ROP_NIL, value = perf_compiler_register(compiler), 0, 0);
+
+            perf_compiler_at(compiler, current->token);
+            perf_compiler_emit_register(compiler, ROP_RETURN, value, 0, 0);
+            break;
+        }
+
+        if (current->lhs != PERF_AST_NONE) perf_compiler_expression(compiler, current->lhs);
+        else perf_compiler_emit_op(compiler, is_initializer ? OP_GET_THIS : OP_NIL);
+
+        perf_compiler_at(compiler, current->token);
+        perf_compiler_emit_op(compiler, OP_RETURN);
+        break;
+    }
+
+    case AST_BREAK_STMT:
+    case AST_CONTINUE_STMT:
+    {
+        bool is_continue = current->node_type == AST_CONTINUE_STMT;
+
+        if (function->loop == NULL)
+        {
+            perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, is_continue ? "continue outside of a loop" : "break outside of a loop", current->token);
+            break;
+        }
+
+        // Continue jumps straight back when the target is known already.
+        if (is_continue && function->loop->continue_target != UINT32_MAX)
+        {
+            perf_compiler_emit_loop(compiler, function->loop->continue_target);
+            break;
+        }
+
+        // Otherwise the jump is patched when the loop ends.
+        uint32_t at = perf_compiler_emit_jump(compiler, OP_JUMP);
+        perf_compiler_push_jump(compiler, is_continue ? at | PERF_COMPILER_CONTINUE : at);
+        break;
+    }
+
+    default: perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "expected a statement", current->token); break;
+    }
+
+    // Leave the level
+    compiler->depth--;
+}
+
+/**
+ * @brief Starts compiling a function, making it the current one.
+ *
+ * @param compiler The compiler to use.
+ * @param name The interned name of the function, NULL for the script.
+ * @param is_local True if the function is a local of the enclosing one.
+ *
+ * @return The function, or NULL if it couldn't be started.
+*/
+static perf_compiler_function_t* perf_compiler_begin_function(perf_compiler_t *compiler, const char* name, bool is_local)
+{
+    // Functions nest as deep as the AST does, so their state lives on the heap.
+    perf_compiler_function_t* function = (perf_compiler_function_t*)calloc(1, sizeof(perf_compiler_function_t));
+
+    if (function == NULL)
+    {
+        perf_compiler_fail(compiler, PERF_RES_MEMORY_ALLOC_FAIL, "Failed to allocate memory for function", PERF_AST_NONE);
+        return NULL;
+    }
+
+    // Add the function to the program, it is filled in once it is done.
+    const char*   error  = NULL;
+    perf_result_t result = perf_program_add_function(compiler->program, name, &function->index, &error);
+
+    if (result != PERF_RES_OK)
+    {
+        perf_compiler_fail(compiler, result, error, PERF_AST_NONE);
+        free(function);
+        return NULL;
+    }
+
+    // Nest it in the current function
+    function->enclosing = compiler->function;
+    function->name      = name;
+    function->is_local  = is_local;
+    function->line      = compiler->function != NULL ? compiler->function->line : 1;
+    compiler->function  = function;
+
+    // Return the function
+    return function;
+}
+
+/**
+ * @brief Finishes compiling the current function, moving its code and lines into the program.
+ *
+ * @param compiler The compiler to use.
+ *
+ * @return The index of the function.
+*/
+static uint32_t perf_compiler_end_function(perf_compiler_t *compiler)
+{
+    perf_compiler_function_t* function = compiler->function;
+    perf_program_t*           program  = compiler->program;
+
+    // Every function returns nil if it runs off its end, initializers their instance.
+    bool is_initializer = function->kind == PERF_FUNCTION_INITIALIZER;
+
+    if (compiler->format == PERF_PROGRAM_FORMAT_REGISTER)
+    {
+        function->next_register = function->local_count;
+
+        uint32_t value = perf_compiler_register(compiler);
+        perf_compiler_emit_register(compiler, is_initializer ? ROP_GET_THIS : ROP_NIL, value, 0, 0);
+        perf_compiler_emit_register(compiler, ROP_RETURN, value, 0, 0);
+    }
+    else
+    {
+        perf_compiler_emit_op(compiler, is_initializer ? OP_GET_THIS : OP_NIL);
+        perf_compiler_emit_op(compiler, OP_RETURN);
+    }
+
+    // Move the code and lines into the program.
+    uint32_t      code_offset = 0;
+    uint32_t      line_offset = 0;
+    const char*   error       = NULL;
+    perf_result_t result      = compiler->status;
+
+    if (result == PERF_RES_OK) result = perf_program_add_code(program, function->code, function->code_count, &code_offset, &error);
+
+    if (result == PERF_RES_OK)
+    {
+        // Line table offsets are relative to the program's code.
+        for (uint32_t idx = 0; idx < function->line_count; idx++) function->lines[idx].offset += code_offset;
+
+        result = perf_program_add_lines(program, function->lines, function->line_count, &line_offset, &error);
+    }
+
+    // Fill in the function
+    if (result == PERF_RES_OK)
+    {
+        perf_function_t* fn = &program->functions[function->index];
+        fn->code_offset = code_offset;
+        fn->code_length = function->code_count;
+        fn->line_offset = line_offset;
+        fn->line_count  = function->line_count;
+        fn->slot_count  = (uint16_t)function->slot_count;
+        fn->max_stack   = function->max_stack;
+        fn->kind        = (uint8_t)function->kind;
+    }
+    else perf_compiler_fail(compiler, result, error, PERF_AST_NONE);
+
+    // Go back to the enclosing function
+    uint32_t index = function->index;
+    compiler->function = function->enclosing;
+
+    free(function->code);
+    free(function->lines);
+    free(function);
+
+    // Return the index
+    return index;
+}
+
+/**
+ * @brief Starts compiling a method of the class appended last, making it the current function.
+ *
+ * @param compiler The compiler to use.
+ * @param name The interned name of the method.
+ * @param kind PERF_FUNCTION_METHOD or PERF_FUNCTION_INITIALIZER.
+ *
+ * @return The function, or NULL if it couldn't be started.
+*/
+static perf_compiler_function_t* perf_compiler_begin_method(perf_compiler_t *compiler, const char* name, perf_e_function_kind_t kind)
+{
+    perf_compiler_function_t* function = perf_compiler_begin_function(compiler, name, false);
+    if (function == NULL) return NULL;
+
+    // Methods belong to their class, and find their receiver in the callee's slot.
+    function->kind = kind;
+    compiler->program->functions[function->index].class_index = compiler->program->class_count - 1;
+
+    // Add it to the class
+    const char*   error  = NULL;
+    perf_result_t result = perf_program_add_method(compiler->program, name, function->index, &error);
+
+    if (result != PERF_RES_OK) perf_compiler_fail(compiler, result, error, PERF_AST_NONE);
+
+    // Return the function
+    return function;
+}
+
+/**
+ * @brief Compiles a function definition into a function of the program.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the AST_EXPR_FUNCTION_DEF node.
+ * @param is_local True if the function is a local of the enclosing one.
+ * @param kind How calling the function starts, methods are added to the class appended last.
+ *
+ * @return The index of the function.
+*/
+static uint32_t perf_compiler_function(perf_compiler_t *compiler, uint32_t node, bool is_local, perf_e_function_kind_t kind)
+{
+    const perf_parser_node_t* current = &compiler->ast->nodes[node];
+
+    // Start the function
+    const char* name = perf_compiler_string(compiler, current->token);
+    if (name == NULL) return 0;
+
+    perf_compiler_function_t* function = kind == PERF_FUNCTION_PLAIN ? perf_compiler_begin_function(compiler, name, is_local)
+        : perf_compiler_begin_method(compiler, name, kind);
+    if (function == NULL) return 0;
+
+    perf_compiler_at(compiler, current->token);
+
+    // Parameters take the first slots, in the same scope as the body.
+    uint32_t        count = compiler->ast->extra[current->lhs];
+    const uint32_t* items = &compiler->ast->extra[current->lhs + 1];
+
+    function->scope_depth = 1;
+
+    if (count > PERF_COMPILER_MAX_ARGUMENTS) perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "too many parameters", current->token);
+    for (uint32_t idx = 0; idx < count && compiler->status == PERF_RES_OK; idx++)
+        perf_compiler_declare_local(compiler, compiler->ast->nodes[items[idx]].token, false);
+
+    compiler->program->functions[function->index].arity = (uint8_t)count;
+
+    // Compile the body's statements
+    const perf_parser_node_t* body = &compiler->ast->nodes[current->rhs];
+    uint32_t        statement_count = compiler->ast->extra[body->lhs];
+    const uint32_t* statements      = &compiler->ast->extra[body->lhs + 1];
+
+    for (uint32_t idx = 0; idx < statement_count && compiler->status == PERF_RES_OK; idx++) perf_compiler_statement(compiler, statements[idx]);
+
+    // Finish it
+    return perf_compiler_end_function(compiler);
+}
+
+/**
+ * @brief Compiles a class definition into a class of the program and its methods.
+ *
+ * @param compiler The compiler to use.
+ * @param node The index of the AST_CLASS_DEF node.
+ *
+ * @return The index of the class's initializer, which the class's name is bound to.
+*/
+static uint32_t perf_compiler_class(perf_compiler_t *compiler, uint32_t node)
+{
+    const perf_parser_node_t* current = &compiler->ast->nodes[node];
+
+    // Add the class
+    const char* name = perf_compiler_string(compiler, current->token);
+    if (name == NULL) return 0;
+
+    uint32_t      class_index   = 0;
+    const char*   error         = NULL;
+    perf_result_t result        = perf_program_add_class(compiler->program, name, &class_index, &error);
+
+    if (result != PERF_RES_OK)
+    {
+        perf_compiler_fail(compiler, result, error, current->token);
+        return 0;
+    }
+
+    // Compile the methods, init is the initializer.
+    uint32_t        count       = compiler->ast->extra[current->lhs];
+    const uint32_t* items       = &compiler->ast->extra[current->lhs + 1];
+    uint32_t        initializer = UINT32_MAX;
+
+    for (uint32_t idx = 0; idx < count && compiler->status == PERF_RES_OK; idx++)
+    {
+        uint32_t    method_token    = compiler->ast->nodes[items[idx]].token;
+        const char* method_name     = perf_compiler_string(compiler, method_token);
+        if (method_name == NULL) break;
+
+        // Each name may only be declared once.
+        const perf_class_t* klass = &compiler->program->classes[class_index];
+
+        for (uint32_t other = 0; other < klass->method_count; other++)
+        {
+            if (compiler->program->methods[klass->method_offset + other].name == method_name)
+                perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "method already declared", method_token);
+        }
+
+        if (compiler->status != PERF_RES_OK) break;
+
+        bool     is_init  = strcmp(method_name, "init") == 0;
+        uint32_t function = perf_compiler_function(compiler, items[idx], false, is_init ? PERF_FUNCTION_INITIALIZER : PERF_FUNCTION_METHOD);
+
+        if (is_init) initializer = function;
+    }
+
+    // Classes without an init get an empty one.
+    if (initializer == UINT32_MAX && compiler->status == PERF_RES_OK)
+    {
+        const char* init = NULL;
+
+        result = perf_interner_intern(&compiler->lexer->interner, "init", 4, &init, &error);
+
+        if (result != PERF_RES_OK)
+        {
+            perf_compiler_fail(compiler, result, error, current->token);
+            return 0;
+        }
+
+        if (perf_compiler_begin_method(compiler, init, PERF_FUNCTION_INITIALIZER) == NULL) return 0;
+
+        perf_compiler_at(compiler, current->token);
+        initializer = perf_compiler_end_function(compiler);
+    }
+
+    // Calling the class calls its initializer.
+    compiler->program->classes[class_index].initializer = initializer;
+
+    // Return the initializer
+    return initializer;
+}
+
+/**
+ * @brief Frees the compiler's tables, leaving it empty.
+ *
+ * @param compiler The compiler to reset.
+*/
+static void perf_compiler_reset(perf_compiler_t *compiler)
+{
+    free(compiler->globals);
+    free(compiler->constants);
+    free(compiler->jumps);
+
+    compiler->globals           = NULL;
+    compiler->global_capacity   = 0;
+    compiler->global_count      = 0;
+    compiler->constants         = NULL;
+    compiler->constant_capacity = 0;
+    compiler->jumps             = NULL;
+    compiler->jump_count        = 0;
+    compiler->jump_capacity     = 0;
+}
+
+// Implementation for compiler.h perf_compiler_init
+perf_result_t perf_compiler_init(perf_compiler_t *compiler, perf_lexer_t *lexer, const char** error)
+{
+    // Check if the lexer is null
+    if (lexer == NULL)
+    {
+        // Set the error message
+        *error = "Lexer is null";
+
+        // Return an error
+        return PERF_RES_COMPILE_ERROR;
+    }
+
+    // Zero everything, the tables are allocated on first use.
+    memset(compiler, 0, sizeof(perf_compiler_t));
+    compiler->lexer = lexer;
+    compiler->fuse  = true;
+
+    // Return ok
+    return PERF_RES_OK;
+}
+
+// Implementation for compiler.h perf_compiler_compile
+perf_result_t perf_compiler_compile(perf_compiler_t *compiler, const perf_ast_t *ast, perf_program_t *program, const char** error)
+{
+    // Start from an empty program, with a fresh set of globals and constants.
+    perf_program_init(program);
+    perf_compiler_reset(compiler);
+
+    program->format = compiler->format;
+
+    compiler->ast           = ast;
+    compiler->program       = program;
+    compiler->function      = NULL;
+    compiler->depth         = 0;
+    compiler->status        = PERF_RES_OK;
+    compiler->status_error  = NULL;
+
+    // The script is function 0.
+    if (perf_compiler_begin_function(compiler, NULL, false) == NULL)
+    {
+        *error = compiler->status_error;
+        return compiler->status;
+    }
+
+    // Declare every top level variable and function first, so functions can use globals declared after them.
+    for (uint32_t idx = 0; idx < ast->statement_count && compiler->status == PERF_RES_OK; idx++)
+    {
+        const perf_parser_node_t* current = &ast->nodes[ast->statements[idx]];
+
+        if (current->node_type != AST_VAR_DECL && current->node_type != AST_EXPR_FUNCTION_DEF && current->node_type != AST_CLASS_DEF) continue;
+
+        const char* name = perf_compiler_string(compiler, current->token);
+        if (name == NULL) break;
+
+        // A constant must be the only declaration of its name, classes are constants.
+        bool is_const = (current->node_type == AST_VAR_DECL && current->flags == TOKEN_KEYWORD_CONST) || current->node_type == AST_CLASS_DEF;
+        perf_compiler_global_t* global = perf_compiler_global(compiler, name, false);
+
+        if (global != NULL && (is_const || global->is_const))
+        {
+            perf_compiler_fail(compiler, PERF_RES_COMPILE_ERROR, "constant already declared", current->token);
+            break;
+        }
+
+        if (global == NULL) global = perf_compiler_global(compiler, name, true);
+        if (global != NULL) global->is_const = is_const;
+    }
+
+    // Define every top level function and class before the first statement runs.
+    for (uint32_t idx = 0; idx < ast->statement_count && compiler->status == PERF_RES_OK; idx++)
+    {
+        const perf_parser_node_t* current = &ast->nodes[ast->statements[idx]];
+
+        if (current->node_type != AST_EXPR_FUNCTION_DEF && current->node_type != AST_CLASS_DEF) continue;
+
+        uint32_t index = current->node_type == AST_CLASS_DEF ? perf_compiler_class(compiler, ast->statements[idx])
+            : perf_compiler_function(compiler, ast->statements[idx], false, PERF_FUNCTION_PLAIN);
+        const char* name = perf_compiler_string(compiler, current->token);
+        if (compiler->status != PERF_RES_OK) break;
+
+        perf_compiler_at(compiler, current->token);
+        uint32_t global = perf_compiler_global(compiler, name, false)->index;
+
+        // Register code loads it into a temporary to store it.
+        if (compiler->format == PERF_PROGRAM_FORMAT_REGISTER)
+        {
+            compiler->function->next_register = 0;
+
+            uint32_t value = perf_compiler_register(compiler);
+            perf_compiler_emit_load_function(compiler, index, value);
+            perf_compiler_emit_register(compiler, ROP_SET_GLOBAL, value, 0, 0);
+            perf_compiler_emit_operand(compiler, global, 4);
+            continue;
+        }
+
+        perf_compiler_emit_function(compiler, index);
+        perf_compiler_emit(compiler, OP_SET_GLOBAL, global);
+        perf_compiler_emit_op(compiler, OP_POP);
+    }
+
+    // Compile the statements in order
+    for (uint32_t idx = 0; idx < ast->statement_count && compiler->status == PERF_RES_OK; idx++)
+        perf_compiler_statement(compiler, ast->statements[idx]);
+
+    // Finish the script, unwinding any function left open by an error.
+    while (compiler->function != NULL) perf_compiler_end_function(compiler);
+
+    // Check if the program compiled successfully.
+    if (compiler->status != PERF_RES_OK)
+    {
+        *error = compiler->status_error;
+        return compiler->status;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for compiler.h perf_compiler_free
+perf_result_t perf_compiler_free(perf_compiler_t *compiler)
+{
+    // Free the tables
+    perf_compiler_reset(compiler);
+
+    // Return ok
+    return PERF_RES_OK;
+}
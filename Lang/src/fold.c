@@ -0,0 +1,464 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/token.h"
+#include "../inc/intern.h"
+#include "../inc/lexer.h"
+#include "../inc/ast.h"
+#include "../inc/value.h"
+#include "../inc/fold.h"
+
+#include <math.h>
+
+/**
+ * What the pass knows about the value of a node that isn't a constant.
+*/
+typedef enum _perf_e_fold_kind_t
+{
+    PERF_FOLD_UNKNOWN,          // Could be anything
+    PERF_FOLD_NUMERIC,          // An integer or a number, unless it raises an error
+    PERF_FOLD_INTEGRAL,         // An integer, or a number an integer overflowed into, which is never -0
+    PERF_FOLD_BOOL              // true or false
+} perf_e_fold_kind_t;
+
+// Implementation for fold.h perf_fold_constant
+bool perf_fold_constant(const perf_ast_t *ast, uint32_t node, perf_value_t *value)
+{
+    const perf_parser_node_t* current = &ast->nodes[node];
+    if (current->node_type != AST_CONSTANT) return false;
+
+    const perf_token_t* token = &ast->tokens[current->token];
+
+    switch (token->type)
+    {
+    case TOKEN_KEYWORD_TRUE:    *value = perf_value_bool(true);             return true;
+    case TOKEN_KEYWORD_FALSE:   *value = perf_value_bool(false);            return true;
+    case TOKEN_NUMBER:          *value = perf_value_number(token->as.number); return true;
+
+    // Folded integers are signed and always fit, literals too large for a value are numbers.
+    case TOKEN_INTEGER:
+    {
+        if (current->flags == PERF_AST_FOLDED || token->as.integer <= (uint64_t)PERF_VALUE_INTEGER_MAX) *value = perf_value_integer((int64_t)token->as.integer);
+        else *value = perf_value_number((double)token->as.integer);
+        return true;
+    }
+
+    default: return false;
+    }
+}
+
+/**
+ * @brief Checks if a value is an integer or a number.
+ *
+ * @param value The value to check.
+ *
+ * @return true if arithmetic works on it.
+*/
+static inline bool perf_fold_numeric(perf_value_t value)
+{
+    return perf_value_is_number(value) || perf_value_is(value, PERF_VALUE_INTEGER);
+}
+
+/**
+ * @brief Gets the double of an integer or a number.
+ *
+ * @param value An integer or a number.
+ *
+ * @return The double.
+*/
+static inline double perf_fold_number(perf_value_t value)
+{
+    return perf_value_is(value, PERF_VALUE_INTEGER) ? (double)perf_value_as_integer(value) : perf_value_as_number(value);
+}
+
+/**
+ * @brief Applies a binary operator to two constants, the way the VM would.
+ *
+ * @param op The operator's token type.
+ * @param a The operand on the left.
+ * @param b The operand on the right.
+ * @param out The result.
+ *
+ * @return true if it was folded, false if the VM would raise an error or the operator isn't folded.
+*/
+static bool perf_fold_binary(perf_e_token_type_t op, perf_value_t a, perf_value_t b, perf_value_t *out)
+{
+    // Equality works on anything.
+    if (op == TOKEN_EQUAL_EQUAL || op == TOKEN_EXCLAIM_EQUAL)
+    {
+        *out = perf_value_bool(perf_value_equal(a, b) == (op == TOKEN_EQUAL_EQUAL));
+        return true;
+    }
+
+    // Everything else needs numbers.
+    if (!perf_fold_numeric(a) || !perf_fold_numeric(b)) return false;
+
+    // Integers on both sides stay integers while they fit.
+    if (perf_value_is(a, PERF_VALUE_INTEGER) && perf_value_is(b, PERF_VALUE_INTEGER))
+    {
+        int64_t x = perf_value_as_integer(a);
+        int64_t y = perf_value_as_integer(b);
+
+        switch (op)
+        {
+        case TOKEN_PLUS:            *out = perf_value_integer(x + y);   return true;
+        case TOKEN_MINUS:           *out = perf_value_integer(x - y);   return true;
+        case TOKEN_AMPERSAND:       *out = perf_value_integer(x & y);   return true;
+        case TOKEN_GREATER:         *out = perf_value_bool(x > y);      return true;
+        case TOKEN_GREATER_EQUAL:   *out = perf_value_bool(x >= y);     return true;
+        case TOKEN_LESS:            *out = perf_value_bool(x < y);      return true;
+        case TOKEN_LESS_EQUAL:      *out = perf_value_bool(x <= y);     return true;
+
+        // A product too large for 64 bits is too large for a value, the VM rounds it from the operands the same way.
+        case TOKEN_ASTERISK:
+        {
+            if (x != 0 && llabs(y) > INT64_MAX / llabs(x)) *out = perf_value_number((double)x * (double)y);
+            else *out = perf_value_integer(x * y);
+            return true;
+        }
+
+        // Dividing by zero is left for the runtime error.
+        case TOKEN_SLASH:
+        case TOKEN_PERCENT:
+        {
+            if (y == 0) return false;
+
+            *out = perf_value_integer(op == TOKEN_SLASH ? x / y : x % y);
+            return true;
+        }
+
+        default: return false;
+        }
+    }
+
+    // Otherwise it's done on numbers.
+    double x = perf_fold_number(a);
+    double y = perf_fold_number(b);
+
+    switch (op)
+    {
+    case TOKEN_PLUS:            *out = perf_value_number(x + y);        return true;
+    case TOKEN_MINUS:           *out = perf_value_number(x - y);        return true;
+    case TOKEN_ASTERISK:        *out = perf_value_number(x * y);        return true;
+    case TOKEN_SLASH:           *out = perf_value_number(x / y);        return true;
+    case TOKEN_PERCENT:         *out = perf_value_number(fmod(x, y));   return true;
+    case TOKEN_GREATER:         *out = perf_value_bool(x > y);          return true;
+    case TOKEN_GREATER_EQUAL:   *out = perf_value_bool(x >= y);         return true;
+    case TOKEN_LESS:            *out = perf_value_bool(x < y);          return true;
+    case TOKEN_LESS_EQUAL:      *out = perf_value_bool(x <= y);         return true;
+    default:                    return false;
+    }
+}
+
+/**
+ * @brief Gets what the pass knows about the result of a binary operator it couldn't fold.
+ *
+ * @param op The operator's token type.
+ * @param a What is known about the operand on the left.
+ * @param b What is known about the operand on the right.
+ *
+ * @return What is known about the result.
+*/
+static perf_e_fold_kind_t perf_fold_binary_kind(perf_e_token_type_t op, perf_e_fold_kind_t a, perf_e_fold_kind_t b)
+{
+    bool integral = a == PERF_FOLD_INTEGRAL && b == PERF_FOLD_INTEGRAL;
+
+    switch (op)
+    {
+    // + also joins strings, so it is only known to be numeric when both operands are.
+    case TOKEN_PLUS:
+        if (integral) return PERF_FOLD_INTEGRAL;
+        return (a == PERF_FOLD_NUMERIC || a == PERF_FOLD_INTEGRAL) && (b == PERF_FOLD_NUMERIC || b == PERF_FOLD_INTEGRAL) ? PERF_FOLD_NUMERIC : PERF_FOLD_UNKNOWN;
+
+    // The rest raise unless both operands are numeric.
+    case TOKEN_MINUS:
+    case TOKEN_ASTERISK:
+    case TOKEN_SLASH:
+    case TOKEN_PERCENT:         return integral ? PERF_FOLD_INTEGRAL : PERF_FOLD_NUMERIC;
+    case TOKEN_AMPERSAND:       return PERF_FOLD_INTEGRAL;
+
+    default:                    return PERF_FOLD_BOOL;
+    }
+}
+
+/**
+ * @brief Gets what the pass knows about a constant.
+ *
+ * @param ast The AST the constant is in.
+ * @param node The index of the constant.
+ *
+ * @return What is known about it.
+*/
+static perf_e_fold_kind_t perf_fold_constant_kind(const perf_ast_t *ast, uint32_t node)
+{
+    perf_value_t value;
+    if (!perf_fold_constant(ast, node, &value)) return PERF_FOLD_UNKNOWN;
+
+    switch (perf_value_type(value))
+    {
+    case PERF_VALUE_INTEGER:    return PERF_FOLD_INTEGRAL;
+    case PERF_VALUE_BOOL:       return PERF_FOLD_BOOL;
+    default:                    return PERF_FOLD_NUMERIC;
+    }
+}
+
+/**
+ * @brief Checks if a node is the integer constant given.
+ *
+ * @param ast The AST the node is in.
+ * @param node The index of the node.
+ * @param integer The integer.
+ *
+ * @return true if the node is that integer.
+*/
+static bool perf_fold_is_integer(const perf_ast_t *ast, uint32_t node, int64_t integer)
+{
+    perf_value_t value;
+    return perf_fold_constant(ast, node, &value) && perf_value_is(value, PERF_VALUE_INTEGER) && perf_value_as_integer(value) == integer;
+}
+
+/**
+ * @brief Checks if a node is a ! applied to a ! and gets what the inner one applies to.
+ *
+ * @param ast The AST the node is in.
+ * @param node The index of the node.
+ * @param operand The operand of the inner !.
+ *
+ * @return true if the node is a double negation.
+*/
+static bool perf_fold_double_not(const perf_ast_t *ast, uint32_t node, uint32_t *operand)
+{
+    const perf_parser_node_t* outer = &ast->nodes[node];
+    if (outer->node_type != AST_UNARY_EXPR || ast->tokens[outer->token].type != TOKEN_EXCLAIM) return false;
+
+    const perf_parser_node_t* inner = &ast->nodes[outer->lhs];
+    if (inner->node_type != AST_UNARY_EXPR || ast->tokens[inner->token].type != TOKEN_EXCLAIM) return false;
+
+    *operand = inner->lhs;
+    return true;
+}
+
+/**
+ * @brief Removes double negations from a condition, where only truthiness matters.
+ *
+ * @param ast The AST the condition is in.
+ * @param node The index of the condition, may be PERF_AST_NONE.
+ * @param stats What the pass did.
+ *
+ * @return The index of the condition to use instead.
+*/
+static uint32_t perf_fold_condition(const perf_ast_t *ast, uint32_t node, perf_fold_stats_t *stats)
+{
+    uint32_t operand = 0;
+
+    while (node != PERF_AST_NONE && perf_fold_double_not(ast, node, &operand))
+    {
+        node = operand;
+        stats->simplified++;
+    }
+
+    return node;
+}
+
+/**
+ * @brief Turns a unary or binary node into a constant, reusing its operator token for the literal.
+ *
+ * @param ast The AST the node is in.
+ * @param node The index of the node.
+ * @param value The constant.
+*/
+static void perf_fold_replace_constant(perf_ast_t *ast, uint32_t node, perf_value_t value)
+{
+    perf_parser_node_t* current = &ast->nodes[node];
+    perf_token_t*       token   = &ast->tokens[current->token];
+
+    switch (perf_value_type(value))
+    {
+    case PERF_VALUE_BOOL:       token->type = perf_value_as_index(value) ? TOKEN_KEYWORD_TRUE : TOKEN_KEYWORD_FALSE;  break;
+
+    // Integers keep their sign, the flag tells them apart from literals too large for a value.
+    case PERF_VALUE_INTEGER:
+        token->type         = TOKEN_INTEGER;
+        token->as.integer   = (uint64_t)perf_value_as_integer(value);
+        break;
+
+    default:
+        token->type         = TOKEN_NUMBER;
+        token->as.number    = perf_value_as_number(value);
+        break;
+    }
+
+    current->node_type  = AST_CONSTANT;
+    current->flags      = PERF_AST_FOLDED;
+    current->lhs        = PERF_AST_NONE;
+    current->rhs        = PERF_AST_NONE;
+}
+
+// Implementation for fold.h perf_fold_ast
+perf_result_t perf_fold_ast(perf_ast_t *ast, perf_fold_stats_t *stats, const char** error)
+{
+    // Count into a local when the caller doesn't want to know.
+    perf_fold_stats_t local = { 0 };
+    if (stats == NULL) stats = &local;
+    else memset(stats, 0, sizeof(*stats));
+
+    // What is known about each node that isn't a constant.
+    uint8_t* kinds = (uint8_t*)calloc(ast->node_count == 0 ? 1 : ast->node_count, sizeof(uint8_t));
+
+    if (kinds == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for folding";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Children come before their parents, so they are already folded when their parent is reached.
+    for (uint32_t node = 0; node < ast->node_count; node++)
+    {
+        perf_parser_node_t* current = &ast->nodes[node];
+
+        switch (current->node_type)
+        {
+        case AST_CONSTANT: kinds[node] = (uint8_t)perf_fold_constant_kind(ast, node); break;
+
+        // A group is the expression inside it, the tree already has its precedence.
+        case AST_GROUP_EXPR:
+        {
+            kinds[node] = kinds[current->lhs];
+            *current    = ast->nodes[current->lhs];
+            stats->groups++;
+            break;
+        }
+
+        case AST_UNARY_EXPR:
+        {
+            perf_e_token_type_t op = ast->tokens[current->token].type;
+            perf_value_t        operand;
+            uint32_t            inner = 0;
+
+            // -constant.
+            if (op == TOKEN_MINUS && perf_fold_constant(ast, current->lhs, &operand) && perf_fold_numeric(operand))
+            {
+                if (perf_value_is(operand, PERF_VALUE_INTEGER)) perf_fold_replace_constant(ast, node, perf_value_integer(-perf_value_as_integer(operand)));
+                else perf_fold_replace_constant(ast, node, perf_value_number(-perf_value_as_number(operand)));
+
+                kinds[node] = (uint8_t)perf_fold_constant_kind(ast, node);
+                stats->folded++;
+                break;
+            }
+
+            // !constant, strings are the only constants that aren't folded and they are always truthy.
+            if (op == TOKEN_EXCLAIM && ast->nodes[current->lhs].node_type == AST_CONSTANT)
+            {
+                bool falsy = false;
+
+                if (perf_fold_constant(ast, current->lhs, &operand))
+                {
+                    if (perf_value_is_number(operand)) falsy = perf_value_as_number(operand) == 0.0;
+                    else falsy = perf_value_identical(operand, perf_value_bool(false)) || perf_value_identical(operand, perf_value_integer(0));
+                }
+
+                perf_fold_replace_constant(ast, node, perf_value_bool(falsy));
+                kinds[node] = PERF_FOLD_BOOL;
+                stats->folded++;
+                break;
+            }
+
+            // !!x is x when x is a boolean.
+            if (perf_fold_double_not(ast, node, &inner) && kinds[inner] == PERF_FOLD_BOOL)
+            {
+                *current = ast->nodes[inner];
+                kinds[node] = PERF_FOLD_BOOL;
+                stats->simplified++;
+                break;
+            }
+
+            // Negating an integer can overflow into a number, but never into -0.
+            if (op == TOKEN_EXCLAIM) kinds[node] = PERF_FOLD_BOOL;
+            else kinds[node] = kinds[current->lhs] == PERF_FOLD_INTEGRAL ? PERF_FOLD_INTEGRAL : PERF_FOLD_NUMERIC;
+            break;
+        }
+
+        case AST_BINARY_EXPR:
+        {
+            perf_e_token_type_t op  = ast->tokens[current->token].type;
+            uint32_t            lhs = current->lhs;
+            uint32_t            rhs = current->rhs;
+            perf_value_t        a;
+            perf_value_t        b;
+            perf_value_t        result;
+
+            // constant op constant.
+            if (perf_fold_constant(ast, lhs, &a) && perf_fold_constant(ast, rhs, &b) && perf_fold_binary(op, a, b, &result))
+            {
+                perf_fold_replace_constant(ast, node, result);
+                kinds[node] = (uint8_t)perf_fold_constant_kind(ast, node);
+                stats->folded++;
+                break;
+            }
+
+            bool lhs_numeric = kinds[lhs] == PERF_FOLD_NUMERIC || kinds[lhs] == PERF_FOLD_INTEGRAL;
+            bool rhs_numeric = kinds[rhs] == PERF_FOLD_NUMERIC || kinds[rhs] == PERF_FOLD_INTEGRAL;
+            uint32_t keep    = PERF_AST_NONE;
+
+            // Identities, only where the operand that stays is known to give the same result on its own.
+            switch (op)
+            {
+            case TOKEN_ASTERISK:
+                if (lhs_numeric && perf_fold_is_integer(ast, rhs, 1)) keep = lhs;
+                else if (rhs_numeric && perf_fold_is_integer(ast, lhs, 1)) keep = rhs;
+                break;
+
+            case TOKEN_SLASH:
+                if (lhs_numeric && perf_fold_is_integer(ast, rhs, 1)) keep = lhs;
+                break;
+
+            case TOKEN_PLUS:
+                if (kinds[lhs] == PERF_FOLD_INTEGRAL && perf_fold_is_integer(ast, rhs, 0)) keep = lhs;
+                else if (kinds[rhs] == PERF_FOLD_INTEGRAL && perf_fold_is_integer(ast, lhs, 0)) keep = rhs;
+                break;
+
+            case TOKEN_MINUS:
+                if (lhs_numeric && perf_fold_is_integer(ast, rhs, 0)) keep = lhs;
+                break;
+
+            default:
+                break;
+            }
+
+            if (keep != PERF_AST_NONE)
+            {
+                kinds[node] = kinds[keep];
+                *current    = ast->nodes[keep];
+                stats->simplified++;
+                break;
+            }
+
+            kinds[node] = (uint8_t)perf_fold_binary_kind(op, (perf_e_fold_kind_t)kinds[lhs], (perf_e_fold_kind_t)kinds[rhs]);
+            break;
+        }
+
+        // Conditions only decide a branch, so !!x is as good as x.
+        case AST_IF_STMT:
+        case AST_WHILE_STMT:    current->lhs = perf_fold_condition(ast, current->lhs, stats); break;
+        case AST_DO_WHILE_STMT: current->rhs = perf_fold_condition(ast, current->rhs, stats); break;
+
+        case AST_FOR_STMT:
+        {
+            uint32_t* condition = &ast->extra[current->lhs + 2];
+            *condition = perf_fold_condition(ast, *condition, stats);
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    // Free what is known about the nodes
+    free(kinds);
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
@@ -0,0 +1,566 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/value.h"
+#include "../inc/heap.h"
+#include "../inc/object.h"
+
+#include <time.h>
+
+// Bytes of a string's header, the object header and the length.
+#define PERF_HEAP_STRING_HEADER     (sizeof(perf_heap_object_t) + sizeof(uint32_t))
+
+// Initial number of objects the remembered set and the gray stack hold.
+#define PERF_HEAP_INITIAL_CAPACITY  64
+
+/**
+ * @brief Gets the current time, for timing collections.
+ *
+ * @return The time in seconds.
+*/
+static double perf_heap_now(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Checks if an object lives in the nursery.
+ *
+ * @param heap The heap to use.
+ * @param object The object.
+ *
+ * @return true if the object is young.
+*/
+static inline bool perf_heap_is_young(const perf_heap_t *heap, const perf_heap_object_t *object)
+{
+    return (const uint8_t*)object >= heap->nursery && (const uint8_t*)object < heap->nursery_end;
+}
+
+/**
+ * @brief Gets the object a heap value refers to.
+ *
+ * @param value A value for which perf_value_is_heap is true.
+ *
+ * @return The object.
+*/
+static inline perf_heap_object_t* perf_heap_object(perf_value_t value)
+{
+    // Objects are their header, the characters of a string come right after it.
+    if (perf_value_is(value, PERF_VALUE_OBJECT)) return (perf_heap_object_t*)perf_value_as_object(value);
+
+    return (perf_heap_object_t*)(perf_value_as_string(value) - PERF_HEAP_STRING_HEADER);
+}
+
+/**
+ * @brief Makes the value referring to an object.
+ *
+ * @param object The object.
+ *
+ * @return The value.
+*/
+static inline perf_value_t perf_heap_value(perf_heap_object_t *object)
+{
+    if (object->type == PERF_HEAP_STRING) return perf_value_heap_string((const char*)object + PERF_HEAP_STRING_HEADER);
+
+    return perf_value_object(object);
+}
+
+/**
+ * @brief Adds an object to a growable array of objects, doubling it when full.
+ *
+ * @param objects The array.
+ * @param count The number of objects in it.
+ * @param capacity The number of objects it can hold.
+ * @param object The object to add.
+ *
+ * @return false if the array couldn't grow.
+*/
+static bool perf_heap_append(perf_heap_object_t ***objects, uint32_t *count, uint32_t *capacity, perf_heap_object_t *object)
+{
+    // Grow the array if it is full.
+    if (*count == *capacity)
+    {
+        uint32_t                new_capacity    = *capacity == 0 ? PERF_HEAP_INITIAL_CAPACITY : *capacity * 2;
+        perf_heap_object_t**    new_objects     = (perf_heap_object_t**)realloc(*objects, new_capacity * sizeof(perf_heap_object_t*));
+
+        // Check if the allocation failed.
+        if (new_objects == NULL) return false;
+
+        *objects    = new_objects;
+        *capacity   = new_capacity;
+    }
+
+    // Add the object
+    (*objects)[(*count)++] = object;
+    return true;
+}
+
+static perf_heap_object_t* perf_heap_promote(perf_heap_t *heap, perf_heap_object_t *object);
+static void perf_heap_mark(perf_heap_t *heap, perf_heap_object_t *object);
+
+/**
+ * @brief Traces the values an object refers to.
+ *
+ * @param heap The heap collecting.
+ * @param object The object.
+*/
+static void perf_heap_trace_object(perf_heap_t *heap, perf_heap_object_t *object)
+{
+    switch (object->type)
+    {
+    case PERF_HEAP_INSTANCE:
+    {
+        perf_instance_t* instance = (perf_instance_t*)object;
+
+        // Fields the instance outgrew its inline ones into are kept, and moved, along with it.
+        if (instance->fields != instance->inline_fields)
+        {
+            perf_heap_object_t* fields = (perf_heap_object_t*)instance->fields - 1;
+
+            if (heap->is_major) perf_heap_mark(heap, fields);
+            else if (perf_heap_is_young(heap, fields))
+            {
+                if (!(fields->flags & PERF_HEAP_FORWARDED)) perf_heap_promote(heap, fields);
+                if (fields->flags & PERF_HEAP_FORWARDED) instance->fields = (perf_value_t*)(fields->next + 1);
+            }
+        }
+
+        // Then the fields that are set.
+        perf_heap_trace(heap, instance->fields, instance->shape->field_count);
+        break;
+    }
+
+    // Strings refer to nothing, and fields are traced by their instance.
+    case PERF_HEAP_STRING:  break;
+    default:                break;
+    }
+}
+
+/**
+ * @brief Copies a young object into the old generation, leaving a forwarding pointer behind.
+ *
+ * @param heap The heap collecting.
+ * @param object The young object, not forwarded yet.
+ *
+ * @return The copy, or the object itself if the copy couldn't be allocated.
+*/
+static perf_heap_object_t* perf_heap_promote(perf_heap_t *heap, perf_heap_object_t *object)
+{
+    // Allocate the copy
+    perf_heap_object_t* copy = (perf_heap_object_t*)malloc(object->size);
+
+    // Check if the allocation failed, the collection will keep the nursery as it is.
+    if (copy == NULL)
+    {
+        heap->failed = true;
+        return object;
+    }
+
+    // Copy the object, and link it in front of the old generation.
+    memcpy(copy, object, object->size);
+    copy->flags = PERF_HEAP_OLD;
+    copy->next  = heap->old;
+    heap->old   = copy;
+
+    // An instance with its fields inline must use the copy's.
+    if (copy->type == PERF_HEAP_INSTANCE && ((perf_instance_t*)object)->fields == ((perf_instance_t*)object)->inline_fields)
+        ((perf_instance_t*)copy)->fields = ((perf_instance_t*)copy)->inline_fields;
+
+    // Leave the forwarding pointer
+    object->flags   = PERF_HEAP_FORWARDED;
+    object->next    = copy;
+
+    // Track the bytes
+    heap->stats.old_bytes       += copy->size;
+    heap->stats.promoted_bytes  += copy->size;
+
+    // Return the copy
+    return copy;
+}
+
+/**
+ * @brief Marks an old object, adding it to the gray stack so what it refers to is marked too.
+ *
+ * @param heap The heap collecting.
+ * @param object The old object.
+*/
+static void perf_heap_mark(perf_heap_t *heap, perf_heap_object_t *object)
+{
+    // Check if it was already marked.
+    if (object->flags & PERF_HEAP_MARKED) return;
+
+    object->flags |= PERF_HEAP_MARKED;
+
+    // Only instances refer to other objects, no need to visit the rest again.
+    if (object->type != PERF_HEAP_INSTANCE) return;
+
+    // Objects that don't fit are found again by rescanning the old generation.
+    if (!perf_heap_append(&heap->gray, &heap->gray_count, &heap->gray_capacity, object)) heap->gray_overflow = true;
+}
+
+// Implementation for heap.h perf_heap_trace
+void perf_heap_trace(perf_heap_t *heap, perf_value_t *values, size_t count)
+{
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        // Only values in the heap matter.
+        if (!perf_value_is_heap(values[idx])) continue;
+
+        perf_heap_object_t* object = perf_heap_object(values[idx]);
+
+        // Major collections run right after a minor one, every object they see is old.
+        if (heap->is_major)
+        {
+            perf_heap_mark(heap, object);
+            continue;
+        }
+
+        // Minor collections copy the young objects out, once, and update every value to the copy.
+        if (!perf_heap_is_young(heap, object)) continue;
+
+        if (!(object->flags & PERF_HEAP_FORWARDED)) perf_heap_promote(heap, object);
+        if (object->flags & PERF_HEAP_FORWARDED) values[idx] = perf_heap_value(object->next);
+    }
+}
+
+/**
+ * @brief Traces the roots, the values the roots callback hands over and the temporary roots.
+ *
+ * @param heap The heap collecting.
+*/
+static void perf_heap_trace_roots(perf_heap_t *heap)
+{
+    if (heap->roots != NULL) heap->roots(heap, heap->roots_context);
+
+    for (uint32_t idx = 0; idx < heap->temp_count; idx++) perf_heap_trace(heap, heap->temps[idx], 1);
+}
+
+/**
+ * @brief Copies every reachable young object into the old generation, and starts the nursery over.
+ *
+ * @param heap The heap to collect.
+ *
+ * @return PERF_RES_OK if the nursery was collected successfully.
+*/
+static perf_result_t perf_heap_minor(perf_heap_t *heap)
+{
+    double start = perf_heap_now();
+
+    // Remember where the old generation started, everything linked in front of it from now on was promoted.
+    perf_heap_object_t* scanned = heap->old;
+
+    heap->is_major  = false;
+    heap->failed    = false;
+
+    // Copy what the roots and the remembered objects refer to.
+    perf_heap_trace_roots(heap);
+
+    for (uint32_t idx = 0; idx < heap->remembered_count; idx++)
+    {
+        perf_heap_trace_object(heap, heap->remembered[idx]);
+        heap->remembered[idx]->flags &= ~PERF_HEAP_REMEMBERED;
+    }
+
+    heap->remembered_count = 0;
+
+    // Then what the copies refer to, a batch at a time, until a batch promotes nothing.
+    while (heap->old != scanned)
+    {
+        perf_heap_object_t* batch = heap->old;
+
+        for (perf_heap_object_t* object = batch; object != scanned; object = object->next) perf_heap_trace_object(heap, object);
+
+        scanned = batch;
+    }
+
+    // Start the nursery over, unless something couldn't be copied out of it.
+    if (!heap->failed) heap->nursery_top = heap->nursery;
+
+    // Track the pause
+    double pause = perf_heap_now() - start;
+
+    heap->stats.minor_count++;
+    heap->stats.minor_seconds += pause;
+    if (pause > heap->stats.minor_max_pause) heap->stats.minor_max_pause = pause;
+
+    // Return the result.
+    return heap->failed ? PERF_RES_MEMORY_ALLOC_FAIL : PERF_RES_OK;
+}
+
+/**
+ * @brief Marks every reachable old object and frees the rest, the nursery must be empty.
+ *
+ * @param heap The heap to collect.
+*/
+static void perf_heap_major(perf_heap_t *heap)
+{
+    double start = perf_heap_now();
+
+    heap->is_major      = true;
+    heap->gray_count    = 0;
+    heap->gray_overflow = false;
+
+    // Mark the roots, then everything reachable from them.
+    perf_heap_trace_roots(heap);
+
+    for (;;)
+    {
+        while (heap->gray_count > 0) perf_heap_trace_object(heap, heap->gray[--heap->gray_count]);
+
+        // Objects that didn't fit in the gray stack are marked, trace every marked object again to find them.
+        if (!heap->gray_overflow) break;
+
+        heap->gray_overflow = false;
+
+        for (perf_heap_object_t* object = heap->old; object != NULL; object = object->next)
+        {
+            if (object->flags & PERF_HEAP_MARKED) perf_heap_trace_object(heap, object);
+        }
+    }
+
+    heap->is_major = false;
+
+    // Sweep, freeing what wasn't marked and clearing the marks of the rest.
+    perf_heap_object_t** link = &heap->old;
+
+    while (*link != NULL)
+    {
+        perf_heap_object_t* object = *link;
+
+        if (object->flags & PERF_HEAP_MARKED)
+        {
+            object->flags &= ~PERF_HEAP_MARKED;
+            link = &object->next;
+            continue;
+        }
+
+        *link = object->next;
+
+        heap->stats.old_bytes   -= object->size;
+        heap->stats.freed_bytes += object->size;
+        free(object);
+    }
+
+    // Let the old generation grow relative to what survived.
+    size_t limit    = heap->stats.old_bytes * PERF_HEAP_GROWTH_FACTOR;
+    heap->old_limit = limit > PERF_HEAP_OLD_MINIMUM ? limit : PERF_HEAP_OLD_MINIMUM;
+
+    // Track the pause
+    double pause = perf_heap_now() - start;
+
+    heap->stats.major_count++;
+    heap->stats.major_seconds += pause;
+    if (pause > heap->stats.major_max_pause) heap->stats.major_max_pause = pause;
+}
+
+// Implementation for heap.h perf_heap_init
+perf_result_t perf_heap_init(perf_heap_t *heap, perf_heap_roots_t roots, void *context, const char** error)
+{
+    // Zero everything, the remembered set and the gray stack are allocated when first needed.
+    memset(heap, 0, sizeof(perf_heap_t));
+
+    heap->roots         = roots;
+    heap->roots_context = context;
+    heap->old_limit     = PERF_HEAP_OLD_MINIMUM;
+
+    // Allocate the nursery
+    heap->nursery = (uint8_t*)malloc(PERF_HEAP_NURSERY_SIZE);
+
+    // Check if the allocation failed.
+    if (heap->nursery == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for nursery";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    heap->nursery_top = heap->nursery;
+    heap->nursery_end = heap->nursery + PERF_HEAP_NURSERY_SIZE;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for heap.h perf_heap_alloc
+perf_result_t perf_heap_alloc(perf_heap_t *heap, perf_e_heap_type_t type, size_t size, perf_heap_object_t **object, const char** error)
+{
+    // Round the size up so the next object stays aligned.
+    perf_heap_object_t* allocated = NULL;
+    size = (size + 7) & ~(size_t)7;
+
+    if (size > PERF_HEAP_LARGE_OBJECT)
+    {
+        // Large objects would fill the nursery, they go to the old generation, collecting it first if it is full.
+        if (heap->stats.old_bytes + size > heap->old_limit) perf_heap_collect(heap, true);
+
+        allocated = (perf_heap_object_t*)malloc(size);
+
+        if (allocated != NULL)
+        {
+            allocated->flags    = PERF_HEAP_OLD;
+            allocated->next     = heap->old;
+            heap->old           = allocated;
+
+            heap->stats.old_bytes += size;
+        }
+    }
+    else
+    {
+        // Collect if the nursery is full, which empties it unless we ran out of memory.
+        if ((size_t)(heap->nursery_end - heap->nursery_top) < size) perf_heap_collect(heap, false);
+
+        if ((size_t)(heap->nursery_end - heap->nursery_top) >= size)
+        {
+            allocated = (perf_heap_object_t*)heap->nursery_top;
+            heap->nursery_top += size;
+
+            allocated->flags    = 0;
+            allocated->next     = NULL;
+        }
+    }
+
+    // Check if the allocation failed.
+    if (allocated == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for heap object";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Write the header
+    allocated->size         = (uint32_t)size;
+    allocated->type         = (uint8_t)type;
+    allocated->reserved[0]  = 0;
+    allocated->reserved[1]  = 0;
+
+    // Track the bytes
+    heap->stats.allocated_bytes += size;
+
+    // Output the object
+    *object = allocated;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for heap.h perf_heap_string
+perf_result_t perf_heap_string(perf_heap_t *heap, uint32_t length, char **str, const char** error)
+{
+    // Header, length, characters and terminator.
+    perf_heap_object_t* object = NULL;
+    perf_result_t       result = perf_heap_alloc(heap, PERF_HEAP_STRING, PERF_HEAP_STRING_HEADER + (size_t)length + 1, &object, error);
+
+    if (result != PERF_RES_OK)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for string";
+
+        // Return the result.
+        return result;
+    }
+
+    // Write the length and the terminator.
+    *(uint32_t*)((uint8_t*)object + sizeof(perf_heap_object_t)) = length;
+
+    *str = (char*)object + PERF_HEAP_STRING_HEADER;
+    (*str)[length] = '\x00';
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for heap.h perf_heap_collect
+perf_result_t perf_heap_collect(perf_heap_t *heap, bool major)
+{
+    // Always empty the nursery first, so major collections only see old objects.
+    perf_result_t result = perf_heap_minor(heap);
+
+    if (result != PERF_RES_OK) return result;
+
+    // Then collect the old generation, if asked to or if it has grown past its limit.
+    if (major || heap->stats.old_bytes > heap->old_limit) perf_heap_major(heap);
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for heap.h perf_heap_write_barrier
+perf_result_t perf_heap_write_barrier(perf_heap_t *heap, perf_heap_object_t *object, perf_value_t value)
+{
+    // Only old objects made to refer to the nursery need remembering.
+    if (!perf_value_is_heap(value) || !perf_heap_is_young(heap, perf_heap_object(value))) return PERF_RES_OK;
+
+    // Return the result.
+    return perf_heap_remember(heap, object);
+}
+
+// Implementation for heap.h perf_heap_remember
+perf_result_t perf_heap_remember(perf_heap_t *heap, perf_heap_object_t *object)
+{
+    // Only old objects need remembering, and only once.
+    if (!(object->flags & PERF_HEAP_OLD) || (object->flags & PERF_HEAP_REMEMBERED)) return PERF_RES_OK;
+
+    // Remember it
+    if (!perf_heap_append(&heap->remembered, &heap->remembered_count, &heap->remembered_capacity, object)) return PERF_RES_MEMORY_ALLOC_FAIL;
+
+    object->flags |= PERF_HEAP_REMEMBERED;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for heap.h perf_heap_push_temp
+void perf_heap_push_temp(perf_heap_t *heap, perf_value_t *value)
+{
+    heap->temps[heap->temp_count++] = value;
+}
+
+// Implementation for heap.h perf_heap_pop_temp
+void perf_heap_pop_temp(perf_heap_t *heap, uint32_t count)
+{
+    heap->temp_count -= count;
+}
+
+// Implementation for heap.h perf_heap_get_stats
+perf_result_t perf_heap_get_stats(perf_heap_t *heap, perf_heap_stats_t *stats)
+{
+    // Copy them
+    *stats = heap->stats;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for heap.h perf_heap_free
+perf_result_t perf_heap_free(perf_heap_t *heap)
+{
+    // Free the old generation, object by object.
+    perf_heap_object_t* object = heap->old;
+
+    while (object != NULL)
+    {
+        perf_heap_object_t* next = object->next;
+        free(object);
+        object = next;
+    }
+
+    // Free the nursery, the remembered set and the gray stack.
+    free(heap->nursery);
+    free(heap->remembered);
+    free(heap->gray);
+
+    heap->nursery       = NULL;
+    heap->nursery_top   = NULL;
+    heap->nursery_end   = NULL;
+    heap->old           = NULL;
+    heap->remembered    = NULL;
+    heap->gray          = NULL;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
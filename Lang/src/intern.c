@@ -0,0 +1,329 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/intern.h"
+
+// Initial number of slots in the intern table.
+#define PERF_INTERN_INITIAL_CAPACITY    256
+
+// Minimum size of a string storage chunk.
+#define PERF_INTERN_CHUNK_SIZE          (64 * 1024)
+
+/**
+ * @brief Hashes a string using 32-bit FNV-1a.
+ *
+ * @param str The string to hash.
+ * @param length The length of the string.
+ *
+ * @return The hash of the string.
+*/
+static uint32_t perf_intern_hash(const char* str, size_t length)
+{
+    // FNV offset basis
+    uint32_t hash = 2166136261u;
+
+    // Mix in every byte.
+    for (size_t idx = 0; idx < length; idx++)
+    {
+        hash ^= (uint8_t)str[idx];
+        hash *= 16777619u;
+    }
+
+    // Finalize so the low bits used for the slot index depend on every byte.
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+
+    // Return the hash
+    return hash;
+}
+
+/**
+ * @brief Copies a string into the interner's storage.
+ *
+ * Each string is stored as a 32-bit length header followed by the bytes and a null terminator,
+ * which lets perf_interner_length work without a table lookup.
+ *
+ * @param interner The interner to use.
+ * @param str The string to copy.
+ * @param length The length of the string.
+ *
+ * @return The stored string, or NULL if the allocation failed.
+*/
+static const char* perf_intern_store(perf_interner_t* interner, const char* str, size_t length)
+{
+    // Header + string + terminator, rounded up so the next header stays aligned.
+    size_t size = (sizeof(uint32_t) + length + 1 + 3) & ~(size_t)3;
+
+    // Get the current chunk
+    perf_intern_chunk_t* chunk = interner->chunks;
+
+    // Check if we need a new chunk.
+    if (chunk == NULL || chunk->capacity - chunk->used < size)
+    {
+        // Large strings get a chunk of their own.
+        size_t capacity = size > PERF_INTERN_CHUNK_SIZE ? size : PERF_INTERN_CHUNK_SIZE;
+
+        // Allocate the chunk
+        chunk = (perf_intern_chunk_t*)malloc(sizeof(perf_intern_chunk_t) + capacity);
+
+        // Check if the allocation failed.
+        if (chunk == NULL) return NULL;
+
+        // Link the chunk in front of the previous ones.
+        chunk->next         = interner->chunks;
+        chunk->used         = 0;
+        chunk->capacity     = capacity;
+        interner->chunks    = chunk;
+
+        // Track the reserved bytes.
+        interner->arena_bytes += capacity;
+    }
+
+    // Bump allocate the string.
+    char* header = chunk->data + chunk->used;
+    chunk->used += size;
+
+    // Write the header, the string and the terminator.
+    *(uint32_t*)header = (uint32_t)length;
+    memcpy(header + sizeof(uint32_t), str, length);
+    header[sizeof(uint32_t) + length] = '\x00';
+
+    // Track the string bytes.
+    interner->string_bytes += length;
+
+    // Return the string itself.
+    return header + sizeof(uint32_t);
+}
+
+/**
+ * @brief Doubles the size of the intern table.
+ *
+ * @param interner The interner to grow.
+ *
+ * @return PERF_RES_OK if the table was grown successfully.
+*/
+static perf_result_t perf_intern_grow(perf_interner_t* interner)
+{
+    // Calculate the new capacity.
+    uint32_t capacity = interner->capacity == 0 ? PERF_INTERN_INITIAL_CAPACITY : interner->capacity * 2;
+
+    // Allocate the new table, zeroed so every slot starts empty.
+    perf_intern_entry_t* entries = (perf_intern_entry_t*)calloc(capacity, sizeof(perf_intern_entry_t));
+
+    // Check if the allocation failed.
+    if (entries == NULL) return PERF_RES_MEMORY_ALLOC_FAIL;
+
+    // Reinsert the existing entries using their stored hashes.
+    for (uint32_t idx = 0; idx < interner->capacity; idx++)
+    {
+        // Get the entry
+        perf_intern_entry_t* entry = &interner->entries[idx];
+
+        // Skip empty slots.
+        if (entry->str == NULL) continue;
+
+        // Find a free slot in the new table.
+        uint32_t slot = entry->hash & (capacity - 1);
+        while (entries[slot].str != NULL) slot = (slot + 1) & (capacity - 1);
+
+        // Move the entry over.
+        entries[slot] = *entry;
+    }
+
+    // Swap in the new table.
+    free(interner->entries);
+    interner->entries   = entries;
+    interner->capacity  = capacity;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for intern.h perf_interner_init
+perf_result_t perf_interner_init(perf_interner_t *interner)
+{
+    // Zero everything, the table is allocated lazily.
+    memset(interner, 0, sizeof(perf_interner_t));
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+/**
+ * @brief Interns a string whose hash is already known.
+ *
+ * @param interner The interner to use.
+ * @param str The string to intern.
+ * @param length The length of the string.
+ * @param hash The hash of the string, from perf_intern_hash.
+ * @param out The interned string.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the string was interned successfully.
+*/
+static perf_result_t perf_intern_insert(perf_interner_t* interner, const char* str, size_t length, uint32_t hash, const char** out, const char** error)
+{
+    // Grow the table if it is more than 75% full.
+    if (interner->count + 1 > (interner->capacity / 4) * 3)
+    {
+        // Grow the table
+        if (perf_intern_grow(interner) != PERF_RES_OK)
+        {
+            // Set the error
+            *error = "Failed to allocate memory for intern table.";
+
+            // Return memory allocation failure result.
+            return PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+    }
+
+    // Find the home slot.
+    uint32_t mask   = interner->capacity - 1;
+    uint32_t slot   = hash & mask;
+    uint32_t probes = 1;
+
+    // Probe until we find the string or an empty slot.
+    while (interner->entries[slot].str != NULL)
+    {
+        // Get the entry
+        perf_intern_entry_t* entry = &interner->entries[slot];
+
+        // Compare the stored hash first, so mismatches rarely touch the string.
+        if (entry->hash == hash && entry->length == length && memcmp(entry->str, str, length) == 0)
+            break;
+
+        // Move to the next slot.
+        slot = (slot + 1) & mask;
+        probes++;
+    }
+
+    // Update the probe statistics.
+    interner->lookup_count++;
+    interner->probe_count += probes;
+    if (probes > interner->max_probe) interner->max_probe = probes;
+
+    // Get the slot we ended on.
+    perf_intern_entry_t* entry = &interner->entries[slot];
+
+    // Insert the string if it wasn't found.
+    if (entry->str == NULL)
+    {
+        // Copy the string into storage.
+        const char* stored = perf_intern_store(interner, str, length);
+
+        // Check if the allocation failed.
+        if (stored == NULL)
+        {
+            // Set the error
+            *error = "Failed to allocate memory for interned string.";
+
+            // Return memory allocation failure result.
+            return PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+
+        // Fill in the slot.
+        entry->hash     = hash;
+        entry->length   = (uint32_t)length;
+        entry->str      = stored;
+
+        // One more unique string.
+        interner->count++;
+    }
+
+    // Output the interned string.
+    *out = entry->str;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for intern.h perf_interner_intern
+perf_result_t perf_interner_intern(perf_interner_t *interner, const char* str, size_t length, const char** out, const char** error)
+{
+    // Hash the string and insert it.
+    return perf_intern_insert(interner, str, length, perf_intern_hash(str, length), out, error);
+}
+
+// Implementation for intern.h perf_interner_absorb
+perf_result_t perf_interner_absorb(perf_interner_t *interner, perf_interner_t *other, const char** error)
+{
+    // Move every string over, reusing the stored hashes.
+    for (uint32_t idx = 0; idx < other->capacity; idx++)
+    {
+        // Get the entry
+        perf_intern_entry_t* entry = &other->entries[idx];
+
+        // Skip empty slots.
+        if (entry->str == NULL) continue;
+
+        // Intern the string here.
+        const char* target = NULL;
+        perf_result_t result = perf_intern_insert(interner, entry->str, entry->length, entry->hash, &target, error);
+
+        // Check if the string was interned successfully.
+        if (result != PERF_RES_OK) return result;
+
+        // Every stored string takes at least 8 bytes from its header on, room for the forwarding pointer.
+        memcpy((char*)entry->str - sizeof(uint32_t), &target, sizeof(target));
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for intern.h perf_interner_forward
+const char* perf_interner_forward(const char* str)
+{
+    // The forwarding pointer overwrote the header and the start of the string.
+    const char* target;
+    memcpy(&target, str - sizeof(uint32_t), sizeof(target));
+
+    // Return the target string
+    return target;
+}
+
+// Implementation for intern.h perf_interner_length
+uint32_t perf_interner_length(const char* str)
+{
+    // The length lives in the header right before the string.
+    return *(const uint32_t*)(str - sizeof(uint32_t));
+}
+
+// Implementation for intern.h perf_interner_get_stats
+perf_result_t perf_interner_get_stats(perf_interner_t *interner, perf_interner_stats_t *stats)
+{
+    // Copy the counters over.
+    stats->unique_count         = interner->count;
+    stats->capacity             = interner->capacity;
+    stats->string_bytes         = interner->string_bytes;
+    stats->arena_bytes          = interner->arena_bytes;
+    stats->table_bytes          = (size_t)interner->capacity * sizeof(perf_intern_entry_t);
+    stats->lookup_count         = interner->lookup_count;
+    stats->max_probe_length     = interner->max_probe;
+
+    // Calculate the average probe length.
+    stats->average_probe_length = interner->lookup_count == 0 ? 0.0 : (double)interner->probe_count / (double)interner->lookup_count;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for intern.h perf_interner_free
+perf_result_t perf_interner_free(perf_interner_t *interner)
+{
+    // Free every storage chunk.
+    perf_intern_chunk_t* chunk = interner->chunks;
+    while (chunk != NULL)
+    {
+        // Save the next chunk before freeing this one.
+        perf_intern_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    // Free the table.
+    free(interner->entries);
+
+    // Reset back to the initial state.
+    return perf_interner_init(interner);
+}
@@ -0,0 +1,1033 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#endif
+
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/value.h"
+#include "../inc/program.h"
+#include "../inc/jit.h"
+
+#if PERF_JIT_ENABLED
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Registers, by their encoding. rbx holds the frame's slots and r13 the tag of integers, the rest is scratch.
+#define PERF_JIT_RAX            0
+#define PERF_JIT_RCX            1
+#define PERF_JIT_RDX            2
+#define PERF_JIT_RBX            3
+#define PERF_JIT_RSI            6
+#define PERF_JIT_RDI            7
+#define PERF_JIT_R8             8
+#define PERF_JIT_R13            13
+
+// Condition codes, the low bit negates them.
+#define PERF_JIT_CC_O           0x0
+#define PERF_JIT_CC_B           0x2
+#define PERF_JIT_CC_AE          0x3
+#define PERF_JIT_CC_E           0x4
+#define PERF_JIT_CC_NE          0x5
+#define PERF_JIT_CC_A           0x7
+#define PERF_JIT_CC_P           0xA
+#define PERF_JIT_CC_L           0xC
+#define PERF_JIT_CC_GE          0xD
+#define PERF_JIT_CC_LE          0xE
+#define PERF_JIT_CC_G           0xF
+#define PERF_JIT_ALWAYS         0x10
+
+// ModRM extensions of the shifts.
+#define PERF_JIT_SHL            4
+#define PERF_JIT_SHR            5
+#define PERF_JIT_SAR            7
+
+// Jumps a label can take, a template that needs more fails to compile and its function stays in the interpreter.
+#define PERF_JIT_LABEL_JUMPS    4
+
+// Top 16 bits of the boxed types the templates check for.
+#define PERF_JIT_TAG(type)      (PERF_VALUE_TAG_BASE + (uint32_t)(type))
+
+/**
+ * Represents a jump whose target is only known once every instruction is compiled.
+*/
+typedef struct _perf_jit_patch_t
+{
+    uint32_t    position;       // Offset of the jump's rel32 in the machine code
+    uint32_t    target;         // Offset in the program's code of the instruction it goes to
+    bool        is_exit;        // True to hand target to the interpreter, false to jump to its machine code
+} perf_jit_patch_t;
+
+/**
+ * Represents a label within a template, the jumps to it are patched once it is bound.
+*/
+typedef struct _perf_jit_label_t
+{
+    uint32_t    positions[PERF_JIT_LABEL_JUMPS];   // Offsets of the jumps' rel32s
+    uint32_t    count;                              // Number of jumps
+} perf_jit_label_t;
+
+/**
+ * Represents the machine code of a function as it is being built.
+*/
+typedef struct _perf_jit_assembler_t
+{
+    uint8_t*            bytes;          // The machine code
+    uint32_t            count;          // Number of bytes
+    uint32_t            capacity;       // Number of bytes we can hold
+
+    perf_jit_patch_t*   patches;        // Jumps to patch at the end
+    uint32_t            patch_count;    // Number of patches
+    uint32_t            patch_capacity; // Number of patches we can hold
+
+    uint32_t            offset;         // Offset in the program's code of the instruction being compiled
+    bool                failed;         // True if memory ran out or a template failed, nothing is emitted after that
+    const char*         failure;        // Why a template failed, NULL if memory ran out
+} perf_jit_assembler_t;
+
+/**
+ * Represents the machine code of a function, as called by perf_jit_enter.
+ *
+ * @param slots The frame's slots.
+ * @param target The machine code of the instruction to start at.
+ *
+ * @return The offset in the program's code of the instruction for the interpreter to run next.
+*/
+typedef uint32_t (*perf_jit_code_t)(perf_value_t *slots, const void *target);
+
+/**
+ * @brief Appends a byte to the machine code.
+*/
+static void perf_jit_byte(perf_jit_assembler_t *as, uint8_t byte)
+{
+    // Grow the buffer if it is full.
+    if (as->count == as->capacity)
+    {
+        uint32_t    capacity    = as->capacity == 0 ? 4096 : as->capacity * 2;
+        uint8_t*    bytes       = as->failed ? NULL : (uint8_t*)realloc(as->bytes, capacity);
+
+        if (bytes == NULL)
+        {
+            as->failed = true;
+            return;
+        }
+
+        as->bytes       = bytes;
+        as->capacity    = capacity;
+    }
+
+    as->bytes[as->count++] = byte;
+}
+
+/**
+ * @brief Appends a little endian 32-bit value to the machine code.
+*/
+static void perf_jit_u32(perf_jit_assembler_t *as, uint32_t value)
+{
+    for (uint32_t idx = 0; idx < 4; idx++) perf_jit_byte(as, (uint8_t)(value >> (idx * 8)));
+}
+
+/**
+ * @brief Appends a little endian 64-bit value to the machine code.
+*/
+static void perf_jit_u64(perf_jit_assembler_t *as, uint64_t value)
+{
+    for (uint32_t idx = 0; idx < 8; idx++) perf_jit_byte(as, (uint8_t)(value >> (idx * 8)));
+}
+
+/**
+ * @brief Appends a one byte opcode, or a two byte one starting with 0x0F.
+*/
+static void perf_jit_opcode(perf_jit_assembler_t *as, uint32_t opcode)
+{
+    if (opcode > 0xFF) perf_jit_byte(as, (uint8_t)(opcode >> 8));
+    perf_jit_byte(as, (uint8_t)opcode);
+}
+
+/**
+ * @brief Appends a 64-bit operation on two registers: REX.W, the opcode, and ModRM with reg and rm.
+*/
+static void perf_jit_rr(perf_jit_assembler_t *as, uint32_t opcode, int reg, int rm)
+{
+    perf_jit_byte(as, (uint8_t)(0x48 | (reg >> 3) << 2 | (rm >> 3)));
+    perf_jit_opcode(as, opcode);
+    perf_jit_byte(as, (uint8_t)(0xC0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+/**
+ * @brief Appends a 64-bit operation on a register and [base + disp32], base must not be rsp, rbp, r12 or r13.
+*/
+static void perf_jit_rm(perf_jit_assembler_t *as, uint32_t opcode, int reg, int base, int32_t disp)
+{
+    perf_jit_byte(as, (uint8_t)(0x48 | (reg >> 3) << 2 | (base >> 3)));
+    perf_jit_opcode(as, opcode);
+    perf_jit_byte(as, (uint8_t)(0x80 | (reg & 7) << 3 | (base & 7)));
+    perf_jit_u32(as, (uint32_t)disp);
+}
+
+/**
+ * @brief Appends mov reg, [rbx + slot * 8].
+*/
+static void perf_jit_load(perf_jit_assembler_t *as, int reg, uint32_t slot)
+{
+    perf_jit_rm(as, 0x8B, reg, PERF_JIT_RBX, (int32_t)(slot * sizeof(perf_value_t)));
+}
+
+/**
+ * @brief Appends mov [rbx + slot * 8], reg.
+*/
+static void perf_jit_store(perf_jit_assembler_t *as, uint32_t slot, int reg)
+{
+    perf_jit_rm(as, 0x89, reg, PERF_JIT_RBX, (int32_t)(slot * sizeof(perf_value_t)));
+}
+
+/**
+ * @brief Appends mov reg, imm64.
+*/
+static void perf_jit_mov_imm(perf_jit_assembler_t *as, int reg, uint64_t value)
+{
+    perf_jit_byte(as, (uint8_t)(0x48 | (reg >> 3)));
+    perf_jit_byte(as, (uint8_t)(0xB8 + (reg & 7)));
+    perf_jit_u64(as, value);
+}
+
+/**
+ * @brief Appends a shift of a register by a constant, ext is PERF_JIT_SHL, PERF_JIT_SHR or PERF_JIT_SAR.
+*/
+static void perf_jit_shift(perf_jit_assembler_t *as, int reg, int ext, uint8_t count)
+{
+    perf_jit_byte(as, (uint8_t)(0x48 | (reg >> 3)));
+    perf_jit_byte(as, 0xC1);
+    perf_jit_byte(as, (uint8_t)(0xC0 | ext << 3 | (reg & 7)));
+    perf_jit_byte(as, count);
+}
+
+/**
+ * @brief Appends a check of a register's tag, leaving ZF set if it is tag. Clobbers rcx.
+*/
+static void perf_jit_is_tag(perf_jit_assembler_t *as, int reg, uint32_t tag)
+{
+    // mov rcx, reg; shr rcx, 48; cmp ecx, tag
+    perf_jit_rr(as, 0x89, reg, PERF_JIT_RCX);
+    perf_jit_shift(as, PERF_JIT_RCX, PERF_JIT_SHR, 48);
+    perf_jit_byte(as, 0x81);
+    perf_jit_byte(as, 0xF9);
+    perf_jit_u32(as, tag);
+}
+
+/**
+ * @brief Appends movq xmm, reg.
+*/
+static void perf_jit_to_xmm(perf_jit_assembler_t *as, int xmm, int reg)
+{
+    perf_jit_byte(as, 0x66);
+    perf_jit_rr(as, 0x0F6E, xmm, reg);
+}
+
+/**
+ * @brief Appends movq reg, xmm.
+*/
+static void perf_jit_from_xmm(perf_jit_assembler_t *as, int reg, int xmm)
+{
+    perf_jit_byte(as, 0x66);
+    perf_jit_rr(as, 0x0F7E, xmm, reg);
+}
+
+/**
+ * @brief Appends a scalar double operation on xmm0 and xmm1, prefix and opcode as in F2 0F 58 for addsd.
+*/
+static void perf_jit_sse(perf_jit_assembler_t *as, uint8_t prefix, uint8_t opcode, bool swap)
+{
+    perf_jit_byte(as, prefix);
+    perf_jit_byte(as, 0x0F);
+    perf_jit_byte(as, opcode);
+    perf_jit_byte(as, swap ? 0xC8 : 0xC1);
+}
+
+/**
+ * @brief Appends a jump, conditional unless cc is PERF_JIT_ALWAYS, with a rel32 left to patch.
+ *
+ * @return The offset of the rel32.
+*/
+static uint32_t perf_jit_jump(perf_jit_assembler_t *as, int cc)
+{
+    if (cc == PERF_JIT_ALWAYS) perf_jit_byte(as, 0xE9);
+    else
+    {
+        perf_jit_byte(as, 0x0F);
+        perf_jit_byte(as, (uint8_t)(0x80 | cc));
+    }
+
+    uint32_t position = as->count;
+    perf_jit_u32(as, 0);
+    return position;
+}
+
+/**
+ * @brief Points the rel32 at position to target, both offsets in the machine code.
+*/
+static void perf_jit_patch(perf_jit_assembler_t *as, uint32_t position, uint32_t target)
+{
+    // Nothing past a failure was emitted.
+    if (as->failed) return;
+
+    int32_t relative = (int32_t)(target - (position + 4));
+    memcpy(as->bytes + position, &relative, sizeof(relative));
+}
+
+/**
+ * @brief Appends a jump to a label.
+*/
+static void perf_jit_to(perf_jit_assembler_t *as, int cc, perf_jit_label_t *label)
+{
+    // A label only holds so many jumps, the function isn't compiled if one needs more.
+    if (label->count == PERF_JIT_LABEL_JUMPS)
+    {
+        as->failed  = true;
+        as->failure = "Too many jumps to a label in a JIT template";
+        return;
+    }
+
+    label->positions[label->count++] = perf_jit_jump(as, cc);
+}
+
+/**
+ * @brief Binds a label here, patching the jumps to it.
+*/
+static void perf_jit_bind(perf_jit_assembler_t *as, perf_jit_label_t *label)
+{
+    for (uint32_t idx = 0; idx < label->count; idx++) perf_jit_patch(as, label->positions[idx], as->count);
+}
+
+/**
+ * @brief Appends a jump to an instruction, or to handing it to the interpreter, patched once everything is compiled.
+*/
+static void perf_jit_jump_to(perf_jit_assembler_t *as, int cc, uint32_t target, bool is_exit)
+{
+    uint32_t position = perf_jit_jump(as, cc);
+
+    // Grow the patches if they are full.
+    if (as->patch_count == as->patch_capacity)
+    {
+        uint32_t            capacity    = as->patch_capacity == 0 ? 64 : as->patch_capacity * 2;
+        perf_jit_patch_t*   patches     = as->failed ? NULL : (perf_jit_patch_t*)realloc(as->patches, capacity * sizeof(perf_jit_patch_t));
+
+        if (patches == NULL)
+        {
+            as->failed = true;
+            return;
+        }
+
+        as->patches         = patches;
+        as->patch_capacity  = capacity;
+    }
+
+    as->patches[as->patch_count++] = (perf_jit_patch_t){ position, target, is_exit };
+}
+
+/**
+ * @brief Appends a guard handing the instruction being compiled to the interpreter if cc holds.
+*/
+static void perf_jit_exit(perf_jit_assembler_t *as, int cc)
+{
+    perf_jit_jump_to(as, cc, as->offset, true);
+}
+
+/**
+ * @brief Appends a jump to the falsy label if rax is nil, false, 0 or 0.0. Clobbers rcx.
+*/
+static void perf_jit_falsy(perf_jit_assembler_t *as, perf_jit_label_t *falsy)
+{
+    // cmp rax, rcx for false and nil
+    perf_jit_mov_imm(as, PERF_JIT_RCX, perf_value_bool(false).bits);
+    perf_jit_rr(as, 0x39, PERF_JIT_RCX, PERF_JIT_RAX);
+    perf_jit_to(as, PERF_JIT_CC_E, falsy);
+
+    perf_jit_mov_imm(as, PERF_JIT_RCX, perf_value_nil().bits);
+    perf_jit_rr(as, 0x39, PERF_JIT_RCX, PERF_JIT_RAX);
+    perf_jit_to(as, PERF_JIT_CC_E, falsy);
+
+    // The integer 0 is the tag alone.
+    perf_jit_rr(as, 0x39, PERF_JIT_R13, PERF_JIT_RAX);
+    perf_jit_to(as, PERF_JIT_CC_E, falsy);
+
+    // 0.0 and -0.0 are all zeros past the sign.
+    perf_jit_rr(as, 0x89, PERF_JIT_RAX, PERF_JIT_RCX);
+    perf_jit_shift(as, PERF_JIT_RCX, PERF_JIT_SHL, 1);
+    perf_jit_to(as, PERF_JIT_CC_E, falsy);
+}
+
+/**
+ * @brief Appends a boolean made from a condition code into a slot. Clobbers rax and rcx.
+*/
+static void perf_jit_set_bool(perf_jit_assembler_t *as, int cc, uint32_t slot)
+{
+    // setcc al; movzx eax, al; or rax, false
+    perf_jit_byte(as, 0x0F);
+    perf_jit_byte(as, (uint8_t)(0x90 | cc));
+    perf_jit_byte(as, 0xC0);
+    perf_jit_byte(as, 0x0F);
+    perf_jit_byte(as, 0xB6);
+    perf_jit_byte(as, 0xC0);
+    perf_jit_mov_imm(as, PERF_JIT_RCX, perf_value_bool(false).bits);
+    perf_jit_rr(as, 0x09, PERF_JIT_RCX, PERF_JIT_RAX);
+    perf_jit_store(as, slot, PERF_JIT_RAX);
+}
+
+/**
+ * @brief Appends the exit of both guards taken when rax and rdx aren't two numbers.
+*/
+static void perf_jit_numbers(perf_jit_assembler_t *as, int rhs)
+{
+    // Numbers are the bit patterns below the first tag, which r13 holds.
+    perf_jit_rr(as, 0x39, PERF_JIT_R13, PERF_JIT_RAX);
+    perf_jit_exit(as, PERF_JIT_CC_AE);
+    perf_jit_rr(as, 0x39, PERF_JIT_R13, rhs);
+    perf_jit_exit(as, PERF_JIT_CC_AE);
+
+    perf_jit_to_xmm(as, 0, PERF_JIT_RAX);
+    perf_jit_to_xmm(as, 1, rhs);
+}
+
+/**
+ * @brief Appends R[a] = R[b] op rdx for ROP_ADD, ROP_SUBTRACT or ROP_MULTIPLY, with rdx already loaded.
+*/
+static void perf_jit_arithmetic(perf_jit_assembler_t *as, uint8_t opcode, uint32_t a, uint32_t b)
+{
+    perf_jit_label_t numbers    = { 0 };
+    perf_jit_label_t done       = { 0 };
+
+    perf_jit_load(as, PERF_JIT_RAX, b);
+
+    // Two integers, shifted to the top of 64 bits so the operation overflows exactly when the result leaves
+    // 48 bits. Those are left to the interpreter, which makes them numbers.
+    perf_jit_is_tag(as, PERF_JIT_RAX, PERF_JIT_TAG(PERF_VALUE_INTEGER));
+    perf_jit_to(as, PERF_JIT_CC_NE, &numbers);
+    perf_jit_is_tag(as, PERF_JIT_RDX, PERF_JIT_TAG(PERF_VALUE_INTEGER));
+    perf_jit_to(as, PERF_JIT_CC_NE, &numbers);
+
+    perf_jit_shift(as, PERF_JIT_RAX, PERF_JIT_SHL, 16);
+    perf_jit_shift(as, PERF_JIT_RDX, PERF_JIT_SHL, 16);
+
+    switch (opcode)
+    {
+    case ROP_ADD:       perf_jit_rr(as, 0x01, PERF_JIT_RDX, PERF_JIT_RAX);     break;
+    case ROP_SUBTRACT:  perf_jit_rr(as, 0x29, PERF_JIT_RDX, PERF_JIT_RAX);     break;
+    default:
+        // Only one side is shifted for a product.
+        perf_jit_shift(as, PERF_JIT_RDX, PERF_JIT_SAR, 16);
+        perf_jit_rr(as, 0x0FAF, PERF_JIT_RAX, PERF_JIT_RDX);
+        break;
+    }
+
+    perf_jit_exit(as, PERF_JIT_CC_O);
+
+    // Shifting back down clears the tag bits, then it is boxed again.
+    perf_jit_shift(as, PERF_JIT_RAX, PERF_JIT_SHR, 16);
+    perf_jit_rr(as, 0x09, PERF_JIT_R13, PERF_JIT_RAX);
+    perf_jit_store(as, a, PERF_JIT_RAX);
+    perf_jit_to(as, PERF_JIT_ALWAYS, &done);
+
+    // Two numbers
+    perf_jit_bind(as, &numbers);
+    perf_jit_numbers(as, PERF_JIT_RDX);
+    perf_jit_sse(as, 0xF2, opcode == ROP_ADD ? 0x58 : opcode == ROP_SUBTRACT ? 0x5C : 0x59, false);
+    perf_jit_from_xmm(as, PERF_JIT_RAX, 0);
+    perf_jit_store(as, a, PERF_JIT_RAX);
+
+    perf_jit_bind(as, &done);
+}
+
+/**
+ * @brief Appends R[a] = R[b] / R[c] or R[b] % R[c], for ROP_DIVIDE or ROP_MODULO.
+*/
+static void perf_jit_divide(perf_jit_assembler_t *as, uint8_t opcode, uint32_t a, uint32_t b, uint32_t c)
+{
+    perf_jit_label_t numbers    = { 0 };
+    perf_jit_label_t done       = { 0 };
+
+    // idiv takes rdx, the divisor goes in r8.
+    perf_jit_load(as, PERF_JIT_RAX, b);
+    perf_jit_load(as, PERF_JIT_R8, c);
+
+    // Numbers only divide here, the interpreter takes the remainder of numbers.
+    int not_integer = opcode == ROP_DIVIDE ? PERF_JIT_CC_NE : -1;
+
+    perf_jit_is_tag(as, PERF_JIT_RAX, PERF_JIT_TAG(PERF_VALUE_INTEGER));
+    if (opcode == ROP_DIVIDE) perf_jit_to(as, not_integer, &numbers); else perf_jit_exit(as, PERF_JIT_CC_NE);
+    perf_jit_is_tag(as, PERF_JIT_R8, PERF_JIT_TAG(PERF_VALUE_INTEGER));
+    if (opcode == ROP_DIVIDE) perf_jit_to(as, not_integer, &numbers); else perf_jit_exit(as, PERF_JIT_CC_NE);
+
+    // Two integers, sign extended. Positive divisors can't fail or leave the range, the rest are the interpreter's.
+    perf_jit_shift(as, PERF_JIT_RAX, PERF_JIT_SHL, 16);
+    perf_jit_shift(as, PERF_JIT_RAX, PERF_JIT_SAR, 16);
+    perf_jit_shift(as, PERF_JIT_R8, PERF_JIT_SHL, 16);
+    perf_jit_shift(as, PERF_JIT_R8, PERF_JIT_SAR, 16);
+    perf_jit_rr(as, 0x85, PERF_JIT_R8, PERF_JIT_R8);
+    perf_jit_exit(as, PERF_JIT_CC_LE);
+
+    // cqo; idiv r8
+    perf_jit_byte(as, 0x48);
+    perf_jit_byte(as, 0x99);
+    perf_jit_byte(as, 0x49);
+    perf_jit_byte(as, 0xF7);
+    perf_jit_byte(as, 0xF8);
+
+    if (opcode == ROP_MODULO) perf_jit_rr(as, 0x89, PERF_JIT_RDX, PERF_JIT_RAX);
+
+    // Box it
+    perf_jit_shift(as, PERF_JIT_RAX, PERF_JIT_SHL, 16);
+    perf_jit_shift(as, PERF_JIT_RAX, PERF_JIT_SHR, 16);
+    perf_jit_rr(as, 0x09, PERF_JIT_R13, PERF_JIT_RAX);
+    perf_jit_store(as, a, PERF_JIT_RAX);
+
+    if (opcode == ROP_MODULO) return;
+
+    perf_jit_to(as, PERF_JIT_ALWAYS, &done);
+
+    // Two numbers
+    perf_jit_bind(as, &numbers);
+    perf_jit_numbers(as, PERF_JIT_R8);
+    perf_jit_sse(as, 0xF2, 0x5E, false);
+    perf_jit_from_xmm(as, PERF_JIT_RAX, 0);
+    perf_jit_store(as, a, PERF_JIT_RAX);
+
+    perf_jit_bind(as, &done);
+}
+
+/**
+ * @brief Appends an ordered comparison of R[x] and R[y], stored into R[a] or, if branch, jumping to target unless it held.
+*/
+static void perf_jit_compare(perf_jit_assembler_t *as, uint8_t opcode, uint32_t x, uint32_t y, uint32_t a, bool branch, uint32_t target)
+{
+    perf_jit_label_t numbers    = { 0 };
+    perf_jit_label_t done       = { 0 };
+
+    // Signed conditions for integers, unsigned ones on ucomisd for numbers, which leaves NaNs unordered so nothing holds.
+    int     integer_cc;
+    int     number_cc;
+    bool    swap;
+
+    switch (opcode)
+    {
+    case ROP_GREATER:       integer_cc = PERF_JIT_CC_G;     number_cc = PERF_JIT_CC_A;      swap = false;   break;
+    case ROP_GREATER_EQUAL: integer_cc = PERF_JIT_CC_GE;    number_cc = PERF_JIT_CC_AE;     swap = false;   break;
+    case ROP_LESS:          integer_cc = PERF_JIT_CC_L;     number_cc = PERF_JIT_CC_A;      swap = true;    break;
+    default:                integer_cc = PERF_JIT_CC_LE;    number_cc = PERF_JIT_CC_AE;     swap = true;    break;
+    }
+
+    perf_jit_load(as, PERF_JIT_RAX, x);
+    perf_jit_load(as, PERF_JIT_RDX, y);
+
+    // Two integers compare in the top 48 bits.
+    perf_jit_is_tag(as, PERF_JIT_RAX, PERF_JIT_TAG(PERF_VALUE_INTEGER));
+    perf_jit_to(as, PERF_JIT_CC_NE, &numbers);
+    perf_jit_is_tag(as, PERF_JIT_RDX, PERF_JIT_TAG(PERF_VALUE_INTEGER));
+    perf_jit_to(as, PERF_JIT_CC_NE, &numbers);
+
+    perf_jit_shift(as, PERF_JIT_RAX, PERF_JIT_SHL, 16);
+    perf_jit_shift(as, PERF_JIT_RDX, PERF_JIT_SHL, 16);
+    perf_jit_rr(as, 0x39, PERF_JIT_RDX, PERF_JIT_RAX);
+
+    if (branch) perf_jit_jump_to(as, integer_cc ^ 1, target, false);
+    else perf_jit_set_bool(as, integer_cc, a);
+
+    perf_jit_to(as, PERF_JIT_ALWAYS, &done);
+
+    // Two numbers, less and less equal swap them to use above and above equal.
+    perf_jit_bind(as, &numbers);
+    perf_jit_numbers(as, PERF_JIT_RDX);
+    perf_jit_byte(as, 0x66);
+    perf_jit_byte(as, 0x0F);
+    perf_jit_byte(as, 0x2E);
+    perf_jit_byte(as, swap ? 0xC8 : 0xC1);
+
+    if (branch) perf_jit_jump_to(as, number_cc ^ 1, target, false);
+    else perf_jit_set_bool(as, number_cc, a);
+
+    perf_jit_bind(as, &done);
+}
+
+/**
+ * @brief Appends a comparison of R[x] and R[y] for equality, jumping to the equal or not_equal label.
+ * Every path ends in one of the jumps, the code after it is reached from neither.
+*/
+static void perf_jit_equal(perf_jit_assembler_t *as, uint32_t x, uint32_t y, perf_jit_label_t *equal, perf_jit_label_t *not_equal)
+{
+    perf_jit_label_t numbers = { 0 };
+
+    perf_jit_load(as, PERF_JIT_RAX, x);
+    perf_jit_load(as, PERF_JIT_RDX, y);
+
+    // Boxed values on both sides are equal when their bits are, except strings, which compare by content.
+    perf_jit_rr(as, 0x39, PERF_JIT_R13, PERF_JIT_RAX);
+    perf_jit_to(as, PERF_JIT_CC_B, &numbers);
+    perf_jit_rr(as, 0x39, PERF_JIT_R13, PERF_JIT_RDX);
+    perf_jit_exit(as, PERF_JIT_CC_B);
+
+    perf_jit_rr(as, 0x39, PERF_JIT_RDX, PERF_JIT_RAX);
+    perf_jit_to(as, PERF_JIT_CC_E, equal);
+
+    perf_jit_is_tag(as, PERF_JIT_RAX, PERF_JIT_TAG(PERF_VALUE_STRING));
+    perf_jit_to(as, PERF_JIT_CC_NE, not_equal);
+    perf_jit_is_tag(as, PERF_JIT_RDX, PERF_JIT_TAG(PERF_VALUE_STRING));
+    perf_jit_exit(as, PERF_JIT_CC_E);
+    perf_jit_to(as, PERF_JIT_ALWAYS, not_equal);
+
+    // Two numbers compare by value, NaNs are unordered and equal nothing.
+    perf_jit_bind(as, &numbers);
+    perf_jit_numbers(as, PERF_JIT_RDX);
+    perf_jit_sse(as, 0x66, 0x2E, false);
+    perf_jit_to(as, PERF_JIT_CC_P, not_equal);
+    perf_jit_to(as, PERF_JIT_CC_NE, not_equal);
+    perf_jit_to(as, PERF_JIT_ALWAYS, equal);
+}
+
+/**
+ * @brief Appends the template of a register instruction.
+ *
+ * @param as The assembler, its offset is the instruction's.
+ * @param program The program running.
+ * @param globals The globals of the run.
+ * @param ip The instruction.
+*/
+static void perf_jit_instruction(perf_jit_assembler_t *as, const perf_program_t *program, perf_value_t *globals, const uint8_t *ip)
+{
+    uint32_t a          = ip[1];
+    uint32_t b          = ip[2];
+    uint32_t c          = ip[3];
+    uint32_t bx         = (uint32_t)ip[2] | (uint32_t)ip[3] << 8;
+    uint32_t next       = as->offset + perf_reg_opcode_info[ip[0]].size;
+
+    perf_jit_label_t first  = { 0 };
+    perf_jit_label_t second = { 0 };
+    perf_jit_label_t done   = { 0 };
+
+    switch (ip[0])
+    {
+    case ROP_MOVE:
+        perf_jit_load(as, PERF_JIT_RAX, b);
+        perf_jit_store(as, a, PERF_JIT_RAX);
+        break;
+
+    case ROP_CONSTANT:
+    case ROP_CONSTANT_WIDE:
+    {
+        // Constants never change, they are part of the instruction.
+        uint32_t index = ip[0] == ROP_CONSTANT ? bx : (uint32_t)ip[4] | (uint32_t)ip[5] << 8 | (uint32_t)ip[6] << 16 | (uint32_t)ip[7] << 24;
+
+        perf_jit_mov_imm(as, PERF_JIT_RAX, program->constants[index].bits);
+        perf_jit_store(as, a, PERF_JIT_RAX);
+        break;
+    }
+
+    case ROP_NIL:
+    case ROP_TRUE:
+    case ROP_FALSE:
+        perf_jit_mov_imm(as, PERF_JIT_RAX, ip[0] == ROP_NIL ? perf_value_nil().bits : perf_value_bool(ip[0] == ROP_TRUE).bits);
+        perf_jit_store(as, a, PERF_JIT_RAX);
+        break;
+
+    case ROP_GET_GLOBAL:
+    case ROP_SET_GLOBAL:
+    {
+        // Globals stay where they are for the run.
+        uint32_t index = (uint32_t)ip[4] | (uint32_t)ip[5] << 8 | (uint32_t)ip[6] << 16 | (uint32_t)ip[7] << 24;
+
+        perf_jit_mov_imm(as, PERF_JIT_RCX, (uint64_t)(uintptr_t)&globals[index]);
+
+        if (ip[0] == ROP_SET_GLOBAL)
+        {
+            perf_jit_load(as, PERF_JIT_RAX, a);
+            perf_jit_rm(as, 0x89, PERF_JIT_RAX, PERF_JIT_RCX, 0);
+            break;
+        }
+
+        // The interpreter reports reading one before it is assigned.
+        perf_jit_rm(as, 0x8B, PERF_JIT_RAX, PERF_JIT_RCX, 0);
+        perf_jit_mov_imm(as, PERF_JIT_RDX, perf_value_undefined().bits);
+        perf_jit_rr(as, 0x39, PERF_JIT_RDX, PERF_JIT_RAX);
+        perf_jit_exit(as, PERF_JIT_CC_E);
+        perf_jit_store(as, a, PERF_JIT_RAX);
+        break;
+    }
+
+    case ROP_GET_THIS:
+        perf_jit_rm(as, 0x8B, PERF_JIT_RAX, PERF_JIT_RBX, -(int32_t)sizeof(perf_value_t));
+        perf_jit_store(as, a, PERF_JIT_RAX);
+        break;
+
+    case ROP_NEGATE:
+        perf_jit_load(as, PERF_JIT_RAX, b);
+
+        // An integer, -2^47 is left to the interpreter as its negation doesn't fit.
+        perf_jit_is_tag(as, PERF_JIT_RAX, PERF_JIT_TAG(PERF_VALUE_INTEGER));
+        perf_jit_to(as, PERF_JIT_CC_NE, &first);
+        perf_jit_shift(as, PERF_JIT_RAX, PERF_JIT_SHL, 16);
+        perf_jit_rr(as, 0xF7, 3, PERF_JIT_RAX);
+        perf_jit_exit(as, PERF_JIT_CC_O);
+        perf_jit_shift(as, PERF_JIT_RAX, PERF_JIT_SHR, 16);
+        perf_jit_rr(as, 0x09, PERF_JIT_R13, PERF_JIT_RAX);
+        perf_jit_store(as, a, PERF_JIT_RAX);
+        perf_jit_to(as, PERF_JIT_ALWAYS, &done);
+
+        // A number flips its sign bit.
+        perf_jit_bind(as, &first);
+        perf_jit_rr(as, 0x39, PERF_JIT_R13, PERF_JIT_RAX);
+        perf_jit_exit(as, PERF_JIT_CC_AE);
+        perf_jit_mov_imm(as, PERF_JIT_RCX, 0x8000000000000000ull);
+        perf_jit_rr(as, 0x31, PERF_JIT_RCX, PERF_JIT_RAX);
+        perf_jit_store(as, a, PERF_JIT_RAX);
+
+        perf_jit_bind(as, &done);
+        break;
+
+    case ROP_NOT:
+        perf_jit_load(as, PERF_JIT_RAX, b);
+        perf_jit_falsy(as, &first);
+
+        perf_jit_mov_imm(as, PERF_JIT_RAX, perf_value_bool(false).bits);
+        perf_jit_store(as, a, PERF_JIT_RAX);
+        perf_jit_to(as, PERF_JIT_ALWAYS, &done);
+
+        perf_jit_bind(as, &first);
+        perf_jit_mov_imm(as, PERF_JIT_RAX, perf_value_bool(true).bits);
+        perf_jit_store(as, a, PERF_JIT_RAX);
+
+        perf_jit_bind(as, &done);
+        break;
+
+    case ROP_ADD:
+    case ROP_SUBTRACT:
+    case ROP_MULTIPLY:
+        perf_jit_load(as, PERF_JIT_RDX, c);
+        perf_jit_arithmetic(as, ip[0], a, b);
+        break;
+
+    case ROP_ADD_CONSTANT:
+    case ROP_SUBTRACT_CONSTANT:
+        perf_jit_mov_imm(as, PERF_JIT_RDX, program->constants[c].bits);
+        perf_jit_arithmetic(as, ip[0] == ROP_ADD_CONSTANT ? ROP_ADD : ROP_SUBTRACT, a, b);
+        break;
+
+    case ROP_DIVIDE:
+    case ROP_MODULO:
+        perf_jit_divide(as, ip[0], a, b, c);
+        break;
+
+    case ROP_BIT_AND:
+        // The bits of two integers that fit always fit, tag included.
+        perf_jit_load(as, PERF_JIT_RAX, b);
+        perf_jit_load(as, PERF_JIT_RDX, c);
+        perf_jit_is_tag(as, PERF_JIT_RAX, PERF_JIT_TAG(PERF_VALUE_INTEGER));
+        perf_jit_exit(as, PERF_JIT_CC_NE);
+        perf_jit_is_tag(as, PERF_JIT_RDX, PERF_JIT_TAG(PERF_VALUE_INTEGER));
+        perf_jit_exit(as, PERF_JIT_CC_NE);
+        perf_jit_rr(as, 0x21, PERF_JIT_RDX, PERF_JIT_RAX);
+        perf_jit_store(as, a, PERF_JIT_RAX);
+        break;
+
+    case ROP_EQUAL:
+    case ROP_NOT_EQUAL:
+        perf_jit_equal(as, b, c, &first, &second);
+
+        perf_jit_bind(as, &first);
+        perf_jit_mov_imm(as, PERF_JIT_RAX, perf_value_bool(ip[0] == ROP_EQUAL).bits);
+        perf_jit_store(as, a, PERF_JIT_RAX);
+        perf_jit_to(as, PERF_JIT_ALWAYS, &done);
+
+        perf_jit_bind(as, &second);
+        perf_jit_mov_imm(as, PERF_JIT_RAX, perf_value_bool(ip[0] != ROP_EQUAL).bits);
+        perf_jit_store(as, a, PERF_JIT_RAX);
+
+        perf_jit_bind(as, &done);
+        break;
+
+    case ROP_GREATER:
+    case ROP_GREATER_EQUAL:
+    case ROP_LESS:
+    case ROP_LESS_EQUAL:
+        perf_jit_compare(as, ip[0], b, c, a, false, 0);
+        break;
+
+    case ROP_JUMP:
+        perf_jit_jump_to(as, PERF_JIT_ALWAYS, next + bx, false);
+        break;
+
+    case ROP_LOOP:
+        perf_jit_jump_to(as, PERF_JIT_ALWAYS, next - bx, false);
+        break;
+
+    case ROP_JUMP_IF_FALSE:
+        perf_jit_load(as, PERF_JIT_RAX, a);
+        perf_jit_falsy(as, &first);
+        perf_jit_to(as, PERF_JIT_ALWAYS, &done);
+
+        perf_jit_bind(as, &first);
+        perf_jit_jump_to(as, PERF_JIT_ALWAYS, next + bx, false);
+
+        perf_jit_bind(as, &done);
+        break;
+
+    case ROP_JUMP_IF_NOT_EQUAL:
+    case ROP_JUMP_IF_EQUAL:
+    {
+        // Jumps unless R[a] == R[b] held, or unless it didn't.
+        uint32_t target = next + ((uint32_t)ip[6] | (uint32_t)ip[7] << 8);
+
+        perf_jit_equal(as, a, b, &first, &second);
+
+        perf_jit_bind(as, ip[0] == ROP_JUMP_IF_NOT_EQUAL ? &second : &first);
+        perf_jit_jump_to(as, PERF_JIT_ALWAYS, target, false);
+
+        perf_jit_bind(as, ip[0] == ROP_JUMP_IF_NOT_EQUAL ? &first : &second);
+        break;
+    }
+
+    case ROP_JUMP_IF_NOT_GREATER:
+    case ROP_JUMP_IF_NOT_GREATER_EQUAL:
+    case ROP_JUMP_IF_NOT_LESS:
+    case ROP_JUMP_IF_NOT_LESS_EQUAL:
+    {
+        static const uint8_t compares[] = { ROP_GREATER, ROP_GREATER_EQUAL, ROP_LESS, ROP_LESS_EQUAL };
+
+        perf_jit_compare(as, compares[ip[0] - ROP_JUMP_IF_NOT_GREATER], a, b, 0, true, next + ((uint32_t)ip[6] | (uint32_t)ip[7] << 8));
+        break;
+    }
+
+    // Calls, returns and instances are the interpreter's.
+    default:
+        perf_jit_exit(as, PERF_JIT_ALWAYS);
+        break;
+    }
+}
+#endif
+
+// Implementation for jit.h perf_jit_reset
+perf_result_t perf_jit_reset(perf_jit_t *jit, const perf_program_t *program, const char** error)
+{
+    // Free the last run's machine code, the threshold stays.
+    uint32_t threshold = jit->threshold;
+
+    perf_jit_free(jit);
+
+    jit->threshold  = threshold;
+    jit->functions  = (perf_jit_function_t*)calloc(program->function_count > 0 ? program->function_count : 1, sizeof(perf_jit_function_t));
+
+    if (jit->functions == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for JIT functions";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    jit->function_count = program->function_count;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for jit.h perf_jit_compile
+perf_result_t perf_jit_compile(perf_jit_t *jit, const perf_program_t *program, perf_value_t *globals, uint32_t function, const char** error)
+{
+#if PERF_JIT_ENABLED
+    const perf_function_t*  source      = &program->functions[function];
+    perf_jit_function_t*    compiled    = &jit->functions[function];
+    perf_jit_assembler_t    as          = { 0 };
+
+    // Every call leaves the machine code and comes back through a stub, which only loops win back.
+    bool calls = false;
+    bool loops = false;
+
+    for (uint32_t offset = source->code_offset; offset < source->code_offset + source->code_length; offset += perf_reg_opcode_info[program->code[offset]].size)
+    {
+        if (program->code[offset] == ROP_CALL || program->code[offset] == ROP_INVOKE) calls = true;
+        if (program->code[offset] == ROP_LOOP) loops = true;
+    }
+
+    if (calls && !loops)
+    {
+        jit->stats.declined_count++;
+
+        // Set the error
+        *error = "Function calls without looping, it stays in the interpreter";
+
+        // Return unsupported result.
+        return PERF_RES_UNSUPPORTED;
+    }
+
+    // One entry per word, instructions start on one.
+    uint32_t* entries = (uint32_t*)calloc(source->code_length / 4 + 1, sizeof(uint32_t));
+
+    if (entries == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for JIT entries";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // The prologue saves what it uses, loads the slots and the integer tag, and jumps to the instruction to start at:
+    // push rbx; push r13; mov rbx, rdi; mov r13, tag; jmp rsi
+    perf_jit_byte(&as, 0x53);
+    perf_jit_byte(&as, 0x41);
+    perf_jit_byte(&as, 0x55);
+    perf_jit_rr(&as, 0x89, PERF_JIT_RDI, PERF_JIT_RBX);
+    perf_jit_mov_imm(&as, PERF_JIT_R13, perf_value_box(PERF_VALUE_INTEGER, 0).bits);
+    perf_jit_byte(&as, 0xFF);
+    perf_jit_byte(&as, 0xE6);
+
+    // Each instruction's template, the compiler ends every function with a return so nothing falls off the end.
+    for (uint32_t offset = source->code_offset; offset < source->code_offset + source->code_length; offset += perf_reg_opcode_info[program->code[offset]].size)
+    {
+        entries[(offset - source->code_offset) / 4] = as.count;
+        as.offset = offset;
+
+        perf_jit_instruction(&as, program, globals, program->code + offset);
+    }
+
+    // The epilogue returns the instruction in eax: pop r13; pop rbx; ret
+    uint32_t epilogue = as.count;
+
+    perf_jit_byte(&as, 0x41);
+    perf_jit_byte(&as, 0x5D);
+    perf_jit_byte(&as, 0x5B);
+    perf_jit_byte(&as, 0xC3);
+
+    // Jumps go to their instruction's template, exits to a stub per instruction: mov eax, offset; jmp epilogue
+    uint32_t stub_offset    = UINT32_MAX;
+    uint32_t stub           = 0;
+
+    for (uint32_t idx = 0; idx < as.patch_count && !as.failed; idx++)
+    {
+        const perf_jit_patch_t* patch = &as.patches[idx];
+
+        if (!patch->is_exit)
+        {
+            perf_jit_patch(&as, patch->position, entries[(patch->target - source->code_offset) / 4]);
+            continue;
+        }
+
+        // An instruction's exits come one after the other, they share its stub.
+        if (patch->target != stub_offset)
+        {
+            stub_offset = patch->target;
+            stub        = as.count;
+
+            perf_jit_byte(&as, 0xB8);
+            perf_jit_u32(&as, patch->target);
+            perf_jit_patch(&as, perf_jit_jump(&as, PERF_JIT_ALWAYS), epilogue);
+        }
+
+        perf_jit_patch(&as, patch->position, stub);
+    }
+
+    free(as.patches);
+
+    // Map it writable, copy it in, then make it executable instead.
+    size_t  page    = (size_t)sysconf(_SC_PAGESIZE);
+    size_t  size    = ((size_t)as.count + page - 1) / page * page;
+    void*   code    = as.failed ? MAP_FAILED : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (code != MAP_FAILED)
+    {
+        memcpy(code, as.bytes, as.count);
+
+        if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(code, size);
+            code = MAP_FAILED;
+        }
+    }
+
+    free(as.bytes);
+
+    if (code == MAP_FAILED)
+    {
+        free(entries);
+
+        // Set the error
+        *error = as.failure != NULL ? as.failure : "Failed to allocate memory for machine code";
+
+        // Return compile error or memory allocation failure result.
+        return as.failure != NULL ? PERF_RES_COMPILE_ERROR : PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    compiled->code          = (uint8_t*)code;
+    compiled->code_size     = size;
+    compiled->entries       = entries;
+    compiled->code_offset   = source->code_offset;
+
+    jit->stats.compiled_count++;
+    jit->stats.code_bytes += as.count;
+
+    // Return OK result.
+    return PERF_RES_OK;
+#else
+    // There is nothing to compile with.
+    (void)jit;
+    (void)program;
+    (void)globals;
+    (void)function;
+
+    // Set the error
+    *error = "The JIT is not part of this build";
+
+    // Return unsupported result.
+    return PERF_RES_UNSUPPORTED;
+#endif
+}
+
+// Implementation for jit.h perf_jit_enter
+uint32_t perf_jit_enter(perf_jit_t *jit, uint32_t function, perf_value_t *slots, uint32_t offset)
+{
+#if PERF_JIT_ENABLED
+    const perf_jit_function_t*  compiled    = &jit->functions[function];
+    const void*                 start       = compiled->code;
+    perf_jit_code_t             code;
+
+    // The machine code starts with the prologue, which jumps to the instruction's template.
+    memcpy(&code, &start, sizeof(code));
+    jit->stats.entry_count++;
+
+    return code(slots, compiled->code + compiled->entries[(offset - compiled->code_offset) / 4]);
+#else
+    // Nothing is ever compiled, the interpreter runs everything.
+    (void)jit;
+    (void)function;
+    (void)slots;
+
+    return offset;
+#endif
+}
+
+// Implementation for jit.h perf_jit_get_stats
+perf_result_t perf_jit_get_stats(perf_jit_t *jit, perf_jit_stats_t *stats)
+{
+    *stats = jit->stats;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for jit.h perf_jit_free
+perf_result_t perf_jit_free(perf_jit_t *jit)
+{
+    // Unmap every function's machine code.
+    for (uint32_t idx = 0; idx < jit->function_count; idx++)
+    {
+#if PERF_JIT_ENABLED
+        if (jit->functions[idx].code != NULL) munmap(jit->functions[idx].code, jit->functions[idx].code_size);
+#endif
+        free(jit->functions[idx].entries);
+    }
+
+    free(jit->functions);
+    memset(jit, 0, sizeof(perf_jit_t));
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
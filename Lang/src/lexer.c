@@ -1,18 +1,10 @@
 #include "../inc/shared.h"
 #include "../inc/result.h"
 #include "../inc/token.h"
+#include "../inc/intern.h"
 #include "../inc/lexer.h"
-
-/**
- * Used to determine the integer mode of an int literal.
-*/
-typedef enum _perf_e_integer_mode_t
-{
-    INT_BINARY  = 2,
-    INT_OCTAL   = 8,
-    INT_DECIMAL = 10,
-    INT_HEX     = 16
-} perf_e_integer_mode_t;
+#include "../inc/scan.h"
+#include "../inc/number.h"
 
 /**
  * @brief Determines if the given character is whitespace.
@@ -62,29 +54,6 @@ bool char_is_alphanumeric(char ch)
     return char_is_alphabetic(ch) || char_is_numeric(ch);
 }
 
-/**
- * @brief Determines if the given character matches the given integer mode.
- * 
- * @param ch The character to check.
- * @param integer_mode The integer mode to check against.
- * 
- * @return true if the character matches the integer mode, false otherwise.
-*/
-bool char_matches_integer_mode(char ch, perf_e_integer_mode_t integer_mode)
-{
-    // Check if the character matches the integer mode.
-    switch (integer_mode)
-    {
-    case INT_BINARY:    return ch == '0' || ch == '1';
-    case INT_OCTAL:     return ch >= '0' && ch <= '8';
-    case INT_DECIMAL:   return ch >= '0' && ch <= '9';
-    case INT_HEX:       return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
-    }
-
-    // Return false if the integer mode is invalid.
-    return false;
-}
-
 /**
  * @brief Resizes the token array.
  * 
@@ -145,8 +114,97 @@ perf_result_t perf_lexer_init(perf_lexer_t *lexer)
     lexer->current_ch       = NULL;
     lexer->line_number      = 0;
     lexer->column_number    = 0;
+    lexer->mode             = PERF_LEXER_MODE_INTERN;
+    lexer->lookahead_head   = 0;
+    lexer->lookahead_count  = 0;
 
-    // Return OK result
+    // Pick the scanning kernels for this CPU.
+    perf_scan_init();
+
+    // Initialize the interner, which persists across digests.
+    return perf_interner_init(&lexer->interner);
+}
+
+// Implementation for lexer.h perf_lexer_free
+perf_result_t perf_lexer_free(perf_lexer_t *lexer)
+{
+    // Free the interned strings
+    return perf_interner_free(&lexer->interner);
+}
+
+/**
+ * @brief Moves the lexer forward to the given character, updating the line and column numbers.
+ * 
+ * @param lexer The lexer to use.
+ * @param end The character to move to.
+ * @param newlines The number of newlines between the current character and end.
+ * @param line_start The character after the last of those newlines, if there were any.
+*/
+static inline void perf_lexer_advance(perf_lexer_t* lexer, const char* end, uint32_t newlines, const char* line_start)
+{
+    // Check if we moved onto a new line, the column is then relative to its start.
+    if (newlines != 0)
+    {
+        lexer->line_number     += newlines;
+        lexer->column_number    = (uint32_t)(end - line_start);
+    }
+
+    // Otherwise we stayed on the same line.
+    else lexer->column_number += (uint32_t)(end - lexer->current_ch);
+
+    // Move to the character.
+    lexer->current_ch = end;
+}
+
+// Implementation for lexer.h perf_lexer_token_text
+const char* perf_lexer_token_text(const perf_lexer_t *lexer, const perf_token_t *token, size_t *length)
+{
+    // Zero copy tokens point straight into the source.
+    if (lexer->mode == PERF_LEXER_MODE_ZERO_COPY)
+    {
+        *length = token->as.span.length;
+        return lexer->src + token->as.span.offset;
+    }
+
+    // Interned strings know their own length.
+    *length = perf_interner_length(token->as.str);
+    return token->as.str;
+}
+
+/**
+ * @brief Stores the text of an identifier or string token according to the lexer mode.
+ * 
+ * @param lexer The lexer to use.
+ * @param token The token to store the text in.
+ * @param text The start of the text in the source.
+ * @param length The length of the text.
+ * 
+ * @return PERF_RES_OK if the text was stored successfully.
+*/
+perf_result_t perf_lexer_store_text(perf_lexer_t* lexer, perf_token_t* token, const char* text, size_t length, const char** error)
+{
+    // Intern the text, so repeated names share one copy.
+    if (lexer->mode == PERF_LEXER_MODE_INTERN)
+        return perf_interner_intern(&lexer->interner, text, length, &token->as.str, error);
+
+    // Calculate the offset of the text in the source.
+    size_t offset = (size_t)(text - lexer->src);
+
+    // Spans are 32-bit, so the source must fit.
+    if (offset + length > UINT32_MAX)
+    {
+        // Set the error
+        *error = "Source is too large for zero copy mode.";
+
+        // Return the error result.
+        return PERF_RES_LEX_ERROR;
+    }
+
+    // Reference the text in place.
+    token->as.span.offset = (uint32_t)offset;
+    token->as.span.length = (uint32_t)length;
+
+    // Return OK result.
     return PERF_RES_OK;
 }
 
@@ -160,51 +218,35 @@ perf_result_t perf_lexer_init(perf_lexer_t *lexer)
 */
 perf_result_t perf_lexer_handle_comment(perf_lexer_t *lexer, bool ds_comment, const char** error)
 {
-    // Used to determine if the comment is terminated or not.
-    bool is_terminated = ds_comment;
-
-    // Loop until we reach either EOF or end of comment.
-    while (*lexer->current_ch != '\x00')
+    // Handle a single line comment, which runs up to and including the newline.
+    if (ds_comment)
     {
-        // Get the current character.
-        char ch = *lexer->current_ch;
+        // Find the end of the line.
+        const char* end = perf_scan_line_comment(lexer->current_ch);
 
-        // Move to the next character.
-        lexer->current_ch++;
-        lexer->column_number++;
-
-        // Check for a newline character
-        if (ch == '\n')
-        {
-            lexer->line_number++;       // Increment line number
-            lexer->column_number = 0;   // Reset to the start of the newline.
-        }
+        // Consume the newline as well, if there is one.
+        if (*end == '\n') perf_lexer_advance(lexer, end + 1, 1, end + 1);
+        else perf_lexer_advance(lexer, end, 0, NULL);
 
-        // Check if it's a multi-line comment. If not, then we can return.
-        if (ds_comment && ch == '\n') break;
+        // Return OK result.
+        return PERF_RES_OK;
+    }
 
-        // Check for comment termination
-        if (!ds_comment && ch == '*' && *lexer->current_ch == '/')
-        {
-            // Move to the next character.
-            lexer->current_ch++;
-            lexer->column_number++;
+    // Will store the newlines inside the comment.
+    uint32_t newlines = 0;
+    const char* line_start = NULL;
 
-            // Set the is_terminated flag to true.
-            is_terminated = true;
+    // Find the end of the comment, starting from the '*' of the opening "/*".
+    const char* end = perf_scan_block_comment(lexer->current_ch + 1, &newlines, &line_start);
 
-            // Break out of the loop.
-            break;
-        }
-    }
-    
+    // Move past the comment
+    perf_lexer_advance(lexer, end, newlines, line_start);
 
-    // If comment is unterminated out of the loop, we have an error.
-    if (!is_terminated)
+    // If we stopped at EOF without a closing "*/" (past the opening "/"), we have an error.
+    if (*end == '\x00' && (end - lexer->token_start < 3 || *(end - 1) != '/' || *(end - 2) != '*'))
     {
         // Set the error
-        *error = "Unterminated string.";
-        
+        *error = "Unterminated comment.";
 
         // Return the error result.
         return PERF_RES_LEX_ERROR;
@@ -224,65 +266,24 @@ perf_result_t perf_lexer_handle_comment(perf_lexer_t *lexer, bool ds_comment, co
 */
 perf_result_t perf_lexer_handle_identifier(perf_lexer_t* lexer, perf_token_t* token, const char** error)
 {
-    // Loop until we reach the end of the identifier, or EOF.
-    while (*lexer->current_ch != '\x00' && char_is_alphanumeric(*lexer->current_ch))
-	{
-        // Move to the next character.
-        lexer->column_number++;
-        lexer->current_ch++;
-	}
+    // Find the end of the identifier.
+    perf_lexer_advance(lexer, perf_scan_identifier(lexer->current_ch), 0, NULL);
 
     // Calculate the length of the identifier
     int32_t length = (int32_t)(lexer->current_ch - lexer->token_start);
 
     // Construct the token
-    token->type             = TOKEN_IDENTIFIER;
     token->line_number      = lexer->line_number;
     token->column_number    = lexer->column_number - (int32_t)length;
-    token->as.str           = malloc(length + 1);
 
-    // Ensure the string was allocated successfully.
-    if (token->as.str == NULL) 
-    {
-        // Set the error
-        *error = "Failed to allocate memory for identifier.";
-        
-        // Return memory allocation failure result.
-        return PERF_RES_MEMORY_ALLOC_FAIL;
-    }
+    // Classify the identifier straight from the source span, before allocating anything.
+    token->type = perf_token_keyword_lookup(lexer->token_start, (size_t)length);
 
-    // Zero the allocated memory.
-    memset(token->as.str, 0, length + 1);
+    // Keywords carry no payload, so we are done.
+    if (token->type != TOKEN_IDENTIFIER) return PERF_RES_OK;
 
-    // Copy the identifier into the token.
-    memcpy(token->as.str, lexer->token_start, length);
-
-    // Handle keywords
-    // TODO: This is a temporary solution. We should use a hash table instead.
-    for (int idx = 26; idx <= 40; idx++)
-    {
-        // Find the matching keyword
-        const char* keyword = keyword_map[idx - 26];
-        
-        // Find the token type
-        const char* token_type = token_map[idx];
-
-        // Now compare the keyword to the token representation
-        if (strcmp(token->as.str, keyword) == 0)
-        {
-            // Set the token type
-            token->type = (perf_e_token_type_t)idx;
-
-            // Free the string
-            free(token->as.str);
-
-            // Return OK result
-            return PERF_RES_OK;
-        }
-    }
-
-    // Return OK result.
-    return PERF_RES_OK;
+    // Store the identifier text.
+    return perf_lexer_store_text(lexer, token, lexer->token_start, (size_t)length, error);
 }
 
 /**
@@ -295,185 +296,23 @@ perf_result_t perf_lexer_handle_identifier(perf_lexer_t* lexer, perf_token_t* to
 */
 perf_result_t perf_lexer_handle_number(perf_lexer_t *lexer, perf_token_t* token, const char** error)
 {
-    // Used to determine if the number is a float or not
-    bool is_float = false;
-
-    // Used to determine the integer mode of the number.
-    perf_e_integer_mode_t integer_mode = INT_DECIMAL;
-
-    // Loop until we reach the end of the number, or EOF.
-    while (*lexer->current_ch != '\x00')
-    {
-        // Handle digit seperators
-        if (*lexer->current_ch == '_')
-        {
-            // Move to the next character.
-            lexer->current_ch++;
-            lexer->column_number++;
-
-            // Continue to the next iteration.
-            continue;
-        }
-
-        // Check we are at the start of the token
-        if (lexer->current_ch == lexer->token_start)
-        {
-            // Check first for a single zero. This fixes an issue with defining zero numbers with our integer mode check.
-            if (*lexer->current_ch == '0' && (*(lexer->current_ch + 1) == ' ' || *(lexer->current_ch + 1) == ';'))
-            {
-                // Move to the next character.
-                lexer->column_number++;
-                lexer->current_ch++;
-
-                // No further processing needed
-                break;
-            }
-
-            // Handle integer mode notation
-            if (*lexer->current_ch == '0' && *(lexer->current_ch + 1) != '\x00'
-                && *(lexer->current_ch + 1) != '.' && *(lexer->current_ch + 1) != '_'
-                && !char_is_numeric(*(lexer->current_ch + 1)))
-            {
-                // Move to the next character.
-                lexer->current_ch++;
-                lexer->column_number++;
-
-                // Handle notations
-                switch (*lexer->current_ch)
-                {
-                case 'b':                           // Handle binary notation
-                    lexer->column_number++;
-                    lexer->current_ch++;
-
-                    integer_mode = INT_BINARY;
-                    break;
-                case 'o':                           // Handle octal notation   
-                    lexer->column_number++;
-                    lexer->current_ch++;
-
-                    integer_mode = INT_OCTAL;
-                    break;
-                case 'x':                           // Handle hexadecimal notation
-                    lexer->column_number++;
-                    lexer->current_ch++;
-
-                    integer_mode = INT_HEX;
-                    break;
-                default:                            // Handle unknown notation
-
-                    // Set the error
-                    *error = "Unknown integer notation.";
-
-                    // Return lex error result.
-                    return PERF_RES_LEX_ERROR;
-                }
-
-                // Handle incomplete integer literal
-                if (*lexer->current_ch == '\x00' || !char_matches_integer_mode(*lexer->current_ch, integer_mode)) return PERF_RES_LEX_ERROR;
-            }
-
-            // Check if next digit matches the integer mode
-            else if (char_matches_integer_mode(*lexer->current_ch, integer_mode))
-            {
-                // Move to the next character.
-                lexer->column_number++;
-                lexer->current_ch++;
-            }
-
-            // Otherwise we have reached the end of the number.
-            else break;
-        }
-
-        // Check if there's more digits to parse.
-        else if (char_matches_integer_mode(*lexer->current_ch, integer_mode))
-        {
-            // Move to the next character.
-            lexer->column_number++;
-            lexer->current_ch++;
-        }
-
-        // Check for a floating point number.
-        else if (integer_mode == INT_DECIMAL && !is_float && *lexer->current_ch == '.')
-        {
-            // Move to the next character.
-            lexer->column_number++;
-            lexer->current_ch++;
+    // Will store the end of the number.
+    const char* end;
 
-            // Mark the number as a float.
-            is_float = true;
-        }
-
-        // Otherwise, we have reached the end of the number.
-        else break;
-    }
+    // Scan and convert the number in a single pass.
+    perf_result_t result = perf_number_scan(lexer->current_ch, &end, token, error);
 
-    // Calculate the length of the number.
-    size_t literal_length = (size_t)(lexer->current_ch - lexer->token_start);
+    // Check if the number was converted successfully.
+    if (result != PERF_RES_OK) return result;
 
-    // Check if we should skip integer notation
-    size_t str_literal_offset = integer_mode == INT_DECIMAL ? 0 : 2;
+    // Move past the number, it never spans lines.
+    lexer->column_number   += (uint32_t)(end - lexer->current_ch);
+    lexer->current_ch       = end;
 
-    // Calculate the size of the string literal without the integer notation.
-    size_t literal_str_size = (size_t)literal_length - str_literal_offset;
-
-    // Will store the size of the literal without underscores.
-    size_t size_without_uss = literal_str_size;
-
-    // Check for a valid floating point number
-    if (is_float && literal_str_size == 2) 
-    {
-        // Set the error
-        *error = "Invalid float literal.";
-
-        // Return lex error result.   
-        return PERF_RES_LEX_ERROR;
-    }
-
-    // Loop through the string
-    for ( size_t i = 0; i < literal_str_size; i++ )
-    {
-        // Check for an underscore, and if so, decrement the size.
-        if (*(lexer->token_start + i + str_literal_offset) == '_') size_without_uss--;
-    }
-
-    // Allocate space for the raw integer literal
-    char *literal_str = malloc( size_without_uss + 1 );
-
-    // Check if the allocation failed.
-    if (literal_str == NULL) 
-    {
-        // Set the error
-        *error = "Failed to allocate memory for integer literal.";
-
-        // Return memory allocation fail result.
-        return PERF_RES_MEMORY_ALLOC_FAIL;
-    }
-
-    // Zero the memory.
-    memset(literal_str, 0, size_without_uss + 1);
-
-    // Loop through the string
-    for ( size_t i = 0, j = 0; i < literal_str_size; i++ )
-    {
-        // If the char is not an underscore, we can store it.
-        if (*(lexer->token_start + i + str_literal_offset) != '_')
-        {
-            // Store the character.
-            *(literal_str + (j++)) = *(lexer->token_start + i + str_literal_offset);
-        }
-    }
-
-    // Construct the token.
-    token->type             = is_float ? TOKEN_NUMBER : TOKEN_INTEGER;
+    // Set the location of the token.
     token->line_number      = lexer->line_number;
     token->column_number    = lexer->column_number;
 
-    // Check if the number is a float, and parse it.
-    if (is_float) token->as.number = strtod(literal_str, NULL);
-
-    // Otherwise, parse it as an integer.
-    else token->as.integer = strtoull(literal_str, NULL, (int)integer_mode);
-
     // Return OK result.
     return PERF_RES_OK;
 }
@@ -535,26 +374,9 @@ perf_result_t perf_lexer_handle_string(perf_lexer_t* lexer, perf_token_t* token,
     token->type             = TOKEN_STRING;
     token->line_number      = lexer->line_number;
     token->column_number    = lexer->column_number - (int32_t)(length + 2);
-    token->as.str           = malloc(length + 1);
 
-    // Ensure the string was allocated successfully.
-    if (token->as.str == NULL) 
-    {
-        // Set the error
-        *error = "Failed to allocate memory for string literal.";
-
-        // Return memory allocation fail result.
-        return PERF_RES_MEMORY_ALLOC_FAIL;
-    }
-
-    // Zero the allocated memory.
-    memset(token->as.str, 0, length + 1);
-
-    // Copy the string into the token.
-    memcpy(token->as.str, lexer->token_start + 1, length);
-
-    // Return OK result.
-    return PERF_RES_OK;
+    // Store the string contents, without the quotes. Escapes are decoded lazily by the consumer.
+    return perf_lexer_store_text(lexer, token, lexer->token_start + 1, (size_t)length, error);
 }
 
 /**
@@ -570,75 +392,173 @@ perf_result_t perf_lexer_handle_symbol(perf_lexer_t* lexer, perf_token_t* token,
     // Get the current character.
     char ch = *lexer->current_ch;
 
-    // Used to store the match index
-    int match_idx = -1;
-
-    // Used to determine if the symbol is 2x length
-    bool is_2x_length = false;
+    // Look up the one character symbol starting with this character.
+    uint8_t entry = symbol_dispatch[(uint8_t)ch];
 
-    // Loop through the symbol map
-    for (int idx = 0; idx < 22; idx++)
+    // Check if no symbol starts with this character.
+    if (entry == 0)
     {
-        // Get the symbol from the symbol list
-        const char* sym = symbol_map[idx];
+        // Format the error with the offending character.
+        if (ch > ' ' && ch < '\x7F') snprintf(lexer->error_buffer, sizeof(lexer->error_buffer), "Invalid symbol '%c'.", ch);
+        else snprintf(lexer->error_buffer, sizeof(lexer->error_buffer), "Invalid symbol 0x%02X.", (uint8_t)ch);
 
-        // Check if we have a 2x length symbol
-        if (strlen(sym) == 2)
-        {
-            // Check for a match against the current character and the next character.
-            if (ch == sym[0] && *(lexer->current_ch + 1) == sym[1])
-            {
-                // Set the match index.
-                match_idx = idx;
-
-                // Set the 2x length flag.
-                is_2x_length = true;
-            }
-        }
+        // Set the error
+        *error = lexer->error_buffer;
 
-        // Check if we have a 1x length symbol
-        else if (strlen(sym) == 1)
-        {
-            // Check for a match against the current character. & set the match index.
-            if (ch == sym[0]) match_idx = idx;
-        }
+        // Return the error result.
+        return PERF_RES_LEX_ERROR;
     }
 
-    // Check if we have a match
-    if (match_idx != -1)
+    // Construct the token
+    token->type             = (perf_e_token_type_t)(entry - 1);
+    token->line_number      = lexer->line_number;
+    token->column_number    = lexer->column_number;
+
+    // Move to the next character.
+    lexer->current_ch++;
+    lexer->column_number++;
+
+    // Check for the two character form, e.g. "==" for "=".
+    if (symbol_pair_second[(uint8_t)ch] != '\x00' && *lexer->current_ch == symbol_pair_second[(uint8_t)ch])
     {
-        // Construct the token
-        token->type             = (perf_e_token_type_t)match_idx;
-        token->line_number      = lexer->line_number;
-        token->column_number    = lexer->column_number;
+        // Use the two character token type.
+        token->type = (perf_e_token_type_t)symbol_pair_type[(uint8_t)ch];
 
         // Move to the next character.
         lexer->current_ch++;
         lexer->column_number++;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+
+// Implementation for lexer.h perf_lexer_scan_token
+perf_result_t perf_lexer_scan_token(perf_lexer_t* lexer, perf_token_t* token, const char** error)
+{
+    // Loop until we reach EOF character.
+    while (*lexer->current_ch != '\x00')
+    {
+        // Get the current character.
+        char ch = *lexer->current_ch;
+
+        // Check if the current character is whitespace.
+        if (char_is_whitespace(ch))
+        {
+            // Will store the newlines in the run.
+            uint32_t newlines = 0;
+            const char* line_start = NULL;
 
-        // Check if the symbol is 2x length and move to the next character.
-        if (is_2x_length)
+            // Skip the whole run of whitespace at once.
+            const char* end = perf_scan_whitespace(lexer->current_ch, &newlines, &line_start);
+            perf_lexer_advance(lexer, end, newlines, line_start);
+        }
+
+        // Check for a comment
+        else if (ch == '/' && (*(lexer->current_ch + 1) == '/' || *(lexer->current_ch + 1) == '*'))
         {
-            // Move to the next character.
-            lexer->current_ch++;
-            lexer->column_number++;
+            // Save the start of the comment.
+            lexer->token_start = lexer->current_ch;
+
+            // Used to determine if it's a single line comment or a multi-line comment.
+            bool ds_comment = *(lexer->current_ch + 1) == '/';
+
+            // Skip the comment characters.
+            perf_result_t res = perf_lexer_handle_comment(lexer, ds_comment, error);
+
+            // Check if the comment was handled successfully.
+            if (res != PERF_RES_OK) return res;
         }
 
+        // Otherwise, we can actually start lexing.
+        else
+        {
+            // Save the start of the token.
+            lexer->token_start = lexer->current_ch;
 
-        // Return OK result.
-        return PERF_RES_OK;
+            // Handle an identifier
+            if (char_is_alphabetic(ch)) return perf_lexer_handle_identifier(lexer, token, error);
+
+            // Handle a number
+            if (char_is_numeric(ch)) return perf_lexer_handle_number(lexer, token, error);
+
+            // Handle a string
+            if (ch == '"') return perf_lexer_handle_string(lexer, token, error);
+
+            // Handle everything else
+            return perf_lexer_handle_symbol(lexer, token, error);
+        }
     }
 
-    // Set the error
-    *error = "Invalid symbol.";
-    
-    // Append the invalid symbol to the error.
-    strncat((char*)(*error), &ch, 1);
+    // Produce the EOF token
+    lexer->token_start      = lexer->current_ch;
+    token->type             = TOKEN_EOF;
+    token->line_number      = lexer->line_number;
+    token->column_number    = lexer->column_number;
 
-    // Return the error result.
-    return PERF_RES_LEX_ERROR;
+    // Return OK result
+    return PERF_RES_OK;
 }
 
+// Implementation for lexer.h perf_lexer_begin
+perf_result_t perf_lexer_begin(perf_lexer_t* lexer, const char* src)
+{
+    // Point the lexer at the start of the source code.
+    lexer->src              = src;
+    lexer->token_start      = src;
+    lexer->current_ch       = src;
+    lexer->line_number      = 0;
+    lexer->column_number    = 0;
+
+    // Drop any tokens buffered from a previous source.
+    lexer->lookahead_head   = 0;
+    lexer->lookahead_count  = 0;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for lexer.h perf_lexer_next
+perf_result_t perf_lexer_next(perf_lexer_t* lexer, perf_token_t* token, const char** error)
+{
+    // Nothing buffered, scan straight into the caller's token.
+    if (lexer->lookahead_count == 0) return perf_lexer_scan_token(lexer, token, error);
+
+    // Otherwise hand out the oldest buffered token.
+    *token = lexer->lookahead[lexer->lookahead_head];
+    lexer->lookahead_head = (lexer->lookahead_head + 1) & (PERF_LEXER_LOOKAHEAD - 1);
+    lexer->lookahead_count--;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for lexer.h perf_lexer_peek
+perf_result_t perf_lexer_peek(perf_lexer_t* lexer, uint32_t distance, const perf_token_t** token, const char** error)
+{
+    // Scan tokens into the ring until the requested one is buffered.
+    while (lexer->lookahead_count <= distance)
+    {
+        // Get the next free slot
+        perf_token_t* slot = &lexer->lookahead[(lexer->lookahead_head + lexer->lookahead_count) & (PERF_LEXER_LOOKAHEAD - 1)];
+
+        // Scan the token
+        perf_result_t result = perf_lexer_scan_token(lexer, slot, error);
+
+        // Check if the token was scanned successfully.
+        if (result != PERF_RES_OK) return result;
+
+        // One more buffered token.
+        lexer->lookahead_count++;
+    }
+
+    // Output the buffered token.
+    *token = &lexer->lookahead[(lexer->lookahead_head + distance) & (PERF_LEXER_LOOKAHEAD - 1)];
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
 
 // Implementation for lexer.h perf_lexer_digest
 perf_result_t perf_lexer_digest(perf_lexer_t* lexer, const char* src, perf_token_t** tokens, int32_t* token_count, const char** error)
@@ -673,110 +593,35 @@ perf_result_t perf_lexer_digest(perf_lexer_t* lexer, const char* src, perf_token
     // Set up the 'current_ch' pointer to the start of the source code.
     lexer->current_ch = src;
 
-    // Loop until we reach EOF character.
-    while (*lexer->current_ch != '\x00')
+    // Loop until we have produced the EOF token.
+    for (;;)
     {
-        // Get the current character.
-        char ch = *lexer->current_ch;
-
-        // Check if the current character is whitespace.
-        if (char_is_whitespace(ch))
+        // Check that we have enough space for the token.
+        if (num_tokens >= (token_capacity * 0.75))
         {
-            // Skip to the next char & column.
-            lexer->current_ch++;
-            lexer->column_number++;
-
-            // Check if it is a newline character.
-            if (ch == '\n')
-            {
-                lexer->line_number++;       // Increment line number
-                lexer->column_number = 0;   // Reset to the start of the newline.
-            }
-        }
-
-        // Check for a comment
-        else if (ch == '/' && (*(lexer->current_ch + 1) == '/' || *(lexer->current_ch + 1) == '*'))
-        {
-            // Used to determine if it's a single line comment or a multi-line comment.
-            bool ds_comment = *(lexer->current_ch + 1) == '/';
+            // Resize the token array.
+            result = token_array_resize(&token_array, &token_capacity, error);
 
-            // Skip the comment characters.
-            perf_result_t res = perf_lexer_handle_comment(lexer, ds_comment, error);
+            // Check if the token array was resized successfully.
+            if (result != PERF_RES_OK) return result;
 
-            // Check if the comment was handled successfully.
-            if (res != PERF_RES_OK) return res;
+            *tokens         = token_array;
+            *token_count    = num_tokens;
         }
 
-        // Otherwise, we can actually start lexing.
-        else
-        {
-            // Save the start of the token.
-            lexer->token_start = lexer->current_ch;
-
-            // Check that we have enough space for the token.
-            if (num_tokens >= (token_capacity * 0.75))
-            {
-                // Resize the token array.
-                result = token_array_resize(&token_array, &token_capacity, error);
-
-                // Check if the token array was resized successfully.
-                if (result != PERF_RES_OK) return result;
-
-                *tokens         = token_array;
-                *token_count    = num_tokens;
-            }
-
-            // Get a pointer to the next token
-            perf_token_t *token = &token_array[num_tokens++];
-
-            // Handle an identifier
-            if (char_is_alphabetic(ch))
-            {
-                // Handle the identifier
-                perf_result_t parse_result = perf_lexer_handle_identifier(lexer, token, error);
-
-                // Check if the identifier was handled successfully.
-                if (parse_result != PERF_RES_OK) return parse_result;
-            }
-
-            // Handle a number
-            else if (char_is_numeric(ch))
-            {
-                // Handle the number
-                perf_result_t parse_result = perf_lexer_handle_number(lexer, token, error);
-
-                // Check if the number was handled successfully.
-                if (parse_result != PERF_RES_OK) return parse_result;
-            }
+        // Get a pointer to the next token
+        perf_token_t *token = &token_array[num_tokens++];
 
-            // Handle a string
-            else if (ch == '"')
-            {
-                // Handle the string
-                perf_result_t parse_result = perf_lexer_handle_string(lexer, token, error);
+        // Scan the token
+        result = perf_lexer_scan_token(lexer, token, error);
 
-                // Check if the string was handled successfully.
-                if (parse_result != PERF_RES_OK) return parse_result;
-            }
+        // Check if the token was scanned successfully.
+        if (result != PERF_RES_OK) return result;
 
-            // Handle everything else
-            else
-            {
-                // Handle the symbol
-                perf_result_t parse_result = perf_lexer_handle_symbol(lexer, token, error);
-
-                // Check if the symbol was handled successfully.
-                if (parse_result != PERF_RES_OK) return parse_result;
-            }
-        }
+        // Stop once we reach the end of the source.
+        if (token->type == TOKEN_EOF) break;
     }
 
-    // Add the EOF token
-    perf_token_t *token = &token_array[num_tokens++];
-    token->type             = TOKEN_EOF;
-    token->line_number      = lexer->line_number;
-    token->column_number    = lexer->column_number;
-
     // Output the number of tokens
     *token_count = num_tokens;
 
@@ -785,4 +630,4 @@ perf_result_t perf_lexer_digest(perf_lexer_t* lexer, const char* src, perf_token
 
     // Return OK result
     return PERF_RES_OK;
-}
\ No newline at end of file
+}
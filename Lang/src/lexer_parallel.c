@@ -0,0 +1,443 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/token.h"
+#include "../inc/intern.h"
+#include "../inc/lexer.h"
+#include "../inc/pool.h"
+
+/**
+ * Represents a chunk of the source lexed by perf_lexer_digest_parallel.
+*/
+typedef struct _perf_lexer_chunk_t
+{
+    const char*     start;          // First character of the chunk, always the start of a line
+    const char*     end;            // First character past the chunk
+
+    perf_lexer_t    lexer;          // Lexer of the chunk, with an interner of its own
+    perf_token_t*   tokens;         // Tokens starting inside the chunk
+    uint32_t        count;          // Number of tokens
+    uint32_t        capacity;       // Number of tokens we can hold
+
+    perf_token_t    next;           // First token starting at or past the end, where the following chunk should resume
+    const char*     next_at;        // Where that token starts
+
+    bool            has_first;      // Whether the chunk scanned any token
+    const char*     first_at;       // Where the chunk's first token starts
+    uint32_t        first_line;     // Line number of the first token, relative to the chunk
+    uint32_t        first_column;   // Column number of the first token
+
+    bool            valid;          // Whether the chunk started where the serial lexer would have been
+    int64_t         line_offset;    // Added to the chunk's line numbers to get those of the whole source
+    uint32_t        output;         // Index of the chunk's first token in the stitched array
+
+    perf_result_t   result;         // Result of lexing the chunk
+    const char*     error;          // The error message if result is not PERF_RES_OK
+} perf_lexer_chunk_t;
+
+/**
+ * Represents the state shared by the tasks of a parallel digest.
+*/
+typedef struct _perf_lexer_parallel_t
+{
+    perf_lexer_t*       lexer;      // The lexer doing the digest
+    perf_lexer_chunk_t* chunks;     // Every chunk
+    uint32_t            count;      // Number of chunks
+    perf_token_t*       tokens;     // The stitched tokens
+} perf_lexer_parallel_t;
+
+/**
+ * @brief Lexes a chunk up to the first token starting at or past the given end.
+ *
+ * @param chunk The chunk to lex, its lexer picks up where it left off.
+ * @param end Tokens starting before this belong to the chunk.
+ *
+ * @return PERF_RES_OK if the tokens were scanned successfully.
+*/
+static perf_result_t perf_lexer_chunk_scan(perf_lexer_chunk_t* chunk, const char* end)
+{
+    for (;;)
+    {
+        // Check that we have enough space for the token.
+        if (chunk->count == chunk->capacity)
+        {
+            // Double the capacity
+            uint32_t capacity = chunk->capacity * 2;
+            perf_token_t* tokens = (perf_token_t*)realloc(chunk->tokens, sizeof(perf_token_t) * capacity);
+
+            // Check if the reallocation failed.
+            if (tokens == NULL)
+            {
+                // Set the error
+                chunk->error = "Token array resize memory reallocation failed.";
+
+                // Return memory allocation failure result.
+                return chunk->result = PERF_RES_MEMORY_ALLOC_FAIL;
+            }
+
+            chunk->tokens   = tokens;
+            chunk->capacity = capacity;
+        }
+
+        // Scan the token straight into the array.
+        perf_token_t* token = &chunk->tokens[chunk->count];
+        perf_result_t result = perf_lexer_scan_token(&chunk->lexer, token, &chunk->error);
+
+        // Check if the token was scanned successfully.
+        if (result != PERF_RES_OK) return chunk->result = result;
+
+        // Remember where the chunk's first token is, to check it against the chunk before.
+        if (!chunk->has_first)
+        {
+            chunk->has_first    = true;
+            chunk->first_at     = chunk->lexer.token_start;
+            chunk->first_line   = token->line_number;
+            chunk->first_column = token->column_number;
+        }
+
+        // Stop at the first token belonging to the next chunk, or at the end of the source.
+        if (chunk->lexer.token_start >= end || token->type == TOKEN_EOF)
+        {
+            chunk->next     = *token;
+            chunk->next_at  = chunk->lexer.token_start;
+            return chunk->result = PERF_RES_OK;
+        }
+
+        // Keep the token
+        chunk->count++;
+    }
+}
+
+/**
+ * @brief Lexes one chunk, run on the pool.
+ *
+ * @param context The parallel digest.
+ * @param task The index of the chunk.
+ * @param worker The index of the thread.
+*/
+static void perf_lexer_chunk_task(void* context, uint32_t task, uint32_t worker)
+{
+    // Every thread lexes chunks the same way.
+    (void)worker;
+
+    // Get the chunk
+    perf_lexer_chunk_t* chunk = &((perf_lexer_parallel_t*)context)->chunks[task];
+
+    // Lex it
+    perf_lexer_chunk_scan(chunk, chunk->end);
+}
+
+/**
+ * @brief Copies a valid chunk's tokens into the stitched array, run on the pool.
+ *
+ * @param context The parallel digest.
+ * @param task The index of the chunk.
+ * @param worker The index of the thread.
+*/
+static void perf_lexer_place_task(void* context, uint32_t task, uint32_t worker)
+{
+    // Every thread copies tokens the same way.
+    (void)worker;
+
+    // Get the digest and the chunk
+    perf_lexer_parallel_t* parallel = (perf_lexer_parallel_t*)context;
+    perf_lexer_chunk_t*    chunk    = &parallel->chunks[task];
+
+    // Chunks that were lexed again by the chunk before them have nothing to copy.
+    if (!chunk->valid) return;
+
+    // Used to determine if the chunk's strings were interned by its own interner.
+    bool interned = parallel->lexer->mode == PERF_LEXER_MODE_INTERN;
+
+    // Get where the tokens go
+    perf_token_t* out = parallel->tokens + chunk->output;
+
+    for (uint32_t idx = 0; idx < chunk->count; idx++)
+    {
+        // Copy the token
+        perf_token_t token = chunk->tokens[idx];
+
+        // Move its line onto the line numbering of the whole source.
+        token.line_number = (uint32_t)((int64_t)token.line_number + chunk->line_offset);
+
+        // Swap the chunk's copy of the text for the shared one.
+        if (interned && (token.type == TOKEN_IDENTIFIER || token.type == TOKEN_STRING)) token.as.str = perf_interner_forward(token.as.str);
+
+        // Output the token
+        out[idx] = token;
+    }
+
+    // The chunk's tokens aren't needed anymore, release them while the other chunks are copied.
+    if (chunk->tokens != parallel->tokens)
+    {
+        free(chunk->tokens);
+        chunk->tokens = NULL;
+    }
+}
+
+/**
+ * @brief Frees every chunk.
+ *
+ * @param chunks The chunks.
+ * @param count The number of chunks.
+*/
+static void perf_lexer_chunks_free(perf_lexer_chunk_t* chunks, uint32_t count)
+{
+    for (uint32_t idx = 0; idx < count; idx++)
+    {
+        free(chunks[idx].tokens);
+        perf_lexer_free(&chunks[idx].lexer);
+    }
+
+    free(chunks);
+}
+
+// Implementation for lexer.h perf_lexer_digest_parallel
+perf_result_t perf_lexer_digest_parallel(perf_lexer_t* lexer, const char* src, size_t length, uint32_t thread_count, perf_token_t** tokens, int32_t* token_count, const char** error)
+{
+    // Default to one thread per processor.
+    if (thread_count == 0) thread_count = perf_pool_cpu_count();
+
+    // Work out how many chunks to cut, each at least PERF_LEXER_PARALLEL_MIN_CHUNK long.
+    size_t chunk_count = (size_t)thread_count * PERF_LEXER_PARALLEL_CHUNKS_PER_THREAD;
+    if (chunk_count > length / PERF_LEXER_PARALLEL_MIN_CHUNK) chunk_count = length / PERF_LEXER_PARALLEL_MIN_CHUNK;
+
+    // A single thread, or a source too small to be worth splitting, is lexed serially.
+    if (thread_count <= 1 || chunk_count <= 1) return perf_lexer_digest(lexer, src, tokens, token_count, error);
+
+    // Save ptr to the start of the source code
+    lexer->src = src;
+
+    // Nothing is output until every chunk has been stitched.
+    *tokens         = NULL;
+    *token_count    = 0;
+
+    // Allocate the chunks
+    perf_lexer_chunk_t* chunks = (perf_lexer_chunk_t*)calloc(chunk_count, sizeof(perf_lexer_chunk_t));
+
+    // Check if the allocation failed.
+    if (chunks == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for lexer chunks.";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Cut the source into chunks of about the same size, each starting right after a newline.
+    const char* src_end = src + length;
+    size_t      stride  = length / chunk_count;
+    uint32_t    count   = 0;
+    const char* start   = src;
+
+    while (start < src_end)
+    {
+        // Find the start of the line after the next cut, or run to the end of the source for the last chunk.
+        const char* end = src_end;
+        if (count + 1 < chunk_count && start + stride < src_end)
+        {
+            const char* newline = (const char*)memchr(start + stride, '\n', (size_t)(src_end - (start + stride)));
+            if (newline != NULL) end = newline + 1;
+        }
+
+        // Set up the chunk
+        perf_lexer_chunk_t* chunk = &chunks[count++];
+        chunk->start    = start;
+        chunk->end      = end;
+
+        start = end;
+    }
+
+    // Set up each chunk's lexer and token array, here rather than on the threads so the lexers are ready up front.
+    perf_result_t result = PERF_RES_OK;
+    for (uint32_t idx = 0; idx < count && result == PERF_RES_OK; idx++)
+    {
+        // Get the chunk
+        perf_lexer_chunk_t* chunk = &chunks[idx];
+
+        // Initialize the lexer, spans stay relative to the whole source.
+        perf_lexer_init(&chunk->lexer);
+        chunk->lexer.mode           = lexer->mode;
+        chunk->lexer.src            = src;
+        chunk->lexer.token_start    = chunk->start;
+        chunk->lexer.current_ch     = chunk->start;
+
+        // The first chunk carries on from the lexer's position, like perf_lexer_digest.
+        if (idx == 0)
+        {
+            chunk->lexer.line_number    = lexer->line_number;
+            chunk->lexer.column_number  = lexer->column_number;
+        }
+
+        // Reserve roughly a token per 4 characters.
+        chunk->capacity = (uint32_t)((chunk->end - chunk->start) / 4) + 16;
+        chunk->tokens   = (perf_token_t*)malloc(sizeof(perf_token_t) * chunk->capacity);
+
+        // Check if the allocation failed.
+        if (chunk->tokens == NULL)
+        {
+            // Set the error
+            *error = "Failed to allocate memory for token array.";
+
+            // Return memory allocation failure result.
+            result = PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+    }
+
+    // Lex every chunk, each assuming it starts outside any string or comment.
+    perf_lexer_parallel_t parallel = { lexer, chunks, count, NULL };
+    if (result == PERF_RES_OK) result = perf_pool_run(thread_count, count, perf_lexer_chunk_task, &parallel);
+
+    // Check if the chunks could be set up and lexed.
+    if (result != PERF_RES_OK)
+    {
+        perf_lexer_chunks_free(chunks, count);
+        return result;
+    }
+
+    // Walk the chunks in order, checking each one resumes where the chunk that owns the text before it stopped.
+    perf_lexer_chunk_t* owner = &chunks[0];
+    owner->valid        = true;
+    owner->line_offset  = 0;
+
+    for (uint32_t idx = 1; idx < count && owner->result == PERF_RES_OK; idx++)
+    {
+        // Get the chunk
+        perf_lexer_chunk_t* chunk = &chunks[idx];
+
+        // The owner stopped on a token at or past this chunk's start. If the chunk's first token is that same
+        // token at the same column, both lexers are in the same state from there on and the chunk is right.
+        if (chunk->has_first && chunk->first_at == owner->next_at && chunk->first_column == owner->next.column_number)
+        {
+            // Line the chunk's line numbers up with the owner's.
+            chunk->valid        = true;
+            chunk->line_offset  = owner->line_offset + (int64_t)owner->next.line_number - (int64_t)chunk->first_line;
+
+            // The chunk owns the text from here.
+            owner = chunk;
+            continue;
+        }
+
+        // The chunk started inside a string or a comment, its tokens are wrong, release them before the owner grows.
+        free(chunk->tokens);
+        chunk->tokens = NULL;
+
+        // The owner lexes the chunk again itself.
+        if (owner->next_at < chunk->end && owner->next.type != TOKEN_EOF)
+        {
+            // Keep the token the owner stopped on, it starts inside this chunk.
+            owner->count++;
+
+            // Lex up to the end of this chunk.
+            perf_lexer_chunk_scan(owner, chunk->end);
+        }
+    }
+
+    // Check if the owner ran into an error, the first error in the source since every chunk before it was clean.
+    if (owner->result != PERF_RES_OK)
+    {
+        // Error messages with source text live in the chunk's lexer, move them over.
+        if (owner->error == owner->lexer.error_buffer)
+        {
+            memcpy(lexer->error_buffer, owner->lexer.error_buffer, sizeof(lexer->error_buffer));
+            *error = lexer->error_buffer;
+        }
+        else *error = owner->error;
+
+        // Leave the lexer where the error is.
+        lexer->token_start      = owner->lexer.token_start;
+        lexer->current_ch       = owner->lexer.current_ch;
+        lexer->line_number      = (uint32_t)((int64_t)owner->lexer.line_number + owner->line_offset);
+        lexer->column_number    = owner->lexer.column_number;
+
+        // Free the chunks, keeping the result.
+        result = owner->result;
+        perf_lexer_chunks_free(chunks, count);
+
+        // Return the error result.
+        return result;
+    }
+
+    // Work out where each valid chunk's tokens go, and move every string into the lexer's interner in source order.
+    size_t total = 0;
+    for (uint32_t idx = 0; idx < count && result == PERF_RES_OK; idx++)
+    {
+        // Get the chunk
+        perf_lexer_chunk_t* chunk = &chunks[idx];
+
+        // Skip chunks that were lexed again by the chunk before them.
+        if (!chunk->valid) continue;
+
+        // Place the chunk after the ones before it.
+        chunk->output = (uint32_t)total;
+        total += chunk->count;
+
+        // Intern the chunk's strings into the lexer.
+        if (lexer->mode == PERF_LEXER_MODE_INTERN) result = perf_interner_absorb(&lexer->interner, &chunk->lexer.interner, error);
+    }
+
+    // The token count is 32-bit, so the source must fit.
+    if (result == PERF_RES_OK && total + 1 > INT32_MAX)
+    {
+        // Set the error
+        *error = "Source has too many tokens.";
+
+        // Set the error result.
+        result = PERF_RES_LEX_ERROR;
+    }
+
+    // Grow the first chunk's array into the stitched array, with room for the EOF token. Its tokens are already
+    // in place, and only one chunk per thread is ever held twice while the rest are copied in.
+    perf_token_t* token_array = NULL;
+    if (result == PERF_RES_OK)
+    {
+        token_array = (perf_token_t*)realloc(chunks[0].tokens, sizeof(perf_token_t) * (total + 1));
+
+        // Check if the reallocation failed.
+        if (token_array == NULL)
+        {
+            // Set the error
+            *error = "Token array resize memory reallocation failed.";
+
+            // Set memory allocation failure result.
+            result = PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+
+        // Otherwise the first chunk's tokens are the stitched array now.
+        else chunks[0].tokens = token_array;
+    }
+
+    // Copy the chunks over in parallel.
+    parallel.tokens = token_array;
+    if (result == PERF_RES_OK) result = perf_pool_run(thread_count, count, perf_lexer_place_task, &parallel);
+
+    // Check if the tokens were stitched successfully.
+    if (result != PERF_RES_OK)
+    {
+        perf_lexer_chunks_free(chunks, count);
+        return result;
+    }
+
+    // The stitched array is the caller's now.
+    chunks[0].tokens = NULL;
+
+    // The last owner stopped on the EOF token.
+    token_array[total]              = owner->next;
+    token_array[total].line_number  = (uint32_t)((int64_t)owner->next.line_number + owner->line_offset);
+
+    // Leave the lexer at the end of the source, like perf_lexer_digest.
+    lexer->token_start      = owner->lexer.token_start;
+    lexer->current_ch       = owner->lexer.current_ch;
+    lexer->line_number      = (uint32_t)((int64_t)owner->lexer.line_number + owner->line_offset);
+    lexer->column_number    = owner->lexer.column_number;
+
+    // Free the chunks, their strings have all been forwarded.
+    perf_lexer_chunks_free(chunks, count);
+
+    // Output the tokens
+    *tokens         = token_array;
+    *token_count    = (int32_t)(total + 1);
+
+    // Return OK result
+    return PERF_RES_OK;
+}
@@ -1,58 +1,235 @@
 #include "../inc/shared.h"
 #include "../inc/result.h"
 #include "../inc/token.h"
+#include "../inc/intern.h"
 #include "../inc/lexer.h"
+#include "../inc/token_stream.h"
 #include "../inc/ast.h"
 #include "../inc/parser.h"
+#include "../inc/cache.h"
+#include "../inc/value.h"
+#include "../inc/heap.h"
+#include "../inc/fold.h"
+#include "../inc/program.h"
+#include "../inc/compiler.h"
+#include "../inc/module.h"
+#include "../inc/jit.h"
+#include "../inc/vm.h"
+#include "../inc/number.h"
+#include "../inc/bench.h"
+#include "../inc/source.h"
 
 
 /**
- * Read the contents of a file.
+ * Print the lexer's intern table statistics.
  * 
- * @param path The path to the file.
+ * @param lexer The lexer to print the statistics of.
+*/
+void print_intern_stats(perf_lexer_t* lexer)
+{
+    // Gather the statistics
+    perf_interner_stats_t stats;
+    perf_interner_get_stats(&lexer->interner, &stats);
+
+    // Print them
+    printf("Interned Strings: %u unique, %llu lookups\n", stats.unique_count, (unsigned long long)stats.lookup_count);
+    printf("Intern Memory: %zu string bytes, %zu arena bytes, %zu table bytes (%u slots)\n",
+        stats.string_bytes, stats.arena_bytes, stats.table_bytes, stats.capacity);
+    printf("Intern Probes: %.3f average, %u max\n", stats.average_probe_length, stats.max_probe_length);
+}
+
+
+/**
+ * Print whether the token and AST cache had the file.
  * 
- * @return The contents of the file.
+ * @param cache The cache entry of the file.
+ * @param cached True if the AST came from the entry.
+ * @param store_error The error writing the entry on a miss, NULL if it was written.
 */
-char* load_file(char const* path)
+void print_source_cache_stats(perf_cache_t* cache, bool cached, const char* store_error)
 {
-    // Will store the contents of the file
-    char* buffer = 0;
+    // Print them
+    if (cached) printf("Source Cache: hit, %zu bytes mapped from %s\n", cache->mapping_size, cache->path);
+    else if (store_error == NULL) printf("Source Cache: miss, stored %s\n", cache->path);
+    else printf("Source Cache: miss, not stored (%s)\n", store_error);
+}
 
-    // Will store the length of the file
-    long length;
+/**
+ * Print the AST's memory statistics.
+ * 
+ * @param ast The AST to print the statistics of.
+ * @param line_count The number of lines that were parsed.
+*/
+void print_ast_stats(perf_ast_t* ast, uint32_t line_count)
+{
+    // Add up the bytes in use by each array
+    size_t node_bytes       = (size_t)ast->node_count * sizeof(perf_parser_node_t);
+    size_t token_bytes      = ast->owns_tokens ? (size_t)ast->token_count * sizeof(perf_token_t) : 0;
+    size_t extra_bytes      = (size_t)ast->extra_count * sizeof(uint32_t);
+    size_t statement_bytes  = (size_t)ast->statement_count * sizeof(uint32_t);
+    size_t total_bytes      = node_bytes + token_bytes + extra_bytes + statement_bytes;
+
+    // And the bytes allocated for them, growing leaves room to spare.
+    size_t reserved_bytes   = (size_t)ast->node_capacity * sizeof(perf_parser_node_t) + (size_t)ast->extra_capacity * sizeof(uint32_t)
+        + (size_t)ast->statement_capacity * sizeof(uint32_t) + (ast->owns_tokens ? (size_t)ast->token_capacity * sizeof(perf_token_t) : 0);
+
+    // Print them
+    printf("AST Memory: %u nodes (%zu bytes), %u tokens (%zu bytes), %u list entries (%zu bytes), %u statements (%zu bytes)\n",
+        ast->node_count, node_bytes, ast->token_count, token_bytes, ast->extra_count, extra_bytes, ast->statement_count, statement_bytes);
+    printf("AST Memory: %u allocations, %zu bytes reserved, %.1f bytes per source line\n", ast->allocation_count, reserved_bytes,
+        line_count == 0 ? 0.0 : (double)total_bytes / line_count);
+}
 
-    // Open handle to the file
-    FILE * f = fopen (path, "rb");
+/**
+ * Print what folding did to the AST.
+ * 
+ * @param stats The statistics of the fold pass.
+*/
+void print_fold_stats(perf_fold_stats_t* stats)
+{
+    // Print them
+    printf("Folding: %u constant expressions, %u identities, %u groups\n", stats->folded, stats->simplified, stats->groups);
+}
 
-    // Check if the file was opened successfully
-    if (f)
-    {
-        // Get the length of the file
-        fseek(f, 0, SEEK_END);
+/**
+ * Print the program's size statistics.
+ * 
+ * @param program The program to print the statistics of.
+*/
+void print_program_stats(perf_program_t* program)
+{
+    // Print them
+    printf("Bytecode: %u functions, %u code bytes, %u constants, %u globals, %u line entries\n",
+        program->function_count, program->code_count, program->constant_count, program->global_count, program->line_count);
+}
 
-        // Store the length of the file
-        length = ftell(f);
+/**
+ * Print what the VM's heap did while the program ran.
+ * 
+ * @param heap The heap to print the statistics of.
+*/
+void print_heap_stats(perf_heap_t* heap)
+{
+    // Get the statistics
+    perf_heap_stats_t stats;
+    perf_heap_get_stats(heap, &stats);
+
+    // Print them
+    printf("Heap: %llu bytes allocated, %llu promoted, %llu freed, %zu old\n", (unsigned long long)stats.allocated_bytes,
+        (unsigned long long)stats.promoted_bytes, (unsigned long long)stats.freed_bytes, stats.old_bytes);
+    printf("GC: %u minor (%.3f ms, %.3f ms max pause), %u major (%.3f ms, %.3f ms max pause)\n",
+        stats.minor_count, stats.minor_seconds * 1000.0, stats.minor_max_pause * 1000.0,
+        stats.major_count, stats.major_seconds * 1000.0, stats.major_max_pause * 1000.0);
+}
 
-        // Reset the file pointer
-        fseek (f, 0, SEEK_SET);
+/**
+ * Print how the VM's inline caches did while the program ran.
+ * 
+ * @param vm The VM to print the statistics of.
+*/
+void print_cache_stats(perf_vm_t* vm)
+{
+    // Get the statistics
+    perf_vm_cache_stats_t stats;
+    perf_vm_get_cache_stats(vm, &stats);
 
-        // Allocate memory for the file
-        buffer = (char*)malloc ((length+1)*sizeof(char));
-        
-        // Read the file into the buffer
-        if (buffer) fread (buffer, sizeof(char), length, f);
+    // Print them
+    printf("Inline Caches: %u sites, %u monomorphic, %u polymorphic, %u megamorphic\n", stats.site_count,
+        stats.monomorphic_count, stats.polymorphic_count, stats.megamorphic_count);
+}
 
-        // Close the file
-        fclose (f);
-    }
+/**
+ * Print what the JIT compiled and how often the interpreter entered it.
+ * 
+ * @param jit The JIT to print the statistics of.
+*/
+void print_jit_stats(perf_jit_t* jit)
+{
+    // Get the statistics
+    perf_jit_stats_t stats;
+    perf_jit_get_stats(jit, &stats);
 
-    // Null terminate the buffer
-    buffer[length] = '\0';
+    // Print them
+    printf("JIT: %u functions compiled, %u calling without looping left to the interpreter, %zu bytes of machine code, %llu entries\n", stats.compiled_count,
+        stats.declined_count, stats.code_bytes, (unsigned long long)stats.entry_count);
+}
 
-    // Return the buffer
-    return buffer;
+/**
+ * Print the module a program was loaded from.
+ * 
+ * @param module The module.
+ * @param path The path of the module.
+*/
+void print_module_stats(perf_module_t* module, const char* path)
+{
+    // Print them
+    printf("Module: %zu bytes from %s, verified\n", module->size, path);
 }
 
+/**
+ * Check if a path ends with an extension.
+ * 
+ * @param path The path.
+ * @param extension The extension, with its dot.
+ * 
+ * @return true if the path ends with it.
+*/
+bool has_extension(const char* path, const char* extension)
+{
+    size_t path_length      = strlen(path);
+    size_t extension_length = strlen(extension);
+
+    return path_length >= extension_length && strcmp(path + path_length - extension_length, extension) == 0;
+}
+
+/**
+ * Run a compiled program, printing what the VM did if asked to.
+ * 
+ * @param program The program to run.
+ * @param dispatch How the VM dispatches instructions.
+ * @param jit_threshold Calls plus back edges before the JIT compiles a function.
+ * @param print_stats Whether to print the heap, cache and JIT statistics.
+ * 
+ * @return true if the program ran successfully, otherwise the error was printed.
+*/
+bool run_program(perf_program_t* program, perf_e_vm_dispatch_t dispatch, uint32_t jit_threshold, bool print_stats)
+{
+    // Will store the VM and its error message.
+    perf_vm_t vm;
+    const char* vm_error = NULL;
+
+    // Run the script
+    perf_result_t result = perf_vm_init(&vm, &vm_error);
+    vm.dispatch         = dispatch;
+    vm.jit.threshold    = jit_threshold;
+    if (result == PERF_RES_OK) result = perf_vm_run(&vm, program, NULL, &vm_error);
+
+    // Check if the script ran successfully.
+    if (result != PERF_RES_OK)
+    {
+        // Print the error
+        printf("Error: %s (line %u)\n", vm_error, vm.error_line);
+
+        // Return failure
+        return false;
+    }
+
+    // Print the instructions dispatched, if they were counted.
+    if (dispatch == PERF_VM_DISPATCH_COUNTED) printf("Instructions: %llu\n", (unsigned long long)vm.instruction_count);
+
+    // Print what the heap and the caches did, before they are freed with the VM.
+    if (print_stats)
+    {
+        print_heap_stats(&vm.heap);
+        print_cache_stats(&vm);
+        if (dispatch == PERF_VM_DISPATCH_JIT) print_jit_stats(&vm.jit);
+    }
+
+    perf_vm_free(&vm);
+
+    // Return success
+    return true;
+}
 
 int main(int argc, char **argv) {
 
@@ -60,12 +237,155 @@ int main(int argc, char **argv) {
     perf_lexer_t lexer;
     perf_parser_t parser;
 
-    // Will store the error message for the lexer
-    const char* lexer_error = NULL;
-
     // Initialize the lexer
     perf_lexer_init(&lexer);
 
+    // Will store the path of the file to run, if any.
+    const char* path = NULL;
+
+    // Used to determine if we should print statistics.
+    bool print_stats = false;
+
+    // Used to determine if we should print the AST.
+    bool print_ast = false;
+
+    // Used to determine if we should compile the AST and print the bytecode.
+    bool print_bytecode = false;
+
+    // Used to determine if we should compile the AST and run it.
+    bool run = false;
+
+    // Used to determine if we should fold constant expressions before compiling.
+    bool fold = true;
+
+    // How the VM dispatches instructions.
+    perf_e_vm_dispatch_t dispatch = PERF_VM_DISPATCH_THREADED;
+
+    // Instruction set to compile to.
+    perf_e_program_format_t format = PERF_PROGRAM_FORMAT_STACK;
+
+    // Calls plus back edges before the JIT compiles a function.
+    uint32_t jit_threshold = PERF_JIT_THRESHOLD;
+
+    // Will store the name of the benchmark to run, if any.
+    const char* bench = NULL;
+
+    // Number of threads to lex the file on, 1 pulls tokens from the lexer as the parser goes.
+    uint32_t threads = 1;
+
+    // Used to determine if a single thread lexes the file into a token stream before parsing it.
+    bool token_stream = false;
+
+    // Directory of the token and AST cache, NULL to always parse.
+    const char* cache_directory = NULL;
+
+    // Path to write the compiled program to as a module, NULL to not write one.
+    const char* compile_path = NULL;
+
+    // Parse the command line arguments
+    for (int idx = 1; idx < argc; idx++)
+    {
+        // Check for the statistics flag
+        if (strcmp(argv[idx], "--stats") == 0) print_stats = true;
+
+        // Check for the AST flag
+        else if (strcmp(argv[idx], "--dump-ast") == 0) print_ast = true;
+
+        // Check for the bytecode flag
+        else if (strcmp(argv[idx], "--dump-bytecode") == 0) print_bytecode = true;
+
+        // Check for the run flag
+        else if (strcmp(argv[idx], "--run") == 0) run = true;
+
+        // Check for the no fold flag, compiling the AST as it was parsed.
+        else if (strcmp(argv[idx], "--no-fold") == 0) fold = false;
+
+        // Check for the dispatch flag, which takes threaded, switch or counted.
+        else if (strcmp(argv[idx], "--dispatch") == 0 && idx + 1 < argc)
+        {
+            idx++;
+            if (strcmp(argv[idx], "switch") == 0) dispatch = PERF_VM_DISPATCH_SWITCH;
+            else if (strcmp(argv[idx], "counted") == 0) dispatch = PERF_VM_DISPATCH_COUNTED;
+            else dispatch = PERF_VM_DISPATCH_THREADED;
+        }
+
+        // Check for the registers flag, compiling to register code.
+        else if (strcmp(argv[idx], "--registers") == 0) format = PERF_PROGRAM_FORMAT_REGISTER;
+
+        // Check for the JIT flag, compiling to register code and hot functions of it to machine code.
+        else if (strcmp(argv[idx], "--jit") == 0)
+        {
+            // Check if the JIT was left out of this build.
+            if (!PERF_JIT_ENABLED)
+            {
+                // Print the error
+                printf("Error: the JIT is not part of this build\n");
+
+                // Exit the program with an error
+                return 1;
+            }
+
+            dispatch    = PERF_VM_DISPATCH_JIT;
+            format      = PERF_PROGRAM_FORMAT_REGISTER;
+        }
+
+        // Check for the JIT threshold flag, which takes the calls plus back edges before compiling a function.
+        else if (strcmp(argv[idx], "--jit-threshold") == 0 && idx + 1 < argc) jit_threshold = (uint32_t)strtoul(argv[++idx], NULL, 10);
+
+        // Check for the zero copy flag, tokens will reference the file buffer.
+        else if (strcmp(argv[idx], "--zero-copy") == 0) lexer.mode = PERF_LEXER_MODE_ZERO_COPY;
+
+        // Check for the threads flag, which takes the thread count, 0 for one per processor.
+        else if (strcmp(argv[idx], "--threads") == 0 && idx + 1 < argc) threads = (uint32_t)strtoul(argv[++idx], NULL, 10);
+
+        // Check for the token stream flag, the file is lexed into a structure of arrays before parsing.
+        else if (strcmp(argv[idx], "--token-stream") == 0) token_stream = true;
+
+        // Check for the cache flag, which takes the directory of the cache entries.
+        else if (strcmp(argv[idx], "--cache") == 0 && idx + 1 < argc) cache_directory = argv[++idx];
+
+        // Check for the compile flag, which takes the path of the module to write.
+        else if (strcmp(argv[idx], "--compile") == 0 && idx + 1 < argc) compile_path = argv[++idx];
+
+        // Check for the benchmark flag, which takes the benchmark name.
+        else if (strcmp(argv[idx], "--bench") == 0 && idx + 1 < argc) bench = argv[++idx];
+
+        // Otherwise it's the file path
+        else path = argv[idx];
+    }
+
+    // Check if we should run a benchmark instead.
+    if (bench != NULL)
+    {
+        // Will store the error message, unknown benchmarks keep the default.
+        const char* error = "Unknown benchmark.";
+
+        // Used to store the result of the benchmark.
+        perf_result_t result = PERF_RES_UNSUPPORTED;
+
+        // Run the benchmark
+        if (strcmp(bench, "numbers") == 0) result = perf_bench_numbers(1000000, &error);
+        else if (strcmp(bench, "parse") == 0) result = perf_bench_parse(100000, &error);
+        else if (strcmp(bench, "lex") == 0) result = perf_bench_lex(500, &error);
+        else if (strcmp(bench, "parse-parallel") == 0) result = perf_bench_parse_parallel(100000, &error);
+        else if (strcmp(bench, "vm") == 0) result = perf_bench_vm(&error);
+        else if (strcmp(bench, "cache") == 0) result = perf_bench_cache(10000, cache_directory != NULL ? cache_directory : "/tmp", &error);
+        else if (strcmp(bench, "module") == 0) result = perf_bench_module(10000, cache_directory != NULL ? cache_directory : "/tmp", &error);
+
+        // Check if the benchmark failed.
+        if (result != PERF_RES_OK)
+        {
+            // Print the error
+            printf("Error: %s\n", error);
+
+            // Exit the program with an error
+            return 1;
+        }
+
+        // Exit the program
+        return 0;
+    }
+
     // Will store the error message for the parser
     const char* parser_error = NULL;
 
@@ -73,51 +393,240 @@ int main(int argc, char **argv) {
     perf_parser_init(&parser, &lexer, &parser_error);
 
     // Check if we should parse file or cli
-    if ( argc > 1 ) 
+    if ( path != NULL ) 
     {
-        // Read the file into a buffer
-        char* buffer = load_file(argv[1]);
+        // Will store the contents of the file
+        perf_source_t source;
+
+        // Will store the error message for the source
+        const char* source_error = NULL;
+
+        // Map or read the file
+        if (perf_source_open(&source, path, &source_error) != PERF_RES_OK)
+        {
+            // Print the error
+            printf("Error: %s (%s)\n", source_error, path);
+
+            // Exit the program with an error
+            return 1;
+        }
+
+        // Modules are compiled already, load the program from it in place and verify it.
+        if (has_extension(path, PERF_MODULE_EXTENSION))
+        {
+            // Will store the module and its error message.
+            perf_module_t module;
+            const char* module_error = NULL;
 
-        // Will store the number of tokens in the file
+            // Load the module
+            if (perf_module_load(&module, source.data, source.length, &module_error) != PERF_RES_OK)
+            {
+                // Print the error
+                printf("Error: %s (%s)\n", module_error, path);
+
+                // Exit the program with an error
+                return 1;
+            }
+
+            // Print the bytecode if requested
+            if (print_bytecode)
+            {
+                for (uint32_t idx = 0; idx < module.program.function_count; idx++) perf_program_disassemble(&module.program, idx);
+            }
+
+            // Run the program if requested, the error was printed if it failed.
+            if (run && !run_program(&module.program, dispatch, jit_threshold, print_stats)) return 1;
+
+            // Print the statistics if requested
+            if (print_stats)
+            {
+                print_module_stats(&module, path);
+                print_program_stats(&module.program);
+            }
+
+            // Free the module, then the file it points into.
+            perf_module_free(&module);
+            perf_source_free(&source);
+
+            // Exit the program
+            return 0;
+        }
+
+        // Get the contents of the file
+        const char* buffer = source.data;
+
+        // Will store the AST
+        perf_ast_t ast;
+
+        // Will store the tokens, when the file is lexed up front.
+        perf_token_t* tokens = NULL;
         int32_t token_count = 0;
 
-        // Will store the tokens
-        perf_token_t *tokens = NULL;
+        // Used to store the result of parsing the file.
+        perf_result_t result = PERF_RES_OK;
 
-        // Will store the error message
-        const char *error = NULL;
+        // Will store the cache entry of the file, and whether the AST came from it.
+        perf_cache_t cache;
+        bool cached = false;
 
-        // Digest the file
-        if (perf_lexer_digest( &lexer, buffer, &tokens, &token_count, &lexer_error) != PERF_RES_OK)
+        // Look the file up in the cache first. Cached tokens are zero copy tokens, so the lexer must be too.
+        if (cache_directory != NULL)
         {
-            // Print the error
-            printf("Error: %s\n", lexer_error);
+            lexer.mode = PERF_LEXER_MODE_ZERO_COPY;
+            result = perf_cache_init(&cache, cache_directory, buffer, source.length, &parser_error);
+
+            // A hit leaves the lexer pointed at the source for the tokens' text, as if it had lexed it.
+            uint32_t line_count = 0;
+            const char* cache_error = NULL;
+
+            if (result == PERF_RES_OK && perf_cache_load(&cache, &ast, &line_count, &cache_error) == PERF_RES_OK)
+            {
+                cached = true;
+                perf_lexer_begin(&lexer, buffer);
+                lexer.line_number = line_count;
+            }
+        }
+
+        // Otherwise parse it
+        if (result == PERF_RES_OK && !cached)
+        {
+            // Lex and then parse the whole file on several threads if asked to.
+            if (threads != 1)
+            {
+                result = perf_lexer_digest_parallel(&lexer, buffer, source.length, threads, &tokens, &token_count, &parser_error);
+                if (result == PERF_RES_OK) result = perf_parser_digest_parallel(&parser, tokens, token_count, threads, &ast, &parser_error);
+            }
+
+            // Or lex it into a token stream and parse that, if asked to.
+            else if (token_stream)
+            {
+                // Will store the token stream, only the tokens the AST keeps outlive it.
+                perf_token_stream_t stream;
+                perf_token_stream_init(&stream);
+
+                result = perf_token_stream_digest(&stream, &lexer, buffer, &parser_error);
+                if (result == PERF_RES_OK) result = perf_parser_digest_stream(&parser, &stream, &ast, &parser_error);
+
+                perf_token_stream_free(&stream);
+            }
+
+            // Otherwise the parser pulls tokens from the lexer as it goes.
+            else result = perf_parser_parse(&parser, buffer, &ast, &parser_error);
+        }
+
+        // Check if the file was parsed successfully.
+        if (result != PERF_RES_OK)
+        {
+            // Print the error, with the line of the token a parse error refers to.
+            if (result == PERF_RES_PARSE_ERROR) printf("Error: %s (line %u)\n", parser_error, parser.erroring_token.line_number + 1);
+            else printf("Error: %s\n", parser_error);
 
             // Exit the program with an error
             return 1;
         }
 
-        // Free the file contents buffer since we don't need it anymore
-        free(buffer);
+        // Write the cache entry on a miss, before folding changes the AST. Failing to only costs the next run a parse.
+        const char* store_error = NULL;
+
+        if (cache_directory != NULL && !cached) perf_cache_store(&cache, &ast, lexer.line_number, &store_error);
 
-        // Will store the number of nodes in the AST
-        int32_t ast_node_count = 0;
+        // Print how many nodes were in the AST
+        printf("AST Node Count: %u (%u statements)\n", ast.node_count, ast.statement_count);
+
+        // Fold constant expressions before the AST is printed or compiled, unless asked not to.
+        perf_fold_stats_t fold_stats = { 0 };
 
-        // Will store the AST nodes
-        perf_parser_node_t *ast_nodes = NULL;
-        
-        // DIgest the tokens into an AST
-        if (perf_parser_digest(&parser, tokens, token_count, &ast_nodes, &ast_node_count, &parser_error) != PERF_RES_OK)
+        if (fold && (print_ast || print_bytecode || print_stats || run || compile_path != NULL) && perf_fold_ast(&ast, &fold_stats, &parser_error) != PERF_RES_OK)
         {
             // Print the error
-            printf("Error: %s\n", error);
+            printf("Error: %s\n", parser_error);
 
             // Exit the program with an error
             return 1;
         }
 
-        // Print how many nodes were in the AST
-        printf("AST Node Count: %d\n", ast_node_count);
+        // Print the AST if requested
+        if (print_ast)
+        {
+            for (uint32_t idx = 0; idx < ast.statement_count; idx++) perf_ast_print(&ast, &lexer, ast.statements[idx]);
+        }
+
+        // Will store the program, compiled if it is run or the bytecode or statistics were requested.
+        perf_program_t program;
+        perf_program_init(&program);
+
+        if (print_bytecode || print_stats || run || compile_path != NULL)
+        {
+            // Will store the compiler and its error message.
+            perf_compiler_t compiler;
+            const char* compiler_error = NULL;
+
+            // Compile the AST
+            result = perf_compiler_init(&compiler, &lexer, &compiler_error);
+            compiler.format = format;
+            if (result == PERF_RES_OK) result = perf_compiler_compile(&compiler, &ast, &program, &compiler_error);
+
+            // Check if the AST was compiled successfully.
+            if (result != PERF_RES_OK)
+            {
+                // Print the error
+                printf("Error: %s (line %u)\n", compiler_error, compiler.erroring_token.line_number + 1);
+
+                // Exit the program with an error
+                return 1;
+            }
+
+            perf_compiler_free(&compiler);
+        }
+
+        // Print the bytecode if requested
+        if (print_bytecode)
+        {
+            for (uint32_t idx = 0; idx < program.function_count; idx++) perf_program_disassemble(&program, idx);
+        }
+
+        // Write the program as a module if requested
+        if (compile_path != NULL)
+        {
+            // Will store the error message for the module.
+            const char* module_error = NULL;
+
+            // Write the module
+            if (perf_module_write(&program, compile_path, &module_error) != PERF_RES_OK)
+            {
+                // Print the error
+                printf("Error: %s (%s)\n", module_error, compile_path);
+
+                // Exit the program with an error
+                return 1;
+            }
+        }
+
+        // Run the program if requested, the error was printed if it failed.
+        if (run && !run_program(&program, dispatch, jit_threshold, print_stats)) return 1;
+
+        // Print the statistics if requested
+        if (print_stats)
+        {
+            print_intern_stats(&lexer);
+            if (cache_directory != NULL) print_source_cache_stats(&cache, cached, store_error);
+            print_ast_stats(&ast, lexer.line_number + 1);
+            print_fold_stats(&fold_stats);
+            print_program_stats(&program);
+        }
+
+        // Free the program, the AST, the parser and the lexer, and with it every interned string.
+        perf_program_free(&program);
+        free(tokens);
+
+        // A cached AST is the cache entry's mapping, which goes with the entry.
+        if (!cached) perf_ast_free(&ast);
+        if (cache_directory != NULL) perf_cache_free(&cache);
+        perf_parser_free(&parser);
+        perf_lexer_free(&lexer);
+
+        // Release the file contents, which zero copy tokens reference.
+        perf_source_free(&source);
     }
 
     // Otherwise parse command line input
@@ -0,0 +1,899 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/intern.h"
+#include "../inc/value.h"
+#include "../inc/program.h"
+#include "../inc/module.h"
+
+// Magic at the start of every module.
+static const char perf_module_magic[8] = "PERFMOD";
+
+/**
+ * Represents a string of the program and where it went in the string table, while writing a module.
+*/
+typedef struct _perf_module_string_t
+{
+    const char* str;            // Interned string, NULL for an empty slot
+    uint32_t    offset;         // String reference, the offset of its first byte in the string table
+} perf_module_string_t;
+
+/**
+ * Represents the string table of a module being written, a set of the program's interned strings by pointer.
+*/
+typedef struct _perf_module_strings_t
+{
+    perf_module_string_t*   slots;      // Open addressed, a power of two of them
+    uint32_t                capacity;   // Number of slots
+    uint32_t                count;      // Number of strings
+    uint32_t                size;       // Bytes of the string table so far
+} perf_module_strings_t;
+
+/**
+ * @brief Rounds an offset up to the next multiple of 8, where every section of a module starts.
+*/
+static inline uint64_t perf_module_align(uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+/**
+ * @brief Gets the bytes a string takes in the string table: its length, the bytes and a terminator, padded to 4.
+*/
+static inline uint32_t perf_module_string_size(uint32_t length)
+{
+    return (uint32_t)((sizeof(uint32_t) + length + 1 + 3) & ~(size_t)3);
+}
+
+/**
+ * @brief Adds a string to the string table unless it is in it already, interned strings are the same pointer.
+ *
+ * @param strings The string table.
+ * @param str The interned string, NULL for none.
+ *
+ * @return The string reference, PERF_MODULE_NO_STRING for NULL.
+*/
+static uint32_t perf_module_string(perf_module_strings_t *strings, const char* str)
+{
+    if (str == NULL) return PERF_MODULE_NO_STRING;
+
+    // Strings are 4-byte aligned, the bits above spread the pointers over the slots.
+    uint32_t mask = strings->capacity - 1;
+    uint32_t slot = (uint32_t)((((uintptr_t)str >> 2) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+
+    while (strings->slots[slot].str != NULL)
+    {
+        if (strings->slots[slot].str == str) return strings->slots[slot].offset;
+        slot = (slot + 1) & mask;
+    }
+
+    // Otherwise it goes at the end, after its length.
+    strings->slots[slot].str    = str;
+    strings->slots[slot].offset = strings->size + (uint32_t)sizeof(uint32_t);
+    strings->size              += perf_module_string_size(perf_interner_length(str));
+    strings->count++;
+
+    return strings->slots[slot].offset;
+}
+
+/**
+ * @brief Writes a section of a module at its offset, padding up to it with zeros.
+ *
+ * @param file The module being written.
+ * @param written The bytes written so far, updated.
+ * @param offset The offset of the section.
+ * @param items The section.
+ * @param size The size of the section in bytes.
+ *
+ * @return true if everything was written.
+*/
+static bool perf_module_write_section(FILE* file, uint64_t* written, uint64_t offset, const void* items, size_t size)
+{
+    static const uint8_t zeros[8] = { 0 };
+
+    if (offset > *written && fwrite(zeros, 1, (size_t)(offset - *written), file) != offset - *written) return false;
+    if (size > 0 && fwrite(items, 1, size, file) != size) return false;
+
+    *written = offset + size;
+    return true;
+}
+
+// Implementation for module.h perf_module_write
+perf_result_t perf_module_write(const perf_program_t *program, const char* path, const char** error)
+{
+    // Every name and string constant can be a string, size the set so it stays at most half full.
+    uint32_t capacity   = 64;
+    uint64_t references = (uint64_t)program->constant_count + program->function_count + program->global_count
+        + program->class_count + program->method_count;
+
+    while (capacity < references * 2) capacity *= 2;
+
+    perf_module_strings_t strings = { 0 };
+    strings.slots       = (perf_module_string_t*)calloc(capacity, sizeof(perf_module_string_t));
+    strings.capacity    = capacity;
+
+    // Convert every table, names and string constants to string references.
+    perf_value_t*           constants   = (perf_value_t*)malloc((size_t)program->constant_count * sizeof(perf_value_t) + 1);
+    perf_module_function_t* functions   = (perf_module_function_t*)malloc((size_t)program->function_count * sizeof(perf_module_function_t) + 1);
+    uint32_t*               globals     = (uint32_t*)malloc((size_t)program->global_count * sizeof(uint32_t) + 1);
+    perf_module_class_t*    classes     = (perf_module_class_t*)malloc((size_t)program->class_count * sizeof(perf_module_class_t) + 1);
+    perf_module_method_t*   methods     = (perf_module_method_t*)malloc((size_t)program->method_count * sizeof(perf_module_method_t) + 1);
+    char*                   table       = NULL;
+
+    // Used to store the result of writing the module.
+    perf_result_t result = PERF_RES_OK;
+
+    if (strings.slots == NULL || constants == NULL || functions == NULL || globals == NULL || classes == NULL || methods == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for module";
+
+        // Set the memory allocation failure result.
+        result = PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    for (uint32_t idx = 0; result == PERF_RES_OK && idx < program->constant_count; idx++)
+    {
+        perf_value_t value = program->constants[idx];
+
+        // Strings become a reference in the same box, everything else is stored as it is.
+        if (perf_value_is(value, PERF_VALUE_STRING)) value = perf_value_box(PERF_VALUE_STRING, perf_module_string(&strings, perf_value_as_string(value)));
+        constants[idx] = value;
+    }
+
+    for (uint32_t idx = 0; result == PERF_RES_OK && idx < program->function_count; idx++)
+    {
+        const perf_function_t*  from    = &program->functions[idx];
+        perf_module_function_t* to      = &functions[idx];
+
+        to->name        = perf_module_string(&strings, from->name);
+        to->code_offset = from->code_offset;
+        to->code_length = from->code_length;
+        to->line_offset = from->line_offset;
+        to->line_count  = from->line_count;
+        to->arity       = from->arity;
+        to->kind        = from->kind;
+        to->slot_count  = from->slot_count;
+        to->max_stack   = from->max_stack;
+        to->class_index = from->class_index;
+    }
+
+    for (uint32_t idx = 0; result == PERF_RES_OK && idx < program->global_count; idx++)
+        globals[idx] = perf_module_string(&strings, program->globals[idx]);
+
+    for (uint32_t idx = 0; result == PERF_RES_OK && idx < program->class_count; idx++)
+    {
+        classes[idx].name           = perf_module_string(&strings, program->classes[idx].name);
+        classes[idx].initializer    = program->classes[idx].initializer;
+        classes[idx].method_offset  = program->classes[idx].method_offset;
+        classes[idx].method_count   = program->classes[idx].method_count;
+    }
+
+    for (uint32_t idx = 0; result == PERF_RES_OK && idx < program->method_count; idx++)
+    {
+        methods[idx].name       = perf_module_string(&strings, program->methods[idx].name);
+        methods[idx].function   = program->methods[idx].function;
+    }
+
+    // Lay the strings out at their references.
+    if (result == PERF_RES_OK && (table = (char*)calloc(strings.size + 1, 1)) == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for module";
+
+        // Set the memory allocation failure result.
+        result = PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    for (uint32_t idx = 0; result == PERF_RES_OK && idx < strings.capacity; idx++)
+    {
+        const perf_module_string_t* string = &strings.slots[idx];
+        if (string->str == NULL) continue;
+
+        uint32_t length = perf_interner_length(string->str);
+
+        memcpy(table + string->offset - sizeof(uint32_t), &length, sizeof(uint32_t));
+        memcpy(table + string->offset, string->str, length);
+    }
+
+    // Lay the sections out after the header, each aligned, the code last.
+    perf_module_header_t header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, perf_module_magic, sizeof(perf_module_magic));
+    header.version          = PERF_MODULE_VERSION;
+    header.format           = (uint32_t)program->format;
+    header.value_size       = (uint16_t)sizeof(perf_value_t);
+    header.function_size    = (uint16_t)sizeof(perf_module_function_t);
+
+    header.code_count       = program->code_count;
+    header.constant_count   = program->constant_count;
+    header.function_count   = program->function_count;
+    header.line_count       = program->line_count;
+    header.global_count     = program->global_count;
+    header.class_count      = program->class_count;
+    header.method_count     = program->method_count;
+    header.site_count       = program->site_count;
+    header.string_size      = strings.size;
+    header.string_count     = strings.count;
+
+    header.constant_offset  = perf_module_align(sizeof(header));
+    header.function_offset  = perf_module_align(header.constant_offset + (uint64_t)header.constant_count * sizeof(perf_value_t));
+    header.line_offset      = perf_module_align(header.function_offset + (uint64_t)header.function_count * sizeof(perf_module_function_t));
+    header.global_offset    = perf_module_align(header.line_offset + (uint64_t)header.line_count * sizeof(perf_program_line_t));
+    header.class_offset     = perf_module_align(header.global_offset + (uint64_t)header.global_count * sizeof(uint32_t));
+    header.method_offset    = perf_module_align(header.class_offset + (uint64_t)header.class_count * sizeof(perf_module_class_t));
+    header.site_offset      = perf_module_align(header.method_offset + (uint64_t)header.method_count * sizeof(perf_module_method_t));
+    header.string_offset    = perf_module_align(header.site_offset + (uint64_t)header.site_count * sizeof(uint32_t));
+    header.code_offset      = perf_module_align(header.string_offset + header.string_size);
+    header.size             = header.code_offset + header.code_count;
+
+    // Write it all out.
+    FILE*       file    = result == PERF_RES_OK ? fopen(path, "wb") : NULL;
+    uint64_t    written = 0;
+    bool        ok      = file != NULL
+        && perf_module_write_section(file, &written, 0, &header, sizeof(header))
+        && perf_module_write_section(file, &written, header.constant_offset, constants, (size_t)header.constant_count * sizeof(perf_value_t))
+        && perf_module_write_section(file, &written, header.function_offset, functions, (size_t)header.function_count * sizeof(perf_module_function_t))
+        && perf_module_write_section(file, &written, header.line_offset, program->lines, (size_t)header.line_count * sizeof(perf_program_line_t))
+        && perf_module_write_section(file, &written, header.global_offset, globals, (size_t)header.global_count * sizeof(uint32_t))
+        && perf_module_write_section(file, &written, header.class_offset, classes, (size_t)header.class_count * sizeof(perf_module_class_t))
+        && perf_module_write_section(file, &written, header.method_offset, methods, (size_t)header.method_count * sizeof(perf_module_method_t))
+        && perf_module_write_section(file, &written, header.site_offset, program->sites, (size_t)header.site_count * sizeof(uint32_t))
+        && perf_module_write_section(file, &written, header.string_offset, table, header.string_size)
+        && perf_module_write_section(file, &written, header.code_offset, program->code, header.code_count);
+
+    // Closing flushes, it can fail too.
+    if (file != NULL && fclose(file) != 0) ok = false;
+
+    if (result == PERF_RES_OK && !ok)
+    {
+        // Leave nothing half written behind.
+        if (file != NULL) remove(path);
+
+        // Set the error
+        *error = "Failed to write module";
+
+        // Set the IO error result.
+        result = PERF_RES_IO_ERROR;
+    }
+
+    // Free the converted tables.
+    free(strings.slots);
+    free(constants);
+    free(functions);
+    free(globals);
+    free(classes);
+    free(methods);
+    free(table);
+
+    // Return the result.
+    return result;
+}
+
+/**
+ * Represents a module being verified.
+*/
+typedef struct _perf_module_verifier_t
+{
+    const perf_module_header_t*     header;     // The header
+    const uint8_t*                  base;       // The file
+    const char*                     strings;    // The string table
+    uint8_t*                        starts;     // A bit per 4 bytes of the string table, set where a string's first byte is
+    const perf_module_function_t*   functions;  // The functions
+    const uint32_t*                 sites;      // The member sites
+    uint8_t*                        marks;      // Per byte of the function being verified, see perf_module_verify_code
+    int32_t*                        depths;     // Per byte, the depth of the operand stack before the instruction there
+    uint32_t*                       pending;    // Instructions whose successors are still to be followed
+} perf_module_verifier_t;
+
+// Marks of perf_module_verifier_t marks.
+#define PERF_MODULE_MARK_START  1   // An instruction starts here
+#define PERF_MODULE_MARK_SEEN   2   // The instruction was reached while following the stack's depth
+
+/**
+ * @brief Checks that a section is aligned and inside the file.
+ *
+ * @param offset The offset of the section.
+ * @param count The number of items.
+ * @param item_size The size of an item.
+ * @param size The size of the file.
+ *
+ * @return true if the section can be used in place.
+*/
+static bool perf_module_check_section(uint64_t offset, uint32_t count, size_t item_size, uint64_t size)
+{
+    return offset % 8 == 0 && offset <= size && (uint64_t)count * item_size <= size - offset;
+}
+
+/**
+ * @brief Checks a string reference.
+ *
+ * @param verifier The module being verified.
+ * @param reference The string reference.
+ *
+ * @return true if it is the first byte of one of the strings.
+*/
+static bool perf_module_check_string(const perf_module_verifier_t *verifier, uint32_t reference)
+{
+    return reference < verifier->header->string_size && reference % 4 == 0
+        && (verifier->starts[reference / 32] & (1u << (reference / 4 % 8))) != 0;
+}
+
+/**
+ * @brief Walks the string table, marking where each string's first byte is.
+ *
+ * @param verifier The module being verified.
+ *
+ * @return true if every string is inside the table, terminated, and as many as the header says.
+*/
+static bool perf_module_verify_strings(perf_module_verifier_t *verifier)
+{
+    uint32_t size   = verifier->header->string_size;
+    uint32_t count  = 0;
+
+    for (uint32_t offset = 0; offset < size; count++)
+    {
+        // The length, then the bytes and the terminator.
+        uint32_t length;
+
+        if (size - offset < sizeof(uint32_t) + 1) return false;
+        memcpy(&length, verifier->strings + offset, sizeof(uint32_t));
+        if (length > size - offset - sizeof(uint32_t) - 1 || verifier->strings[offset + sizeof(uint32_t) + length] != '\x00') return false;
+
+        uint32_t reference = offset + (uint32_t)sizeof(uint32_t);
+        verifier->starts[reference / 32] |= (uint8_t)(1u << (reference / 4 % 8));
+
+        // Padding runs to the next string, or past the end of the table.
+        offset += perf_module_string_size(length);
+    }
+
+    return count == verifier->header->string_count;
+}
+
+/**
+ * @brief Checks the jump of an instruction lands on an instruction of the same function.
+ *
+ * @param verifier The module being verified.
+ * @param next The offset of the next instruction in the function.
+ * @param distance The distance of the jump.
+ * @param backward True for OP_LOOP and ROP_LOOP.
+ * @param length The length of the function's code.
+ * @param target The offset the jump lands on.
+ *
+ * @return true if the target is an instruction.
+*/
+static bool perf_module_check_jump(const perf_module_verifier_t *verifier, uint32_t next, uint32_t distance, bool backward, uint32_t length, uint32_t *target)
+{
+    if (backward ? distance > next : distance >= length - next) return false;
+
+    *target = backward ? next - distance : next + distance;
+    return (verifier->marks[*target] & PERF_MODULE_MARK_START) != 0;
+}
+
+/**
+ * @brief Reads an operand of an instruction.
+*/
+static inline uint32_t perf_module_operand(const uint8_t *code, uint8_t size)
+{
+    // Operands are little endian
+    uint32_t operand = 0;
+    for (uint8_t idx = 0; idx < size; idx++) operand |= (uint32_t)code[idx] << (idx * 8);
+
+    return operand;
+}
+
+/**
+ * @brief Checks the instructions of a function in stack code, and follows the depth of its operand stack.
+ *
+ * @param verifier The module being verified.
+ * @param fn The function.
+ * @param code The function's code.
+ *
+ * @return NULL if the function is fine, otherwise what is wrong with it.
+*/
+static const char* perf_module_verify_stack_code(perf_module_verifier_t *verifier, const perf_module_function_t *fn, const uint8_t *code)
+{
+    const perf_module_header_t* header = verifier->header;
+
+    // Find where each instruction starts, and check it fits.
+    uint32_t last = 0;
+
+    for (uint32_t offset = 0; offset < fn->code_length; )
+    {
+        if (code[offset] >= OP_COUNT) return "module has an unknown instruction";
+
+        uint32_t size = 1u + perf_opcode_info[code[offset]].operand_size;
+        if (size > fn->code_length - offset) return "module has an instruction past the end of its function";
+
+        verifier->marks[offset] = PERF_MODULE_MARK_START;
+        last    = offset;
+        offset += size;
+    }
+
+    // Nothing runs off the end: the last instruction returns or jumps.
+    if (code[last] != OP_RETURN && code[last] != OP_JUMP && code[last] != OP_LOOP) return "module has a function that runs off its end";
+
+    // Follow every path from the start, the stack is empty there.
+    uint32_t pending_count = 0;
+
+    verifier->depths[0]                 = 0;
+    verifier->marks[0]                 |= PERF_MODULE_MARK_SEEN;
+    verifier->pending[pending_count++]  = 0;
+
+    while (pending_count > 0)
+    {
+        uint32_t                    offset  = verifier->pending[--pending_count];
+        uint8_t                     opcode  = code[offset];
+        const perf_opcode_info_t*   info    = &perf_opcode_info[opcode];
+        uint32_t                    operand = perf_module_operand(code + offset + 1, info->operand_size > 4 ? 4 : info->operand_size);
+        uint32_t                    next    = offset + 1 + info->operand_size;
+        int32_t                     depth   = verifier->depths[offset];
+        int32_t                     popped  = 0;
+        uint32_t                    target  = 0;
+        bool                        jumps   = false;
+        bool                        falls   = true;
+
+        // Check the operand names something that exists.
+        switch (opcode)
+        {
+        case OP_CONSTANT:
+        case OP_CONSTANT_WIDE:
+        case OP_ADD_CONSTANT:
+        case OP_SUBTRACT_CONSTANT:  if (operand >= header->constant_count) return "module names a constant that doesn't exist"; break;
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_ADD_LOCAL:
+        case OP_STORE_LOCAL:        if (operand >= fn->slot_count) return "module names a slot its function doesn't have"; break;
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_STORE_GLOBAL:       if (operand >= header->global_count) return "module names a global that doesn't exist"; break;
+        case OP_GET_MEMBER:
+        case OP_SET_MEMBER:         if (operand >= header->site_count) return "module names a member site that doesn't exist"; break;
+        case OP_INVOKE:             if (operand >= header->site_count) return "module names a member site that doesn't exist";
+                                    popped = code[offset + 5];                                                                      break;
+        case OP_CALL:               popped = (int32_t)operand;                                                                      break;
+        case OP_RETURN:             falls = false;                                                                                  break;
+        case OP_JUMP:               falls = false; jumps = true;                                                                    break;
+        case OP_LOOP:               falls = false; jumps = true;                                                                    break;
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_NOT_EQUAL:
+        case OP_JUMP_IF_EQUAL:
+        case OP_JUMP_IF_NOT_GREATER:
+        case OP_JUMP_IF_NOT_GREATER_EQUAL:
+        case OP_JUMP_IF_NOT_LESS:
+        case OP_JUMP_IF_NOT_LESS_EQUAL:                                 jumps = true;                                                   break;
+        default:                                                                                                                        break;
+        }
+
+        if (jumps && !perf_module_check_jump(verifier, next, operand, opcode == OP_LOOP, fn->code_length, &target))
+            return "module has a jump that doesn't land on an instruction of its function";
+
+        // Calls need the callee below their arguments, everything pops no more than it has.
+        if (depth < popped + 1 && (opcode == OP_CALL || opcode == OP_INVOKE)) return "module's operand stack goes below empty";
+
+        depth += info->stack_effect - popped;
+
+        if (depth < 0) return "module's operand stack goes below empty";
+        if ((uint32_t)depth > fn->max_stack) return "module's operand stack gets deeper than its function's max_stack";
+
+        // Carry the depth on to the instructions that can come next, which must all agree on it.
+        for (uint32_t successor = 0; successor < 2; successor++)
+        {
+            if (successor == 0 ? !falls : !jumps) continue;
+
+            uint32_t at = successor == 0 ? next : target;
+
+            if ((verifier->marks[at] & PERF_MODULE_MARK_SEEN) != 0)
+            {
+                if (verifier->depths[at] != depth) return "module's operand stack has different depths where paths join";
+                continue;
+            }
+
+            verifier->marks[at]                |= PERF_MODULE_MARK_SEEN;
+            verifier->depths[at]                = depth;
+            verifier->pending[pending_count++]  = at;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Checks the instructions of a function in register code.
+ *
+ * @param verifier The module being verified.
+ * @param fn The function.
+ * @param code The function's code.
+ *
+ * @return NULL if the function is fine, otherwise what is wrong with it.
+*/
+static const char* perf_module_verify_register_code(perf_module_verifier_t *verifier, const perf_module_function_t *fn, const uint8_t *code)
+{
+    const perf_module_header_t* header = verifier->header;
+
+    // Instructions are whole words.
+    if (fn->code_offset % 4 != 0 || fn->code_length % 4 != 0) return "module has a function that isn't whole instructions";
+
+    // Find where each instruction starts, and check it fits.
+    uint32_t last = 0;
+
+    for (uint32_t offset = 0; offset < fn->code_length; )
+    {
+        if (code[offset] >= ROP_COUNT) return "module has an unknown instruction";
+
+        uint32_t size = perf_reg_opcode_info[code[offset]].size;
+        if (size > fn->code_length - offset) return "module has an instruction past the end of its function";
+
+        verifier->marks[offset] = PERF_MODULE_MARK_START;
+        last    = offset;
+        offset += size;
+    }
+
+    // Nothing runs off the end: the last instruction returns or jumps.
+    if (code[last] != ROP_RETURN && code[last] != ROP_JUMP && code[last] != ROP_LOOP) return "module has a function that runs off its end";
+
+    // Check every instruction's operands.
+    for (uint32_t offset = 0; offset < fn->code_length; )
+    {
+        const uint8_t*                  word    = code + offset;
+        const perf_reg_opcode_info_t*   info    = &perf_reg_opcode_info[word[0]];
+        uint32_t                        bx      = perf_module_operand(word + 2, 2);
+        uint32_t                        x       = info->size == 8 ? perf_module_operand(word + 4, 4) : 0;
+        uint32_t                        next    = offset + info->size;
+        uint32_t                        slots   = fn->slot_count;
+        uint32_t                        target  = 0;
+        bool                            fine    = true;
+
+        switch (info->layout)
+        {
+        case PERF_REG_LAYOUT_A:             fine = word[1] < slots;                                                             break;
+        case PERF_REG_LAYOUT_AB:            fine = word[1] < slots && word[2] < slots;                                          break;
+        case PERF_REG_LAYOUT_ABC:           fine = word[1] < slots && word[2] < slots && word[3] < slots;                       break;
+        case PERF_REG_LAYOUT_ABK:           fine = word[1] < slots && word[2] < slots && word[3] < header->constant_count;      break;
+        case PERF_REG_LAYOUT_AK:            fine = word[1] < slots && bx < header->constant_count;                              break;
+        case PERF_REG_LAYOUT_AX_CONSTANT:   fine = word[1] < slots && x < header->constant_count;                               break;
+        case PERF_REG_LAYOUT_AX_GLOBAL:     fine = word[1] < slots && x < header->global_count;                                 break;
+        case PERF_REG_LAYOUT_ABX_MEMBER:    fine = word[1] < slots && word[2] < slots && x < header->site_count;                break;
+        case PERF_REG_LAYOUT_CALL:          fine = (uint32_t)word[1] + word[2] < slots;                                         break;
+        case PERF_REG_LAYOUT_INVOKE:        fine = (uint32_t)word[1] + word[2] < slots && x < header->site_count;               break;
+        case PERF_REG_LAYOUT_JUMP:          fine = perf_module_check_jump(verifier, next, bx, false, fn->code_length, &target); break;
+        case PERF_REG_LAYOUT_A_JUMP:        fine = word[1] < slots && perf_module_check_jump(verifier, next, bx, false, fn->code_length, &target); break;
+        case PERF_REG_LAYOUT_AB_JUMP:       fine = word[1] < slots && word[2] < slots && perf_module_check_jump(verifier, next, x >> 16, false, fn->code_length, &target); break;
+        case PERF_REG_LAYOUT_LOOP:          fine = perf_module_check_jump(verifier, next, bx, true, fn->code_length, &target);  break;
+        default:                            fine = false;                                                                       break;
+        }
+
+        if (!fine) return "module has an instruction whose operands don't exist";
+
+        offset = next;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Checks every table and every function's code of a module.
+ *
+ * @param verifier The module being verified, its header already checked.
+ *
+ * @return NULL if the module is fine, otherwise what is wrong with it.
+*/
+static const char* perf_module_verify(perf_module_verifier_t *verifier)
+{
+    const perf_module_header_t* header  = verifier->header;
+    const uint8_t*              base    = verifier->base;
+
+    // Strings first, everything else refers to them.
+    if (!perf_module_verify_strings(verifier)) return "module has a broken string table";
+
+    // Constants are the values a compiler makes: numbers, integers, strings, functions, nil and booleans.
+    for (uint32_t idx = 0; idx < header->constant_count; idx++)
+    {
+        perf_value_t value;
+        memcpy(&value, base + header->constant_offset + (uint64_t)idx * sizeof(perf_value_t), sizeof(value));
+
+        switch (perf_value_type(value))
+        {
+        case PERF_VALUE_NUMBER:
+        case PERF_VALUE_INTEGER:
+        case PERF_VALUE_NIL:
+        case PERF_VALUE_BOOL:       break;
+        case PERF_VALUE_STRING:     if ((value.bits & PERF_VALUE_PAYLOAD) > UINT32_MAX || !perf_module_check_string(verifier, perf_value_as_index(value)))
+                                        return "module has a string constant that isn't in its string table";
+                                    break;
+        case PERF_VALUE_FUNCTION:   if (perf_value_as_index(value) >= header->function_count || (value.bits & PERF_VALUE_PAYLOAD) > UINT32_MAX)
+                                        return "module has a function constant that doesn't exist";
+                                    break;
+        default:                    return "module has a constant a compiler can't make";
+        }
+    }
+
+    // Globals, classes and methods, by name.
+    for (uint32_t idx = 0; idx < header->global_count; idx++)
+    {
+        uint32_t name;
+        memcpy(&name, base + header->global_offset + (uint64_t)idx * sizeof(uint32_t), sizeof(name));
+
+        if (!perf_module_check_string(verifier, name)) return "module has a global without a name";
+    }
+
+    const perf_module_class_t*  classes = (const perf_module_class_t*)(base + header->class_offset);
+    const perf_module_method_t* methods = (const perf_module_method_t*)(base + header->method_offset);
+
+    for (uint32_t idx = 0; idx < header->class_count; idx++)
+    {
+        if (!perf_module_check_string(verifier, classes[idx].name)) return "module has a class without a name";
+        if (classes[idx].initializer >= header->function_count) return "module has a class whose initializer doesn't exist";
+        if (classes[idx].method_offset > header->method_count || classes[idx].method_count > header->method_count - classes[idx].method_offset)
+            return "module has a class whose methods don't exist";
+    }
+
+    for (uint32_t idx = 0; idx < header->method_count; idx++)
+    {
+        if (!perf_module_check_string(verifier, methods[idx].name)) return "module has a method without a name";
+        if (methods[idx].function >= header->function_count) return "module has a method whose function doesn't exist";
+    }
+
+    // Member sites name their member through a string constant.
+    for (uint32_t idx = 0; idx < header->site_count; idx++)
+    {
+        perf_value_t value;
+
+        if (verifier->sites[idx] >= header->constant_count) return "module has a member site without a name";
+        memcpy(&value, base + header->constant_offset + (uint64_t)verifier->sites[idx] * sizeof(perf_value_t), sizeof(value));
+        if (!perf_value_is(value, PERF_VALUE_STRING)) return "module has a member site without a name";
+    }
+
+    // The top level script comes first, and is called without arguments.
+    if (header->function_count == 0 || verifier->functions[0].arity != 0 || verifier->functions[0].kind != PERF_FUNCTION_PLAIN)
+        return "module has no top level script";
+
+    // Then every function and its code.
+    const uint8_t* code = base + header->code_offset;
+
+    for (uint32_t idx = 0; idx < header->function_count; idx++)
+    {
+        const perf_module_function_t* fn = &verifier->functions[idx];
+
+        if (fn->name != PERF_MODULE_NO_STRING ? !perf_module_check_string(verifier, fn->name) : idx != 0) return "module has a function without a name";
+        if (fn->kind > PERF_FUNCTION_INITIALIZER) return "module has a function of an unknown kind";
+        if (fn->class_index != UINT32_MAX ? fn->class_index >= header->class_count : fn->kind != PERF_FUNCTION_PLAIN)
+            return "module has a method whose class doesn't exist";
+        if (fn->arity > fn->slot_count) return "module has a function with fewer slots than parameters";
+        if (fn->line_offset > header->line_count || fn->line_count > header->line_count - fn->line_offset) return "module has a function whose lines don't exist";
+        if (fn->code_length == 0 || fn->code_offset > header->code_count || fn->code_length > header->code_count - fn->code_offset)
+            return "module has a function whose code doesn't exist";
+
+        // Marks and depths are per byte of the function.
+        memset(verifier->marks, 0, fn->code_length);
+
+        const char* message = header->format == PERF_PROGRAM_FORMAT_REGISTER
+            ? perf_module_verify_register_code(verifier, fn, code + fn->code_offset)
+            : perf_module_verify_stack_code(verifier, fn, code + fn->code_offset);
+
+        if (message != NULL) return message;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Checks a module's header: that it is a module of this version and layout, with every section in the file.
+ *
+ * @param header The header.
+ * @param size The size of the file.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the sections can be used in place.
+*/
+static perf_result_t perf_module_check_header(const perf_module_header_t *header, size_t size, const char** error)
+{
+    // Written by this version, for this layout.
+    if (memcmp(header->magic, perf_module_magic, sizeof(perf_module_magic)) != 0 || header->version != PERF_MODULE_VERSION
+        || header->value_size != sizeof(perf_value_t) || header->function_size != sizeof(perf_module_function_t))
+    {
+        // Set the error
+        *error = "Not a module of this version";
+
+        // Return unsupported result.
+        return PERF_RES_UNSUPPORTED;
+    }
+
+    // Every section is where it can be used in place.
+    bool fine = header->size == size
+        && (header->format == PERF_PROGRAM_FORMAT_STACK || header->format == PERF_PROGRAM_FORMAT_REGISTER)
+        && perf_module_check_section(header->constant_offset, header->constant_count, sizeof(perf_value_t), size)
+        && perf_module_check_section(header->function_offset, header->function_count, sizeof(perf_module_function_t), size)
+        && perf_module_check_section(header->line_offset, header->line_count, sizeof(perf_program_line_t), size)
+        && perf_module_check_section(header->global_offset, header->global_count, sizeof(uint32_t), size)
+        && perf_module_check_section(header->class_offset, header->class_count, sizeof(perf_module_class_t), size)
+        && perf_module_check_section(header->method_offset, header->method_count, sizeof(perf_module_method_t), size)
+        && perf_module_check_section(header->site_offset, header->site_count, sizeof(uint32_t), size)
+        && perf_module_check_section(header->string_offset, header->string_size, 1, size)
+        && perf_module_check_section(header->code_offset, header->code_count, 1, size);
+
+    if (!fine)
+    {
+        // Set the error
+        *error = "module has a section outside the file";
+
+        // Return compile error result.
+        return PERF_RES_COMPILE_ERROR;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for module.h perf_module_load
+perf_result_t perf_module_load(perf_module_t *module, const void* data, size_t size, const char** error)
+{
+    const uint8_t*              base    = (const uint8_t*)data;
+    const perf_module_header_t* header  = (const perf_module_header_t*)data;
+
+    memset(module, 0, sizeof(perf_module_t));
+    perf_program_init(&module->program);
+
+    // The sections are used in place, so they must be aligned in memory too.
+    if (size < sizeof(perf_module_header_t) || (uintptr_t)data % 8 != 0)
+    {
+        // Set the error
+        *error = "Not a module of this version";
+
+        // Return unsupported result.
+        return PERF_RES_UNSUPPORTED;
+    }
+
+    perf_result_t result = perf_module_check_header(header, size, error);
+    if (result != PERF_RES_OK) return result;
+
+    // Verify it all, with room to follow the code of the longest function.
+    perf_module_verifier_t verifier;
+    memset(&verifier, 0, sizeof(verifier));
+
+    uint32_t longest = 1;
+    verifier.header     = header;
+    verifier.base       = base;
+    verifier.strings    = (const char*)(base + header->string_offset);
+    verifier.functions  = (const perf_module_function_t*)(base + header->function_offset);
+    verifier.sites      = (const uint32_t*)(base + header->site_offset);
+
+    for (uint32_t idx = 0; idx < header->function_count; idx++)
+        if (verifier.functions[idx].code_length > longest && verifier.functions[idx].code_length <= header->code_count) longest = verifier.functions[idx].code_length;
+
+    verifier.starts     = (uint8_t*)calloc((size_t)header->string_size / 32 + 1, 1);
+    verifier.marks      = (uint8_t*)malloc(longest);
+    verifier.depths     = (int32_t*)malloc((size_t)longest * sizeof(int32_t));
+    verifier.pending    = (uint32_t*)malloc((size_t)longest * sizeof(uint32_t));
+
+    const char* message = NULL;
+
+    if (verifier.starts == NULL || verifier.marks == NULL || verifier.depths == NULL || verifier.pending == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for module verifier";
+
+        // Set the memory allocation failure result.
+        result = PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+    else if ((message = perf_module_verify(&verifier)) != NULL)
+    {
+        // Set the error
+        *error = message;
+
+        // Set the compile error result.
+        result = PERF_RES_COMPILE_ERROR;
+    }
+
+    free(verifier.starts);
+    free(verifier.marks);
+    free(verifier.depths);
+    free(verifier.pending);
+
+    if (result != PERF_RES_OK) return result;
+
+    // The code, lines and sites are used where they are.
+    perf_program_t* program = &module->program;
+
+    module->data                = base;
+    module->size                = size;
+    program->format             = (perf_e_program_format_t)header->format;
+    program->code               = (uint8_t*)(base + header->code_offset);
+    program->code_count         = program->code_capacity        = header->code_count;
+    program->lines              = (perf_program_line_t*)(base + header->line_offset);
+    program->line_count         = program->line_capacity        = header->line_count;
+    program->sites              = (uint32_t*)(base + header->site_offset);
+    program->site_count         = program->site_capacity        = header->site_count;
+
+    // The rest holds pointers, decode it, string references become pointers into the string table.
+    program->constants  = (perf_value_t*)malloc((size_t)header->constant_count * sizeof(perf_value_t) + 1);
+    program->functions  = (perf_function_t*)malloc((size_t)header->function_count * sizeof(perf_function_t) + 1);
+    program->globals    = (const char**)malloc((size_t)header->global_count * sizeof(const char*) + 1);
+    program->classes    = (perf_class_t*)malloc((size_t)header->class_count * sizeof(perf_class_t) + 1);
+    program->methods    = (perf_method_t*)malloc((size_t)header->method_count * sizeof(perf_method_t) + 1);
+
+    if (program->constants == NULL || program->functions == NULL || program->globals == NULL || program->classes == NULL || program->methods == NULL)
+    {
+        perf_module_free(module);
+
+        // Set the error
+        *error = "Failed to allocate memory for module";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    const char*                     strings     = verifier.strings;
+    const perf_module_function_t*   functions   = verifier.functions;
+    const perf_module_class_t*      classes     = (const perf_module_class_t*)(base + header->class_offset);
+    const perf_module_method_t*     methods     = (const perf_module_method_t*)(base + header->method_offset);
+
+    memcpy(program->constants, base + header->constant_offset, (size_t)header->constant_count * sizeof(perf_value_t));
+
+    for (uint32_t idx = 0; idx < header->constant_count; idx++)
+        if (perf_value_is(program->constants[idx], PERF_VALUE_STRING)) program->constants[idx] = perf_value_string(strings + perf_value_as_index(program->constants[idx]));
+
+    for (uint32_t idx = 0; idx < header->function_count; idx++)
+    {
+        const perf_module_function_t*   from    = &functions[idx];
+        perf_function_t*                to      = &program->functions[idx];
+
+        to->name        = from->name == PERF_MODULE_NO_STRING ? NULL : strings + from->name;
+        to->code_offset = from->code_offset;
+        to->code_length = from->code_length;
+        to->line_offset = from->line_offset;
+        to->line_count  = from->line_count;
+        to->arity       = from->arity;
+        to->kind        = from->kind;
+        to->slot_count  = from->slot_count;
+        to->max_stack   = from->max_stack;
+        to->class_index = from->class_index;
+    }
+
+    for (uint32_t idx = 0; idx < header->global_count; idx++)
+    {
+        uint32_t name;
+        memcpy(&name, base + header->global_offset + (uint64_t)idx * sizeof(uint32_t), sizeof(name));
+
+        program->globals[idx] = strings + name;
+    }
+
+    for (uint32_t idx = 0; idx < header->class_count; idx++)
+    {
+        program->classes[idx].name          = strings + classes[idx].name;
+        program->classes[idx].initializer   = classes[idx].initializer;
+        program->classes[idx].method_offset = classes[idx].method_offset;
+        program->classes[idx].method_count  = classes[idx].method_count;
+    }
+
+    for (uint32_t idx = 0; idx < header->method_count; idx++)
+    {
+        program->methods[idx].name      = strings + methods[idx].name;
+        program->methods[idx].function  = methods[idx].function;
+    }
+
+    program->constant_count = program->constant_capacity    = header->constant_count;
+    program->function_count = program->function_capacity    = header->function_count;
+    program->global_count   = program->global_capacity      = header->global_count;
+    program->class_count    = program->class_capacity       = header->class_count;
+    program->method_count   = program->method_capacity      = header->method_count;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for module.h perf_module_free
+perf_result_t perf_module_free(perf_module_t *module)
+{
+    // Only the decoded tables are ours, the rest is the file's.
+    free(module->program.constants);
+    free(module->program.functions);
+    free((void*)module->program.globals);
+    free(module->program.classes);
+    free(module->program.methods);
+
+    memset(module, 0, sizeof(perf_module_t));
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
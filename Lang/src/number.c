@@ -0,0 +1,450 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/token.h"
+#include "../inc/number.h"
+#include "../inc/pow5_table.h"
+
+#include <math.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// Number of significant digits that always fit in the 64-bit significand.
+#define PERF_NUMBER_MANTISSA_DIGITS     19
+
+// Number of significant digits the slow path keeps, enough to round any double correctly.
+#define PERF_NUMBER_SLOW_PATH_DIGITS    800
+
+// Largest significand that converts to a double exactly (2^53).
+#define PERF_NUMBER_EXACT_MANTISSA      (1ull << 53)
+
+/**
+ * Powers of ten that are exactly representable as doubles.
+*/
+static const double perf_number_pow10[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * @brief Gets the value of a digit in any base up to 16.
+ *
+ * @param ch The character to convert.
+ *
+ * @return The value of the digit, or 0xFF if the character isn't a digit.
+*/
+static inline uint32_t perf_number_digit(char ch)
+{
+    // Decimal digits
+    if (ch >= '0' && ch <= '9') return (uint32_t)(ch - '0');
+
+    // Hexadecimal digits, either case
+    char lower = (char)(ch | 0x20);
+    if (lower >= 'a' && lower <= 'f') return (uint32_t)(lower - 'a' + 10);
+
+    // Not a digit
+    return 0xFF;
+}
+
+/**
+ * @brief Multiplies two 64-bit integers into a 128-bit product.
+ *
+ * @param a The first factor.
+ * @param b The second factor.
+ * @param high The upper 64 bits of the product.
+ *
+ * @return The lower 64 bits of the product.
+*/
+static inline uint64_t perf_number_mul128(uint64_t a, uint64_t b, uint64_t* high)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 product = (unsigned __int128)a * b;
+    *high = (uint64_t)(product >> 64);
+    return (uint64_t)product;
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return _umul128(a, b, high);
+#else
+    // Split into 32-bit halves and combine the partial products.
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+    *high = hi_hi + (hi_lo >> 32) + (cross >> 32);
+    return (cross << 32) | (uint32_t)lo_lo;
+#endif
+}
+
+/**
+ * @brief Counts the leading zero bits of a non-zero 64-bit integer.
+ *
+ * @param value The value to check.
+ *
+ * @return The number of leading zero bits.
+*/
+static inline int perf_number_clz64(uint64_t value)
+{
+#if defined(__GNUC__)
+    return __builtin_clzll(value);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return 63 - (int)index;
+#else
+    int count = 0;
+    while ((value & (1ull << 63)) == 0) { value <<= 1; count++; }
+    return count;
+#endif
+}
+
+// Implementation for number.h perf_number_compute_float
+bool perf_number_compute_float(uint64_t mantissa, int32_t exponent, double* out)
+{
+    // Zero is zero at any scale.
+    if (mantissa == 0)
+    {
+        *out = 0.0;
+        return true;
+    }
+
+    // Clinger's fast path, both operands are exact so the single rounding is correct.
+    if (mantissa <= PERF_NUMBER_EXACT_MANTISSA && exponent >= -22 && exponent <= 22)
+    {
+        double value = (double)mantissa;
+        *out = exponent < 0 ? value / perf_number_pow10[-exponent] : value * perf_number_pow10[exponent];
+        return true;
+    }
+
+    // Anything below the table underflows to zero, anything above overflows to infinity.
+    if (exponent < PERF_POW5_SMALLEST)
+    {
+        *out = 0.0;
+        return true;
+    }
+    if (exponent > PERF_POW5_LARGEST)
+    {
+        *out = HUGE_VAL;
+        return true;
+    }
+
+    // Eisel-Lemire: multiply the normalized significand by the truncated 128-bit power of five.
+    const uint64_t* power = perf_pow5_table[exponent - PERF_POW5_SMALLEST];
+
+    // Normalize the significand so its top bit is set.
+    int leading_zeros = perf_number_clz64(mantissa);
+    mantissa <<= leading_zeros;
+
+    // Multiply by the upper half of the power first, it is usually enough.
+    uint64_t upper;
+    uint64_t lower = perf_number_mul128(mantissa, power[0], &upper);
+
+    // If the bits below the result are all ones, the lower half of the power may carry into them.
+    if ((upper & 0x1FF) == 0x1FF && lower + mantissa < lower)
+    {
+        // Multiply by the lower half of the power.
+        uint64_t second_high;
+        uint64_t second_low = perf_number_mul128(mantissa, power[1], &second_high);
+
+        // Add the partial products.
+        uint64_t middle = lower + second_high;
+        if (middle < lower) upper++;
+
+        // Still ambiguous, give up.
+        if (middle + 1 == 0 && (upper & 0x1FF) == 0x1FF && second_low + mantissa < second_low) return false;
+
+        // Use the refined product.
+        lower = middle;
+    }
+
+    // Extract the 54 bits we need (53 + 1 rounding bit).
+    uint64_t upper_bit  = upper >> 63;
+    uint64_t result     = upper >> (upper_bit + 9);
+    leading_zeros      += (int)(1 ^ upper_bit);
+
+    // Exactly halfway between two doubles, the truncated power can't tell which way to round.
+    if (lower == 0 && (upper & 0x1FF) == 0 && (result & 3) == 1) return false;
+
+    // Round to nearest, ties to even.
+    result += result & 1;
+    result >>= 1;
+
+    // Rounding may have carried into a new bit.
+    if (result >= PERF_NUMBER_EXACT_MANTISSA)
+    {
+        result = PERF_NUMBER_EXACT_MANTISSA >> 1;
+        leading_zeros--;
+    }
+
+    // Compute the biased binary exponent, floor(log2(10^exponent)) + 1024 + 63 - leading zeros.
+    int64_t binary_exponent = ((((int64_t)152170 + 65536) * exponent) >> 16) + 1024 + 63 - leading_zeros;
+
+    // Subnormals and overflow are left to the slow path.
+    if (binary_exponent < 1 || binary_exponent > 2046) return false;
+
+    // Assemble the double.
+    uint64_t bits = (result & ~(PERF_NUMBER_EXACT_MANTISSA >> 1)) | ((uint64_t)binary_exponent << 52);
+    memcpy(out, &bits, sizeof(double));
+
+    // Return success.
+    return true;
+}
+
+/**
+ * @brief Converts a decimal float literal with strtod, for the cases the fast paths can't decide.
+ *
+ * The significant digits are copied to a stack buffer with an explicit exponent, so the conversion is
+ * independent of the locale's decimal point. Digits past the buffer are folded into a sticky digit.
+ *
+ * @param start The first character of the literal.
+ * @param end The first character after the literal.
+ *
+ * @return The converted value.
+*/
+static double perf_number_slow_path(const char* start, const char* end)
+{
+    // Significant digits, a sticky digit, and the exponent suffix.
+    char buffer[PERF_NUMBER_SLOW_PATH_DIGITS + 16];
+
+    // Used to keep track of the digits and the exponent.
+    size_t  count       = 0;
+    int32_t exponent    = 0;
+    bool    seen_point  = false;
+    bool    sticky      = false;
+
+    // Collect the significant digits.
+    for (const char* ch = start; ch < end; ch++)
+    {
+        // Skip separators
+        if (*ch == '_') continue;
+
+        // Note the decimal point
+        if (*ch == '.')
+        {
+            seen_point = true;
+            continue;
+        }
+
+        // Skip leading zeros, after the point they still scale the value.
+        if (count == 0 && *ch == '0')
+        {
+            if (seen_point) exponent--;
+            continue;
+        }
+
+        // Keep the digit if there's room.
+        if (count < PERF_NUMBER_SLOW_PATH_DIGITS - 1)
+        {
+            buffer[count++] = *ch;
+            if (seen_point) exponent--;
+        }
+
+        // Otherwise only remember if it was non-zero.
+        else
+        {
+            if (*ch != '0') sticky = true;
+            if (!seen_point) exponent++;
+        }
+    }
+
+    // Nothing but zeros.
+    if (count == 0) return 0.0;
+
+    // A non-zero digit past the end of the buffer nudges the value off any halfway point.
+    if (sticky)
+    {
+        buffer[count++] = '1';
+        exponent--;
+    }
+
+    // Append the exponent and convert.
+    snprintf(buffer + count, sizeof(buffer) - count, "e%d", (int)exponent);
+    return strtod(buffer, NULL);
+}
+
+/**
+ * @brief Accumulates the digits of an integer literal, checking for overflow.
+ *
+ * @param ch The first digit.
+ * @param base The base of the literal.
+ * @param end Set to the first character after the literal.
+ * @param token The token to populate.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the integer fits in 64 bits.
+*/
+static perf_result_t perf_number_finish_integer(const char* ch, uint32_t base, const char** end, perf_token_t* token, const char** error)
+{
+    // Anything above the limit overflows when multiplied by the base.
+    uint64_t integer    = 0;
+    uint64_t limit      = UINT64_MAX / base;
+    bool     overflow   = false;
+
+    // Loop until we reach the end of the number.
+    for (;; ch++)
+    {
+        // Get the value of the digit
+        uint32_t digit = perf_number_digit(*ch);
+
+        // Handle a digit, adding it can only wrap if the result ends up below it.
+        if (digit < base)
+        {
+            uint64_t next = integer * base + digit;
+            overflow   |= integer > limit || next < digit;
+            integer     = next;
+        }
+
+        // Handle digit seperators, anything else ends the number.
+        else if (*ch != '_') break;
+    }
+
+    // Output the end of the literal.
+    *end = ch;
+
+    // Check if the integer fits
+    if (overflow)
+    {
+        // Set the error
+        *error = "Integer literal is too large.";
+
+        // Return lex error result.
+        return PERF_RES_LEX_ERROR;
+    }
+
+    // Construct the token.
+    token->type         = TOKEN_INTEGER;
+    token->as.integer   = integer;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for number.h perf_number_scan
+perf_result_t perf_number_scan(const char* ch, const char** end, perf_token_t* token, const char** error)
+{
+    // Save the start of the literal for the slow path.
+    const char* start = ch;
+
+    // Used to determine the base of the literal.
+    uint32_t base = 10;
+
+    // Handle integer notation
+    if (ch[0] == '0' && ((ch[1] | 0x20) >= 'a' && (ch[1] | 0x20) <= 'z'))
+    {
+        // Handle notations
+        switch (ch[1])
+        {
+        case 'b': base = 2;  break;     // Handle binary notation
+        case 'o': base = 8;  break;     // Handle octal notation
+        case 'x': base = 16; break;     // Handle hexadecimal notation
+        default:                        // Handle unknown notation
+
+            // Set the error
+            *error = "Unknown integer notation.";
+
+            // Return lex error result.
+            return PERF_RES_LEX_ERROR;
+        }
+
+        // Skip the notation
+        ch += 2;
+
+        // Handle incomplete integer literal
+        if (perf_number_digit(*ch) >= base)
+        {
+            // Set the error
+            *error = "Incomplete integer literal.";
+
+            // Return lex error result.
+            return PERF_RES_LEX_ERROR;
+        }
+    }
+
+    // Integers in other bases, or decimals too long for the significand, are accumulated with overflow checks.
+    if (base != 10) return perf_number_finish_integer(ch, base, end, token, error);
+
+    // Accumulates the decimal significand, the first 19 significant digits and a power of ten.
+    uint64_t mantissa   = 0;
+    int32_t  exponent   = 0;
+    uint32_t digits     = 0;
+    bool     truncated  = false;
+    bool     is_float   = false;
+
+    // Loop until we reach the end of the number.
+    for (;; ch++)
+    {
+        // Get the value of the digit
+        uint32_t digit = (uint32_t)(*ch - '0');
+
+        // Handle a digit
+        if (digit < 10)
+        {
+            // Keep the digit if it fits in the significand, leading zeros don't count towards the 19.
+            if (digits < PERF_NUMBER_MANTISSA_DIGITS)
+            {
+                mantissa    = mantissa * 10 + digit;
+                digits     += mantissa != 0;
+                exponent   -= is_float;
+            }
+
+            // Otherwise only remember whether it was non-zero.
+            else
+            {
+                truncated  |= digit != 0;
+                exponent   += !is_float;
+            }
+
+            // Continue to the next character.
+            continue;
+        }
+
+        // Handle digit seperators
+        if (*ch == '_') continue;
+
+        // Handle a decimal point, it must be followed by a digit or a separator.
+        if (*ch == '.' && !is_float && ((ch[1] >= '0' && ch[1] <= '9') || ch[1] == '_'))
+        {
+            is_float = true;
+            continue;
+        }
+
+        // Otherwise we have reached the end of the number.
+        break;
+    }
+
+    // Handle an integer
+    if (!is_float)
+    {
+        // More than 19 significant digits may still fit, accumulate them properly.
+        if (exponent != 0) return perf_number_finish_integer(start, 10, end, token, error);
+
+        // Output the end of the literal.
+        *end = ch;
+
+        // Construct the token.
+        token->type         = TOKEN_INTEGER;
+        token->as.integer   = mantissa;
+
+        // Return OK result.
+        return PERF_RES_OK;
+    }
+
+    // Output the end of the literal.
+    *end = ch;
+
+    // Used to store the converted value.
+    double value;
+
+    // With more than 19 digits, the value lies between mantissa and mantissa + 1, both must round the same.
+    double upper_value;
+    bool converted = perf_number_compute_float(mantissa, exponent, &value)
+        && (!truncated || (perf_number_compute_float(mantissa + 1, exponent, &upper_value) && upper_value == value));
+
+    // Construct the token, falling back to strtod if the fast paths couldn't decide.
+    token->type         = TOKEN_NUMBER;
+    token->as.number    = converted ? value : perf_number_slow_path(start, ch);
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
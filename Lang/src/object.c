@@ -0,0 +1,249 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/value.h"
+#include "../inc/heap.h"
+#include "../inc/object.h"
+
+/**
+ * @brief Allocates a shape and links it into a list.
+ *
+ * @param list The list of shapes to add it to.
+ * @param shape The shape, zeroed.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the shape was allocated successfully.
+*/
+static perf_result_t perf_shape_alloc(perf_shape_t **list, perf_shape_t **shape, const char** error)
+{
+    // Allocate the shape
+    *shape = (perf_shape_t*)calloc(1, sizeof(perf_shape_t));
+
+    // Check if the allocation failed.
+    if (*shape == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for shape";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Link it into the list
+    (*shape)->next  = *list;
+    *list           = *shape;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for object.h perf_shape_root
+perf_result_t perf_shape_root(perf_shape_t **list, uint32_t class_index, const char* name, perf_shape_t **shape, const char** error)
+{
+    // Allocate the shape
+    perf_result_t result = perf_shape_alloc(list, shape, error);
+
+    if (result != PERF_RES_OK) return result;
+
+    // It is its own root, with no fields.
+    (*shape)->root          = *shape;
+    (*shape)->name          = name;
+    (*shape)->class_index   = class_index;
+    (*shape)->field_hint    = PERF_OBJECT_MIN_FIELDS;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for object.h perf_shape_find
+bool perf_shape_find(const perf_shape_t *shape, const char* name, uint32_t *index)
+{
+    // Each shape adds the last of its fields, walk back towards the root.
+    for (; shape->parent != NULL; shape = shape->parent)
+    {
+        if (shape->name != name) continue;
+
+        *index = shape->field_count - 1;
+        return true;
+    }
+
+    return false;
+}
+
+// Implementation for object.h perf_shape_add
+perf_result_t perf_shape_add(perf_shape_t **list, perf_shape_t *shape, const char* name, perf_shape_t **next, const char** error)
+{
+    // Follow the transition if another instance took it before.
+    for (perf_shape_t* child = shape->children; child != NULL; child = child->sibling)
+    {
+        if (child->name != name) continue;
+
+        *next = child;
+        return PERF_RES_OK;
+    }
+
+    // Otherwise make it
+    perf_shape_t*   child   = NULL;
+    perf_result_t   result  = perf_shape_alloc(list, &child, error);
+
+    if (result != PERF_RES_OK) return result;
+
+    child->parent       = shape;
+    child->root         = shape->root;
+    child->name         = name;
+    child->class_index  = shape->class_index;
+    child->field_count  = shape->field_count + 1;
+
+    // Link it in as one of the shape's transitions.
+    child->sibling      = shape->children;
+    shape->children     = child;
+
+    // Output the shape
+    *next = child;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for object.h perf_shape_free
+perf_result_t perf_shape_free(perf_shape_t **list)
+{
+    // Free the shapes one by one.
+    perf_shape_t* shape = *list;
+
+    while (shape != NULL)
+    {
+        perf_shape_t* next = shape->next;
+        free(shape);
+        shape = next;
+    }
+
+    *list = NULL;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for object.h perf_instance_new
+perf_result_t perf_instance_new(perf_heap_t *heap, perf_shape_t *root, perf_value_t *instance, const char** error)
+{
+    // Make room for as many fields as the class's instances got so far.
+    uint32_t            capacity    = root->field_hint;
+    perf_heap_object_t* object      = NULL;
+    perf_result_t       result      = perf_heap_alloc(heap, PERF_HEAP_INSTANCE, sizeof(perf_instance_t) + (size_t)capacity * sizeof(perf_value_t), &object, error);
+
+    if (result != PERF_RES_OK) return result;
+
+    // Start it out without fields.
+    perf_instance_t* created = (perf_instance_t*)object;
+
+    created->shape      = root;
+    created->fields     = created->inline_fields;
+    created->capacity   = capacity;
+    created->reserved   = 0;
+
+    // Output the instance
+    *instance = perf_value_object(created);
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+/**
+ * @brief Moves the fields of an instance to a PERF_HEAP_FIELDS object twice their capacity, which may collect first.
+ *
+ * @param heap The heap the instance lives in.
+ * @param instance The instance, updated if collecting moves it.
+ * @param value The value about to be stored, updated if collecting moves it.
+ * @param error The error message if result is not PERF_RES_OK.
+ *
+ * @return PERF_RES_OK if the fields were moved successfully.
+*/
+static perf_result_t perf_instance_grow(perf_heap_t *heap, perf_value_t *instance, perf_value_t *value, const char** error)
+{
+    uint32_t capacity = ((perf_instance_t*)perf_value_as_object(*instance))->capacity * 2;
+
+    // Check if the field count would overflow.
+    if (capacity > UINT16_MAX)
+    {
+        // Set the error
+        *error = "too many fields";
+
+        // Return runtime error result.
+        return PERF_RES_RUNTIME_ERROR;
+    }
+
+    // Allocate the fields, holding on to the instance and the value as collecting may move them.
+    perf_heap_object_t* fields = NULL;
+
+    perf_heap_push_temp(heap, instance);
+    perf_heap_push_temp(heap, value);
+    perf_result_t result = perf_heap_alloc(heap, PERF_HEAP_FIELDS, sizeof(perf_heap_object_t) + (size_t)capacity * sizeof(perf_value_t), &fields, error);
+    perf_heap_pop_temp(heap, 2);
+
+    if (result != PERF_RES_OK) return result;
+
+    // Copy the fields over from wherever the instance is now.
+    perf_instance_t*    object  = (perf_instance_t*)perf_value_as_object(*instance);
+    perf_value_t*       values  = (perf_value_t*)(fields + 1);
+
+    memcpy(values, object->fields, (size_t)object->shape->field_count * sizeof(perf_value_t));
+
+    object->fields      = values;
+    object->capacity    = capacity;
+
+    // An old instance now refers to fields that may be young.
+    if (perf_heap_remember(heap, &object->header) != PERF_RES_OK)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for remembered set";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for object.h perf_instance_add
+perf_result_t perf_instance_add(perf_heap_t *heap, perf_shape_t **list, perf_value_t *instance, const char* name, perf_value_t *value, uint32_t *index, const char** error)
+{
+    // Get the shape with the field
+    perf_shape_t*   shape   = ((perf_instance_t*)perf_value_as_object(*instance))->shape;
+    perf_shape_t*   next    = NULL;
+    perf_result_t   result  = perf_shape_add(list, shape, name, &next, error);
+
+    if (result != PERF_RES_OK) return result;
+
+    // Make room for it
+    if (next->field_count > ((perf_instance_t*)perf_value_as_object(*instance))->capacity)
+    {
+        result = perf_instance_grow(heap, instance, value, error);
+
+        if (result != PERF_RES_OK) return result;
+    }
+
+    // New instances of the class get room for it.
+    if (next->field_count > next->root->field_hint) next->root->field_hint = next->field_count;
+
+    // Store the value, then take the shape, so collecting never sees a field that isn't set.
+    perf_instance_t* object = (perf_instance_t*)perf_value_as_object(*instance);
+
+    *index = next->field_count - 1;
+
+    result = perf_instance_set(heap, object, *index, *value);
+    object->shape = next;
+
+    // Check if the instance couldn't be remembered.
+    if (result != PERF_RES_OK)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for remembered set";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
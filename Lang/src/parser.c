@@ -1,56 +1,12 @@
 #include "../inc/shared.h"
 #include "../inc/result.h"
 #include "../inc/token.h"
+#include "../inc/intern.h"
 #include "../inc/lexer.h"
+#include "../inc/token_stream.h"
 #include "../inc/ast.h"
 #include "../inc/parser.h"
 
-/**
- * Resize the AST nodes buffer.
- * 
- * @param out_ast_nodes The AST nodes buffer to resize.
- * @param capacity The capacity of the AST nodes buffer.
- * 
- * @return PERF_RES_OK if the AST nodes buffer was resized successfully.
- */
-perf_result_t reallocate_ast_nodes_buffer(perf_parser_node_t **out_ast_nodes, int32_t *capacity)
-{
-	// Adjust the capacity of the AST nodes buffer.
-	*capacity = ((*capacity) < 16) ? 16 : (*capacity) * 2;
-
-	// Check if we need to malloc the AST nodes buffer.
-	if (*out_ast_nodes == NULL)
-	{
-        // Allocate memory for the AST nodes buffer
-		*out_ast_nodes = malloc(sizeof(perf_parser_node_t) * (*capacity));
-
-		// Check if the AST nodes buffer was allocated successfully
-        if (*out_ast_nodes == NULL)
-        {
-            // Return an error
-            return PERF_RES_MEMORY_ALLOC_FAIL;
-        }
-	}
-
-	// Otherwise, reallocate the existing memory block.
-	else
-	{
-        // Resize the AST nodes buffer
-		*out_ast_nodes = realloc(*out_ast_nodes, sizeof(perf_parser_node_t) * (*capacity));
-
-		// Check if the AST nodes buffer was reallocated successfully
-        if (out_ast_nodes == NULL)
-        {
-            // Return an error
-            return PERF_RES_MEMORY_ALLOC_FAIL;
-        }
-	}
-
-    // Return ok
-	return PERF_RES_OK;
-}
-
-
 // Implementation for parser.h perf_parser_init
 perf_result_t perf_parser_init(perf_parser_t *parser, perf_lexer_t *lexer, const char** error)
 {
@@ -79,477 +35,1100 @@ perf_result_t perf_parser_init(perf_parser_t *parser, perf_lexer_t *lexer, const
 
     // Set the current token
     parser->current_token = NULL;
+    parser->current_type  = TOKEN_EOF;
 
     // Set the erroring token
-    parser->erroring_token = NULL;
+    memset(&parser->erroring_token, 0, sizeof(perf_token_t));
+
+    // Nothing to pull from or build yet.
+    parser->tokens              = NULL;
+    parser->stream              = NULL;
+    parser->position            = 0;
+    parser->ast                 = NULL;
+    parser->depth               = 0;
+    parser->scratch             = NULL;
+    parser->scratch_count       = 0;
+    parser->scratch_capacity    = 0;
+    parser->status              = PERF_RES_OK;
+    parser->status_error        = NULL;
+
+    // Set up the token that stands in once pulling fails
+    memset(&parser->eof_token, 0, sizeof(perf_token_t));
+    parser->eof_token.type  = TOKEN_EOF;
+
+    // Return ok
+    return PERF_RES_OK;
+}
+
+// Implementation for parser.h perf_parser_free
+perf_result_t perf_parser_free(perf_parser_t *parser)
+{
+    // Free the scratch stack
+    free(parser->scratch);
+    parser->scratch             = NULL;
+    parser->scratch_count       = 0;
+    parser->scratch_capacity    = 0;
 
     // Return ok
     return PERF_RES_OK;
 }
 
 /**
- * @brief Parse a primary expression.
+ * @brief Records the first lexer or allocation failure, and stops the parse at a stand-in EOF token.
  * 
  * @param parser The parser to use.
+ * @param status The result of the failed operation.
+ * @param error The error message of the failed operation.
+*/
+static void perf_parser_fail(perf_parser_t *parser, perf_result_t status, const char* error)
+{
+    // Keep the first failure, later ones are usually caused by it.
+    if (parser->status == PERF_RES_OK)
+    {
+        parser->status          = status;
+        parser->status_error    = error;
+    }
+
+    // Point the stand-in at where the lexer stopped.
+    parser->eof_token.line_number   = parser->lexer->line_number;
+    parser->eof_token.column_number = parser->lexer->column_number;
+
+    // Every rule stops at EOF.
+    parser->current_token = &parser->eof_token;
+    parser->current_type  = TOKEN_EOF;
+}
+
+/**
+ * @brief Gets the index of the current token in the AST, copying it in when pulling from the lexer or a stream.
  * 
- * @return PERF_PARSER_RESULT_T The result of the parse.
+ * @param parser The parser to use.
+ * 
+ * @return The index of the token, or PERF_AST_NONE if the parse has already failed.
 */
-perf_parser_result_t perf_parser_parse_primary_expression(perf_parser_t* parser)
+static uint32_t perf_parser_keep(perf_parser_t *parser)
+{
+    // The stand-in is never part of the AST.
+    if (parser->current_token == &parser->eof_token) return PERF_AST_NONE;
+
+    // Tokens in an array are referred to where they are.
+    if (parser->tokens != NULL) return (uint32_t)(parser->current_token - parser->tokens);
+
+    // Will store the index of the copy.
+    uint32_t    index = PERF_AST_NONE;
+    const char* error = NULL;
+
+    // Will store a token materialized from the stream.
+    perf_token_t    token;
+    perf_result_t   result = PERF_RES_OK;
+
+    // Materialize the token from the stream and copy it in, else copy it out of the lexer's lookahead buffer.
+    if (parser->stream != NULL)
+    {
+        result = perf_token_stream_get(parser->stream, parser->position, &token, &error);
+        if (result == PERF_RES_OK) result = perf_ast_add_token(parser->ast, &token, &index, &error);
+    }
+    else result = perf_ast_add_token(parser->ast, parser->current_token, &index, &error);
+
+    // Check if the copy failed.
+    if (result != PERF_RES_OK) perf_parser_fail(parser, result, error);
+
+    // Return the index of the copy
+    return index;
+}
+
+/**
+ * @brief Moves past the current token without keeping it.
+ * 
+ * @param parser The parser to use.
+*/
+static void perf_parser_skip(perf_parser_t *parser)
+{
+    // Never move past the end.
+    if (parser->current_type == TOKEN_EOF) return;
+
+    // Move through the stream, only its type array is touched.
+    if (parser->stream != NULL)
+    {
+        parser->current_type = parser->stream->types[++parser->position];
+        return;
+    }
+
+    // Move through the array
+    if (parser->tokens != NULL)
+    {
+        parser->current_type = (uint8_t)(++parser->current_token)->type;
+        return;
+    }
+
+    // Will store the dropped token, and any lexer error.
+    perf_token_t        dropped;
+    const perf_token_t* next = NULL;
+    const char*         error = NULL;
+
+    // Drop the current token from the lexer and look at the one after it.
+    perf_result_t result = perf_lexer_next(parser->lexer, &dropped, &error);
+    if (result == PERF_RES_OK) result = perf_lexer_peek(parser->lexer, 0, &next, &error);
+
+    // Check if the lexer failed.
+    if (result != PERF_RES_OK)
+    {
+        perf_parser_fail(parser, result, error);
+        return;
+    }
+
+    // The buffered token stays valid until it is dropped.
+    parser->current_token = (perf_token_t*)next;
+    parser->current_type  = (uint8_t)next->type;
+}
+
+/**
+ * @brief Moves past the current token, keeping it for the AST.
+ * 
+ * @param parser The parser to use.
+ * 
+ * @return The index of the token that was moved past.
+*/
+static uint32_t perf_parser_advance(perf_parser_t *parser)
+{
+    // Keep the token, then move past it.
+    uint32_t token = perf_parser_keep(parser);
+    perf_parser_skip(parser);
+
+    // Return the kept token
+    return token;
+}
+
+/**
+ * @brief Builds the error result for a parse error at the current token.
+ * 
+ * @param parser The parser to use.
+ * @param message The error message.
+ * 
+ * @return PERF_PARSER_RESULT_T The error result.
+*/
+static perf_parser_result_t perf_parser_error(perf_parser_t *parser, const char* message)
 {
     perf_parser_result_t result;
 
-	result.is_error = true;
-	result.node = malloc(sizeof(perf_parser_node_t));
-
-	if (parser->current_token->type == TOKEN_IDENTIFIER)
-	{
-		result.is_error = false;
-		result.node->node_type = AST_VARIABLE;
-		result.node->as.variable = parser->current_token++;
-	}
-	else if ((parser->current_token->type >= TOKEN_NUMBER && parser->current_token->type <= TOKEN_STRING)
-		|| parser->current_token->type == TOKEN_KEYWORD_TRUE || parser->current_token->type == TOKEN_KEYWORD_FALSE)
-	{
-		result.is_error = false;
-		result.node->node_type = AST_CONSTANT;
-		result.node->as.constant = parser->current_token++;
-	}
-	else if (parser->current_token->type == TOKEN_LEFT_PARENTHESES)
-	{
-		parser->current_token++;
-
-		if (parser->current_token->type == TOKEN_EOF)
-		{
-			if (result.node != NULL)
-			{
-				perf_parser_node_free(result.node);
-				free(result.node);
-			}
+    result.is_error = true;
+    result.error = message;
 
-			result.error = "expected identifier, number, integer or string literal";
+    // Only now is a stream token's line and column computed, a failure leaves it on line 0.
+    const char* error = NULL;
 
-			parser->erroring_token = parser->current_token;
+    if (parser->stream != NULL && parser->current_token == NULL) perf_token_stream_get(parser->stream, parser->position, &parser->erroring_token, &error);
+    else parser->erroring_token = *parser->current_token;
 
-			return result;
-		}
+    return result;
+}
 
-		perf_parser_result_t nested_expr = perf_parser_parse_expression(parser);
+/**
+ * @brief Appends a node to the AST, after its children.
+ * 
+ * @param parser The parser to use.
+ * @param node_type The type of the node.
+ * @param token The index of the node's token, or PERF_AST_NONE.
+ * @param lhs The index of the first child, or PERF_AST_NONE.
+ * @param rhs The index of the second child, or PERF_AST_NONE.
+ * 
+ * @return PERF_PARSER_RESULT_T The new node, or an error if it couldn't be allocated.
+*/
+static perf_parser_result_t perf_parser_new_node(perf_parser_t *parser, perf_e_parser_node_type_t node_type, uint32_t token, uint32_t lhs, uint32_t rhs)
+{
+    perf_parser_result_t result;
+    const char* error = NULL;
 
-		if (nested_expr.is_error)
-		{
-			if (result.node != NULL)
-			{
-				perf_parser_node_free(result.node);
-				free(result.node);
-			}
+    // Append the node
+    perf_result_t status = perf_ast_add_node(parser->ast, node_type, token, lhs, rhs, &result.node, &error);
 
-			return nested_expr;
-		}
+    // Check if the allocation failed, the failure takes priority over the parse error.
+    if (status != PERF_RES_OK)
+    {
+        perf_parser_fail(parser, status, error);
+        return perf_parser_error(parser, error);
+    }
 
-		if ((parser->current_token++)->type != TOKEN_RIGHT_PARENTHESES)
-		{
-			if (result.node != NULL)
-			{
-				perf_parser_node_free(result.node);
-				free(result.node);
-			}
+    result.is_error = false;
 
-			if (nested_expr.node != NULL)
-			{
-				perf_parser_node_free(nested_expr.node);
-				free(nested_expr.node);
-			}
+    return result;
+}
 
-			result.error = "expected closing parenthesis";
+/**
+ * Binding powers of the operators, from loosest to tightest. Left associative operators bind their
+ * right operand at their own power, right associative ones one below it.
+*/
+typedef enum _perf_e_parser_power_t
+{
+    PERF_POWER_NONE         = 0,    // Not an operator, ends the expression
+    PERF_POWER_ASSIGNMENT   = 2,    // =
+    PERF_POWER_EQUALITY     = 4,    // == !=
+    PERF_POWER_COMPARISON   = 6,    // < <= > >=
+    PERF_POWER_BITWISE_AND  = 8,    // &
+    PERF_POWER_TERM         = 10,   // + -
+    PERF_POWER_FACTOR       = 12,   // * / %
+    PERF_POWER_PREFIX       = 14,   // ! -
+    PERF_POWER_POSTFIX      = 16    // () .
+} perf_e_parser_power_t;
 
-			parser->erroring_token = (parser->current_token - 1);
+/**
+ * Describes what a token does at the start of an expression, and after one.
+*/
+typedef struct _perf_parser_rule_t
+{
+    bool    is_prefix;      // True if the token can start an expression
+    uint8_t prefix_type;    // Node built when it does
+    uint8_t prefix_power;   // Binding power of the operand of a prefix operator
 
-			return result;
-		}
+    uint8_t infix_type;     // Node built when the token follows an expression
+    uint8_t left_power;     // Binding power towards the expression on the left, PERF_POWER_NONE if not infix
+    uint8_t right_power;    // Binding power of the operand on the right
+} perf_parser_rule_t;
 
-		result.is_error = false;
-		result.node->node_type = AST_GROUP_EXPR;
-		result.node->as.group_expression = nested_expr.node;
-	}
-	else
-	{
-		if (result.node != NULL)
-		{
-			perf_parser_node_free(result.node);
-			free(result.node);
-		}
+/**
+ * Parse rules, indexed by token type. Tokens without an entry can't appear in an expression.
+*/
+static const perf_parser_rule_t perf_parser_rules[TOKEN_EOF + 1] =
+{
+    [TOKEN_IDENTIFIER]          = { true,  AST_VARIABLE,   PERF_POWER_NONE,   0,               PERF_POWER_NONE,        PERF_POWER_NONE },
+    [TOKEN_STRING]              = { true,  AST_CONSTANT,   PERF_POWER_NONE,   0,               PERF_POWER_NONE,        PERF_POWER_NONE },
+    [TOKEN_NUMBER]              = { true,  AST_CONSTANT,   PERF_POWER_NONE,   0,               PERF_POWER_NONE,        PERF_POWER_NONE },
+    [TOKEN_INTEGER]             = { true,  AST_CONSTANT,   PERF_POWER_NONE,   0,               PERF_POWER_NONE,        PERF_POWER_NONE },
+    [TOKEN_KEYWORD_TRUE]        = { true,  AST_CONSTANT,   PERF_POWER_NONE,   0,               PERF_POWER_NONE,        PERF_POWER_NONE },
+    [TOKEN_KEYWORD_FALSE]       = { true,  AST_CONSTANT,   PERF_POWER_NONE,   0,               PERF_POWER_NONE,        PERF_POWER_NONE },
+    [TOKEN_KEYWORD_THIS]        = { true,  AST_THIS_EXPR,  PERF_POWER_NONE,   0,               PERF_POWER_NONE,        PERF_POWER_NONE },
+    [TOKEN_EXCLAIM]             = { true,  AST_UNARY_EXPR, PERF_POWER_PREFIX, 0,               PERF_POWER_NONE,        PERF_POWER_NONE },
+    [TOKEN_MINUS]               = { true,  AST_UNARY_EXPR, PERF_POWER_PREFIX, AST_BINARY_EXPR, PERF_POWER_TERM,        PERF_POWER_TERM },
+    [TOKEN_LEFT_PARENTHESES]    = { true,  AST_GROUP_EXPR, PERF_POWER_NONE,   AST_CALL_EXPR,   PERF_POWER_POSTFIX,     PERF_POWER_NONE },
+    [TOKEN_PERIOD]              = { false, 0,              PERF_POWER_NONE,   AST_MEMBER_EXPR, PERF_POWER_POSTFIX,     PERF_POWER_NONE },
+    [TOKEN_PLUS]                = { false, 0,              PERF_POWER_NONE,   AST_BINARY_EXPR, PERF_POWER_TERM,        PERF_POWER_TERM },
+    [TOKEN_ASTERISK]            = { false, 0,              PERF_POWER_NONE,   AST_BINARY_EXPR, PERF_POWER_FACTOR,      PERF_POWER_FACTOR },
+    [TOKEN_SLASH]               = { false, 0,              PERF_POWER_NONE,   AST_BINARY_EXPR, PERF_POWER_FACTOR,      PERF_POWER_FACTOR },
+    [TOKEN_PERCENT]             = { false, 0,              PERF_POWER_NONE,   AST_BINARY_EXPR, PERF_POWER_FACTOR,      PERF_POWER_FACTOR },
+    [TOKEN_AMPERSAND]           = { false, 0,              PERF_POWER_NONE,   AST_BINARY_EXPR, PERF_POWER_BITWISE_AND, PERF_POWER_BITWISE_AND },
+    [TOKEN_GREATER]             = { false, 0,              PERF_POWER_NONE,   AST_BINARY_EXPR, PERF_POWER_COMPARISON,  PERF_POWER_COMPARISON },
+    [TOKEN_GREATER_EQUAL]       = { false, 0,              PERF_POWER_NONE,   AST_BINARY_EXPR, PERF_POWER_COMPARISON,  PERF_POWER_COMPARISON },
+    [TOKEN_LESS]                = { false, 0,              PERF_POWER_NONE,   AST_BINARY_EXPR, PERF_POWER_COMPARISON,  PERF_POWER_COMPARISON },
+    [TOKEN_LESS_EQUAL]          = { false, 0,              PERF_POWER_NONE,   AST_BINARY_EXPR, PERF_POWER_COMPARISON,  PERF_POWER_COMPARISON },
+    [TOKEN_EQUAL_EQUAL]         = { false, 0,              PERF_POWER_NONE,   AST_BINARY_EXPR, PERF_POWER_EQUALITY,    PERF_POWER_EQUALITY },
+    [TOKEN_EXCLAIM_EQUAL]       = { false, 0,              PERF_POWER_NONE,   AST_BINARY_EXPR, PERF_POWER_EQUALITY,    PERF_POWER_EQUALITY },
+    [TOKEN_EQUAL]               = { false, 0,              PERF_POWER_NONE,   AST_ASSIGN_EXPR, PERF_POWER_ASSIGNMENT,  PERF_POWER_ASSIGNMENT - 1 },
+};
+
+/**
+ * @brief Pushes a node onto the parser's scratch stack.
+ * 
+ * @param parser The parser to use.
+ * @param node The index of the node.
+ * 
+ * @return PERF_RES_OK if the node was pushed successfully.
+*/
+static perf_result_t perf_parser_push_scratch(perf_parser_t *parser, uint32_t node)
+{
+    // Make room for the node
+    if (parser->scratch_count == parser->scratch_capacity)
+    {
+        // Adjust the capacity of the stack.
+        uint32_t capacity = parser->scratch_capacity < 64 ? 64 : parser->scratch_capacity * 2;
+
+        // Resize the stack
+        uint32_t* resized = (uint32_t*)realloc(parser->scratch, (size_t)capacity * sizeof(uint32_t));
+
+        // Check if the stack was resized successfully.
+        if (resized == NULL)
+        {
+            perf_parser_fail(parser, PERF_RES_MEMORY_ALLOC_FAIL, "Failed to allocate memory for AST node");
+            return PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+
+        // Use the resized stack
+        parser->scratch             = resized;
+        parser->scratch_capacity    = capacity;
+    }
+
+    // Push the node
+    parser->scratch[parser->scratch_count++] = node;
+
+    // Return ok
+    return PERF_RES_OK;
+}
+
+/**
+ * @brief Moves the nodes pushed since base from the scratch stack into a list in the AST.
+ * 
+ * @param parser The parser to use.
+ * @param base The scratch stack count before the first node of the list was pushed.
+ * 
+ * @return The index of the list, or PERF_AST_NONE if it couldn't be allocated.
+*/
+static uint32_t perf_parser_pop_list(perf_parser_t *parser, uint32_t base)
+{
+    // Will store the index of the list.
+    uint32_t    index = PERF_AST_NONE;
+    const char* error = NULL;
+
+    // Copy the nodes into the AST
+    perf_result_t result = perf_ast_add_list(parser->ast, parser->scratch + base, parser->scratch_count - base, &index, &error);
 
-		result.error = "unexpected token";
+    // Check if the copy failed.
+    if (result != PERF_RES_OK) perf_parser_fail(parser, result, error);
 
-		parser->erroring_token = parser->current_token;
-	}
+    // Pop the nodes
+    parser->scratch_count = base;
 
-	return result;
+    // Return the index of the list
+    return index;
 }
 
 /**
- * @brief Parse a unary expression.
+ * @brief Leaves a level of expression nesting.
  * 
  * @param parser The parser to use.
+ * @param result The result of the level.
+ * 
+ * @return PERF_PARSER_RESULT_T The result of the level.
+*/
+static inline perf_parser_result_t perf_parser_leave(perf_parser_t *parser, perf_parser_result_t result)
+{
+    parser->depth--;
+
+    return result;
+}
+
+/**
+ * @brief Parse an expression whose operators bind tighter than min_power.
+ * 
+ * @param parser The parser to use.
+ * @param min_power Operators binding this loosely or looser end the expression.
  * 
  * @return PERF_PARSER_RESULT_T The result of the parse.
 */
-perf_parser_result_t perf_parser_parse_unary_expression(perf_parser_t* parser)
+perf_parser_result_t perf_parser_parse_precedence(perf_parser_t *parser, uint8_t min_power)
 {
-    if (parser->current_token->type == TOKEN_EXCLAIM || parser->current_token->type == TOKEN_MINUS)
-	{
-		perf_parser_result_t result;
+    perf_parser_result_t lhs;
 
-		result.is_error = false;
-		result.node = malloc(sizeof(perf_parser_node_t));
+    // Refuse input nested deep enough to overflow the stack.
+    if (++parser->depth > PERF_PARSER_MAX_DEPTH)
+        return perf_parser_leave(parser, perf_parser_error(parser, "expression nested too deeply"));
 
-		result.node->node_type = AST_UNARY_EXPR;
-		result.node->as.unary_expr.op_token = parser->current_token++;
+    // Look up what the first token does.
+    const perf_parser_rule_t* rule = &perf_parser_rules[parser->current_type];
 
-		perf_parser_result_t nested_expr = perf_parser_parse_unary_expression(parser);
+    if (!rule->is_prefix)
+        return perf_parser_leave(parser, perf_parser_error(parser, "unexpected token"));
 
-		if (nested_expr.is_error)
-		{
-			if (result.node != NULL)
-			{
-				perf_parser_node_free(result.node);
-				free(result.node);
-			}
+    switch (rule->prefix_type)
+    {
+    case AST_VARIABLE:
+    case AST_CONSTANT:
+    case AST_THIS_EXPR:
+    {
+        uint32_t token = perf_parser_advance(parser);
 
-			return nested_expr;
-		}
+        lhs = perf_parser_new_node(parser, (perf_e_parser_node_type_t)rule->prefix_type, token, PERF_AST_NONE, PERF_AST_NONE);
+        break;
+    }
+    case AST_UNARY_EXPR:
+    {
+        uint32_t op_token = perf_parser_advance(parser);
+
+        perf_parser_result_t operand = perf_parser_parse_precedence(parser, rule->prefix_power);
+
+        if (operand.is_error)
+            return perf_parser_leave(parser, operand);
+
+        lhs = perf_parser_new_node(parser, AST_UNARY_EXPR, op_token, operand.node, PERF_AST_NONE);
+        break;
+    }
+    default:
+    {
+        perf_parser_skip(parser);
 
-		result.node->as.unary_expr.operand = nested_expr.node;
+        if (parser->current_type == TOKEN_EOF)
+            return perf_parser_leave(parser, perf_parser_error(parser, "expected identifier, number, integer or string literal"));
 
-		return result;
-	}
+        perf_parser_result_t nested_expr = perf_parser_parse_precedence(parser, PERF_POWER_NONE);
 
-	return perf_parser_parse_primary_expression(parser);
+        if (nested_expr.is_error)
+            return perf_parser_leave(parser, nested_expr);
+
+        if (parser->current_type != TOKEN_RIGHT_PARENTHESES)
+            return perf_parser_leave(parser, perf_parser_error(parser, "expected closing parenthesis"));
+
+        perf_parser_skip(parser);
+
+        lhs = perf_parser_new_node(parser, AST_GROUP_EXPR, PERF_AST_NONE, nested_expr.node, PERF_AST_NONE);
+        break;
+    }
+    }
+
+    // Fold in operators for as long as they bind tighter than our caller's.
+    for (;;)
+    {
+        if (lhs.is_error)
+            return perf_parser_leave(parser, lhs);
+
+        rule = &perf_parser_rules[parser->current_type];
+
+        if (rule->left_power <= min_power)
+            break;
+
+        switch (rule->infix_type)
+        {
+        case AST_MEMBER_EXPR:
+        {
+            perf_parser_skip(parser);
+
+            if (parser->current_type != TOKEN_IDENTIFIER)
+                return perf_parser_leave(parser, perf_parser_error(parser, "expected member name"));
+
+            uint32_t name_token = perf_parser_advance(parser);
+
+            lhs = perf_parser_new_node(parser, AST_MEMBER_EXPR, name_token, lhs.node, PERF_AST_NONE);
+            break;
+        }
+        case AST_CALL_EXPR:
+        {
+            uint32_t paren_token = perf_parser_advance(parser);
+            uint32_t base = parser->scratch_count;
+
+            // Collect the arguments on the scratch stack, nested calls push and pop above them.
+            while (parser->current_type != TOKEN_RIGHT_PARENTHESES)
+            {
+                perf_parser_result_t argument = perf_parser_parse_precedence(parser, PERF_POWER_NONE);
+
+                if (argument.is_error)
+                    return perf_parser_leave(parser, argument);
+
+                if (perf_parser_push_scratch(parser, argument.node) != PERF_RES_OK)
+                    return perf_parser_leave(parser, perf_parser_error(parser, parser->status_error));
+
+                if (parser->current_type != TOKEN_COMMA)
+                    break;
+
+                perf_parser_skip(parser);
+            }
+
+            if (parser->current_type != TOKEN_RIGHT_PARENTHESES)
+                return perf_parser_leave(parser, perf_parser_error(parser, "expected closing parenthesis"));
+
+            perf_parser_skip(parser);
+
+            uint32_t arguments = perf_parser_pop_list(parser, base);
+
+            lhs = perf_parser_new_node(parser, AST_CALL_EXPR, paren_token, lhs.node, arguments);
+            break;
+        }
+        default:
+        {
+            // Only variables and members can be assigned to.
+            if (rule->infix_type == AST_ASSIGN_EXPR)
+            {
+                uint8_t target_type = parser->ast->nodes[lhs.node].node_type;
+
+                if (target_type != AST_VARIABLE && target_type != AST_MEMBER_EXPR)
+                    return perf_parser_leave(parser, perf_parser_error(parser, "invalid assignment target"));
+            }
+
+            uint8_t  infix_type = rule->infix_type;
+            uint32_t op_token   = perf_parser_advance(parser);
+
+            perf_parser_result_t rhs = perf_parser_parse_precedence(parser, rule->right_power);
+
+            if (rhs.is_error)
+                return perf_parser_leave(parser, rhs);
+
+            lhs = perf_parser_new_node(parser, (perf_e_parser_node_type_t)infix_type, op_token, lhs.node, rhs.node);
+            break;
+        }
+        }
+    }
+
+    return perf_parser_leave(parser, lhs);
 }
 
 /**
- * @brief Parse a multiplication expression.
+ * @brief Parse an expression.
  * 
  * @param parser The parser to use.
  * 
  * @return PERF_PARSER_RESULT_T The result of the parse.
 */
-perf_parser_result_t perf_parser_parse_multiplication_expression(perf_parser_t* parser)
+perf_parser_result_t perf_parser_parse_expression(perf_parser_t *parser)
 {
-    perf_parser_result_t nested_lhs_expr = perf_parser_parse_unary_expression(parser);
+    return perf_parser_parse_precedence(parser, PERF_POWER_NONE);
+}
 
-	if (nested_lhs_expr.is_error)
-		return nested_lhs_expr;
+/**
+ * @brief Moves past the current token if it is of the given type.
+ * 
+ * @param parser The parser to use.
+ * @param type The type of token to accept.
+ * 
+ * @return True if the token was there and has been moved past.
+*/
+static bool perf_parser_accept(perf_parser_t *parser, perf_e_token_type_t type)
+{
+    if (parser->current_type != type)
+        return false;
 
-	while (parser->current_token->type == TOKEN_ASTERISK || parser->current_token->type == TOKEN_SLASH)
-	{
-		perf_parser_result_t result;
+    perf_parser_skip(parser);
 
-		result.is_error = false;
-		result.node = malloc(sizeof(perf_parser_node_t));
+    return true;
+}
 
-		result.node->node_type = AST_BINARY_EXPR;
-		result.node->as.binary_expr.op_token = parser->current_token++;
+/**
+ * @brief Parse a parenthesized condition, as used by if, while and do.
+ * 
+ * @param parser The parser to use.
+ * 
+ * @return PERF_PARSER_RESULT_T The result of the parse.
+*/
+static perf_parser_result_t perf_parser_parse_condition(perf_parser_t *parser)
+{
+    if (!perf_parser_accept(parser, TOKEN_LEFT_PARENTHESES))
+        return perf_parser_error(parser, "expected '(' before condition");
 
-		perf_parser_result_t nested_rhs_expr = perf_parser_parse_unary_expression(parser);
+    perf_parser_result_t condition = perf_parser_parse_expression(parser);
 
-		if (nested_rhs_expr.is_error)
-		{
-			if (result.node != NULL)
-			{
-				perf_parser_node_free(result.node);
-				free(result.node);
-			}
-
-			if (nested_lhs_expr.node != NULL)
-			{
-				perf_parser_node_free(nested_lhs_expr.node);
-				free(nested_lhs_expr.node);
-			}
-
-			return nested_rhs_expr;
-		}
+    if (condition.is_error)
+        return condition;
 
-		result.node->as.binary_expr.left = nested_lhs_expr.node;
-		result.node->as.binary_expr.right = nested_rhs_expr.node;
+    if (!perf_parser_accept(parser, TOKEN_RIGHT_PARENTHESES))
+        return perf_parser_error(parser, "expected closing parenthesis");
 
-		nested_lhs_expr = result;
-	}
+    return condition;
+}
 
-	return nested_lhs_expr;
+/**
+ * @brief Parse a let, var or const declaration, without its terminating semicolon.
+ * 
+ * @param parser The parser to use.
+ * 
+ * @return PERF_PARSER_RESULT_T The result of the parse.
+*/
+perf_parser_result_t perf_parser_parse_declaration(perf_parser_t *parser)
+{
+    // Remember which keyword introduced the declaration.
+    perf_e_token_type_t keyword = (perf_e_token_type_t)parser->current_type;
+    perf_parser_skip(parser);
+
+    if (parser->current_type != TOKEN_IDENTIFIER)
+        return perf_parser_error(parser, "expected variable name");
+
+    uint32_t name_token = perf_parser_advance(parser);
+    uint32_t value      = PERF_AST_NONE;
+
+    // Parse the value, if any.
+    if (perf_parser_accept(parser, TOKEN_EQUAL))
+    {
+        perf_parser_result_t value_expr = perf_parser_parse_expression(parser);
+
+        if (value_expr.is_error)
+            return value_expr;
+
+        value = value_expr.node;
+    }
+
+    // Constants can't be assigned later, so they need a value now.
+    else if (keyword == TOKEN_KEYWORD_CONST)
+        return perf_parser_error(parser, "expected '=' after constant name");
+
+    perf_parser_result_t result = perf_parser_new_node(parser, AST_VAR_DECL, name_token, value, PERF_AST_NONE);
+
+    if (!result.is_error)
+        parser->ast->nodes[result.node].flags = (uint8_t)keyword;
+
+    return result;
 }
 
 /**
- * @brief Parse an addition expression.
+ * @brief Parse a block of statements between braces.
  * 
  * @param parser The parser to use.
  * 
  * @return PERF_PARSER_RESULT_T The result of the parse.
 */
-perf_parser_result_t perf_parser_parse_addition_expression(perf_parser_t* parser)
+perf_parser_result_t perf_parser_parse_block(perf_parser_t *parser)
 {
-    perf_parser_result_t nested_lhs_expr = perf_parser_parse_multiplication_expression(parser);
+    if (!perf_parser_accept(parser, TOKEN_LEFT_BRACE))
+        return perf_parser_error(parser, "expected '{'");
 
-	if (nested_lhs_expr.is_error)
-		return nested_lhs_expr;
+    // Collect the statements on the scratch stack, nested blocks push and pop above them.
+    uint32_t base = parser->scratch_count;
 
-	while (parser->current_token->type == TOKEN_PLUS || parser->current_token->type == TOKEN_MINUS)
-	{
-		perf_parser_result_t result;
+    for (;;)
+    {
+        // Skip empty statements
+        while (perf_parser_accept(parser, TOKEN_SEMICOLON));
 
-		result.is_error = false;
-		result.node = malloc(sizeof(perf_parser_node_t));
+        if (parser->current_type == TOKEN_RIGHT_BRACE || parser->current_type == TOKEN_EOF)
+            break;
 
-		result.node->node_type = AST_BINARY_EXPR;
-		result.node->as.binary_expr.op_token = parser->current_token++;
+        perf_parser_result_t statement = perf_parser_parse_generic_statement(parser);
 
-		perf_parser_result_t nested_rhs_expr = perf_parser_parse_multiplication_expression(parser);
+        if (statement.is_error)
+            return statement;
 
-		if (nested_rhs_expr.is_error)
-		{
-			if (result.node != NULL)
-			{
-				perf_parser_node_free(result.node);
-				free(result.node);
-			}
-
-			if (nested_lhs_expr.node != NULL)
-			{
-				perf_parser_node_free(nested_lhs_expr.node);
-				free(nested_lhs_expr.node);
-			}
-
-			return nested_rhs_expr;
-		}
+        if (perf_parser_push_scratch(parser, statement.node) != PERF_RES_OK)
+            return perf_parser_error(parser, parser->status_error);
+    }
 
-		result.node->as.binary_expr.left = nested_lhs_expr.node;
-		result.node->as.binary_expr.right = nested_rhs_expr.node;
+    if (!perf_parser_accept(parser, TOKEN_RIGHT_BRACE))
+        return perf_parser_error(parser, "expected '}'");
 
-		nested_lhs_expr = result;
-	}
+    uint32_t statements = perf_parser_pop_list(parser, base);
 
-	return nested_lhs_expr;
+    return perf_parser_new_node(parser, AST_BLOCK, PERF_AST_NONE, statements, PERF_AST_NONE);
 }
 
 /**
- * @brief Parse a comparison expression.
+ * @brief Parse a function definition.
  * 
  * @param parser The parser to use.
  * 
  * @return PERF_PARSER_RESULT_T The result of the parse.
 */
-perf_parser_result_t perf_parser_parse_comparison_expression(perf_parser_t *parser)
+perf_parser_result_t perf_parser_parse_function_definition(perf_parser_t *parser)
 {
-    perf_parser_result_t nested_lhs_expr = perf_parser_parse_addition_expression(parser);
+    // Skip the func keyword
+    perf_parser_skip(parser);
 
-	if (nested_lhs_expr.is_error)
-		return nested_lhs_expr;
+    if (parser->current_type != TOKEN_IDENTIFIER)
+        return perf_parser_error(parser, "expected function name");
 
-	while (parser->current_token->type == TOKEN_GREATER || parser->current_token->type == TOKEN_GREATER_EQUAL
-		|| parser->current_token->type == TOKEN_LESS || parser->current_token->type == TOKEN_LESS_EQUAL)
-	{
-		perf_parser_result_t result;
+    uint32_t name_token = perf_parser_advance(parser);
 
-		result.is_error = false;
-		result.node = malloc(sizeof(perf_parser_node_t));
+    if (!perf_parser_accept(parser, TOKEN_LEFT_PARENTHESES))
+        return perf_parser_error(parser, "expected '(' after function name");
 
-		result.node->node_type = AST_BINARY_EXPR;
-		result.node->as.binary_expr.op_token = parser->current_token++;
+    // Collect the parameters on the scratch stack.
+    uint32_t base = parser->scratch_count;
 
-		perf_parser_result_t nested_rhs_expr = perf_parser_parse_addition_expression(parser);
+    while (parser->current_type != TOKEN_RIGHT_PARENTHESES)
+    {
+        if (parser->current_type != TOKEN_IDENTIFIER)
+            return perf_parser_error(parser, "expected parameter name");
 
-		if (nested_rhs_expr.is_error)
-		{
-			if (result.node != NULL)
-			{
-				perf_parser_node_free(result.node);
-				free(result.node);
-			}
-
-			if (nested_lhs_expr.node != NULL)
-			{
-				perf_parser_node_free(nested_lhs_expr.node);
-				free(nested_lhs_expr.node);
-			}
-
-			return nested_rhs_expr;
-		}
+        uint32_t param_token = perf_parser_advance(parser);
+
+        perf_parser_result_t param = perf_parser_new_node(parser, AST_PARAM, param_token, PERF_AST_NONE, PERF_AST_NONE);
+
+        if (param.is_error)
+            return param;
+
+        if (perf_parser_push_scratch(parser, param.node) != PERF_RES_OK)
+            return perf_parser_error(parser, parser->status_error);
+
+        if (!perf_parser_accept(parser, TOKEN_COMMA))
+            break;
+    }
+
+    if (!perf_parser_accept(parser, TOKEN_RIGHT_PARENTHESES))
+        return perf_parser_error(parser, "expected closing parenthesis");
 
-		result.node->as.binary_expr.left = nested_lhs_expr.node;
-		result.node->as.binary_expr.right = nested_rhs_expr.node;
+    uint32_t params = perf_parser_pop_list(parser, base);
 
-		nested_lhs_expr = result;
-	}
+    // Parse the body
+    perf_parser_result_t body = perf_parser_parse_block(parser);
 
-	return nested_lhs_expr;
+    if (body.is_error)
+        return body;
+
+    return perf_parser_new_node(parser, AST_EXPR_FUNCTION_DEF, name_token, params, body.node);
 }
 
 /**
- * @brief Parse an equality expression.
+ * @brief Parse a class definition, a name and a brace enclosed list of methods.
  * 
  * @param parser The parser to use.
  * 
  * @return PERF_PARSER_RESULT_T The result of the parse.
 */
-perf_parser_result_t perf_parser_parse_equality_expression(perf_parser_t *parser)
+perf_parser_result_t perf_parser_parse_class_definition(perf_parser_t *parser)
 {
-    // Parse as a comparison expression
-    perf_parser_result_t nested_lhs_expr = perf_parser_parse_comparison_expression(parser);
+    // Skip the class keyword
+    perf_parser_skip(parser);
 
-	if (nested_lhs_expr.is_error)
-		return nested_lhs_expr;
+    if (parser->current_type != TOKEN_IDENTIFIER)
+        return perf_parser_error(parser, "expected class name");
 
-	while (parser->current_token->type == TOKEN_EXCLAIM_EQUAL || parser->current_token->type == TOKEN_EQUAL_EQUAL)
-	{
-		perf_parser_result_t result;
+    uint32_t name_token = perf_parser_advance(parser);
 
-		result.is_error = false;
-		result.node = malloc(sizeof(perf_parser_node_t));
+    if (!perf_parser_accept(parser, TOKEN_LEFT_BRACE))
+        return perf_parser_error(parser, "expected '{' after class name");
 
-		result.node->node_type = AST_BINARY_EXPR;
-		result.node->as.binary_expr.op_token = parser->current_token++;
+    // Collect the methods on the scratch stack.
+    uint32_t base = parser->scratch_count;
 
-		perf_parser_result_t nested_rhs_expr = perf_parser_parse_comparison_expression(parser);
+    while (parser->current_type != TOKEN_RIGHT_BRACE && parser->current_type != TOKEN_EOF)
+    {
+        if (parser->current_type != TOKEN_KEYWORD_FUNC)
+            return perf_parser_error(parser, "expected method definition");
 
-		if (nested_rhs_expr.is_error)
-		{
-			if (result.node != NULL)
-			{
-				perf_parser_node_free(result.node);
-				free(result.node);
-			}
-
-			if (nested_lhs_expr.node != NULL)
-			{
-				perf_parser_node_free(nested_lhs_expr.node);
-				free(nested_lhs_expr.node);
-			}
-
-			return nested_rhs_expr;
-		}
+        perf_parser_result_t method = perf_parser_parse_function_definition(parser);
+
+        if (method.is_error)
+            return method;
+
+        if (perf_parser_push_scratch(parser, method.node) != PERF_RES_OK)
+            return perf_parser_error(parser, parser->status_error);
+    }
 
-		result.node->as.binary_expr.left = nested_lhs_expr.node;
-		result.node->as.binary_expr.right = nested_rhs_expr.node;
+    if (!perf_parser_accept(parser, TOKEN_RIGHT_BRACE))
+        return perf_parser_error(parser, "expected '}'");
 
-		nested_lhs_expr = result;
-	}
+    uint32_t methods = perf_parser_pop_list(parser, base);
 
-	return nested_lhs_expr;
+    return perf_parser_new_node(parser, AST_CLASS_DEF, name_token, methods, PERF_AST_NONE);
 }
 
 /**
- * @brief Parse an expression.
+ * @brief Parse an if statement, with its else branch if there is one.
  * 
  * @param parser The parser to use.
  * 
  * @return PERF_PARSER_RESULT_T The result of the parse.
 */
-perf_parser_result_t perf_parser_parse_expression(perf_parser_t *parser)
+perf_parser_result_t perf_parser_parse_if_statement(perf_parser_t *parser)
+{
+    // Skip the if keyword
+    perf_parser_skip(parser);
+
+    perf_parser_result_t condition = perf_parser_parse_condition(parser);
+
+    if (condition.is_error)
+        return condition;
+
+    // Collect the branches on the scratch stack.
+    uint32_t base = parser->scratch_count;
+
+    perf_parser_result_t then_branch = perf_parser_parse_generic_statement(parser);
+
+    if (then_branch.is_error)
+        return then_branch;
+
+    if (perf_parser_push_scratch(parser, then_branch.node) != PERF_RES_OK)
+        return perf_parser_error(parser, parser->status_error);
+
+    if (perf_parser_accept(parser, TOKEN_KEYWORD_ELSE))
+    {
+        perf_parser_result_t else_branch = perf_parser_parse_generic_statement(parser);
+
+        if (else_branch.is_error)
+            return else_branch;
+
+        if (perf_parser_push_scratch(parser, else_branch.node) != PERF_RES_OK)
+            return perf_parser_error(parser, parser->status_error);
+    }
+
+    uint32_t branches = perf_parser_pop_list(parser, base);
+
+    return perf_parser_new_node(parser, AST_IF_STMT, PERF_AST_NONE, condition.node, branches);
+}
+
+/**
+ * @brief Parse a while loop.
+ * 
+ * @param parser The parser to use.
+ * 
+ * @return PERF_PARSER_RESULT_T The result of the parse.
+*/
+perf_parser_result_t perf_parser_parse_while_statement(perf_parser_t *parser)
 {
-    return perf_parser_parse_equality_expression(parser);
+    // Skip the while keyword
+    perf_parser_skip(parser);
+
+    perf_parser_result_t condition = perf_parser_parse_condition(parser);
+
+    if (condition.is_error)
+        return condition;
+
+    perf_parser_result_t body = perf_parser_parse_generic_statement(parser);
+
+    if (body.is_error)
+        return body;
+
+    return perf_parser_new_node(parser, AST_WHILE_STMT, PERF_AST_NONE, condition.node, body.node);
 }
 
 /**
- * @brief Parse a function definition.
+ * @brief Parse a do while loop.
  * 
  * @param parser The parser to use.
  * 
  * @return PERF_PARSER_RESULT_T The result of the parse.
 */
-perf_parser_result_t perf_parser_parse_function_definition(perf_parser_t *parser)
+perf_parser_result_t perf_parser_parse_do_statement(perf_parser_t *parser)
 {
-    perf_parser_result_t result;
-    result.is_error = true;
-    result.error = "Not yet implemented";
-    return result;
+    // Skip the do keyword
+    perf_parser_skip(parser);
+
+    perf_parser_result_t body = perf_parser_parse_generic_statement(parser);
+
+    if (body.is_error)
+        return body;
+
+    if (!perf_parser_accept(parser, TOKEN_KEYWORD_WHILE))
+        return perf_parser_error(parser, "expected 'while' after do body");
+
+    perf_parser_result_t condition = perf_parser_parse_condition(parser);
+
+    if (condition.is_error)
+        return condition;
+
+    // Skip the terminating semicolon, if any.
+    perf_parser_accept(parser, TOKEN_SEMICOLON);
+
+    return perf_parser_new_node(parser, AST_DO_WHILE_STMT, PERF_AST_NONE, body.node, condition.node);
 }
 
 /**
- * @brief Parse generic statement
+ * @brief Parse a for loop. The init, condition and step are all optional.
  * 
  * @param parser The parser to use.
  * 
  * @return PERF_PARSER_RESULT_T The result of the parse.
- */
-perf_parser_result_t perf_parser_parse_generic_statement(perf_parser_t *parser)
+*/
+perf_parser_result_t perf_parser_parse_for_statement(perf_parser_t *parser)
 {
-    // Check for a function definition
-    if (parser->current_token->type == TOKEN_KEYWORD_FUNC)
+    // Skip the for keyword
+    perf_parser_skip(parser);
+
+    if (!perf_parser_accept(parser, TOKEN_LEFT_PARENTHESES))
+        return perf_parser_error(parser, "expected '(' after for");
+
+    // Will store the init, condition, step and body.
+    uint32_t parts[4] = { PERF_AST_NONE, PERF_AST_NONE, PERF_AST_NONE, PERF_AST_NONE };
+
+    // Parse the init, a declaration or an expression.
+    if (parser->current_type != TOKEN_SEMICOLON)
     {
-        // Parse a function definition
-        return perf_parser_parse_function_definition(parser);
+        perf_e_token_type_t type = (perf_e_token_type_t)parser->current_type;
+
+        perf_parser_result_t init = (type == TOKEN_KEYWORD_LET || type == TOKEN_KEYWORD_VAR || type == TOKEN_KEYWORD_CONST)
+            ? perf_parser_parse_declaration(parser) : perf_parser_parse_expression(parser);
+
+        if (init.is_error)
+            return init;
+
+        parts[0] = init.node;
     }
 
-    // Otherwise, handle anything else.
-    else
+    if (!perf_parser_accept(parser, TOKEN_SEMICOLON))
+        return perf_parser_error(parser, "expected ';' after loop initializer");
+
+    // Parse the condition
+    if (parser->current_type != TOKEN_SEMICOLON)
     {
-        // Parse expression
-        perf_parser_result_t expression = perf_parser_parse_expression(parser);
+        perf_parser_result_t condition = perf_parser_parse_expression(parser);
+
+        if (condition.is_error)
+            return condition;
+
+        parts[1] = condition.node;
+    }
+
+    if (!perf_parser_accept(parser, TOKEN_SEMICOLON))
+        return perf_parser_error(parser, "expected ';' after loop condition");
+
+    // Parse the step
+    if (parser->current_type != TOKEN_RIGHT_PARENTHESES)
+    {
+        perf_parser_result_t step = perf_parser_parse_expression(parser);
 
+        if (step.is_error)
+            return step;
+
+        parts[2] = step.node;
+    }
+
+    if (!perf_parser_accept(parser, TOKEN_RIGHT_PARENTHESES))
+        return perf_parser_error(parser, "expected closing parenthesis");
+
+    // Parse the body
+    perf_parser_result_t body = perf_parser_parse_generic_statement(parser);
+
+    if (body.is_error)
+        return body;
+
+    parts[3] = body.node;
+
+    // Store the parts as a list
+    uint32_t    list  = PERF_AST_NONE;
+    const char* error = NULL;
+    perf_result_t status = perf_ast_add_list(parser->ast, parts, 4, &list, &error);
+
+    if (status != PERF_RES_OK)
+    {
+        perf_parser_fail(parser, status, error);
+        return perf_parser_error(parser, error);
     }
+
+    return perf_parser_new_node(parser, AST_FOR_STMT, PERF_AST_NONE, list, PERF_AST_NONE);
 }
 
+/**
+ * @brief Parse a return, break or continue statement.
+ * 
+ * @param parser The parser to use.
+ * 
+ * @return PERF_PARSER_RESULT_T The result of the parse.
+*/
+perf_parser_result_t perf_parser_parse_jump_statement(perf_parser_t *parser)
+{
+    perf_e_token_type_t keyword = (perf_e_token_type_t)parser->current_type;
 
+    // Keep the keyword, so later passes can point at it.
+    uint32_t keyword_token = perf_parser_advance(parser);
+    uint32_t value         = PERF_AST_NONE;
 
-// Implementation for parser.h perf_parser_parse
-perf_result_t perf_parser_digest(perf_parser_t *parser, perf_token_t *tokens, int32_t token_count, perf_parser_node_t **ast, int32_t *ast_count, const char** error)
+    // Parse the returned value, if any.
+    if (keyword == TOKEN_KEYWORD_RETURN && parser->current_type != TOKEN_SEMICOLON
+        && parser->current_type != TOKEN_RIGHT_BRACE && parser->current_type != TOKEN_EOF)
+    {
+        perf_parser_result_t value_expr = perf_parser_parse_expression(parser);
+
+        if (value_expr.is_error)
+            return value_expr;
+
+        value = value_expr.node;
+    }
+
+    // Skip the terminating semicolon, if any.
+    perf_parser_accept(parser, TOKEN_SEMICOLON);
+
+    perf_e_parser_node_type_t node_type = keyword == TOKEN_KEYWORD_RETURN ? AST_RETURN_STMT
+        : keyword == TOKEN_KEYWORD_BREAK ? AST_BREAK_STMT : AST_CONTINUE_STMT;
+
+    return perf_parser_new_node(parser, node_type, keyword_token, value, PERF_AST_NONE);
+}
+
+/**
+ * @brief Parse a single statement.
+ * 
+ * @param parser The parser to use.
+ * 
+ * @return PERF_PARSER_RESULT_T The result of the parse.
+*/
+static perf_parser_result_t perf_parser_parse_statement(perf_parser_t *parser)
 {
+    switch (parser->current_type)
+    {
+    case TOKEN_KEYWORD_FUNC:        return perf_parser_parse_function_definition(parser);
+    case TOKEN_KEYWORD_CLASS:       return perf_parser_parse_class_definition(parser);
+    case TOKEN_LEFT_BRACE:          return perf_parser_parse_block(parser);
+    case TOKEN_KEYWORD_IF:          return perf_parser_parse_if_statement(parser);
+    case TOKEN_KEYWORD_WHILE:       return perf_parser_parse_while_statement(parser);
+    case TOKEN_KEYWORD_DO:          return perf_parser_parse_do_statement(parser);
+    case TOKEN_KEYWORD_FOR:         return perf_parser_parse_for_statement(parser);
+    case TOKEN_KEYWORD_RETURN:
+    case TOKEN_KEYWORD_BREAK:
+    case TOKEN_KEYWORD_CONTINUE:    return perf_parser_parse_jump_statement(parser);
+
+    // An empty statement, e.g. the body of "while (x);", is an empty block.
+    case TOKEN_SEMICOLON:
+    {
+        perf_parser_skip(parser);
 
-    // Used to keep track of how many nodes we have, and the maximum number of nodes we can have
-    int32_t node_count = 0;
-    int32_t max_node_count = 1;
+        uint32_t    list  = PERF_AST_NONE;
+        const char* error = NULL;
+        perf_result_t status = perf_ast_add_list(parser->ast, NULL, 0, &list, &error);
 
-    // Will store the AST nodes.
-    perf_parser_node_t* nodes = NULL;
+        if (status != PERF_RES_OK)
+        {
+            perf_parser_fail(parser, status, error);
+            return perf_parser_error(parser, error);
+        }
 
-    // Allocate the ast nodes buffer
-    perf_result_t result = reallocate_ast_nodes_buffer(&nodes, &max_node_count);
+        return perf_parser_new_node(parser, AST_BLOCK, PERF_AST_NONE, list, PERF_AST_NONE);
+    }
 
-    // Check if the AST nodes buffer was allocated successfully
-    if (result != PERF_RES_OK)
+    case TOKEN_KEYWORD_LET:
+    case TOKEN_KEYWORD_VAR:
+    case TOKEN_KEYWORD_CONST:
     {
-        // Set the error message
-        *error = "Failed to allocate AST nodes buffer";
+        perf_parser_result_t declaration = perf_parser_parse_declaration(parser);
 
-        // Return an error
-        return PERF_RES_MEMORY_ALLOC_FAIL;
+        if (declaration.is_error)
+            return declaration;
+
+        // Skip the terminating semicolon, if any.
+        perf_parser_accept(parser, TOKEN_SEMICOLON);
+
+        return declaration;
     }
 
-    // Set the output buffer & count
-    *ast        = nodes;
-    *ast_count  = node_count;
+    default:
+    {
+        // Parse expression
+        perf_parser_result_t expression = perf_parser_parse_expression(parser);
 
-    // Set the current token to the first token available.
-	parser->current_token   = &tokens[0];
-	parser->erroring_token  = parser->current_token;
+        // Return the error, if any.
+        if (expression.is_error) return expression;
+
+        // Skip the terminating semicolon, if any.
+        perf_parser_accept(parser, TOKEN_SEMICOLON);
+
+        // Wrap the expression in a statement
+        return perf_parser_new_node(parser, AST_EXPR_STATEMENT, PERF_AST_NONE, expression.node, PERF_AST_NONE);
+    }
+    }
+}
+
+/**
+ * @brief Parse generic statement
+ * 
+ * @param parser The parser to use.
+ * 
+ * @return PERF_PARSER_RESULT_T The result of the parse.
+ */
+perf_parser_result_t perf_parser_parse_generic_statement(perf_parser_t *parser)
+{
+    // Statements nest too (blocks, branches, loop bodies), so they count towards the depth limit.
+    if (++parser->depth > PERF_PARSER_MAX_DEPTH)
+        return perf_parser_leave(parser, perf_parser_error(parser, "statement nested too deeply"));
+
+    return perf_parser_leave(parser, perf_parser_parse_statement(parser));
+}
+
+
+
+/**
+ * @brief Parses statements until the end of the token source.
+ * 
+ * @param parser The parser to use, current_token or position must point at the first token.
+ * @param end Stop before the first statement starting at or past this token of the array, NULL for the whole source.
+ * @param error The error message to print if result is not RES_OK.
+ * 
+ * @return PERF_RES_OK if the tokens were parsed successfully.
+ */
+static perf_result_t perf_parser_run(perf_parser_t *parser, const perf_token_t *end, const char** error)
+{
+    // Start with the first token, at the top level. A stream token is only materialized for an error.
+	if (parser->stream == NULL) parser->erroring_token = *parser->current_token;
+    parser->depth           = 0;
+    parser->scratch_count   = 0;
 
     // Loop until we reach the end of the token stream.
-    while (parser->current_token->type != TOKEN_EOF)
+    for (;;)
     {
-        // Check if we have enough space for nodes.
-		if (node_count >= (max_node_count * 0.75))
-		{
-            // Allocate more memory for the AST nodes buffer
-			perf_result_t result = reallocate_ast_nodes_buffer(&nodes, &max_node_count);
-			
-            // Check if the AST nodes buffer was allocated successfully
-            if (result != PERF_RES_OK)
-            {
-                // Set the error message
-                *error = "Failed to allocate AST nodes buffer";
+        // Skip empty statements
+        while (perf_parser_accept(parser, TOKEN_SEMICOLON));
 
-                // Return an error
-                return PERF_RES_MEMORY_ALLOC_FAIL;
-            }
-
-            // Set the output buffer & count
-            *ast        = nodes;
-            *ast_count  = node_count;
-		}
+        // Check if we reached the end.
+        if (parser->current_type == TOKEN_EOF || (end != NULL && parser->current_token >= end)) break;
 
         // Run the statement parser.
 		perf_parser_result_t parse_result = perf_parser_parse_generic_statement(parser);
 
+        // A lexer or allocation failure takes priority, any parse error is a symptom of it.
+        if (parser->status != PERF_RES_OK)
+        {
+            *error = parser->status_error;
+
+            return parser->status;
+        }
+
 		// Return back to the caller if the parser function return an error.
 		if (parse_result.is_error)
 		{
@@ -558,13 +1137,108 @@ perf_result_t perf_parser_digest(perf_parser_t *parser, perf_token_t *tokens, in
 			return PERF_RES_PARSE_ERROR;
 		}
 
-		// Copy the resulting AST node over and free the previous one.
-		memcpy(&nodes[ node_count++ ], parse_result.node, sizeof(perf_parser_node_t));
-		free(parse_result.node);
-    }
+		// Record the statement, its nodes are already in the AST.
+		perf_result_t result = perf_ast_add_statement(parser->ast, parse_result.node, error);
 
-    *ast        = nodes;
-    *ast_count  = node_count;
+		// Check if the statement was recorded successfully
+		if (result != PERF_RES_OK) return result;
+    }
 
     return PERF_RES_OK;
-}
\ No newline at end of file
+}
+
+// Implementation for parser.h perf_parser_digest
+perf_result_t perf_parser_digest(perf_parser_t *parser, perf_token_t *tokens, int32_t token_count, perf_ast_t *ast, const char** error)
+{
+    // The AST refers to the token array in place.
+    perf_ast_init(ast);
+    ast->tokens         = tokens;
+    ast->token_count    = (uint32_t)token_count;
+    ast->token_capacity = (uint32_t)token_count;
+    ast->owns_tokens    = false;
+
+    // Set the current token to the first token available.
+    parser->ast             = ast;
+    parser->tokens          = tokens;
+    parser->stream          = NULL;
+	parser->current_token   = &tokens[0];
+    parser->current_type    = (uint8_t)tokens[0].type;
+    parser->status          = PERF_RES_OK;
+
+    // Parse the tokens
+    return perf_parser_run(parser, NULL, error);
+}
+
+// Implementation for parser.h perf_parser_digest_range
+perf_result_t perf_parser_digest_range(perf_parser_t *parser, perf_token_t *tokens, int32_t token_count, uint32_t first, uint32_t end, perf_ast_t *ast, uint32_t *stop, const char** error)
+{
+    // The AST refers to the whole token array in place.
+    ast->tokens         = tokens;
+    ast->token_count    = (uint32_t)token_count;
+    ast->token_capacity = (uint32_t)token_count;
+    ast->owns_tokens    = false;
+
+    // Start at the first token of the range.
+    parser->ast             = ast;
+    parser->tokens          = tokens;
+    parser->stream          = NULL;
+    parser->current_token   = &tokens[first];
+    parser->current_type    = (uint8_t)tokens[first].type;
+    parser->status          = PERF_RES_OK;
+
+    // Parse the statements starting inside the range.
+    perf_result_t result = perf_parser_run(parser, &tokens[end], error);
+
+    // Output where we stopped
+    *stop = (uint32_t)(parser->current_token - tokens);
+
+    // Return the result.
+    return result;
+}
+
+// Implementation for parser.h perf_parser_digest_stream
+perf_result_t perf_parser_digest_stream(perf_parser_t *parser, perf_token_stream_t *stream, perf_ast_t *ast, const char** error)
+{
+    // Kept tokens are materialized and copied into the AST.
+    perf_ast_init(ast);
+
+    // Start at the first token of the stream.
+    parser->ast             = ast;
+    parser->tokens          = NULL;
+    parser->stream          = stream;
+    parser->position        = 0;
+    parser->current_token   = NULL;
+    parser->current_type    = stream->types[0];
+    parser->status          = PERF_RES_OK;
+
+    // Parse the tokens
+    return perf_parser_run(parser, NULL, error);
+}
+
+// Implementation for parser.h perf_parser_parse
+perf_result_t perf_parser_parse(perf_parser_t *parser, const char* src, perf_ast_t *ast, const char** error)
+{
+    // Kept tokens are copied into the AST.
+    perf_ast_init(ast);
+
+    // Pull tokens from the lexer
+    parser->ast     = ast;
+    parser->tokens  = NULL;
+    parser->stream  = NULL;
+    parser->status  = PERF_RES_OK;
+    perf_lexer_begin(parser->lexer, src);
+
+    // Look at the first token
+    const perf_token_t* first = NULL;
+    perf_result_t result = perf_lexer_peek(parser->lexer, 0, &first, error);
+
+    // Check if the lexer failed.
+    if (result != PERF_RES_OK) return result;
+
+    // The buffered token stays valid until it is dropped.
+    parser->current_token = (perf_token_t*)first;
+    parser->current_type  = (uint8_t)first->type;
+
+    // Parse the tokens
+    return perf_parser_run(parser, NULL, error);
+}
@@ -0,0 +1,455 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/token.h"
+#include "../inc/intern.h"
+#include "../inc/lexer.h"
+#include "../inc/token_stream.h"
+#include "../inc/ast.h"
+#include "../inc/parser.h"
+#include "../inc/pool.h"
+
+/**
+ * Represents a range of the token stream parsed by perf_parser_digest_parallel.
+*/
+typedef struct _perf_parser_range_t
+{
+    uint32_t        first;              // Index of the first token, always the start of a top level function
+    uint32_t        end;                // Index of the first token past the range
+
+    perf_ast_t      ast;                // Statements starting inside the range
+    uint32_t        stop;               // Index of the token parsing stopped at, the start of the next range if all went well
+
+    bool            valid;              // Whether the range started where the serial parser would have been
+    uint32_t        node_base;          // Where the range's first node goes in the merged AST
+    uint32_t        extra_base;         // Where the range's first list entry goes in the merged AST
+    uint32_t        statement_base;     // Where the range's first statement goes in the merged AST
+
+    perf_result_t   result;             // Result of parsing the range
+    const char*     error;              // The error message if result is not PERF_RES_OK
+    perf_token_t    erroring_token;     // The token the parse error refers to
+} perf_parser_range_t;
+
+/**
+ * Represents a place the token stream could be cut, found by the pre-scan.
+*/
+typedef struct _perf_parser_cut_t
+{
+    uint32_t    index;              // Index of the "func" token
+    int32_t     braces;             // Brace nesting before it, relative to the start of its slice
+    int32_t     parens;             // Parenthesis nesting before it, relative to the start of its slice
+} perf_parser_cut_t;
+
+/**
+ * Represents a slice of the token stream pre-scanned by one task.
+*/
+typedef struct _perf_parser_slice_t
+{
+    uint32_t            first;      // Index of the first token
+    uint32_t            end;        // Index of the first token past the slice
+    int32_t             braces;     // Change in brace nesting over the slice
+    int32_t             parens;     // Change in parenthesis nesting over the slice
+
+    perf_parser_cut_t*  cuts;       // Candidate cuts, in order
+    uint32_t            cut_count;  // Number of candidate cuts
+    uint32_t            cut_capacity; // Number of candidate cuts we can hold
+    bool                failed;     // Whether growing the cuts failed
+} perf_parser_slice_t;
+
+/**
+ * Represents the state shared by the tasks of a parallel digest.
+*/
+typedef struct _perf_parser_parallel_t
+{
+    perf_parser_t*          parsers;    // A parser per thread, so each keeps its own scratch stack
+    perf_token_t*           tokens;     // The token stream
+    int32_t                 count;      // Number of tokens
+    perf_parser_slice_t*    slices;     // Every pre-scan slice
+    perf_parser_range_t*    ranges;     // Every range
+    perf_ast_t*             ast;        // The merged AST
+} perf_parser_parallel_t;
+
+/**
+ * @brief Pre-scans one slice of the token stream, run on the pool.
+ *
+ * A "func" right after a "}" or ";" starts a statement of its own if it is outside any braces or parentheses.
+ * The nesting before the slice isn't known yet, so every such "func" is recorded with the nesting relative to
+ * the slice, and the slices are lined up afterwards.
+ *
+ * @param context The parallel digest.
+ * @param task The index of the slice.
+ * @param worker The index of the thread.
+*/
+static void perf_parser_scan_task(void* context, uint32_t task, uint32_t worker)
+{
+    // Every thread scans slices the same way.
+    (void)worker;
+
+    // Get the digest and the slice
+    perf_parser_parallel_t* parallel = (perf_parser_parallel_t*)context;
+    perf_parser_slice_t*    slice    = &parallel->slices[task];
+    const perf_token_t*     tokens   = parallel->tokens;
+
+    // Nesting relative to the start of the slice.
+    int32_t braces = 0;
+    int32_t parens = 0;
+
+    for (uint32_t idx = slice->first; idx < slice->end; idx++)
+    {
+        // Get the type of the token, and of the one before it.
+        perf_e_token_type_t type = tokens[idx].type;
+        perf_e_token_type_t prev = tokens[idx - 1].type;
+
+        // Record a candidate cut
+        if (type == TOKEN_KEYWORD_FUNC && (prev == TOKEN_RIGHT_BRACE || prev == TOKEN_SEMICOLON))
+        {
+            // Make room for it
+            if (slice->cut_count == slice->cut_capacity)
+            {
+                uint32_t capacity = slice->cut_capacity < 64 ? 64 : slice->cut_capacity * 2;
+                perf_parser_cut_t* cuts = (perf_parser_cut_t*)realloc(slice->cuts, capacity * sizeof(perf_parser_cut_t));
+
+                // Check if the reallocation failed.
+                if (cuts == NULL)
+                {
+                    slice->failed = true;
+                    return;
+                }
+
+                slice->cuts         = cuts;
+                slice->cut_capacity = capacity;
+            }
+
+            // Record it
+            perf_parser_cut_t* cut = &slice->cuts[slice->cut_count++];
+            cut->index  = idx;
+            cut->braces = braces;
+            cut->parens = parens;
+        }
+
+        // Track the nesting after the token.
+        switch (type)
+        {
+        case TOKEN_LEFT_BRACE:          braces++;   break;
+        case TOKEN_RIGHT_BRACE:         braces--;   break;
+        case TOKEN_LEFT_PARENTHESES:    parens++;   break;
+        case TOKEN_RIGHT_PARENTHESES:   parens--;   break;
+        default:                                    break;
+        }
+    }
+
+    // Output the change in nesting
+    slice->braces = braces;
+    slice->parens = parens;
+}
+
+/**
+ * @brief Parses one range with the thread's parser, run on the pool.
+ *
+ * @param context The parallel digest.
+ * @param task The index of the range.
+ * @param worker The index of the thread.
+*/
+static void perf_parser_range_task(void* context, uint32_t task, uint32_t worker)
+{
+    // Get the digest, the range and the thread's parser.
+    perf_parser_parallel_t* parallel = (perf_parser_parallel_t*)context;
+    perf_parser_range_t*    range    = &parallel->ranges[task];
+    perf_parser_t*          parser   = &parallel->parsers[worker];
+
+    // Parse the range
+    range->result = perf_parser_digest_range(parser, parallel->tokens, parallel->count, range->first, range->end, &range->ast, &range->stop, &range->error);
+
+    // The parser moves on to other ranges, so keep the erroring token.
+    range->erroring_token = parser->erroring_token;
+}
+
+/**
+ * @brief Places a valid range's AST into the merged AST, run on the pool.
+ *
+ * @param context The parallel digest.
+ * @param task The index of the range.
+ * @param worker The index of the thread.
+*/
+static void perf_parser_place_task(void* context, uint32_t task, uint32_t worker)
+{
+    // Every thread places ranges the same way.
+    (void)worker;
+
+    // Get the digest and the range
+    perf_parser_parallel_t* parallel = (perf_parser_parallel_t*)context;
+    perf_parser_range_t*    range    = &parallel->ranges[task];
+
+    // Ranges parsed again by the range before them have nothing to place, and the first range is already in place.
+    if (!range->valid || task == 0) return;
+
+    // Place the range
+    perf_ast_place(parallel->ast, &range->ast, range->node_base, range->extra_base, range->statement_base);
+
+    // The range's AST isn't needed anymore, release it while the others are placed.
+    perf_ast_free(&range->ast);
+}
+
+/**
+ * @brief Frees every range.
+ *
+ * @param ranges The ranges.
+ * @param count The number of ranges.
+*/
+static void perf_parser_ranges_free(perf_parser_range_t* ranges, uint32_t count)
+{
+    for (uint32_t idx = 0; idx < count; idx++) perf_ast_free(&ranges[idx].ast);
+
+    free(ranges);
+}
+
+// Implementation for parser.h perf_parser_digest_parallel
+perf_result_t perf_parser_digest_parallel(perf_parser_t *parser, perf_token_t *tokens, int32_t token_count, uint32_t thread_count, perf_ast_t *ast, const char** error)
+{
+    // Default to one thread per processor.
+    if (thread_count == 0) thread_count = perf_pool_cpu_count();
+    if (thread_count > PERF_POOL_MAX_THREADS) thread_count = PERF_POOL_MAX_THREADS;
+
+    // A single thread, or a stream too small to be worth splitting, is parsed serially.
+    if (thread_count <= 1 || token_count < 2 * PERF_PARSER_PARALLEL_MIN_TOKENS) return perf_parser_digest(parser, tokens, token_count, ast, error);
+
+    // The merged AST refers to the token array in place.
+    perf_ast_init(ast);
+    ast->tokens         = tokens;
+    ast->token_count    = (uint32_t)token_count;
+    ast->token_capacity = (uint32_t)token_count;
+    ast->owns_tokens    = false;
+
+    // Aim for a few ranges per thread, but never tiny ones.
+    uint32_t last       = (uint32_t)token_count - 1;
+    uint32_t target     = last / (thread_count * PERF_PARSER_PARALLEL_RANGES_PER_THREAD);
+    if (target < PERF_PARSER_PARALLEL_MIN_TOKENS) target = PERF_PARSER_PARALLEL_MIN_TOKENS;
+
+    // Allocate the ranges, at most one per target tokens.
+    perf_parser_range_t* ranges = (perf_parser_range_t*)calloc(last / target + 1, sizeof(perf_parser_range_t));
+
+    // Check if the allocation failed.
+    if (ranges == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for parser ranges.";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Cut the stream into slices for the pre-scan. The first token is never a cut, so the slices start at 1.
+    uint32_t slice_count = thread_count * PERF_PARSER_PARALLEL_RANGES_PER_THREAD;
+    perf_parser_slice_t* slices = (perf_parser_slice_t*)calloc(slice_count, sizeof(perf_parser_slice_t));
+
+    // Check if the allocation failed.
+    if (slices == NULL)
+    {
+        free(ranges);
+
+        // Set the error
+        *error = "Failed to allocate memory for parser slices.";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    for (uint32_t idx = 0; idx < slice_count; idx++)
+    {
+        slices[idx].first   = 1 + (uint32_t)((uint64_t)(last - 1) * idx / slice_count);
+        slices[idx].end     = 1 + (uint32_t)((uint64_t)(last - 1) * (idx + 1) / slice_count);
+    }
+
+    // Pre-scan the slices in parallel.
+    perf_parser_parallel_t parallel = { NULL, tokens, token_count, slices, ranges, NULL };
+    perf_result_t result = perf_pool_run(thread_count, slice_count, perf_parser_scan_task, &parallel);
+
+    // Line the slices up, and cut before every top level function far enough into the current range. The first
+    // token is never a "func" we cut at, so the nesting starts from it.
+    uint32_t count      = 0;
+    uint32_t start      = 0;
+    int32_t  braces     = tokens[0].type == TOKEN_LEFT_BRACE ? 1 : tokens[0].type == TOKEN_RIGHT_BRACE ? -1 : 0;
+    int32_t  parens     = tokens[0].type == TOKEN_LEFT_PARENTHESES ? 1 : tokens[0].type == TOKEN_RIGHT_PARENTHESES ? -1 : 0;
+
+    for (uint32_t idx = 0; idx < slice_count && result == PERF_RES_OK; idx++)
+    {
+        // Get the slice
+        perf_parser_slice_t* slice = &slices[idx];
+
+        // Check if the slice ran out of memory.
+        if (slice->failed)
+        {
+            // Set the error
+            *error = "Failed to allocate memory for parser cuts.";
+
+            // Set memory allocation failure result.
+            result = PERF_RES_MEMORY_ALLOC_FAIL;
+            break;
+        }
+
+        for (uint32_t cut = 0; cut < slice->cut_count; cut++)
+        {
+            // Get the candidate
+            perf_parser_cut_t* candidate = &slice->cuts[cut];
+
+            // Only cut outside any braces or parentheses, far enough into the current range.
+            if (braces + candidate->braces != 0 || parens + candidate->parens != 0 || candidate->index - start < target) continue;
+
+            // Cut the range
+            ranges[count].first    = start;
+            ranges[count].end      = candidate->index;
+            count++;
+
+            start = candidate->index;
+        }
+
+        // Move on to the nesting after the slice.
+        braces += slice->braces;
+        parens += slice->parens;
+    }
+
+    // Free the slices
+    for (uint32_t idx = 0; idx < slice_count; idx++) free(slices[idx].cuts);
+    free(slices);
+
+    // Check if the pre-scan failed.
+    if (result != PERF_RES_OK)
+    {
+        free(ranges);
+        return result;
+    }
+
+    // The last range runs up to the EOF token.
+    ranges[count].first    = start;
+    ranges[count].end      = last;
+    count++;
+
+    // Nothing to split, parse serially.
+    if (count == 1)
+    {
+        free(ranges);
+        return perf_parser_digest(parser, tokens, token_count, ast, error);
+    }
+
+    // Set up a parser per thread, sharing the lexer.
+    perf_parser_t parsers[PERF_POOL_MAX_THREADS];
+    for (uint32_t idx = 0; idx < thread_count; idx++)
+    {
+        // Initialize the parser
+        result = perf_parser_init(&parsers[idx], parser->lexer, error);
+
+        // Check if the parser was initialized successfully.
+        if (result != PERF_RES_OK)
+        {
+            // Free the parsers set up so far, and the ranges.
+            for (uint32_t done = 0; done < idx; done++) perf_parser_free(&parsers[done]);
+            free(ranges);
+
+            // Return the result.
+            return result;
+        }
+    }
+
+    // Set up each range's AST
+    for (uint32_t idx = 0; idx < count; idx++) perf_ast_init(&ranges[idx].ast);
+
+    // Parse every range, each assuming it starts a statement.
+    parallel.parsers = parsers;
+    result = perf_pool_run(thread_count, count, perf_parser_range_task, &parallel);
+
+    // Walk the ranges in order, checking each one starts where the range that owns the tokens before it stopped.
+    perf_parser_range_t* owner = &ranges[0];
+    owner->valid = true;
+
+    for (uint32_t idx = 1; idx < count && result == PERF_RES_OK && owner->result == PERF_RES_OK; idx++)
+    {
+        // Get the range
+        perf_parser_range_t* range = &ranges[idx];
+
+        // The owner stopped right where the range starts, so the range parsed what the serial parser would have.
+        if (owner->stop == range->first)
+        {
+            range->valid = true;
+            owner = range;
+            continue;
+        }
+
+        // The owner's last statement ran into the range, so the owner parses the rest of the range itself.
+        if (owner->stop < range->end)
+            owner->result = perf_parser_digest_range(parser, tokens, token_count, owner->stop, range->end, &owner->ast, &owner->stop, &owner->error);
+
+        // Keep the erroring token, if any.
+        owner->erroring_token = parser->erroring_token;
+    }
+
+    // Free the per thread parsers
+    for (uint32_t idx = 0; idx < thread_count; idx++) perf_parser_free(&parsers[idx]);
+
+    // Check if the owner ran into an error, the first error in the stream since every range before it was clean.
+    if (result == PERF_RES_OK && owner->result != PERF_RES_OK)
+    {
+        *error                  = owner->error;
+        parser->erroring_token  = owner->erroring_token;
+        result                  = owner->result;
+    }
+
+    // Work out where each valid range goes.
+    uint32_t node_count         = 0;
+    uint32_t extra_count        = 0;
+    uint32_t statement_count    = 0;
+    uint32_t allocation_count   = 0;
+
+    for (uint32_t idx = 0; idx < count && result == PERF_RES_OK; idx++)
+    {
+        // Get the range
+        perf_parser_range_t* range = &ranges[idx];
+
+        // Every range's arrays count towards the merged AST's allocations, the first range's already do.
+        if (idx > 0) allocation_count += range->ast.allocation_count;
+
+        // Skip ranges that were parsed again by the range before them.
+        if (!range->valid) continue;
+
+        // Place the range after the ones before it.
+        range->node_base        = node_count;
+        range->extra_base       = extra_count;
+        range->statement_base   = statement_count;
+
+        node_count         += range->ast.node_count;
+        extra_count        += range->ast.extra_count;
+        statement_count    += range->ast.statement_count;
+    }
+
+    // Grow the first range's AST into the merged AST. Its nodes are already in place, and only one range per
+    // thread is ever held twice while the rest are placed.
+    if (result == PERF_RES_OK) result = perf_ast_reserve(&ranges[0].ast, node_count, extra_count, statement_count, error);
+
+    // Place the ranges in parallel.
+    parallel.ast = &ranges[0].ast;
+    if (result == PERF_RES_OK) result = perf_pool_run(thread_count, count, perf_parser_place_task, &parallel);
+
+    // Check if the AST was merged successfully.
+    if (result != PERF_RES_OK)
+    {
+        perf_parser_ranges_free(ranges, count);
+        return result;
+    }
+
+    // The first range's AST is the merged AST now.
+    *ast                    = ranges[0].ast;
+    ast->node_count         = node_count;
+    ast->extra_count        = extra_count;
+    ast->statement_count    = statement_count;
+    ast->allocation_count  += allocation_count;
+    perf_ast_init(&ranges[0].ast);
+
+    // Free the ranges
+    perf_parser_ranges_free(ranges, count);
+
+    // Leave the parser the way perf_parser_digest does.
+    parser->ast             = ast;
+    parser->tokens          = tokens;
+    parser->current_token   = &tokens[last];
+
+    // Return OK result
+    return PERF_RES_OK;
+}
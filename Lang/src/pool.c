@@ -0,0 +1,259 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#endif
+
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/pool.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// A range of task indices, the first in the low half and the end in the high half, updated atomically as a whole.
+#if defined(_MSC_VER) && !defined(__clang__)
+typedef volatile LONG64 perf_pool_range_t;
+#define PERF_POOL_LOAD(range)                       ((uint64_t)InterlockedOr64(range, 0))
+#define PERF_POOL_STORE(range, value)               InterlockedExchange64(range, (LONG64)(value))
+#define PERF_POOL_SWAP(range, expected, desired)    perf_pool_swap(range, expected, desired)
+
+// Replaces a range if it still holds the expected value, or loads its current value into expected.
+static bool perf_pool_swap(perf_pool_range_t* range, uint64_t* expected, uint64_t desired)
+{
+    uint64_t seen = (uint64_t)InterlockedCompareExchange64(range, (LONG64)desired, (LONG64)*expected);
+    if (seen == *expected) return true;
+    *expected = seen;
+    return false;
+}
+#else
+#include <stdatomic.h>
+typedef _Atomic uint64_t perf_pool_range_t;
+#define PERF_POOL_LOAD(range)                       atomic_load_explicit(range, memory_order_acquire)
+#define PERF_POOL_STORE(range, value)               atomic_store_explicit(range, value, memory_order_release)
+#define PERF_POOL_SWAP(range, expected, desired)    atomic_compare_exchange_weak_explicit(range, expected, desired, memory_order_acq_rel, memory_order_acquire)
+#endif
+
+// Packs a range of task indices.
+#define PERF_POOL_RANGE(begin, end)     (((uint64_t)(end) << 32) | (uint64_t)(begin))
+
+/**
+ * Represents a batch of tasks being run by a pool.
+*/
+typedef struct _perf_pool_batch_t
+{
+    perf_pool_task_t            task;           // The function run for each task
+    void*                       context;        // Passed to every task
+    uint32_t                    thread_count;   // Number of threads working on the batch
+    struct _perf_pool_worker_t* workers;        // Every thread
+} perf_pool_batch_t;
+
+/**
+ * Represents a thread of the pool.
+ *
+ * Each thread starts with its own contiguous range of tasks and takes them from the front. Once it runs out it
+ * steals the back half of another thread's range, so neighbouring tasks mostly stay on one thread.
+*/
+typedef struct _perf_pool_worker_t
+{
+    _Alignas(64) perf_pool_range_t range;       // Tasks left to this thread, on a cache line of its own
+    perf_pool_batch_t*  batch;                  // The batch being run
+    uint32_t            index;                  // Index of the thread, passed to the tasks
+#if defined(_WIN32)
+    HANDLE              handle;                 // The thread
+#else
+    pthread_t           handle;                 // The thread
+#endif
+    bool                started;                // Whether the thread was started
+} perf_pool_worker_t;
+
+/**
+ * @brief Takes the next task from the front of a thread's own range.
+ *
+ * @param worker The thread.
+ * @param task Set to the task taken.
+ *
+ * @return true if a task was taken, false if the range is empty.
+*/
+static bool perf_pool_pop(perf_pool_worker_t* worker, uint32_t* task)
+{
+    // Load the range
+    uint64_t range = PERF_POOL_LOAD(&worker->range);
+
+    for (;;)
+    {
+        // Unpack it
+        uint32_t begin  = (uint32_t)range;
+        uint32_t end    = (uint32_t)(range >> 32);
+
+        // Check if it is empty.
+        if (begin >= end) return false;
+
+        // Take the first task, unless a thief changed the range first.
+        if (PERF_POOL_SWAP(&worker->range, &range, PERF_POOL_RANGE(begin + 1, end)))
+        {
+            *task = begin;
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Steals the back half of another thread's range.
+ *
+ * @param thief The thread stealing, its own range must be empty.
+ * @param victim The thread to steal from.
+ *
+ * @return true if any tasks were stolen, they are the thief's range now.
+*/
+static bool perf_pool_steal(perf_pool_worker_t* thief, perf_pool_worker_t* victim)
+{
+    // Load the range
+    uint64_t range = PERF_POOL_LOAD(&victim->range);
+
+    for (;;)
+    {
+        // Unpack it
+        uint32_t begin  = (uint32_t)range;
+        uint32_t end    = (uint32_t)(range >> 32);
+
+        // Check if it is empty.
+        if (begin >= end) return false;
+
+        // Split it, the victim keeps the front so it carries on where it was.
+        uint32_t middle = begin + (end - begin) / 2;
+
+        // Take the back half, unless the range changed first.
+        if (PERF_POOL_SWAP(&victim->range, &range, PERF_POOL_RANGE(begin, middle)))
+        {
+            PERF_POOL_STORE(&thief->range, PERF_POOL_RANGE(middle, end));
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Runs tasks until every range is empty.
+ *
+ * @param worker The thread running the tasks.
+*/
+static void perf_pool_work(perf_pool_worker_t* worker)
+{
+    // Get the batch
+    perf_pool_batch_t* batch = worker->batch;
+
+    for (;;)
+    {
+        // Run our own tasks first.
+        uint32_t task;
+        while (perf_pool_pop(worker, &task)) batch->task(batch->context, task, worker->index);
+
+        // Then look for a thread with tasks left, starting with the next one.
+        bool stolen = false;
+        for (uint32_t offset = 1; offset < batch->thread_count && !stolen; offset++)
+            stolen = perf_pool_steal(worker, &batch->workers[(worker->index + offset) % batch->thread_count]);
+
+        // Stop once nobody has anything left. Tasks being run never add more, so we are done.
+        if (!stolen) return;
+    }
+}
+
+#if defined(_WIN32)
+// Thread entry point, see perf_pool_work.
+static DWORD WINAPI perf_pool_thread(LPVOID argument)
+{
+    perf_pool_work((perf_pool_worker_t*)argument);
+    return 0;
+}
+#else
+// Thread entry point, see perf_pool_work.
+static void* perf_pool_thread(void* argument)
+{
+    perf_pool_work((perf_pool_worker_t*)argument);
+    return NULL;
+}
+#endif
+
+// Implementation for pool.h perf_pool_cpu_count
+uint32_t perf_pool_cpu_count(void)
+{
+#if defined(_WIN32)
+    // Ask the system
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long count = (long)info.dwNumberOfProcessors;
+#else
+    // Ask the system
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    // Return the count, at least 1.
+    return count < 1 ? 1 : (uint32_t)count;
+}
+
+// Implementation for pool.h perf_pool_run
+perf_result_t perf_pool_run(uint32_t thread_count, uint32_t task_count, perf_pool_task_t task, void* context)
+{
+    // Default to one thread per processor.
+    if (thread_count == 0) thread_count = perf_pool_cpu_count();
+
+    // There's no point in more threads than tasks.
+    if (thread_count > task_count) thread_count = task_count;
+    if (thread_count > PERF_POOL_MAX_THREADS) thread_count = PERF_POOL_MAX_THREADS;
+
+    // Set up the threads, the calling thread is worker 0.
+    perf_pool_worker_t workers[PERF_POOL_MAX_THREADS];
+
+    // Set up the batch
+    perf_pool_batch_t batch;
+    batch.task          = task;
+    batch.context       = context;
+    batch.thread_count  = thread_count;
+    batch.workers       = workers;
+
+    // Give each thread an even, contiguous share of the tasks to start with.
+    for (uint32_t idx = 0; idx < thread_count; idx++)
+    {
+        uint32_t begin  = (uint32_t)((uint64_t)task_count * idx / thread_count);
+        uint32_t end    = (uint32_t)((uint64_t)task_count * (idx + 1) / thread_count);
+
+        PERF_POOL_STORE(&workers[idx].range, PERF_POOL_RANGE(begin, end));
+        workers[idx].batch      = &batch;
+        workers[idx].index      = idx;
+        workers[idx].started    = false;
+    }
+
+    // Start the other threads. One that fails to start just leaves its share to the rest.
+    for (uint32_t idx = 1; idx < thread_count; idx++)
+    {
+#if defined(_WIN32)
+        workers[idx].handle     = CreateThread(NULL, 0, perf_pool_thread, &workers[idx], 0, NULL);
+        workers[idx].started    = workers[idx].handle != NULL;
+#else
+        workers[idx].started    = pthread_create(&workers[idx].handle, NULL, perf_pool_thread, &workers[idx]) == 0;
+#endif
+    }
+
+    // Work on the batch ourselves.
+    if (thread_count > 0) perf_pool_work(&workers[0]);
+
+    // Wait for the other threads.
+    for (uint32_t idx = 1; idx < thread_count; idx++)
+    {
+        // Skip threads that never started.
+        if (!workers[idx].started) continue;
+
+#if defined(_WIN32)
+        WaitForSingleObject(workers[idx].handle, INFINITE);
+        CloseHandle(workers[idx].handle);
+#else
+        pthread_join(workers[idx].handle, NULL);
+#endif
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
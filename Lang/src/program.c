@@ -0,0 +1,439 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/array.h"
+#include "../inc/intern.h"
+#include "../inc/value.h"
+#include "../inc/program.h"
+
+// Implementation for program.h perf_program_init
+perf_result_t perf_program_init(perf_program_t *program)
+{
+    // Zero everything, the arrays are allocated on first use.
+    memset(program, 0, sizeof(perf_program_t));
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for program.h perf_program_add_code
+perf_result_t perf_program_add_code(perf_program_t *program, const uint8_t *code, uint32_t length, uint32_t *offset, const char** error)
+{
+    // Make room for the code
+    while (program->code_capacity - program->code_count < length)
+    {
+        if (perf_array_grow((void**)&program->code, &program->code_capacity, sizeof(uint8_t)) != PERF_RES_OK)
+        {
+            // Set the error
+            *error = "Failed to allocate memory for bytecode";
+
+            // Return memory allocation failure result.
+            return PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+    }
+
+    // Copy the code
+    if (length > 0) memcpy(program->code + program->code_count, code, length);
+
+    // Output the offset
+    *offset = program->code_count;
+    program->code_count += length;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for program.h perf_program_add_constant
+perf_result_t perf_program_add_constant(perf_program_t *program, const perf_value_t *value, uint32_t *index, const char** error)
+{
+    // Make room for the constant
+    if (program->constant_count == program->constant_capacity
+        && perf_array_grow((void**)&program->constants, &program->constant_capacity, sizeof(perf_value_t)) != PERF_RES_OK)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for constant";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Copy the constant
+    program->constants[program->constant_count] = *value;
+
+    // Output the index
+    *index = program->constant_count++;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for program.h perf_program_add_function
+perf_result_t perf_program_add_function(perf_program_t *program, const char* name, uint32_t *index, const char** error)
+{
+    // Make room for the function
+    if (program->function_count == program->function_capacity
+        && perf_array_grow((void**)&program->functions, &program->function_capacity, sizeof(perf_function_t)) != PERF_RES_OK)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for function";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Start the function out empty
+    perf_function_t* function = &program->functions[program->function_count];
+    memset(function, 0, sizeof(perf_function_t));
+    function->name          = name;
+    function->class_index   = UINT32_MAX;
+
+    // Output the index
+    *index = program->function_count++;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for program.h perf_program_add_lines
+perf_result_t perf_program_add_lines(perf_program_t *program, const perf_program_line_t *lines, uint32_t count, uint32_t *offset, const char** error)
+{
+    // Make room for the entries
+    while (program->line_capacity - program->line_count < count)
+    {
+        if (perf_array_grow((void**)&program->lines, &program->line_capacity, sizeof(perf_program_line_t)) != PERF_RES_OK)
+        {
+            // Set the error
+            *error = "Failed to allocate memory for line table";
+
+            // Return memory allocation failure result.
+            return PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+    }
+
+    // Copy the entries
+    if (count > 0) memcpy(program->lines + program->line_count, lines, (size_t)count * sizeof(perf_program_line_t));
+
+    // Output the offset
+    *offset = program->line_count;
+    program->line_count += count;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for program.h perf_program_add_global
+perf_result_t perf_program_add_global(perf_program_t *program, const char* name, uint32_t *index, const char** error)
+{
+    // Make room for the global
+    if (program->global_count == program->global_capacity
+        && perf_array_grow((void**)&program->globals, &program->global_capacity, sizeof(const char*)) != PERF_RES_OK)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for global";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Store the name
+    program->globals[program->global_count] = name;
+
+    // Output the index
+    *index = program->global_count++;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for program.h perf_program_add_class
+perf_result_t perf_program_add_class(perf_program_t *program, const char* name, uint32_t *index, const char** error)
+{
+    // Make room for the class
+    if (program->class_count == program->class_capacity
+        && perf_array_grow((void**)&program->classes, &program->class_capacity, sizeof(perf_class_t)) != PERF_RES_OK)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for class";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Start the class out without methods, they come right after the ones of the classes before it.
+    perf_class_t* klass = &program->classes[program->class_count];
+    klass->name             = name;
+    klass->initializer      = UINT32_MAX;
+    klass->method_offset    = program->method_count;
+    klass->method_count     = 0;
+
+    // Output the index
+    *index = program->class_count++;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for program.h perf_program_add_method
+perf_result_t perf_program_add_method(perf_program_t *program, const char* name, uint32_t function, const char** error)
+{
+    // Make room for the method
+    if (program->method_count == program->method_capacity
+        && perf_array_grow((void**)&program->methods, &program->method_capacity, sizeof(perf_method_t)) != PERF_RES_OK)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for method";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Store it, and count it as one of the last class's methods.
+    program->methods[program->method_count].name        = name;
+    program->methods[program->method_count].function    = function;
+
+    program->method_count++;
+    program->classes[program->class_count - 1].method_count++;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for program.h perf_program_add_site
+perf_result_t perf_program_add_site(perf_program_t *program, uint32_t name, uint32_t *index, const char** error)
+{
+    // Make room for the site
+    if (program->site_count == program->site_capacity
+        && perf_array_grow((void**)&program->sites, &program->site_capacity, sizeof(uint32_t)) != PERF_RES_OK)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for member site";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Store the name
+    program->sites[program->site_count] = name;
+
+    // Output the index
+    *index = program->site_count++;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for program.h perf_program_line
+uint32_t perf_program_line(const perf_program_t *program, uint32_t function, uint32_t offset)
+{
+    // Get the function's part of the line table
+    const perf_function_t*      fn      = &program->functions[function];
+    const perf_program_line_t*  lines   = program->lines + fn->line_offset;
+
+    // Check if there is anything to search.
+    if (fn->line_count == 0) return 0;
+
+    // Find the last entry starting at or before the offset.
+    uint32_t low    = 0;
+    uint32_t high   = fn->line_count;
+
+    while (high - low > 1)
+    {
+        uint32_t middle = low + (high - low) / 2;
+
+        if (lines[middle].offset <= offset) low = middle;
+        else high = middle;
+    }
+
+    // Return the line number
+    return lines[low].line;
+}
+
+/**
+ * @brief Reads an operand of an instruction.
+ *
+ * @param code The first byte of the operand.
+ * @param size The size of the operand, in bytes.
+ *
+ * @return The operand.
+*/
+static uint32_t perf_program_operand(const uint8_t *code, uint8_t size)
+{
+    // Operands are little endian
+    uint32_t operand = 0;
+    for (uint8_t idx = 0; idx < size; idx++) operand |= (uint32_t)code[idx] << (idx * 8);
+
+    // Return the operand
+    return operand;
+}
+
+/**
+ * @brief Prints a constant, and the name of functions.
+ *
+ * @param program The program the constant is in.
+ * @param index The index of the constant.
+*/
+static void perf_program_print_constant(const perf_program_t *program, uint32_t index)
+{
+    perf_value_t value = program->constants[index];
+
+    printf(" %u ", index);
+    perf_value_print(value);
+    if (perf_value_is(value, PERF_VALUE_FUNCTION) && program->functions[perf_value_as_index(value)].name != NULL)
+        printf(" %s", program->functions[perf_value_as_index(value)].name);
+}
+
+/**
+ * @brief Prints a member site and the name it refers to.
+ *
+ * @param program The program the site is in.
+ * @param index The index of the site.
+*/
+static void perf_program_print_site(const perf_program_t *program, uint32_t index)
+{
+    const char* name = perf_value_as_string(program->constants[program->sites[index]]);
+
+    printf(" @%u %.*s", index, (int)perf_interner_length(name), name);
+}
+
+/**
+ * @brief Prints the instructions of a function in register code.
+ *
+ * @param program The program the function is in.
+ * @param function The index of the function.
+ *
+ * @return PERF_RES_OK if the function was printed successfully.
+*/
+static perf_result_t perf_program_disassemble_registers(const perf_program_t *program, uint32_t function)
+{
+    // Get the function and its code
+    const perf_function_t*  fn      = &program->functions[function];
+    const uint8_t*          code    = program->code + fn->code_offset;
+
+    // Only print a line number when it changes.
+    uint32_t last_line = UINT32_MAX;
+
+    for (uint32_t offset = 0; offset < fn->code_length; )
+    {
+        // Decode the instruction
+        const uint8_t*                  word    = code + offset;
+        const perf_reg_opcode_info_t*   info    = &perf_reg_opcode_info[word[0]];
+        uint32_t                        bx      = perf_program_operand(word + 2, 2);
+        uint32_t                        x       = info->size == 8 ? perf_program_operand(word + 4, 4) : 0;
+        uint32_t                        next    = offset + info->size;
+
+        // Print the offset and the line
+        uint32_t line = perf_program_line(program, function, fn->code_offset + offset);
+        if (line != last_line) printf("%04u %5u  %-25s", offset, line, info->name);
+        else printf("%04u     |  %-25s", offset, info->name);
+        last_line = line;
+
+        // Print the operands
+        switch (info->layout)
+        {
+        case PERF_REG_LAYOUT_A:             printf(" r%u", word[1]);                                                    break;
+        case PERF_REG_LAYOUT_AB:            printf(" r%u r%u", word[1], word[2]);                                       break;
+        case PERF_REG_LAYOUT_ABC:           printf(" r%u r%u r%u", word[1], word[2], word[3]);                          break;
+        case PERF_REG_LAYOUT_ABK:           printf(" r%u r%u", word[1], word[2]); perf_program_print_constant(program, word[3]); break;
+        case PERF_REG_LAYOUT_AK:            printf(" r%u", word[1]); perf_program_print_constant(program, bx);          break;
+        case PERF_REG_LAYOUT_AX_CONSTANT:   printf(" r%u", word[1]); perf_program_print_constant(program, x);           break;
+        case PERF_REG_LAYOUT_AX_GLOBAL:     printf(" r%u %u %s", word[1], x, program->globals[x]);                      break;
+        case PERF_REG_LAYOUT_ABX_MEMBER:    printf(" r%u r%u", word[1], word[2]); perf_program_print_site(program, x);  break;
+        case PERF_REG_LAYOUT_INVOKE:        printf(" r%u %u", word[1], word[2]); perf_program_print_site(program, x);   break;
+        case PERF_REG_LAYOUT_JUMP:          printf(" %u -> %04u", bx, next + bx);                                       break;
+        case PERF_REG_LAYOUT_A_JUMP:        printf(" r%u %u -> %04u", word[1], bx, next + bx);                          break;
+        case PERF_REG_LAYOUT_AB_JUMP:       printf(" r%u r%u %u -> %04u", word[1], word[2], x >> 16, next + (x >> 16)); break;
+        case PERF_REG_LAYOUT_LOOP:          printf(" %u -> %04u", bx, next - bx);                                       break;
+        default:                            printf(" r%u %u", word[1], word[2]);                                        break;
+        }
+
+        // End the line, and move to the next instruction.
+        printf("\n");
+        offset = next;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for program.h perf_program_disassemble
+perf_result_t perf_program_disassemble(const perf_program_t *program, uint32_t function)
+{
+    // Get the function and its code
+    const perf_function_t*  fn      = &program->functions[function];
+    const uint8_t*          code    = program->code + fn->code_offset;
+
+    // Print the header, methods under their class's name.
+    if (fn->class_index != UINT32_MAX) printf("== %s.%s (function %u, arity %u, %u slots, stack %u) ==\n", program->classes[fn->class_index].name,
+        fn->name, function, fn->arity, fn->slot_count, fn->max_stack);
+    else printf("== %s (function %u, arity %u, %u slots, stack %u) ==\n", fn->name == NULL ? "<script>" : fn->name,
+        function, fn->arity, fn->slot_count, fn->max_stack);
+
+    // Register code has its own layout.
+    if (program->format == PERF_PROGRAM_FORMAT_REGISTER) return perf_program_disassemble_registers(program, function);
+
+    // Only print a line number when it changes.
+    uint32_t last_line = UINT32_MAX;
+
+    for (uint32_t offset = 0; offset < fn->code_length; )
+    {
+        // Decode the instruction
+        uint8_t                     opcode  = code[offset];
+        const perf_opcode_info_t*   info    = &perf_opcode_info[opcode];
+        uint32_t                    operand = perf_program_operand(code + offset + 1, info->operand_size > 4 ? 4 : info->operand_size);
+        uint32_t                    next    = offset + 1 + info->operand_size;
+
+        // Print the offset and the line
+        uint32_t line = perf_program_line(program, function, fn->code_offset + offset);
+        if (line != last_line) printf("%04u %5u  %-*s", offset, line, info->operand_size > 0 ? 25 : 0, info->name);
+        else printf("%04u     |  %-*s", offset, info->operand_size > 0 ? 25 : 0, info->name);
+        last_line = line;
+
+        // Print the operand
+        switch (opcode)
+        {
+        case OP_CONSTANT:
+        case OP_CONSTANT_WIDE:
+        case OP_ADD_CONSTANT:
+        case OP_SUBTRACT_CONSTANT:  perf_program_print_constant(program, operand);        break;
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_STORE_GLOBAL:   printf(" %u %s", operand, program->globals[operand]);   break;
+        case OP_GET_MEMBER:
+        case OP_SET_MEMBER:     perf_program_print_site(program, operand);              break;
+        case OP_INVOKE:         printf(" %u", code[offset + 5]); perf_program_print_site(program, operand); break;
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_NOT_EQUAL:
+        case OP_JUMP_IF_EQUAL:
+        case OP_JUMP_IF_NOT_GREATER:
+        case OP_JUMP_IF_NOT_GREATER_EQUAL:
+        case OP_JUMP_IF_NOT_LESS:
+        case OP_JUMP_IF_NOT_LESS_EQUAL:  printf(" %u -> %04u", operand, next + operand); break;
+        case OP_LOOP:           printf(" %u -> %04u", operand, next - operand);         break;
+        default:                if (info->operand_size > 0) printf(" %u", operand);     break;
+        }
+
+        // End the line, and move to the next instruction.
+        printf("\n");
+        offset = next;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for program.h perf_program_free
+perf_result_t perf_program_free(perf_program_t *program)
+{
+    // Free the arrays
+    free(program->code);
+    free(program->constants);
+    free(program->functions);
+    free(program->lines);
+    free(program->globals);
+    free(program->classes);
+    free(program->methods);
+    free(program->sites);
+
+    // Reset back to the initial state.
+    return perf_program_init(program);
+}
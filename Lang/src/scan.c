@@ -0,0 +1,447 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/scan.h"
+
+// The vector kernels are only built for x86-64, where SSE2 is always available.
+#if defined(__x86_64__) || defined(_M_X64)
+#define PERF_SCAN_HAVE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang need to be told which functions may use AVX2, MSVC allows the intrinsics anywhere.
+#if defined(__GNUC__)
+#define PERF_SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PERF_SCAN_TARGET_AVX2
+#endif
+
+// Masks covering every byte of a 16 and 32 byte block.
+#define PERF_SCAN_MASK_16 0x0000FFFFu
+#define PERF_SCAN_MASK_32 0xFFFFFFFFu
+
+/**
+ * @brief Counts the trailing zero bits of a non-zero mask.
+*/
+static inline uint32_t perf_scan_ctz(uint32_t mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return (uint32_t)idx;
+#else
+    return (uint32_t)__builtin_ctz(mask);
+#endif
+}
+
+/**
+ * @brief Gets the index of the highest set bit of a non-zero mask.
+*/
+static inline uint32_t perf_scan_msb(uint32_t mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanReverse(&idx, mask);
+    return (uint32_t)idx;
+#else
+    return 31u - (uint32_t)__builtin_clz(mask);
+#endif
+}
+
+/**
+ * @brief Counts the set bits of a mask.
+*/
+static inline uint32_t perf_scan_popcount(uint32_t mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    mask = mask - ((mask >> 1) & 0x55555555u);
+    mask = (mask & 0x33333333u) + ((mask >> 2) & 0x33333333u);
+    return (((mask + (mask >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+#else
+    return (uint32_t)__builtin_popcount(mask);
+#endif
+}
+
+/**
+ * Scalar kernels, used on every other architecture and as the reference implementation.
+*/
+
+static const char* perf_scan_whitespace_scalar(const char* ch, uint32_t* newlines, const char** line_start)
+{
+    // Will store the number of newlines
+    uint32_t count = 0;
+
+    // Skip every whitespace character.
+    while (*ch == ' ' || *ch == '\t' || *ch == '\r' || *ch == '\n')
+    {
+        // Track the newlines
+        if (*ch == '\n')
+        {
+            count++;
+            *line_start = ch + 1;
+        }
+
+        ch++;
+    }
+
+    // Output the number of newlines
+    *newlines = count;
+    return ch;
+}
+
+static const char* perf_scan_identifier_scalar(const char* ch)
+{
+    // Skip every letter and digit.
+    while ((*ch >= 'a' && *ch <= 'z') || (*ch >= 'A' && *ch <= 'Z') || (*ch >= '0' && *ch <= '9')) ch++;
+    return ch;
+}
+
+static const char* perf_scan_line_comment_scalar(const char* ch)
+{
+    // Find the newline or the null terminator.
+    while (*ch != '\n' && *ch != '\x00') ch++;
+    return ch;
+}
+
+static const char* perf_scan_block_comment_scalar(const char* ch, uint32_t* newlines, const char** line_start)
+{
+    // Will store the number of newlines
+    uint32_t count = 0;
+
+    // Loop until we reach the end of the comment or the null terminator.
+    while (*ch != '\x00')
+    {
+        // Check for comment termination
+        if (*ch == '*' && *(ch + 1) == '/')
+        {
+            ch += 2;
+            break;
+        }
+
+        // Track the newlines
+        if (*ch == '\n')
+        {
+            count++;
+            *line_start = ch + 1;
+        }
+
+        ch++;
+    }
+
+    // Output the number of newlines
+    *newlines = count;
+    return ch;
+}
+
+#ifdef PERF_SCAN_HAVE_X86
+
+/**
+ * Per block classification. Each function loads one aligned block and returns bit masks, bit i is byte i.
+*/
+
+static inline void perf_scan_sse2_whitespace_block(const char* block, uint32_t* ws, uint32_t* nl)
+{
+    __m128i v   = _mm_load_si128((const __m128i*)block);
+    __m128i n   = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    __m128i w   = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                               _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), n));
+    *ws = (uint32_t)_mm_movemask_epi8(w);
+    *nl = (uint32_t)_mm_movemask_epi8(n);
+}
+
+static inline uint32_t perf_scan_sse2_identifier_block(const char* block)
+{
+    // Folding the case bit maps both letter ranges onto 'a'..'z'. Bytes >= 0x80 are negative and never match.
+    __m128i v       = _mm_load_si128((const __m128i*)block);
+    __m128i lower   = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i alpha   = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit   = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    return (uint32_t)_mm_movemask_epi8(_mm_or_si128(alpha, digit));
+}
+
+static inline uint32_t perf_scan_sse2_eol_block(const char* block)
+{
+    __m128i v = _mm_load_si128((const __m128i*)block);
+    return (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+}
+
+static inline void perf_scan_sse2_comment_block(const char* block, uint32_t* star, uint32_t* slash, uint32_t* nl, uint32_t* zero)
+{
+    __m128i v = _mm_load_si128((const __m128i*)block);
+    *star   = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('*')));
+    *slash  = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+    *nl     = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    *zero   = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+}
+
+PERF_SCAN_TARGET_AVX2 static inline void perf_scan_avx2_whitespace_block(const char* block, uint32_t* ws, uint32_t* nl)
+{
+    __m256i v   = _mm256_load_si256((const __m256i*)block);
+    __m256i n   = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    __m256i w   = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                                  _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), n));
+    *ws = (uint32_t)_mm256_movemask_epi8(w);
+    *nl = (uint32_t)_mm256_movemask_epi8(n);
+}
+
+PERF_SCAN_TARGET_AVX2 static inline uint32_t perf_scan_avx2_identifier_block(const char* block)
+{
+    // Folding the case bit maps both letter ranges onto 'a'..'z'. Bytes >= 0x80 are negative and never match.
+    __m256i v       = _mm256_load_si256((const __m256i*)block);
+    __m256i lower   = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i alpha   = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    __m256i digit   = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(alpha, digit));
+}
+
+PERF_SCAN_TARGET_AVX2 static inline uint32_t perf_scan_avx2_eol_block(const char* block)
+{
+    __m256i v = _mm256_load_si256((const __m256i*)block);
+    return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+}
+
+PERF_SCAN_TARGET_AVX2 static inline void perf_scan_avx2_comment_block(const char* block, uint32_t* star, uint32_t* slash, uint32_t* nl, uint32_t* zero)
+{
+    __m256i v = _mm256_load_si256((const __m256i*)block);
+    *star   = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')));
+    *slash  = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')));
+    *nl     = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    *zero   = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+}
+
+/**
+ * Stamps out the four kernels for one instruction set, on top of its block functions.
+ * The first block is aligned down, with the bytes before the start masked off.
+*/
+#define PERF_SCAN_DEFINE_KERNELS(isa, WIDTH, FULL, TARGET)                                              \
+                                                                                                        \
+TARGET static const char* perf_scan_whitespace_##isa(const char* ch, uint32_t* newlines, const char** line_start) \
+{                                                                                                       \
+    const char* block   = (const char*)((uintptr_t)ch & ~(uintptr_t)(WIDTH - 1));                       \
+    uint32_t    valid   = (FULL << (uint32_t)(ch - block)) & FULL;                                      \
+    uint32_t    count   = 0;                                                                            \
+                                                                                                        \
+    for (;;)                                                                                            \
+    {                                                                                                   \
+        uint32_t ws, nl;                                                                                \
+        perf_scan_##isa##_whitespace_block(block, &ws, &nl);                                           \
+                                                                                                        \
+        /* The first byte that isn't whitespace ends the run. */                                        \
+        uint32_t stop = ~ws & valid;                                                                    \
+        if (stop != 0) valid &= (1u << perf_scan_ctz(stop)) - 1;                                        \
+                                                                                                        \
+        /* Count the newlines before the end of the run. */                                             \
+        nl &= valid;                                                                                    \
+        if (nl != 0)                                                                                    \
+        {                                                                                               \
+            count += perf_scan_popcount(nl);                                                            \
+            *line_start = block + perf_scan_msb(nl) + 1;                                                \
+        }                                                                                               \
+                                                                                                        \
+        if (stop != 0)                                                                                  \
+        {                                                                                               \
+            *newlines = count;                                                                          \
+            return block + perf_scan_ctz(stop);                                                         \
+        }                                                                                               \
+                                                                                                        \
+        block += WIDTH;                                                                                 \
+        valid = FULL;                                                                                   \
+    }                                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+TARGET static const char* perf_scan_identifier_##isa(const char* ch)                                    \
+{                                                                                                       \
+    const char* block   = (const char*)((uintptr_t)ch & ~(uintptr_t)(WIDTH - 1));                       \
+    uint32_t    valid   = (FULL << (uint32_t)(ch - block)) & FULL;                                      \
+                                                                                                        \
+    for (;;)                                                                                            \
+    {                                                                                                   \
+        /* The first byte that isn't a letter or digit ends the identifier. */                          \
+        uint32_t stop = ~perf_scan_##isa##_identifier_block(block) & valid;                             \
+        if (stop != 0) return block + perf_scan_ctz(stop);                                              \
+                                                                                                        \
+        block += WIDTH;                                                                                 \
+        valid = FULL;                                                                                   \
+    }                                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+TARGET static const char* perf_scan_line_comment_##isa(const char* ch)                                  \
+{                                                                                                       \
+    const char* block   = (const char*)((uintptr_t)ch & ~(uintptr_t)(WIDTH - 1));                       \
+    uint32_t    valid   = (FULL << (uint32_t)(ch - block)) & FULL;                                      \
+                                                                                                        \
+    for (;;)                                                                                            \
+    {                                                                                                   \
+        /* The first newline or null terminator ends the comment. */                                    \
+        uint32_t stop = perf_scan_##isa##_eol_block(block) & valid;                                     \
+        if (stop != 0) return block + perf_scan_ctz(stop);                                              \
+                                                                                                        \
+        block += WIDTH;                                                                                 \
+        valid = FULL;                                                                                   \
+    }                                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+TARGET static const char* perf_scan_block_comment_##isa(const char* ch, uint32_t* newlines, const char** line_start) \
+{                                                                                                       \
+    const char* block   = (const char*)((uintptr_t)ch & ~(uintptr_t)(WIDTH - 1));                       \
+    uint32_t    valid   = (FULL << (uint32_t)(ch - block)) & FULL;                                      \
+    uint32_t    count   = 0;                                                                            \
+    uint32_t    carry   = 0;                                                                            \
+                                                                                                        \
+    for (;;)                                                                                            \
+    {                                                                                                   \
+        uint32_t star, slash, nl, zero;                                                                 \
+        perf_scan_##isa##_comment_block(block, &star, &slash, &nl, &zero);                             \
+        star &= valid;                                                                                  \
+                                                                                                        \
+        /* A '/' right after a '*' terminates, the '*' may be the last byte of the previous block. */   \
+        uint32_t term = slash & ((star << 1) | carry) & valid;                                          \
+        uint32_t stop = term | (zero & valid);                                                          \
+        carry = star >> (WIDTH - 1);                                                                    \
+                                                                                                        \
+        /* Only count the newlines before the end of the comment. */                                    \
+        if (stop != 0) valid &= (1u << perf_scan_ctz(stop)) - 1;                                        \
+        nl &= valid;                                                                                    \
+        if (nl != 0)                                                                                    \
+        {                                                                                               \
+            count += perf_scan_popcount(nl);                                                            \
+            *line_start = block + perf_scan_msb(nl) + 1;                                                \
+        }                                                                                               \
+                                                                                                        \
+        if (stop != 0)                                                                                  \
+        {                                                                                               \
+            uint32_t idx = perf_scan_ctz(stop);                                                         \
+            *newlines = count;                                                                          \
+            return block + idx + ((term >> idx) & 1);                                                   \
+        }                                                                                               \
+                                                                                                        \
+        block += WIDTH;                                                                                 \
+        valid = FULL;                                                                                   \
+    }                                                                                                   \
+}
+
+PERF_SCAN_DEFINE_KERNELS(sse2, 16, PERF_SCAN_MASK_16, )
+PERF_SCAN_DEFINE_KERNELS(avx2, 32, PERF_SCAN_MASK_32, PERF_SCAN_TARGET_AVX2)
+
+/**
+ * @brief Determines if the CPU and OS support AVX2.
+*/
+static bool perf_scan_cpu_has_avx2(void)
+{
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#elif defined(_MSC_VER)
+    int info[4];
+
+    // Check the OS saves the YMM registers.
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return false;
+    if ((_xgetbv(0) & 6) != 6) return false;
+
+    // Check for AVX2 itself.
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+#endif // PERF_SCAN_HAVE_X86
+
+// The selected kernels.
+static perf_e_scan_isa_t perf_scan_isa = PERF_SCAN_ISA_SCALAR;
+static const char* (*perf_scan_whitespace_fn)(const char*, uint32_t*, const char**)      = perf_scan_whitespace_scalar;
+static const char* (*perf_scan_identifier_fn)(const char*)                               = perf_scan_identifier_scalar;
+static const char* (*perf_scan_line_comment_fn)(const char*)                             = perf_scan_line_comment_scalar;
+static const char* (*perf_scan_block_comment_fn)(const char*, uint32_t*, const char**)   = perf_scan_block_comment_scalar;
+
+// Implementation for scan.h perf_scan_select
+perf_result_t perf_scan_select(perf_e_scan_isa_t isa)
+{
+    switch (isa)
+    {
+    case PERF_SCAN_ISA_SCALAR:
+        perf_scan_whitespace_fn     = perf_scan_whitespace_scalar;
+        perf_scan_identifier_fn     = perf_scan_identifier_scalar;
+        perf_scan_line_comment_fn   = perf_scan_line_comment_scalar;
+        perf_scan_block_comment_fn  = perf_scan_block_comment_scalar;
+        break;
+
+#ifdef PERF_SCAN_HAVE_X86
+    case PERF_SCAN_ISA_SSE2:
+        perf_scan_whitespace_fn     = perf_scan_whitespace_sse2;
+        perf_scan_identifier_fn     = perf_scan_identifier_sse2;
+        perf_scan_line_comment_fn   = perf_scan_line_comment_sse2;
+        perf_scan_block_comment_fn  = perf_scan_block_comment_sse2;
+        break;
+
+    case PERF_SCAN_ISA_AVX2:
+        if (!perf_scan_cpu_has_avx2()) return PERF_RES_UNSUPPORTED;
+        perf_scan_whitespace_fn     = perf_scan_whitespace_avx2;
+        perf_scan_identifier_fn     = perf_scan_identifier_avx2;
+        perf_scan_line_comment_fn   = perf_scan_line_comment_avx2;
+        perf_scan_block_comment_fn  = perf_scan_block_comment_avx2;
+        break;
+#endif
+
+    default:
+        return PERF_RES_UNSUPPORTED;
+    }
+
+    // Remember the selection
+    perf_scan_isa = isa;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for scan.h perf_scan_init
+perf_result_t perf_scan_init(void)
+{
+    // Only pick once, so a forced selection sticks.
+    static bool initialized = false;
+    if (initialized) return PERF_RES_OK;
+    initialized = true;
+
+    // Try the widest kernels first.
+    if (perf_scan_select(PERF_SCAN_ISA_AVX2) == PERF_RES_OK) return PERF_RES_OK;
+    if (perf_scan_select(PERF_SCAN_ISA_SSE2) == PERF_RES_OK) return PERF_RES_OK;
+
+    // Fall back to the scalar kernels.
+    return perf_scan_select(PERF_SCAN_ISA_SCALAR);
+}
+
+// Implementation for scan.h perf_scan_selected
+perf_e_scan_isa_t perf_scan_selected(void)
+{
+    return perf_scan_isa;
+}
+
+// Implementation for scan.h perf_scan_whitespace
+const char* perf_scan_whitespace(const char* ch, uint32_t* newlines, const char** line_start)
+{
+    return perf_scan_whitespace_fn(ch, newlines, line_start);
+}
+
+// Implementation for scan.h perf_scan_identifier
+const char* perf_scan_identifier(const char* ch)
+{
+    return perf_scan_identifier_fn(ch);
+}
+
+// Implementation for scan.h perf_scan_line_comment
+const char* perf_scan_line_comment(const char* ch)
+{
+    return perf_scan_line_comment_fn(ch);
+}
+
+// Implementation for scan.h perf_scan_block_comment
+const char* perf_scan_block_comment(const char* ch, uint32_t* newlines, const char** line_start)
+{
+    return perf_scan_block_comment_fn(ch, newlines, line_start);
+}
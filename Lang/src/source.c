@@ -0,0 +1,253 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#endif
+
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/source.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Size of each read when the source can't be mapped.
+#define PERF_SOURCE_CHUNK_SIZE  (64 * 1024)
+
+// Implementation for source.h perf_source_init
+perf_result_t perf_source_init(perf_source_t *source)
+{
+    // Zero everything, nothing is loaded yet.
+    memset(source, 0, sizeof(perf_source_t));
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for source.h perf_source_read
+perf_result_t perf_source_read(perf_source_t *source, FILE* stream, const char** error)
+{
+    // Used to keep track of how much we have read, and how much we can hold.
+    size_t length   = 0;
+    size_t capacity = 0;
+    char*  buffer   = NULL;
+
+    for (;;)
+    {
+        // Make room for another chunk plus the terminator.
+        if (capacity - length < PERF_SOURCE_CHUNK_SIZE + 1)
+        {
+            // Adjust the capacity of the buffer.
+            capacity = capacity == 0 ? PERF_SOURCE_CHUNK_SIZE + 1 : capacity * 2;
+
+            // Reallocate the buffer
+            char* grown = (char*)realloc(buffer, capacity);
+            if (grown == NULL)
+            {
+                free(buffer);
+
+                // Set the error
+                *error = "Failed to allocate memory for source buffer.";
+
+                // Return memory allocation failure result.
+                return PERF_RES_MEMORY_ALLOC_FAIL;
+            }
+
+            // Update the buffer.
+            buffer = grown;
+        }
+
+        // Read the next chunk
+        size_t count = fread(buffer + length, 1, PERF_SOURCE_CHUNK_SIZE, stream);
+        length += count;
+
+        // A short read means we hit the end of the stream or an error.
+        if (count < PERF_SOURCE_CHUNK_SIZE) break;
+    }
+
+    // Check if the read failed.
+    if (ferror(stream))
+    {
+        free(buffer);
+
+        // Set the error
+        *error = "Failed to read source file.";
+
+        // Return IO error result.
+        return PERF_RES_IO_ERROR;
+    }
+
+    // Null terminate the buffer
+    buffer[length] = '\x00';
+
+    // Fill in the source.
+    source->data            = buffer;
+    source->length          = length;
+    source->kind            = PERF_SOURCE_BUFFERED;
+    source->mapping         = buffer;
+    source->mapping_size    = capacity;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+#if !defined(_WIN32)
+
+/**
+ * @brief Maps a regular file read-only, followed by at least one zero byte.
+ *
+ * The kernel zero fills the rest of the last page of a mapping, which already gives us the terminator.
+ * When the file is a whole number of pages, an extra anonymous (zero) page is reserved right after it.
+ *
+ * @param source The source to populate.
+ * @param fd The file to map.
+ * @param size The size of the file, must not be zero.
+ *
+ * @return PERF_RES_OK if the file was mapped, PERF_RES_UNSUPPORTED if it has to be read instead.
+*/
+static perf_result_t perf_source_map(perf_source_t *source, int fd, size_t size)
+{
+    // Get the page size
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    // Used to store the mapping.
+    void*  mapping      = MAP_FAILED;
+    size_t mapping_size = size;
+
+    // Check if the last page is full, in which case we need a sentinel page.
+    if (size % page_size == 0)
+    {
+        // Reserve the file's pages plus the zero page.
+        mapping_size = size + page_size;
+        void* reserved = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved == MAP_FAILED) return PERF_RES_UNSUPPORTED;
+
+        // Map the file over the front of the reservation.
+        mapping = mmap(reserved, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            munmap(reserved, mapping_size);
+            return PERF_RES_UNSUPPORTED;
+        }
+    }
+
+    // Otherwise the tail of the last page is already zero.
+    else
+    {
+        mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) return PERF_RES_UNSUPPORTED;
+    }
+
+    // The lexer reads the file front to back exactly once.
+    posix_madvise(mapping, size, POSIX_MADV_SEQUENTIAL);
+
+    // Fill in the source.
+    source->data            = (const char*)mapping;
+    source->length          = size;
+    source->kind            = PERF_SOURCE_MAPPED;
+    source->mapping         = mapping;
+    source->mapping_size    = mapping_size;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+#endif
+
+// Implementation for source.h perf_source_open
+perf_result_t perf_source_open(perf_source_t *source, const char* path, const char** error)
+{
+    // Start from an empty source.
+    perf_source_init(source);
+
+    // Check for stdin
+    if (strcmp(path, "-") == 0) return perf_source_read(source, stdin, error);
+
+#if !defined(_WIN32)
+    // Open the file
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        // Set the error
+        *error = "Failed to open source file.";
+
+        // Return IO error result.
+        return PERF_RES_IO_ERROR;
+    }
+
+    // Find out what we opened
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+
+        // Set the error
+        *error = "Failed to open source file.";
+
+        // Return IO error result.
+        return PERF_RES_IO_ERROR;
+    }
+
+    // Map regular, non-empty files. The mapping stays valid after the file is closed.
+    if (S_ISREG(info.st_mode) && info.st_size > 0 && perf_source_map(source, fd, (size_t)info.st_size) == PERF_RES_OK)
+    {
+        close(fd);
+
+        // Return OK result.
+        return PERF_RES_OK;
+    }
+
+    // Read everything else (pipes, devices, empty files) in chunks.
+    FILE* stream = fdopen(fd, "rb");
+    if (stream == NULL)
+    {
+        close(fd);
+
+        // Set the error
+        *error = "Failed to open source file.";
+
+        // Return IO error result.
+        return PERF_RES_IO_ERROR;
+    }
+#else
+    // Windows has no mapping with a guaranteed terminator, so always read.
+    FILE* stream = fopen(path, "rb");
+    if (stream == NULL)
+    {
+        // Set the error
+        *error = "Failed to open source file.";
+
+        // Return IO error result.
+        return PERF_RES_IO_ERROR;
+    }
+#endif
+
+    // Read the stream
+    perf_result_t result = perf_source_read(source, stream, error);
+
+    // Close the stream
+    fclose(stream);
+
+    // Return the result.
+    return result;
+}
+
+// Implementation for source.h perf_source_free
+perf_result_t perf_source_free(perf_source_t *source)
+{
+    // Release the contents
+    switch (source->kind)
+    {
+#if !defined(_WIN32)
+    case PERF_SOURCE_MAPPED:    munmap(source->mapping, source->mapping_size);  break;
+#endif
+    case PERF_SOURCE_BUFFERED:  free(source->mapping);                          break;
+    default:                                                                    break;
+    }
+
+    // Reset back to the initial state.
+    return perf_source_init(source);
+}
@@ -1,3 +1,59 @@
 #include "../inc/shared.h"
 #include "../inc/result.h"
-#include "../inc/token.h"
\ No newline at end of file
+#include "../inc/token.h"
+
+// Implementation for token.h perf_token_decode_string
+perf_result_t perf_token_decode_string(const char *raw, size_t length, char *out, size_t *out_length, const char** error)
+{
+    // Will store the number of decoded characters.
+    size_t count = 0;
+
+    // Loop through the raw string
+    for (size_t idx = 0; idx < length; idx++)
+    {
+        // Copy plain characters straight over.
+        if (raw[idx] != '\\')
+        {
+            out[count++] = raw[idx];
+            continue;
+        }
+
+        // Check for a dangling escape character
+        if (++idx >= length)
+        {
+            // Set the error
+            *error = "Unterminated escape sequence.";
+
+            // Return the error result.
+            return PERF_RES_LEX_ERROR;
+        }
+
+        // Decode the escape sequence
+        switch (raw[idx])
+        {
+        case 'n':   out[count++] = '\n';    break;
+        case 't':   out[count++] = '\t';    break;
+        case 'r':   out[count++] = '\r';    break;
+        case '0':   out[count++] = '\x00';  break;
+        case '\\':  out[count++] = '\\';    break;
+        case '"':   out[count++] = '"';     break;
+        case '\'':  out[count++] = '\'';    break;
+        default:
+
+            // Set the error
+            *error = "Invalid escape sequence.";
+
+            // Return the error result.
+            return PERF_RES_LEX_ERROR;
+        }
+    }
+
+    // Null terminate the decoded string.
+    out[count] = '\x00';
+
+    // Output the decoded length
+    *out_length = count;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
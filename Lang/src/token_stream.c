@@ -0,0 +1,302 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/array.h"
+#include "../inc/token.h"
+#include "../inc/intern.h"
+#include "../inc/lexer.h"
+#include "../inc/token_stream.h"
+
+/**
+ * @brief Grows the token arrays of a token stream.
+ *
+ * @param stream The stream to grow.
+ *
+ * @return PERF_RES_OK if the stream was grown successfully.
+*/
+static perf_result_t perf_token_stream_grow(perf_token_stream_t* stream)
+{
+    // Both arrays share a capacity, so each grows its own copy of it.
+    uint32_t types_capacity     = stream->capacity;
+    uint32_t offsets_capacity   = stream->capacity;
+
+    // Grow both arrays, a larger type array is harmless if the offsets fail.
+    if (perf_array_grow((void**)&stream->types, &types_capacity, sizeof(uint8_t)) != PERF_RES_OK) return PERF_RES_MEMORY_ALLOC_FAIL;
+    if (perf_array_grow((void**)&stream->offsets, &offsets_capacity, sizeof(uint32_t)) != PERF_RES_OK) return PERF_RES_MEMORY_ALLOC_FAIL;
+
+    // Update the capacity.
+    stream->capacity = types_capacity;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+/**
+ * @brief Builds the line start index of the stream's source.
+ *
+ * @param stream The stream to use.
+ *
+ * @return PERF_RES_OK if the index was built successfully.
+*/
+static perf_result_t perf_token_stream_build_lines(perf_token_stream_t* stream)
+{
+    // The first line starts at the beginning of the source.
+    uint32_t    offset  = 0;
+    const char* ch      = stream->src;
+
+    do
+    {
+        // Check if we need to grow the line index.
+        if (stream->line_count >= stream->line_capacity
+            && perf_array_grow((void**)&stream->line_starts, &stream->line_capacity, sizeof(uint32_t)) != PERF_RES_OK)
+        {
+            // Drop the partial index, the next lookup starts over.
+            stream->line_count = 0;
+
+            // Return memory allocation failure result.
+            return PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+
+        // Record the start of the line.
+        stream->line_starts[stream->line_count++] = offset;
+
+        // Find the next newline, the line after it starts past it.
+        ch = strchr(ch, '\n');
+        if (ch != NULL) offset = (uint32_t)(++ch - stream->src);
+    }
+    while (ch != NULL);
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+/**
+ * @brief Finds the payload of a literal token, moving the literal cursor to it.
+ *
+ * @param stream The stream to use.
+ * @param index The index of the token.
+ *
+ * @return The payload, or NULL if the token has none.
+*/
+static const perf_token_literal_t* perf_token_stream_literal(perf_token_stream_t* stream, uint32_t index)
+{
+    // Start where the last lookup stopped.
+    uint32_t cursor = stream->literal_cursor;
+
+    // Going back, binary search the side table, which is ordered by token index.
+    if (cursor > 0 && stream->literals[cursor - 1].token_index >= index)
+    {
+        uint32_t low    = 0;
+        uint32_t high   = cursor - 1;
+
+        while (low < high)
+        {
+            // Get the middle entry
+            uint32_t mid = low + (high - low) / 2;
+
+            // Narrow the search
+            if (stream->literals[mid].token_index < index) low = mid + 1;
+            else high = mid;
+        }
+
+        cursor = low;
+    }
+
+    // Going forward, walk to it, lookups in order only ever move a step or two.
+    else while (cursor < stream->literal_count && stream->literals[cursor].token_index < index) cursor++;
+
+    // Save the cursor for the next lookup.
+    stream->literal_cursor = cursor;
+
+    // Check if we found the token.
+    if (cursor < stream->literal_count && stream->literals[cursor].token_index == index) return &stream->literals[cursor];
+
+    // The token has no payload.
+    return NULL;
+}
+
+// Implementation for token_stream.h perf_token_stream_init
+perf_result_t perf_token_stream_init(perf_token_stream_t *stream)
+{
+    // Zero everything, the arrays are allocated on demand.
+    memset(stream, 0, sizeof(perf_token_stream_t));
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for token_stream.h perf_token_stream_digest
+perf_result_t perf_token_stream_digest(perf_token_stream_t *stream, perf_lexer_t *lexer, const char* src, const char** error)
+{
+    // Save the source, offsets and diagnostics refer to it.
+    stream->src = src;
+
+    // Empty the stream, keeping its arrays.
+    stream->count               = 0;
+    stream->literal_count       = 0;
+    stream->literal_cursor      = 0;
+    stream->cursor_offset       = 0;
+    stream->cursor_line         = 0;
+    stream->cursor_line_start   = 0;
+    stream->line_count          = 0;
+
+    // Set up the lexer at the start of the source code, on its first line.
+    perf_lexer_begin(lexer, src);
+
+    // Will store each token while it is being scanned.
+    perf_token_t token;
+
+    // Loop until we have produced the EOF token.
+    do
+    {
+        // Scan the token
+        perf_result_t result = perf_lexer_scan_token(lexer, &token, error);
+
+        // Check if the token was scanned successfully.
+        if (result != PERF_RES_OK) return result;
+
+        // Calculate the offset of the token.
+        size_t offset = (size_t)(lexer->token_start - src);
+
+        // Offsets are 32-bit, so the source must fit.
+        if (offset > UINT32_MAX)
+        {
+            // Set the error
+            *error = "Source is too large for a token stream.";
+
+            // Return the error result.
+            return PERF_RES_LEX_ERROR;
+        }
+
+        // Check that we have enough space for the token.
+        if (stream->count >= stream->capacity && perf_token_stream_grow(stream) != PERF_RES_OK)
+        {
+            // Set the error
+            *error = "Failed to allocate memory for token stream.";
+
+            // Return memory allocation failure result.
+            return PERF_RES_MEMORY_ALLOC_FAIL;
+        }
+
+        // Check if the token has a payload, and store it in the side table.
+        if (token.type >= TOKEN_IDENTIFIER && token.type <= TOKEN_INTEGER)
+        {
+            // Check that we have enough space for the payload.
+            if (stream->literal_count >= stream->literal_capacity
+                && perf_array_grow((void**)&stream->literals, &stream->literal_capacity, sizeof(perf_token_literal_t)) != PERF_RES_OK)
+            {
+                // Set the error
+                *error = "Failed to allocate memory for token stream literals.";
+
+                // Return memory allocation failure result.
+                return PERF_RES_MEMORY_ALLOC_FAIL;
+            }
+
+            // Store the payload.
+            perf_token_literal_t* literal = &stream->literals[stream->literal_count++];
+            literal->token_index    = stream->count;
+            literal->as             = token.as;
+        }
+
+        // Store the type and offset.
+        stream->types[stream->count]    = (uint8_t)token.type;
+        stream->offsets[stream->count]  = (uint32_t)offset;
+        stream->count++;
+    }
+    while (token.type != TOKEN_EOF);
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for token_stream.h perf_token_stream_location
+perf_result_t perf_token_stream_location(perf_token_stream_t *stream, uint32_t index, uint32_t *line_number, uint32_t *column_number, const char** error)
+{
+    // Get the offset of the token.
+    uint32_t offset = stream->offsets[index];
+
+    // Going forward, count the newlines between the cursor and the token.
+    if (offset >= stream->cursor_offset)
+    {
+        const char* ch  = stream->src + stream->cursor_offset;
+        const char* end = stream->src + offset;
+
+        while ((ch = (const char*)memchr(ch, '\n', (size_t)(end - ch))) != NULL)
+        {
+            // Move past the newline, the next line starts here.
+            ch++;
+            stream->cursor_line++;
+            stream->cursor_line_start = (uint32_t)(ch - stream->src);
+        }
+
+        // Move the cursor to the token.
+        stream->cursor_offset = offset;
+
+        // Output the location.
+        *line_number    = stream->cursor_line;
+        *column_number  = offset - stream->cursor_line_start;
+
+        // Return OK result.
+        return PERF_RES_OK;
+    }
+
+    // Going back, build the line index the first time it is needed.
+    if (stream->line_count == 0 && perf_token_stream_build_lines(stream) != PERF_RES_OK)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for line index.";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Find the last line that starts at or before the token.
+    uint32_t low    = 0;
+    uint32_t high   = stream->line_count;
+
+    while (high - low > 1)
+    {
+        // Get the middle line
+        uint32_t mid = low + (high - low) / 2;
+
+        // Narrow the search
+        if (stream->line_starts[mid] <= offset) low = mid;
+        else high = mid;
+    }
+
+    // Output the location.
+    *line_number    = low;
+    *column_number  = offset - stream->line_starts[low];
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for token_stream.h perf_token_stream_get
+perf_result_t perf_token_stream_get(perf_token_stream_t *stream, uint32_t index, perf_token_t *token, const char** error)
+{
+    // Copy the type over.
+    token->type = (perf_e_token_type_t)stream->types[index];
+
+    // Copy the payload over, other tokens get an empty one.
+    const perf_token_literal_t* literal = NULL;
+    if (token->type >= TOKEN_IDENTIFIER && token->type <= TOKEN_INTEGER) literal = perf_token_stream_literal(stream, index);
+
+    if (literal != NULL) token->as = literal->as;
+    else memset(&token->as, 0, sizeof(token->as));
+
+    // Compute the location.
+    return perf_token_stream_location(stream, index, &token->line_number, &token->column_number, error);
+}
+
+// Implementation for token_stream.h perf_token_stream_free
+perf_result_t perf_token_stream_free(perf_token_stream_t *stream)
+{
+    // Free every array.
+    free(stream->types);
+    free(stream->offsets);
+    free(stream->literals);
+    free(stream->line_starts);
+
+    // Reset back to the initial state.
+    return perf_token_stream_init(stream);
+}
@@ -0,0 +1,64 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/intern.h"
+#include "../inc/value.h"
+
+// Implementation for value.h perf_value_identical
+bool perf_value_identical(perf_value_t a, perf_value_t b)
+{
+    // Every value is its bits, so the bits decide.
+    return a.bits == b.bits;
+}
+
+// Implementation for value.h perf_value_equal
+bool perf_value_equal(perf_value_t a, perf_value_t b)
+{
+    perf_e_value_type_t a_type = perf_value_type(a);
+    perf_e_value_type_t b_type = perf_value_type(b);
+
+    // Integers and numbers compare by value, whichever mix of the two they are.
+    if (a_type == PERF_VALUE_INTEGER && b_type == PERF_VALUE_INTEGER) return a.bits == b.bits;
+    if (a_type == PERF_VALUE_INTEGER && b_type == PERF_VALUE_NUMBER)  return (double)perf_value_as_integer(a) == perf_value_as_number(b);
+    if (a_type == PERF_VALUE_NUMBER  && b_type == PERF_VALUE_INTEGER) return perf_value_as_number(a) == (double)perf_value_as_integer(b);
+    if (a_type == PERF_VALUE_NUMBER  && b_type == PERF_VALUE_NUMBER)  return perf_value_as_number(a) == perf_value_as_number(b);
+
+    // Strings from different interners can be equal without being the same pointer.
+    if (a_type == PERF_VALUE_STRING && b_type == PERF_VALUE_STRING)
+    {
+        const char* a_str  = perf_value_as_string(a);
+        const char* b_str  = perf_value_as_string(b);
+        uint32_t    length = perf_interner_length(a_str);
+
+        return a_str == b_str || (length == perf_interner_length(b_str) && memcmp(a_str, b_str, length) == 0);
+    }
+
+    // Everything else is equal only to itself.
+    return a.bits == b.bits;
+}
+
+// Implementation for value.h perf_value_print
+perf_result_t perf_value_print(perf_value_t value)
+{
+    switch (perf_value_type(value))
+    {
+    case PERF_VALUE_NIL:        printf("nil");                                                                  break;
+    case PERF_VALUE_BOOL:       printf(perf_value_as_index(value) ? "true" : "false");                          break;
+    case PERF_VALUE_INTEGER:    printf("%lld", (long long)perf_value_as_integer(value));                        break;
+    case PERF_VALUE_NUMBER:     printf("%.17g", perf_value_as_number(value));                                   break;
+    case PERF_VALUE_FUNCTION:   printf("<func %u>", perf_value_as_index(value));                                break;
+    case PERF_VALUE_NATIVE:     printf("<native %u>", perf_value_as_index(value));                              break;
+    case PERF_VALUE_OBJECT:     printf("<object %p>", perf_value_as_object(value));                             break;
+
+    case PERF_VALUE_STRING:
+    {
+        const char* str = perf_value_as_string(value);
+        printf("'%.*s'", (int)perf_interner_length(str), str);
+        break;
+    }
+
+    default:                    printf("<unknown>");                                                            break;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
@@ -0,0 +1,904 @@
+#include "../inc/shared.h"
+#include "../inc/result.h"
+#include "../inc/intern.h"
+#include "../inc/value.h"
+#include "../inc/heap.h"
+#include "../inc/object.h"
+#include "../inc/program.h"
+#include "../inc/jit.h"
+#include "../inc/vm.h"
+
+#include <math.h>
+#include <time.h>
+
+// Reads the u16 operand at ip, little endian.
+#define PERF_VM_U16(ip)     ((uint32_t)(ip)[0] | (uint32_t)(ip)[1] << 8)
+
+// Reads the u32 operand at ip, little endian.
+#define PERF_VM_U32(ip)     ((uint32_t)(ip)[0] | (uint32_t)(ip)[1] << 8 | (uint32_t)(ip)[2] << 16 | (uint32_t)(ip)[3] << 24)
+
+/**
+ * @brief Checks if a value is falsy.
+ *
+ * @param value The value to check.
+ *
+ * @return true for nil, false, 0 and 0.0.
+*/
+static inline bool perf_vm_falsy(perf_value_t value)
+{
+    // Each falsy value has one bit pattern, except 0.0 which has two.
+    return value.bits == perf_value_nil().bits || value.bits == perf_value_bool(false).bits
+        || value.bits == perf_value_box(PERF_VALUE_INTEGER, 0).bits || (value.bits << 1) == 0;
+}
+
+/**
+ * @brief Gets a numeric value as a double.
+ *
+ * @param value An integer or a number.
+ *
+ * @return The value as a double.
+*/
+static inline double perf_vm_number(perf_value_t value)
+{
+    return perf_value_is(value, PERF_VALUE_INTEGER) ? (double)perf_value_as_integer(value) : perf_value_as_number(value);
+}
+
+/**
+ * @brief Checks if a value is an integer or a number.
+ *
+ * @param value The value to check.
+ *
+ * @return true if arithmetic works on it.
+*/
+static inline bool perf_vm_numeric(perf_value_t value)
+{
+    return perf_value_is_number(value) || perf_value_is(value, PERF_VALUE_INTEGER);
+}
+
+/**
+ * @brief Adds, subtracts or multiplies two integers.
+ *
+ * @param opcode OP_ADD, OP_SUBTRACT or OP_MULTIPLY, constant wherever this is inlined.
+ * @param a The integer on the left.
+ * @param b The integer on the right.
+ *
+ * @return The result, a number if it doesn't fit in an integer.
+*/
+static inline perf_value_t perf_vm_integer_arithmetic(uint8_t opcode, perf_value_t a, perf_value_t b)
+{
+    int64_t x = perf_value_as_integer(a);
+    int64_t y = perf_value_as_integer(b);
+
+#if defined(__GNUC__) || defined(__clang__)
+    // Shifted to the top of 64 bits the payloads overflow exactly when the result leaves 48 bits, and shifting
+    // the result back down leaves the tag bits clear. This keeps the sign extension and the range check off the
+    // chain of dependent operations a loop usually is.
+    int64_t shifted = (int64_t)(a.bits << 16);
+    int64_t result;
+    bool overflow;
+
+    switch (opcode)
+    {
+    case OP_ADD:        overflow = __builtin_add_overflow(shifted, (int64_t)(b.bits << 16), &result);  break;
+    case OP_SUBTRACT:   overflow = __builtin_sub_overflow(shifted, (int64_t)(b.bits << 16), &result);  break;
+    default:            overflow = __builtin_mul_overflow(shifted, y, &result);                         break;
+    }
+
+    if (!overflow) return perf_value_box(PERF_VALUE_INTEGER, (uint64_t)result >> 16);
+#else
+    // 48-bit sums can't overflow, products can unless both magnitudes are below 2^31.
+    if (opcode == OP_ADD) return perf_value_integer(x + y);
+    if (opcode == OP_SUBTRACT) return perf_value_integer(x - y);
+    if (x > -2147483648ll && x < 2147483648ll && y > -2147483648ll && y < 2147483648ll) return perf_value_integer(x * y);
+#endif
+
+    // Out of range it's done on numbers.
+    switch (opcode)
+    {
+    case OP_ADD:        return perf_value_number((double)x + (double)y);
+    case OP_SUBTRACT:   return perf_value_number((double)x - (double)y);
+    default:            return perf_value_number((double)x * (double)y);
+    }
+}
+
+/**
+ * @brief Joins two strings into a string in the VM's heap.
+ *
+ * @param vm The VM to use.
+ * @param a The string on the left, replaced by the result.
+ * @param b The string on the right.
+ *
+ * @return NULL on success, otherwise the error message.
+*/
+static const char* perf_vm_concatenate(perf_vm_t *vm, perf_value_t *a, perf_value_t b)
+{
+    uint32_t a_length = perf_interner_length(perf_value_as_string(*a));
+    uint32_t b_length = perf_interner_length(perf_value_as_string(b));
+
+    // Check if the string would be too long for its length.
+    if ((uint64_t)a_length + b_length > UINT32_MAX - 64) return "string too long";
+
+    // Allocate it, holding on to both operands as collecting may move them.
+    const char*     error   = NULL;
+    char*           joined  = NULL;
+
+    perf_heap_push_temp(&vm->heap, a);
+    perf_heap_push_temp(&vm->heap, &b);
+    perf_result_t result = perf_heap_string(&vm->heap, a_length + b_length, &joined, &error);
+    perf_heap_pop_temp(&vm->heap, 2);
+
+    if (result != PERF_RES_OK) return error;
+
+    // Build it from wherever the operands are now.
+    memcpy(joined, perf_value_as_string(*a), a_length);
+    memcpy(joined + a_length, perf_value_as_string(b), b_length);
+
+    *a = perf_value_heap_string(joined);
+    return NULL;
+}
+
+/**
+ * @brief Applies an arithmetic operator to anything the handler's fast paths didn't take.
+ *
+ * @param vm The VM to use.
+ * @param opcode OP_ADD, OP_SUBTRACT, OP_MULTIPLY, OP_DIVIDE, OP_MODULO or OP_BIT_AND.
+ * @param a The operand on the left, replaced by the result.
+ * @param b The operand on the right.
+ *
+ * @return NULL on success, otherwise the error message.
+*/
+static const char* perf_vm_arithmetic(perf_vm_t *vm, uint8_t opcode, perf_value_t *a, perf_value_t b)
+{
+    // Strings only join.
+    if (opcode == OP_ADD && perf_value_is(*a, PERF_VALUE_STRING) && perf_value_is(b, PERF_VALUE_STRING)) return perf_vm_concatenate(vm, a, b);
+
+    if (!perf_vm_numeric(*a) || !perf_vm_numeric(b)) return opcode == OP_ADD ? "operands must be two numbers or two strings" : "operands must be numbers";
+
+    // Integers on both sides stay integers while they fit.
+    if (perf_value_is(*a, PERF_VALUE_INTEGER) && perf_value_is(b, PERF_VALUE_INTEGER))
+    {
+        int64_t x = perf_value_as_integer(*a);
+        int64_t y = perf_value_as_integer(b);
+
+        switch (opcode)
+        {
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:   *a = perf_vm_integer_arithmetic(opcode, *a, b);     return NULL;
+        case OP_BIT_AND:    *a = perf_value_integer(x & y);                     return NULL;
+        default:            break;
+        }
+
+        if (y == 0) return opcode == OP_DIVIDE ? "division by zero" : "modulo by zero";
+
+        *a = perf_value_integer(opcode == OP_DIVIDE ? x / y : x % y);
+        return NULL;
+    }
+
+    // Otherwise it's done on numbers.
+    if (opcode == OP_BIT_AND) return "operands must be integers";
+
+    double x = perf_vm_number(*a);
+    double y = perf_vm_number(b);
+
+    switch (opcode)
+    {
+    case OP_ADD:        *a = perf_value_number(x + y);      break;
+    case OP_SUBTRACT:   *a = perf_value_number(x - y);      break;
+    case OP_MULTIPLY:   *a = perf_value_number(x * y);      break;
+    case OP_DIVIDE:     *a = perf_value_number(x / y);      break;
+    default:            *a = perf_value_number(fmod(x, y)); break;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Applies a comparison to anything the handler's fast paths didn't take.
+ *
+ * @param opcode OP_GREATER, OP_GREATER_EQUAL, OP_LESS or OP_LESS_EQUAL.
+ * @param a The operand on the left.
+ * @param b The operand on the right.
+ * @param out The result of the comparison.
+ *
+ * @return NULL on success, otherwise the error message.
+*/
+static const char* perf_vm_compare(uint8_t opcode, perf_value_t a, perf_value_t b, bool *out)
+{
+    if (!perf_vm_numeric(a) || !perf_vm_numeric(b)) return "operands must be numbers";
+
+    // Every integer that fits in a value is exact as a double, so everything compares as doubles.
+    double x = perf_vm_number(a);
+    double y = perf_vm_number(b);
+
+    switch (opcode)
+    {
+    case OP_GREATER:        *out = x > y;   break;
+    case OP_GREATER_EQUAL:  *out = x >= y;  break;
+    case OP_LESS:           *out = x < y;   break;
+    default:                *out = x <= y;  break;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Gets the interned name of a member site.
+ *
+ * @param vm The VM to use.
+ * @param site The index of the site.
+ *
+ * @return The name.
+*/
+static inline const char* perf_vm_site_name(perf_vm_t *vm, uint32_t site)
+{
+    return perf_value_as_string(vm->program->constants[vm->program->sites[site]]);
+}
+
+/**
+ * @brief Finds the way of an inline cache that saw a shape.
+ *
+ * @param cache The cache.
+ * @param shape The shape.
+ *
+ * @return The way, NULL if the cache never saw the shape.
+*/
+static inline perf_vm_cache_way_t* perf_vm_cache_find(perf_vm_cache_t *cache, const perf_shape_t *shape)
+{
+    for (uint32_t idx = 0; idx < cache->count; idx++)
+    {
+        if (cache->ways[idx].shape == shape) return &cache->ways[idx];
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Remembers where a member is for a shape, unless every way is in use, which makes the site megamorphic.
+ *
+ * @param cache The cache.
+ * @param shape The shape of the instance.
+ * @param target The shape once the field is added, only for PERF_VM_CACHE_ADD.
+ * @param index The slot of the field, or index of the method's function.
+ * @param kind What was found.
+*/
+static void perf_vm_cache_add(perf_vm_cache_t *cache, const perf_shape_t *shape, perf_shape_t *target, uint32_t index, perf_e_vm_cache_kind_t kind)
+{
+    if (cache->count == PERF_VM_CACHE_WAYS)
+    {
+        cache->megamorphic = true;
+        return;
+    }
+
+    perf_vm_cache_way_t* way = &cache->ways[cache->count++];
+
+    way->shape  = shape;
+    way->target = target;
+    way->index  = index;
+    way->kind   = kind;
+}
+
+/**
+ * @brief Gets a field of an instance, for anything the handler's first way didn't take.
+ *
+ * @param vm The VM to use.
+ * @param site The index of the member site.
+ * @param object The instance, replaced by the field.
+ *
+ * @return NULL on success, otherwise the error message.
+*/
+static const char* perf_vm_get_member(perf_vm_t *vm, uint32_t site, perf_value_t *object)
+{
+    if (!perf_value_is(*object, PERF_VALUE_OBJECT)) return "only instances have properties";
+
+    perf_instance_t*        instance    = (perf_instance_t*)perf_value_as_object(*object);
+    perf_vm_cache_t*        cache       = &vm->caches[site];
+    perf_vm_cache_way_t*    way         = perf_vm_cache_find(cache, instance->shape);
+
+    // Fields a get site found before are where they were.
+    if (way != NULL)
+    {
+        *object = instance->fields[way->index];
+        return NULL;
+    }
+
+    // Otherwise look it up, and remember where it is.
+    const char* name = perf_vm_site_name(vm, site);
+    uint32_t    index;
+
+    if (!perf_shape_find(instance->shape, name, &index))
+    {
+        snprintf(vm->error_buffer, sizeof(vm->error_buffer), "undefined property '%s'", name);
+        return vm->error_buffer;
+    }
+
+    perf_vm_cache_add(cache, instance->shape, NULL, index, PERF_VM_CACHE_FIELD);
+
+    *object = instance->fields[index];
+    return NULL;
+}
+
+/**
+ * @brief Sets a field of an instance, adding it if the instance doesn't have it, which may collect first.
+ *
+ * @param vm The VM to use.
+ * @param site The index of the member site.
+ * @param object The instance, updated if collecting moves it.
+ * @param value The value, updated if collecting moves it.
+ *
+ * @return NULL on success, otherwise the error message.
+*/
+static const char* perf_vm_set_member(perf_vm_t *vm, uint32_t site, perf_value_t *object, perf_value_t *value)
+{
+    if (!perf_value_is(*object, PERF_VALUE_OBJECT)) return "only instances have fields";
+
+    perf_instance_t*        instance    = (perf_instance_t*)perf_value_as_object(*object);
+    perf_vm_cache_t*        cache       = &vm->caches[site];
+    perf_vm_cache_way_t*    way         = perf_vm_cache_find(cache, instance->shape);
+    const char*             error       = NULL;
+    uint32_t                index;
+
+    // Fields a set site found before are where they were.
+    if (way != NULL && way->kind == PERF_VM_CACHE_FIELD)
+    {
+        if (perf_instance_set(&vm->heap, instance, way->index, *value) != PERF_RES_OK) return "Failed to allocate memory for remembered set";
+        return NULL;
+    }
+
+    // Fields it added before go where they went, while the instance has room.
+    if (way != NULL && way->target->field_count <= instance->capacity)
+    {
+        if (perf_instance_set(&vm->heap, instance, way->index, *value) != PERF_RES_OK) return "Failed to allocate memory for remembered set";
+
+        instance->shape = way->target;
+        return NULL;
+    }
+
+    // Otherwise look it up.
+    const char* name = perf_vm_site_name(vm, site);
+
+    if (perf_shape_find(instance->shape, name, &index))
+    {
+        perf_vm_cache_add(cache, instance->shape, NULL, index, PERF_VM_CACHE_FIELD);
+
+        if (perf_instance_set(&vm->heap, instance, index, *value) != PERF_RES_OK) return "Failed to allocate memory for remembered set";
+        return NULL;
+    }
+
+    // A field the instance doesn't have yet is added, and so is the transition it took.
+    const perf_shape_t* shape = instance->shape;
+
+    if (perf_instance_add(&vm->heap, &vm->shapes, object, name, value, &index, &error) != PERF_RES_OK) return error;
+
+    if (way == NULL) perf_vm_cache_add(cache, shape, ((perf_instance_t*)perf_value_as_object(*object))->shape, index, PERF_VM_CACHE_ADD);
+    return NULL;
+}
+
+/**
+ * @brief Finds what a method call calls, for anything the handler's first way didn't take.
+ *
+ * Fields come first: a field holding something callable is called like any other value, in place of the receiver.
+ *
+ * @param vm The VM to use.
+ * @param site The index of the member site.
+ * @param receiver The instance, replaced by the field if it has one of that name.
+ * @param function The index of the method's function, UINT32_MAX if it is a field.
+ *
+ * @return NULL on success, otherwise the error message.
+*/
+static const char* perf_vm_invoke_member(perf_vm_t *vm, uint32_t site, perf_value_t *receiver, uint32_t *function)
+{
+    if (!perf_value_is(*receiver, PERF_VALUE_OBJECT)) return "only instances have methods";
+
+    perf_instance_t*        instance    = (perf_instance_t*)perf_value_as_object(*receiver);
+    perf_vm_cache_t*        cache       = &vm->caches[site];
+    perf_vm_cache_way_t*    way         = perf_vm_cache_find(cache, instance->shape);
+
+    // Members a call site found before are where they were.
+    if (way != NULL)
+    {
+        if (way->kind == PERF_VM_CACHE_METHOD) *function = way->index;
+        else
+        {
+            *receiver = instance->fields[way->index];
+            *function = UINT32_MAX;
+        }
+
+        return NULL;
+    }
+
+    // Otherwise look for a field
+    const char* name = perf_vm_site_name(vm, site);
+    uint32_t    index;
+
+    if (perf_shape_find(instance->shape, name, &index))
+    {
+        perf_vm_cache_add(cache, instance->shape, NULL, index, PERF_VM_CACHE_FIELD);
+
+        *receiver = instance->fields[index];
+        *function = UINT32_MAX;
+        return NULL;
+    }
+
+    // Then a method of the class, names are interned so they compare by pointer.
+    const perf_class_t* cls = &vm->program->classes[instance->shape->class_index];
+
+    for (uint32_t idx = cls->method_offset; idx < cls->method_offset + cls->method_count; idx++)
+    {
+        if (vm->program->methods[idx].name != name) continue;
+
+        perf_vm_cache_add(cache, instance->shape, NULL, vm->program->methods[idx].function, PERF_VM_CACHE_METHOD);
+
+        *function = vm->program->methods[idx].function;
+        return NULL;
+    }
+
+    snprintf(vm->error_buffer, sizeof(vm->error_buffer), "undefined method '%s'", name);
+    return vm->error_buffer;
+}
+
+/**
+ * @brief Makes the instance a class's initializer starts with, which may collect first.
+ *
+ * @param vm The VM to use.
+ * @param function The index of the initializer.
+ * @param callee The callee's slot, replaced by the instance.
+ *
+ * @return NULL on success, otherwise the error message.
+*/
+static const char* perf_vm_construct(perf_vm_t *vm, uint32_t function, perf_value_t *callee)
+{
+    const char* error = NULL;
+
+    if (perf_instance_new(&vm->heap, vm->class_shapes[vm->program->functions[function].class_index], callee, &error) != PERF_RES_OK) return error;
+    return NULL;
+}
+
+// Implementation for vm.h perf_vm_print_value
+perf_result_t perf_vm_print_value(perf_value_t value)
+{
+    switch (perf_value_type(value))
+    {
+    case PERF_VALUE_STRING:
+    {
+        const char* str = perf_value_as_string(value);
+        printf("%.*s", (int)perf_interner_length(str), str);
+        break;
+    }
+
+    case PERF_VALUE_NUMBER:
+    {
+        // Prefer the short form, unless it doesn't read back as the same number.
+        double number = perf_value_as_number(value);
+        char   buffer[32];
+
+        snprintf(buffer, sizeof(buffer), "%.15g", number);
+        if (strtod(buffer, NULL) != number) snprintf(buffer, sizeof(buffer), "%.17g", number);
+        printf("%s", buffer);
+        break;
+    }
+
+    case PERF_VALUE_OBJECT:
+    {
+        // Root shapes carry the name of the class.
+        const perf_instance_t* instance = (const perf_instance_t*)perf_value_as_object(value);
+        printf("<%s instance>", instance->shape->root->name);
+        break;
+    }
+
+    default: perf_value_print(value); break;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+/**
+ * @brief Native print: prints its arguments separated by spaces, then a newline.
+*/
+static perf_result_t perf_vm_native_print(perf_vm_t *vm, const perf_value_t *args, uint32_t count, perf_value_t *result, const char** error)
+{
+    // Printing needs no VM state and can't fail.
+    (void)vm;
+    (void)error;
+
+    for (uint32_t idx = 0; idx < count; idx++)
+    {
+        if (idx > 0) printf(" ");
+        perf_vm_print_value(args[idx]);
+    }
+
+    printf("\n");
+
+    // Return nil
+    *result = perf_value_nil();
+    return PERF_RES_OK;
+}
+
+/**
+ * @brief Native clock: returns the current time in seconds, for timing code.
+*/
+static perf_result_t perf_vm_native_clock(perf_vm_t *vm, const perf_value_t *args, uint32_t count, perf_value_t *result, const char** error)
+{
+    // The clock takes no arguments, needs no VM state and can't fail.
+    (void)vm;
+    (void)args;
+    (void)count;
+    (void)error;
+
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+
+    // Return the time
+    *result = perf_value_number((double)now.tv_sec + (double)now.tv_nsec * 1e-9);
+    return PERF_RES_OK;
+}
+
+/**
+ * Represents a native, as bound to the global of the same name.
+*/
+typedef struct _perf_vm_native_entry_t
+{
+    const char*         name;       // Name of the global
+    perf_vm_native_t    function;   // The native
+} perf_vm_native_entry_t;
+
+/**
+ * Natives, by index.
+*/
+static const perf_vm_native_entry_t perf_vm_natives[] =
+{
+    { "print",  perf_vm_native_print },
+    { "clock",  perf_vm_native_clock },
+};
+
+/**
+ * @brief Records a runtime error and where it happened.
+ *
+ * @param vm The VM to use.
+ * @param function The function running.
+ * @param offset The offset of any byte of the failing instruction in the program's code.
+ * @param message The error message.
+ * @param error The error message to set.
+ *
+ * @return PERF_RES_RUNTIME_ERROR.
+*/
+static perf_result_t perf_vm_error(perf_vm_t *vm, uint32_t function, uint32_t offset, const char* message, const char** error)
+{
+    vm->error_line  = perf_program_line(vm->program, function, offset);
+    *error          = message;
+
+    // Return runtime error result.
+    return PERF_RES_RUNTIME_ERROR;
+}
+
+// The interpreter loop, dispatching through a switch.
+#define PERF_VM_EXECUTE         perf_vm_execute_switch
+#define PERF_VM_LOOP_THREADED   0
+#define PERF_VM_LOOP_COUNTED    0
+#include "../inc/vm_loop.h"
+#undef PERF_VM_EXECUTE
+#undef PERF_VM_LOOP_THREADED
+#undef PERF_VM_LOOP_COUNTED
+
+// The interpreter loop, dispatching through a switch and counting instructions.
+#define PERF_VM_EXECUTE         perf_vm_execute_counted
+#define PERF_VM_LOOP_THREADED   0
+#define PERF_VM_LOOP_COUNTED    1
+#include "../inc/vm_loop.h"
+#undef PERF_VM_EXECUTE
+#undef PERF_VM_LOOP_THREADED
+#undef PERF_VM_LOOP_COUNTED
+
+// The interpreter loop, threaded.
+#if PERF_VM_THREADED
+#define PERF_VM_EXECUTE         perf_vm_execute_threaded
+#define PERF_VM_LOOP_THREADED   1
+#define PERF_VM_LOOP_COUNTED    0
+#include "../inc/vm_loop.h"
+#undef PERF_VM_EXECUTE
+#undef PERF_VM_LOOP_THREADED
+#undef PERF_VM_LOOP_COUNTED
+#endif
+
+// The interpreter loop for register code, dispatching through a switch.
+#define PERF_VM_EXECUTE         perf_vm_execute_register_switch
+#define PERF_VM_LOOP_THREADED   0
+#define PERF_VM_LOOP_COUNTED    0
+#define PERF_VM_LOOP_JIT        0
+#include "../inc/vm_register_loop.h"
+#undef PERF_VM_EXECUTE
+#undef PERF_VM_LOOP_THREADED
+#undef PERF_VM_LOOP_COUNTED
+#undef PERF_VM_LOOP_JIT
+
+// The interpreter loop for register code, dispatching through a switch and counting instructions.
+#define PERF_VM_EXECUTE         perf_vm_execute_register_counted
+#define PERF_VM_LOOP_THREADED   0
+#define PERF_VM_LOOP_COUNTED    1
+#define PERF_VM_LOOP_JIT        0
+#include "../inc/vm_register_loop.h"
+#undef PERF_VM_EXECUTE
+#undef PERF_VM_LOOP_THREADED
+#undef PERF_VM_LOOP_COUNTED
+#undef PERF_VM_LOOP_JIT
+
+// The interpreter loop for register code, threaded.
+#if PERF_VM_THREADED
+#define PERF_VM_EXECUTE         perf_vm_execute_register_threaded
+#define PERF_VM_LOOP_THREADED   1
+#define PERF_VM_LOOP_COUNTED    0
+#define PERF_VM_LOOP_JIT        0
+#include "../inc/vm_register_loop.h"
+#undef PERF_VM_EXECUTE
+#undef PERF_VM_LOOP_THREADED
+#undef PERF_VM_LOOP_COUNTED
+#undef PERF_VM_LOOP_JIT
+#endif
+
+#if PERF_JIT_ENABLED
+/**
+ * @brief Counts a call or back edge of a function towards compiling it, and runs its machine code once it has some.
+ *
+ * @param vm The VM to use.
+ * @param function The index of the function running.
+ * @param slots The frame's slots.
+ * @param ip The instruction about to run.
+ *
+ * @return The instruction for the interpreter to run next.
+*/
+static inline const uint8_t* perf_vm_jit_tier(perf_vm_t *vm, uint32_t function, perf_value_t *slots, const uint8_t *ip)
+{
+    perf_jit_function_t*    compiled    = &vm->jit.functions[function];
+    const uint8_t*          code        = vm->program->code;
+    const char*             error       = NULL;
+
+    // Cold functions stay in the interpreter, and so do the ones that failed to compile.
+    if (compiled->code == NULL)
+    {
+        if (compiled->failed || ++compiled->counter < vm->jit.threshold) return ip;
+
+        if (perf_jit_compile(&vm->jit, vm->program, vm->globals, function, &error) != PERF_RES_OK)
+        {
+            compiled->failed = true;
+            return ip;
+        }
+    }
+
+    return code + perf_jit_enter(&vm->jit, function, slots, (uint32_t)(ip - code));
+}
+
+// The interpreter loop for register code, threaded when possible, entering the JIT's machine code.
+#define PERF_VM_EXECUTE         perf_vm_execute_register_jit
+#define PERF_VM_LOOP_THREADED   PERF_VM_THREADED
+#define PERF_VM_LOOP_COUNTED    0
+#define PERF_VM_LOOP_JIT        1
+#include "../inc/vm_register_loop.h"
+#undef PERF_VM_EXECUTE
+#undef PERF_VM_LOOP_THREADED
+#undef PERF_VM_LOOP_COUNTED
+#undef PERF_VM_LOOP_JIT
+#endif
+
+/**
+ * @brief Hands the heap the VM's roots, the globals and the live part of the stack.
+ *
+ * @param heap The VM's heap.
+ * @param context The VM.
+*/
+static void perf_vm_roots(perf_heap_t *heap, void *context)
+{
+    perf_vm_t*              vm      = (perf_vm_t*)context;
+    const perf_program_t*   program = vm->program;
+
+    // Nothing runs yet.
+    if (program == NULL) return;
+
+    perf_heap_trace(heap, vm->globals, program->global_count);
+
+    // Stack code stores its stack pointer before allocating.
+    perf_value_t* top = vm->stack_top;
+
+    // Register code only has registers, a callee's can end below its caller's so every frame counts.
+    if (program->format == PERF_PROGRAM_FORMAT_REGISTER)
+    {
+        top = vm->stack;
+
+        for (uint32_t idx = 0; idx < vm->frame_count; idx++)
+        {
+            perf_value_t* end = vm->frames[idx].slots + program->functions[vm->frames[idx].function].slot_count;
+            if (end > top) top = end;
+        }
+    }
+
+    perf_heap_trace(heap, vm->stack, (size_t)(top - vm->stack));
+}
+
+// Implementation for vm.h perf_vm_init
+perf_result_t perf_vm_init(perf_vm_t *vm, const char** error)
+{
+    // Zero everything, the globals are allocated per program.
+    memset(vm, 0, sizeof(perf_vm_t));
+
+    // Hot functions are compiled after this many calls plus back edges.
+    vm->jit.threshold = PERF_JIT_THRESHOLD;
+
+    // Allocate the stack and the frames
+    vm->stack   = (perf_value_t*)malloc(PERF_VM_STACK_SIZE * sizeof(perf_value_t));
+    vm->frames  = (perf_vm_frame_t*)malloc(PERF_VM_MAX_FRAMES * sizeof(perf_vm_frame_t));
+
+    // Check if the allocations failed.
+    if (vm->stack == NULL || vm->frames == NULL)
+    {
+        perf_vm_free(vm);
+
+        // Set the error
+        *error = "Failed to allocate memory for VM stack";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Set up the heap, the VM hands it its roots.
+    if (perf_heap_init(&vm->heap, perf_vm_roots, vm, error) != PERF_RES_OK)
+    {
+        perf_vm_free(vm);
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for vm.h perf_vm_run
+perf_result_t perf_vm_run(perf_vm_t *vm, const perf_program_t *program, perf_value_t *result, const char** error)
+{
+    // Allocate fresh globals, at least one so an empty program still gets an array.
+    free(vm->globals);
+    vm->globals = (perf_value_t*)malloc((program->global_count > 0 ? program->global_count : 1) * sizeof(perf_value_t));
+
+    if (vm->globals == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for globals";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    // Allocate fresh caches, and a root shape per class so no cache is fooled by a shape of the last program.
+    free(vm->class_shapes);
+    free(vm->caches);
+    vm->class_shapes    = (perf_shape_t**)malloc((program->class_count > 0 ? program->class_count : 1) * sizeof(perf_shape_t*));
+    vm->caches          = (perf_vm_cache_t*)calloc(program->site_count > 0 ? program->site_count : 1, sizeof(perf_vm_cache_t));
+
+    if (vm->class_shapes == NULL || vm->caches == NULL)
+    {
+        // Set the error
+        *error = "Failed to allocate memory for inline caches";
+
+        // Return memory allocation failure result.
+        return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    for (uint32_t idx = 0; idx < program->class_count; idx++)
+    {
+        if (perf_shape_root(&vm->shapes, idx, program->classes[idx].name, &vm->class_shapes[idx], error) != PERF_RES_OK) return PERF_RES_MEMORY_ALLOC_FAIL;
+    }
+
+    vm->program             = program;
+    vm->stack_top           = vm->stack;
+    vm->error_line          = 0;
+    vm->instruction_count   = 0;
+
+    // Globals start out undefined, unless a native has their name.
+    for (uint32_t idx = 0; idx < program->global_count; idx++)
+    {
+        vm->globals[idx] = perf_value_undefined();
+
+        for (uint32_t native = 0; native < sizeof(perf_vm_natives) / sizeof(perf_vm_natives[0]); native++)
+        {
+            if (strcmp(program->globals[idx], perf_vm_natives[native].name) != 0) continue;
+
+            vm->globals[idx] = perf_value_box(PERF_VALUE_NATIVE, native);
+        }
+    }
+
+    // The script is function 0, it has no arguments and sits at the bottom of the stack.
+    const perf_function_t* script = &program->functions[0];
+
+    if (1 + script->slot_count + script->max_stack > PERF_VM_STACK_SIZE)
+    {
+        // Set the error
+        *error = "stack overflow";
+
+        // Return runtime error result.
+        return PERF_RES_RUNTIME_ERROR;
+    }
+
+    vm->stack[0] = perf_value_box(PERF_VALUE_FUNCTION, 0);
+
+    vm->frame_count         = 1;
+    vm->frames[0].function  = 0;
+    vm->frames[0].ip        = program->code + script->code_offset;
+    vm->frames[0].slots     = vm->stack + 1;
+
+    // Its locals start out nil.
+    for (uint32_t idx = 1; idx <= script->slot_count; idx++) vm->stack[idx] = perf_value_nil();
+
+    // Run it
+    perf_value_t    value;
+    perf_result_t   status;
+    bool            is_register = program->format == PERF_PROGRAM_FORMAT_REGISTER;
+
+#if PERF_JIT_ENABLED
+    // The JIT starts over with the program, nothing of the last one's machine code applies.
+    if (vm->dispatch == PERF_VM_DISPATCH_JIT && is_register)
+    {
+        if (perf_jit_reset(&vm->jit, program, error) != PERF_RES_OK) return PERF_RES_MEMORY_ALLOC_FAIL;
+
+        status = perf_vm_execute_register_jit(vm, &value, error);
+    }
+    else
+#endif
+    if (vm->dispatch == PERF_VM_DISPATCH_COUNTED) status = is_register ? perf_vm_execute_register_counted(vm, &value, error) : perf_vm_execute_counted(vm, &value, error);
+#if PERF_VM_THREADED
+    else if (vm->dispatch == PERF_VM_DISPATCH_THREADED || vm->dispatch == PERF_VM_DISPATCH_JIT) status = is_register ? perf_vm_execute_register_threaded(vm, &value, error) : perf_vm_execute_threaded(vm, &value, error);
+#endif
+    else status = is_register ? perf_vm_execute_register_switch(vm, &value, error) : perf_vm_execute_switch(vm, &value, error);
+
+    // Output the script's value
+    if (status == PERF_RES_OK && result != NULL) *result = value;
+
+    // Return the result.
+    return status;
+}
+
+// Implementation for vm.h perf_vm_get_cache_stats
+perf_result_t perf_vm_get_cache_stats(perf_vm_t *vm, perf_vm_cache_stats_t *stats)
+{
+    memset(stats, 0, sizeof(perf_vm_cache_stats_t));
+
+    // Nothing ran yet.
+    if (vm->program == NULL) return PERF_RES_OK;
+
+    // Sort the sites by how many shapes they saw, sites that never ran only count towards the total.
+    stats->site_count = vm->program->site_count;
+
+    for (uint32_t idx = 0; idx < vm->program->site_count; idx++)
+    {
+        const perf_vm_cache_t* cache = &vm->caches[idx];
+
+        if (cache->megamorphic)     stats->megamorphic_count++;
+        else if (cache->count > 1)  stats->polymorphic_count++;
+        else if (cache->count == 1) stats->monomorphic_count++;
+    }
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
+
+// Implementation for vm.h perf_vm_free
+perf_result_t perf_vm_free(perf_vm_t *vm)
+{
+    // Free the stack, the globals, the caches, the heap, the shapes and the machine code.
+    free(vm->stack);
+    free(vm->frames);
+    free(vm->globals);
+    free(vm->class_shapes);
+    free(vm->caches);
+    perf_heap_free(&vm->heap);
+    perf_shape_free(&vm->shapes);
+    perf_jit_free(&vm->jit);
+
+    vm->stack           = NULL;
+    vm->frames          = NULL;
+    vm->globals         = NULL;
+    vm->class_shapes    = NULL;
+    vm->caches          = NULL;
+
+    // Return OK result.
+    return PERF_RES_OK;
+}
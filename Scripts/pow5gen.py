@@ -0,0 +1,66 @@
+"""
+Generates Lang/inc/pow5_table.h, the 128-bit powers of five used by the Eisel-Lemire float parser.
+
+Entry q - PERF_POW5_SMALLEST holds 5^q normalized so its most significant bit is bit 127,
+truncated for q >= 0 and rounded up for q < 0, split into the high and low 64-bit halves.
+
+Usage: python Scripts/pow5gen.py
+"""
+
+import os
+
+ROOT        = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+POW5_H      = os.path.join(ROOT, "Lang", "inc", "pow5_table.h")
+SMALLEST    = -342
+LARGEST     = 308
+
+
+def power(q):
+    if q < 0:
+        power5 = 5 ** -q
+        z = 0
+        while (1 << z) < power5: z += 1
+        if q >= -27:
+            return 2 ** (z + 127) // power5 + 1
+        c = 2 ** (2 * z + 2 * 64) // power5 + 1
+        while c >= (1 << 128): c //= 2
+        return c
+
+    power5 = 5 ** q
+    while power5 < (1 << 127): power5 *= 2
+    while power5 >= (1 << 128): power5 //= 2
+    return power5
+
+
+def main():
+    out = []
+    out.append("/**")
+    out.append(" * GENERATED FILE - DO NOT EDIT.")
+    out.append(" * Regenerate with Scripts/pow5gen.py.")
+    out.append("*/")
+    out.append("#ifndef _PERFECTION_POW5_TABLE_H")
+    out.append("#define _PERFECTION_POW5_TABLE_H")
+    out.append("")
+    out.append("// Range of decimal exponents covered by the table.")
+    out.append("#define PERF_POW5_SMALLEST (%d)" % SMALLEST)
+    out.append("#define PERF_POW5_LARGEST  %d" % LARGEST)
+    out.append("")
+    out.append("/**")
+    out.append(" * 128-bit normalized powers of five, as { high, low } pairs.")
+    out.append("*/")
+    out.append("static const uint64_t perf_pow5_table[%d][2] = {" % (LARGEST - SMALLEST + 1))
+    for q in range(SMALLEST, LARGEST + 1):
+        value = power(q)
+        out.append("    { 0x%016XULL, 0x%016XULL }, // 5^%d" % (value >> 64, value & ((1 << 64) - 1), q))
+    out.append("};")
+    out.append("")
+    out.append("#endif // _PERFECTION_POW5_TABLE_H")
+
+    with open(POW5_H, "w", newline="\n") as f:
+        f.write("\n".join(out) + "\n")
+
+    print("Wrote %s (%d entries)" % (POW5_H, LARGEST - SMALLEST + 1))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,58 +1,208 @@
+"""
+Generates Lang/inc/token_gen.h from the token enum in Lang/inc/token.h.
 
+The enum is the single source of truth: every TOKEN_* entry produces a token_map
+string, every TOKEN_KEYWORD_* entry produces a keyword_map string and an arm in
+the keyword lookup switch. The keyword / symbol text is taken from the trailing
+comment of each enum entry.
 
-tokens = """
-TOKEN_LEFT_PARENTHESES,     // (
-    TOKEN_RIGHT_PARENTHESES,    // )
-    TOKEN_LEFT_BRACE,           // {
-    TOKEN_RIGHT_BRACE,          // }
-    TOKEN_COMMA,                // ,
-    TOKEN_PERIOD,               // .
-    TOKEN_SEMICOLON,            // ;
-    TOKEN_COLON,                // :
-    TOKEN_MINUS,                // -
-    TOKEN_PLUS,                 // +
-    TOKEN_SLASH,                // /
-    TOKEN_ASTERISK,             // *
-    TOKEN_PERCENT,              // %
-    TOKEN_AMPERSAND,            // &
-
-    TOKEN_EXCLAIM,              // !
-    TOKEN_EXCLAIM_EQUAL,        // !=
-    TOKEN_EQUAL,                // =
-    TOKEN_EQUAL_EQUAL,          // ==
-    TOKEN_GREATER,              // >
-    TOKEN_GREATER_EQUAL,        // >=
-    TOKEN_LESS,                 // <
-    TOKEN_LESS_EQUAL,           // <=
-
-    TOKEN_IDENTIFIER,           // Identifier
-    TOKEN_STRING,               // String
-    TOKEN_NUMBER,               // Number
-    TOKEN_INTEGER,              // Integer
-
-    TOKEN_KEYWORD_FUNC,         // func 
-    TOKEN_KEYWORD_VAR,          // var
-    TOKEN_KEYWORD_LET,          // let
-    TOKEN_KEYWORD_CONST,        // const
-    TOKEN_KEYWORD_IF,           // if
-    TOKEN_KEYWORD_ELSE,         // else
-    TOKEN_KEYWORD_FOR,          // for
-    TOKEN_KEYWORD_WHILE,        // while
-    TOKEN_KEYWORD_TRUE,         // true
-    TOKEN_KEYWORD_FALSE,        // false
-    TOKEN_KEYWORD_RETURN,       // return
-    TOKEN_KEYWORD_DO,           // do
-    TOKEN_KEYWORD_CLASS,        // class
-    TOKEN_KEYWORD_CONTINUE,     // continue
-    TOKEN_KEYWORD_BREAK,        // break
-
-    // Useless tokens / EOF
-    TOKEN_SKIP,                 // Skip
-    TOKEN_EOF,                  // End of file
+Usage: python Scripts/tokenconv.py
 """
 
+import os
+import re
+
+ROOT        = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+TOKEN_H     = os.path.join(ROOT, "Lang", "inc", "token.h")
+TOKEN_GEN_H = os.path.join(ROOT, "Lang", "inc", "token_gen.h")
+
+
+def parse_tokens(path):
+    """Returns a list of (name, comment) tuples in enum order."""
+    with open(path, "r") as f:
+        src = f.read()
+
+    body = re.search(r"typedef enum _perf_e_token_type_t\s*{(.*?)}\s*perf_e_token_type_t;", src, re.S)
+    if body is None:
+        raise SystemExit("could not find perf_e_token_type_t in %s" % path)
+
+    tokens = []
+    for line in body.group(1).splitlines():
+        match = re.match(r"\s*(TOKEN_[A-Z_]+)\s*,\s*(?://\s*(.*))?$", line)
+        if match is None: continue
+        tokens.append((match.group(1), (match.group(2) or "").strip()))
+    return tokens
+
+
+def c_char(ch):
+    return "'\\''" if ch == "'" else "'%s'" % ch
+
+
+def gen_keyword_lookup(keywords):
+    out = []
+    out.append("/**")
+    out.append(" * @brief Classifies an identifier span as a keyword without allocating.")
+    out.append(" *")
+    out.append(" * Switches on the length and first character, then compares the remaining bytes")
+    out.append(" * of the (at most two) keywords that share them.")
+    out.append(" *")
+    out.append(" * @param str The start of the identifier (does not need to be null terminated).")
+    out.append(" * @param length The length of the identifier.")
+    out.append(" *")
+    out.append(" * @return The keyword token type, or TOKEN_IDENTIFIER if it is not a keyword.")
+    out.append("*/")
+    out.append("static inline perf_e_token_type_t perf_token_keyword_lookup(const char* str, size_t length)")
+    out.append("{")
+    out.append("    switch (length)")
+    out.append("    {")
+
+    by_length = {}
+    for name, word in keywords:
+        by_length.setdefault(len(word), []).append((name, word))
+
+    for length in sorted(by_length):
+        out.append("    case %d:" % length)
+        out.append("        switch (str[0])")
+        out.append("        {")
+
+        by_first = {}
+        for name, word in by_length[length]:
+            by_first.setdefault(word[0], []).append((name, word))
+
+        for first in sorted(by_first):
+            out.append("        case %s:" % c_char(first))
+            for name, word in by_first[first]:
+                if length == 1:
+                    out.append("            return %s;" % name)
+                else:
+                    out.append("            if (memcmp(str + 1, \"%s\", %d) == 0) return %s;" % (word[1:], length - 1, name))
+            if length != 1:
+                out.append("            break;")
+
+        out.append("        }")
+        out.append("        break;")
+
+    out.append("    }")
+    out.append("")
+    out.append("    // Not a keyword.")
+    out.append("    return TOKEN_IDENTIFIER;")
+    out.append("}")
+    return out
+
+
+def c_byte(code):
+    ch = chr(code)
+    if ch == "\\": return "'\\\\'"
+    if ch == "'": return "'\\''"
+    if 32 < code < 127: return "'%s'" % ch
+    return "0x%02X" % code
+
+
+def gen_symbol_tables(symbols):
+    singles = {}
+    pairs   = {}
+    for name, sym in symbols:
+        if len(sym) == 1: singles[ord(sym)] = name
+        elif len(sym) == 2: pairs[ord(sym[0])] = (sym[1], name)
+        else: raise SystemExit("symbols must be one or two characters: %s" % sym)
+
+    for first in pairs:
+        if first not in singles:
+            raise SystemExit("two character symbol %s%s has no one character prefix" % (chr(first), pairs[first][0]))
+
+    out = []
+    out.append("/**")
+    out.append(" * Maps the first byte of a symbol to its one character token type + 1, or 0 if no symbol starts with it.")
+    out.append("*/")
+    out.append("static const uint8_t symbol_dispatch[256] = {")
+    for first in sorted(singles):
+        out.append("    [%s] = %s + 1," % (c_byte(first), singles[first]))
+    out.append("};")
+    out.append("")
+    out.append("/**")
+    out.append(" * Maps the first byte of a symbol to the second byte of its two character form, or 0 if it has none.")
+    out.append("*/")
+    out.append("static const char symbol_pair_second[256] = {")
+    for first in sorted(pairs):
+        out.append("    [%s] = %s," % (c_byte(first), c_byte(ord(pairs[first][0]))))
+    out.append("};")
+    out.append("")
+    out.append("/**")
+    out.append(" * Maps the first byte of a symbol to the token type of its two character form.")
+    out.append("*/")
+    out.append("static const uint8_t symbol_pair_type[256] = {")
+    for first in sorted(pairs):
+        out.append("    [%s] = %s," % (c_byte(first), pairs[first][1]))
+    out.append("};")
+    return out
+
+
+def main():
+    tokens   = parse_tokens(TOKEN_H)
+    keywords = [(name, word) for name, word in tokens if name.startswith("TOKEN_KEYWORD_")]
+    names    = [name for name, _ in tokens]
+
+    # The symbols are every token before the first literal token.
+    symbols = [(name, sym) for name, sym in tokens[:names.index("TOKEN_IDENTIFIER")]]
+
+    # Keywords must be contiguous for PERF_TOKEN_IS_KEYWORD.
+    first_kw = names.index(keywords[0][0])
+    if names[first_kw:first_kw + len(keywords)] != [name for name, _ in keywords]:
+        raise SystemExit("keyword tokens must be contiguous in the enum")
+
+    out = []
+    out.append("/**")
+    out.append(" * GENERATED FILE - DO NOT EDIT.")
+    out.append(" * Regenerate with Scripts/tokenconv.py after changing perf_e_token_type_t in token.h.")
+    out.append("*/")
+    out.append("#ifndef _PERFECTION_TOKEN_GEN_H")
+    out.append("#define _PERFECTION_TOKEN_GEN_H")
+    out.append("")
+    out.append("// Number of entries in perf_e_token_type_t.")
+    out.append("#define PERF_TOKEN_COUNT %d" % len(tokens))
+    out.append("")
+    out.append("// Number of keywords, and the first keyword token.")
+    out.append("#define PERF_KEYWORD_COUNT %d" % len(keywords))
+    out.append("#define PERF_KEYWORD_FIRST %s" % keywords[0][0])
+    out.append("")
+    out.append("// Determines if the given token type is a keyword.")
+    out.append("#define PERF_TOKEN_IS_KEYWORD(type) ((type) >= %s && (type) <= %s)" % (keywords[0][0], keywords[-1][0]))
+    out.append("")
+    out.append("// Number of symbol tokens, which are always the first tokens in the enum.")
+    out.append("#define PERF_SYMBOL_COUNT %d" % len(symbols))
+    out.append("")
+    out.append("/**")
+    out.append(" * We can use the token type as an index to get the token name as a string.")
+    out.append(" **/")
+    out.append("static const char* token_map[] = {")
+    out.extend("    \"%s\"," % name for name in names)
+    out.append("};")
+    out.append("")
+    out.append("/**")
+    out.append(" * We can use this to map (type - PERF_KEYWORD_FIRST) to an actual keyword in the language.")
+    out.append("*/")
+    out.append("static const char* keyword_map[] = {")
+    out.extend("    \"%s\"," % word for _, word in keywords)
+    out.append("};")
+    out.append("")
+    out.append("/**")
+    out.append(" * We can use this to map an integer to a symbol in the language")
+    out.append("*/")
+    out.append("static const char* symbol_map[] = {")
+    out.extend("    \"%s\"," % sym for _, sym in symbols)
+    out.append("};")
+    out.append("")
+    out.extend(gen_symbol_tables(symbols))
+    out.append("")
+    out.extend(gen_keyword_lookup(keywords))
+    out.append("")
+    out.append("#endif // _PERFECTION_TOKEN_GEN_H")
+
+    with open(TOKEN_GEN_H, "w", newline="\n") as f:
+        f.write("\n".join(out) + "\n")
+
+    print("Wrote %s (%d tokens, %d keywords, %d symbols)" % (TOKEN_GEN_H, len(tokens), len(keywords), len(symbols)))
+
 
-for line in tokens.splitlines():
-    tok = line.strip().split(",")[0]
-    if not tok.startswith("TOKEN"): continue
-    print("\"%s\"," % tok)
\ No newline at end of file
+if __name__ == "__main__":
+    main()